@@ -274,6 +274,206 @@ type_needs_out_release(GITypeInfo *type_info,
     }
 }
 
+/* GList, GSList and GHashTable keep their elements in a pointer, and
+ * most of them are strings or small integers. The converters below are
+ * picked once per container from the element type, so the common cases
+ * skip the big switch in gwkjs_value_{to,from}_g_argument() for every
+ * item; everything else still goes through it.
+ */
+typedef JSBool (*ElementToJSFunc) (JSContextRef    context,
+                                   GITypeInfo     *type_info,
+                                   gpointer        data,
+                                   GwkjsArrayFlags flags,
+                                   jsval          *value_p);
+
+typedef JSBool (*ElementToCFunc) (JSContextRef      context,
+                                  jsval             value,
+                                  GITypeInfo       *type_info,
+                                  GwkjsArgumentType arg_type,
+                                  GITransfer        transfer,
+                                  gboolean          may_be_null,
+                                  gpointer         *data_p);
+
+static JSBool
+element_generic_to_js(JSContextRef    context,
+                      GITypeInfo     *type_info,
+                      gpointer        data,
+                      GwkjsArrayFlags flags,
+                      jsval          *value_p)
+{
+    GArgument arg;
+
+    arg.v_pointer = data;
+    return gwkjs_value_from_g_argument_full(context, value_p, type_info, &arg,
+                                          TRUE, flags);
+}
+
+static JSBool
+element_utf8_to_js(JSContextRef    context,
+                   GITypeInfo     *type_info,
+                   gpointer        data,
+                   GwkjsArrayFlags flags,
+                   jsval          *value_p)
+{
+    if (data == NULL) {
+        *value_p = JSValueMakeUndefined(context);
+        return JS_TRUE;
+    }
+    return gwkjs_string_from_utf8(context, (const char *) data, -1, value_p);
+}
+
+static JSBool
+element_int_to_js(JSContextRef    context,
+                  GITypeInfo     *type_info,
+                  gpointer        data,
+                  GwkjsArrayFlags flags,
+                  jsval          *value_p)
+{
+    *value_p = JSValueMakeNumber(context, GPOINTER_TO_INT(data));
+    return JS_TRUE;
+}
+
+static JSBool
+element_uint_to_js(JSContextRef    context,
+                   GITypeInfo     *type_info,
+                   gpointer        data,
+                   GwkjsArrayFlags flags,
+                   jsval          *value_p)
+{
+    *value_p = JSValueMakeNumber(context, GPOINTER_TO_UINT(data));
+    return JS_TRUE;
+}
+
+static JSBool
+element_boolean_to_js(JSContextRef    context,
+                      GITypeInfo     *type_info,
+                      gpointer        data,
+                      GwkjsArrayFlags flags,
+                      jsval          *value_p)
+{
+    *value_p = JSValueMakeBoolean(context, GPOINTER_TO_INT(data) != 0);
+    return JS_TRUE;
+}
+
+static ElementToJSFunc
+element_to_js_func(GITypeInfo *type_info)
+{
+    switch (g_type_info_get_tag(type_info)) {
+    case GI_TYPE_TAG_UTF8:
+        return element_utf8_to_js;
+    case GI_TYPE_TAG_INT8:
+    case GI_TYPE_TAG_INT16:
+    case GI_TYPE_TAG_INT32:
+        return element_int_to_js;
+    case GI_TYPE_TAG_UINT8:
+    case GI_TYPE_TAG_UINT16:
+    case GI_TYPE_TAG_UINT32:
+        return element_uint_to_js;
+    case GI_TYPE_TAG_BOOLEAN:
+        return element_boolean_to_js;
+    default:
+        return element_generic_to_js;
+    }
+}
+
+static JSBool
+element_generic_to_c(JSContextRef      context,
+                     jsval             value,
+                     GITypeInfo       *type_info,
+                     GwkjsArgumentType arg_type,
+                     GITransfer        transfer,
+                     gboolean          may_be_null,
+                     gpointer         *data_p)
+{
+    GArgument arg = { 0 };
+
+    if (!gwkjs_value_to_g_argument(context, value, type_info, NULL, arg_type,
+                                   transfer, may_be_null, &arg))
+        return JS_FALSE;
+    *data_p = arg.v_pointer;
+    return JS_TRUE;
+}
+
+/* Strings are always copied, whatever the transfer; that's what the
+ * generic path does too and release relies on it. */
+static JSBool
+element_utf8_to_c(JSContextRef      context,
+                  jsval             value,
+                  GITypeInfo       *type_info,
+                  GwkjsArgumentType arg_type,
+                  GITransfer        transfer,
+                  gboolean          may_be_null,
+                  gpointer         *data_p)
+{
+    char *str;
+
+    if (!JSValueIsString(context, value))
+        return element_generic_to_c(context, value, type_info, arg_type,
+                                    transfer, may_be_null, data_p);
+
+    if (!gwkjs_string_to_utf8(context, value, &str))
+        return JS_FALSE;
+    *data_p = str;
+    return JS_TRUE;
+}
+
+/* In-range numbers only; anything else takes the generic path so it
+ * gets the usual conversion and range errors. */
+static JSBool
+element_int_to_c(JSContextRef      context,
+                 jsval             value,
+                 GITypeInfo       *type_info,
+                 GwkjsArgumentType arg_type,
+                 GITransfer        transfer,
+                 gboolean          may_be_null,
+                 gpointer         *data_p)
+{
+    double min, max, d;
+
+    if (JSValueIsNumber(context, value)) {
+        switch (g_type_info_get_tag(type_info)) {
+        case GI_TYPE_TAG_INT8:   min = G_MININT8;  max = G_MAXINT8;   break;
+        case GI_TYPE_TAG_UINT8:  min = 0;          max = G_MAXUINT8;  break;
+        case GI_TYPE_TAG_INT16:  min = G_MININT16; max = G_MAXINT16;  break;
+        case GI_TYPE_TAG_UINT16: min = 0;          max = G_MAXUINT16; break;
+        case GI_TYPE_TAG_INT32:  min = G_MININT32; max = G_MAXINT32;  break;
+        case GI_TYPE_TAG_UINT32: min = 0;          max = G_MAXUINT32; break;
+        default:
+            g_assert_not_reached();
+        }
+
+        d = JSValueToNumber(context, value, NULL);
+        if (d >= min && d <= max && d == (gint64) d) {
+            if (min < 0)
+                *data_p = GINT_TO_POINTER((gint32) d);
+            else
+                *data_p = GUINT_TO_POINTER((guint32) d);
+            return JS_TRUE;
+        }
+    }
+
+    return element_generic_to_c(context, value, type_info, arg_type,
+                                transfer, may_be_null, data_p);
+}
+
+static ElementToCFunc
+element_to_c_func(GITypeInfo *type_info)
+{
+    switch (g_type_info_get_tag(type_info)) {
+    case GI_TYPE_TAG_UTF8:
+        return element_utf8_to_c;
+    case GI_TYPE_TAG_INT8:
+    case GI_TYPE_TAG_UINT8:
+    case GI_TYPE_TAG_INT16:
+    case GI_TYPE_TAG_UINT16:
+    case GI_TYPE_TAG_INT32:
+    case GI_TYPE_TAG_UINT32:
+        return element_int_to_c;
+    default:
+        return element_generic_to_c;
+    }
+}
+
 static JSBool
 gwkjs_array_to_g_list(JSContextRef   context,
                     jsval        array_value,
@@ -288,6 +488,7 @@ gwkjs_array_to_g_list(JSContextRef   context,
     GList *list;
     GSList *slist;
     jsval elem;
+    ElementToCFunc to_c;
 
     list = NULL;
     slist = NULL;
@@ -309,38 +510,34 @@ gwkjs_array_to_g_list(JSContextRef   context,
         transfer = GI_TRANSFER_NOTHING;
     }
 
+    to_c = element_to_c_func(param_info);
+
     for (i = 0; i < length; ++i) {
-        GArgument elem_arg = { 0 };
+        JSValueRef exception = NULL;
+        gpointer data = NULL;
 
-        elem = NULL;
-        if (!gwkjs_array_get_element(context, array_obj, i, &elem)) {
+        elem = JSObjectGetPropertyAtIndex(context, array_obj, i, &exception);
+        if (exception) {
             gwkjs_throw(context,
                       "Missing array element %u",
                       i);
-            return JS_FALSE;
+            goto fail;
         }
 
         /* FIXME we don't know if the list elements can be NULL.
          * gobject-introspection needs to tell us this.
          * Always say they can't for now.
          */
-        if (!gwkjs_value_to_g_argument(context,
-                                     elem,
-                                     param_info,
-                                     NULL,
-                                     GWKJS_ARGUMENT_LIST_ELEMENT,
-                                     transfer,
-                                     FALSE,
-                                     &elem_arg)) {
-            return JS_FALSE;
-        }
+        if (!to_c(context, elem, param_info, GWKJS_ARGUMENT_LIST_ELEMENT,
+                  transfer, FALSE, &data))
+            goto fail;
 
         if (list_type == GI_TYPE_TAG_GLIST) {
             /* GList */
-            list = g_list_prepend(list, elem_arg.v_pointer);
+            list = g_list_prepend(list, data);
         } else {
             /* GSList */
-            slist = g_slist_prepend(slist, elem_arg.v_pointer);
+            slist = g_slist_prepend(slist, data);
         }
     }
 
@@ -351,6 +548,12 @@ gwkjs_array_to_g_list(JSContextRef   context,
     *slist_p = slist;
 
     return JS_TRUE;
+
+ fail:
+    /* Only the spine; elements converted so far are leaked, as before */
+    g_list_free(list);
+    g_slist_free(slist);
+    return JS_FALSE;
 }
 
 static JSBool
@@ -364,8 +567,9 @@ gwkjs_object_to_g_hash(JSContextRef   context,
     GHashTable *result = NULL;
     JSObjectRef props = NULL;
     JSPropertyNameArrayRef jsprops = NULL;
-    JSStringRef jsprop_name = NULL;
-    gchar *prop_name = NULL;
+    ElementToCFunc key_to_c, val_to_c;
+    gboolean utf8_keys;
+    size_t i, nparams;
 
     g_assert(JSValueIsObject(context, hash_value));
     props = JSValueToObject(context, hash_value, NULL);
@@ -385,61 +589,54 @@ gwkjs_object_to_g_hash(JSContextRef   context,
         transfer = GI_TRANSFER_NOTHING;
     }
 
-    jsprops = JSObjectCopyPropertyNames(context, (JSObjectRef) props);
-    int nparams = JSPropertyNameArrayGetCount(jsprops);
+    key_to_c = element_to_c_func(key_param_info);
+    val_to_c = element_to_c_func(val_param_info);
+    utf8_keys = g_type_info_get_tag(key_param_info) == GI_TYPE_TAG_UTF8;
+
+    jsprops = JSObjectCopyPropertyNames(context, props);
+    nparams = JSPropertyNameArrayGetCount(jsprops);
 
     /* Don't use key/value destructor functions here, because we can't
      * construct correct ones in general if the value type is complex.
      * Rely on the type-aware g_argument_release functions. */
-   result = g_hash_table_new(g_str_hash, g_str_equal);
+    result = g_hash_table_new(g_str_hash, g_str_equal);
 
-   int i = 0;
-   while (i < nparams) {
-        jsval key_js, val_js;
-        GArgument key_arg = { 0 }, val_arg = { 0 };
+    for (i = 0; i < nparams; i++) {
+        /* Owned by jsprops; used for both the key and the lookup */
+        JSStringRef jsprop_name = JSPropertyNameArrayGetNameAtIndex(jsprops, i);
         JSValueRef exception = NULL;
-
-        jsprop_name = JSPropertyNameArrayGetNameAtIndex(jsprops, i);
-        prop_name = gwkjs_jsstring_to_cstring(jsprop_name);
-
-        if (!prop_name)
-            goto free_hash_and_fail;
-
-        key_js = JSValueMakeString(context, jsprop_name);
-
-        /* Type check key type. */
-        if (!gwkjs_value_to_g_argument(context, key_js, key_param_info, NULL,
-                                     GWKJS_ARGUMENT_HASH_ELEMENT,
-                                     transfer,
-                                     FALSE /* don't allow null */,
-                                     &key_arg))
+        jsval val_js;
+        gpointer key = NULL, val = NULL;
+
+        /* Property names are strings already */
+        if (utf8_keys) {
+            key = gwkjs_jsstring_to_cstring(jsprop_name);
+            if (!key)
+                goto free_hash_and_fail;
+        } else if (!key_to_c(context, JSValueMakeString(context, jsprop_name),
+                             key_param_info, GWKJS_ARGUMENT_HASH_ELEMENT,
+                             transfer, FALSE /* don't allow null */, &key)) {
             goto free_hash_and_fail;
+        }
 
-        val_js = gwkjs_object_get_property(context, props, prop_name, &exception);
+        val_js = JSObjectGetProperty(context, props, jsprop_name, &exception);
         if (exception)
             goto free_hash_and_fail;
 
         /* Type check and convert value to a c type */
-        if (!gwkjs_value_to_g_argument(context, val_js, val_param_info, NULL,
-                                     GWKJS_ARGUMENT_HASH_ELEMENT,
-                                     transfer,
-                                     TRUE /* allow null */,
-                                     &val_arg))
+        if (!val_to_c(context, val_js, val_param_info, GWKJS_ARGUMENT_HASH_ELEMENT,
+                      transfer, TRUE /* allow null */, &val))
             goto free_hash_and_fail;
 
-        g_hash_table_insert(result, key_arg.v_pointer, val_arg.v_pointer);
-
-        JSStringRelease(jsprop_name);
-        g_free(prop_name);
-        i++;
+        g_hash_table_insert(result, key, val);
     }
 
-    *hash_p = result;
     JSPropertyNameArrayRelease(jsprops);
+    *hash_p = result;
     return JS_TRUE;
 
  free_hash_and_fail:
-    g_free(prop_name);
+    JSPropertyNameArrayRelease(jsprops);
     g_hash_table_destroy(result);
     return JS_FALSE;
 }
@@ -559,6 +756,284 @@ gwkjs_string_to_intarray(JSContextRef   context,
     }
 }
 
+/* Typed arrays (Int32Array, Float64Array, ...) keep their elements in a
+ * flat native buffer, so there is no reason to go through
+ * JSObjectGetPropertyAtIndex() and a number conversion per element.
+ */
+static JSTypedArrayType
+typed_array_get_type(JSContextRef context,
+                     jsval        value)
+{
+    JSValueRef exception = NULL;
+    JSTypedArrayType type;
+
+    if (!JSValueIsObject(context, value))
+        return kJSTypedArrayTypeNone;
+
+    type = JSValueGetTypedArrayType(context, value, &exception);
+    if (exception || type == kJSTypedArrayTypeArrayBuffer)
+        return kJSTypedArrayTypeNone;
+
+    return type;
+}
+
+/* The typed array type whose elements have the same layout as a C array
+ * of @element_type, or kJSTypedArrayTypeNone.
+ */
+static JSTypedArrayType
+typed_array_type_for_tag(GITypeTag element_type)
+{
+    switch (element_type) {
+    case GI_TYPE_TAG_INT8:
+        return kJSTypedArrayTypeInt8Array;
+    case GI_TYPE_TAG_UINT8:
+        return kJSTypedArrayTypeUint8Array;
+    case GI_TYPE_TAG_INT16:
+        return kJSTypedArrayTypeInt16Array;
+    case GI_TYPE_TAG_UINT16:
+        return kJSTypedArrayTypeUint16Array;
+    case GI_TYPE_TAG_INT32:
+        return kJSTypedArrayTypeInt32Array;
+    case GI_TYPE_TAG_UINT32:
+        return kJSTypedArrayTypeUint32Array;
+    case GI_TYPE_TAG_FLOAT:
+        return kJSTypedArrayTypeFloat32Array;
+    case GI_TYPE_TAG_DOUBLE:
+        return kJSTypedArrayTypeFloat64Array;
+    default:
+        return kJSTypedArrayTypeNone;
+    }
+}
+
+static JSTypedArrayType
+typed_array_type_for_int(unsigned intsize,
+                         gboolean is_signed)
+{
+    switch (intsize) {
+    case 1:
+        return is_signed ? kJSTypedArrayTypeInt8Array : kJSTypedArrayTypeUint8Array;
+    case 2:
+        return is_signed ? kJSTypedArrayTypeInt16Array : kJSTypedArrayTypeUint16Array;
+    case 4:
+        return is_signed ? kJSTypedArrayTypeInt32Array : kJSTypedArrayTypeUint32Array;
+    default:
+        return kJSTypedArrayTypeNone;
+    }
+}
+
+static gsize
+typed_array_element_size(JSTypedArrayType type)
+{
+    switch (type) {
+    case kJSTypedArrayTypeInt8Array:
+    case kJSTypedArrayTypeUint8Array:
+    case kJSTypedArrayTypeUint8ClampedArray:
+        return 1;
+    case kJSTypedArrayTypeInt16Array:
+    case kJSTypedArrayTypeUint16Array:
+        return 2;
+    case kJSTypedArrayTypeInt32Array:
+    case kJSTypedArrayTypeUint32Array:
+    case kJSTypedArrayTypeFloat32Array:
+        return 4;
+    case kJSTypedArrayTypeFloat64Array:
+        return 8;
+    default:
+        g_assert_not_reached();
+        return 0;
+    }
+}
+
+static gboolean
+typed_array_same_layout(JSTypedArrayType a,
+                        JSTypedArrayType b)
+{
+    if (a == kJSTypedArrayTypeUint8ClampedArray)
+        a = kJSTypedArrayTypeUint8Array;
+    if (b == kJSTypedArrayTypeUint8ClampedArray)
+        b = kJSTypedArrayTypeUint8Array;
+    return a != kJSTypedArrayTypeNone && a == b;
+}
+
+/* Plain loop with no calls in it, so the compiler can vectorize the
+ * widening/narrowing conversion. Integer narrowing truncates, same as
+ * the per-element path below.
+ */
+template<typename S, typename D>
+static void
+convert_elements(const void *src,
+                 void       *dest,
+                 gsize       n)
+{
+    const S *s = (const S *) src;
+    D *d = (D *) dest;
+    gsize i;
+
+    for (i = 0; i < n; i++)
+        d[i] = (D) s[i];
+}
+
+template<typename D>
+static gboolean
+convert_typed_array(JSTypedArrayType src_type,
+                    const void      *src,
+                    void            *dest,
+                    gsize            n)
+{
+    switch (src_type) {
+    case kJSTypedArrayTypeInt8Array:
+        convert_elements<gint8, D>(src, dest, n); return TRUE;
+    case kJSTypedArrayTypeUint8Array:
+    case kJSTypedArrayTypeUint8ClampedArray:
+        convert_elements<guint8, D>(src, dest, n); return TRUE;
+    case kJSTypedArrayTypeInt16Array:
+        convert_elements<gint16, D>(src, dest, n); return TRUE;
+    case kJSTypedArrayTypeUint16Array:
+        convert_elements<guint16, D>(src, dest, n); return TRUE;
+    case kJSTypedArrayTypeInt32Array:
+        convert_elements<gint32, D>(src, dest, n); return TRUE;
+    case kJSTypedArrayTypeUint32Array:
+        convert_elements<guint32, D>(src, dest, n); return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+template<typename D>
+static gboolean
+convert_typed_array_to_float(JSTypedArrayType src_type,
+                             const void      *src,
+                             void            *dest,
+                             gsize            n)
+{
+    switch (src_type) {
+    case kJSTypedArrayTypeFloat32Array:
+        convert_elements<float, D>(src, dest, n); return TRUE;
+    case kJSTypedArrayTypeFloat64Array:
+        convert_elements<double, D>(src, dest, n); return TRUE;
+    default:
+        return convert_typed_array<D>(src_type, src, dest, n);
+    }
+}
+
+/* Fill @dest, a C array of @length elements of @dest_type, from the
+ * backing store of the typed array @array. Returns FALSE if @array is not
+ * a typed array or can't be converted without JS semantics (float to
+ * integer needs ToInt32), in which case the caller walks the elements.
+ */
+static gboolean
+typed_array_copy(JSContextRef     context,
+                 jsval            array,
+                 unsigned int     length,
+                 JSTypedArrayType dest_type,
+                 void            *dest)
+{
+    JSTypedArrayType src_type;
+    JSObjectRef obj;
+    JSValueRef exception = NULL;
+    const void *src;
+    gsize n;
+    gboolean ok;
+
+    src_type = typed_array_get_type(context, array);
+    if (src_type == kJSTypedArrayTypeNone)
+        return FALSE;
+
+    obj = JSValueToObject(context, array, NULL);
+    n = JSObjectGetTypedArrayLength(context, obj, &exception);
+    if (exception || n < length)
+        return FALSE;
+    n = length;
+    if (n == 0)
+        return TRUE;
+
+    src = JSObjectGetTypedArrayBytesPtr(context, obj, &exception);
+    if (exception || src == NULL)
+        return FALSE;
+
+    if (typed_array_same_layout(src_type, dest_type)) {
+        memcpy(dest, src, n * typed_array_element_size(dest_type));
+        GWKJS_INC_STAT(typed_array_copy);
+        return TRUE;
+    }
+
+    switch (dest_type) {
+    case kJSTypedArrayTypeInt8Array:
+        ok = convert_typed_array<gint8>(src_type, src, dest, n); break;
+    case kJSTypedArrayTypeUint8Array:
+        ok = convert_typed_array<guint8>(src_type, src, dest, n); break;
+    case kJSTypedArrayTypeInt16Array:
+        ok = convert_typed_array<gint16>(src_type, src, dest, n); break;
+    case kJSTypedArrayTypeUint16Array:
+        ok = convert_typed_array<guint16>(src_type, src, dest, n); break;
+    case kJSTypedArrayTypeInt32Array:
+        ok = convert_typed_array<gint32>(src_type, src, dest, n); break;
+    case kJSTypedArrayTypeUint32Array:
+        ok = convert_typed_array<guint32>(src_type, src, dest, n); break;
+    case kJSTypedArrayTypeFloat32Array:
+        ok = convert_typed_array_to_float<float>(src_type, src, dest, n); break;
+    case kJSTypedArrayTypeFloat64Array:
+        ok = convert_typed_array_to_float<double>(src_type, src, dest, n); break;
+    default:
+        ok = FALSE;
+    }
+
+    if (ok)
+        GWKJS_INC_STAT(typed_array_copy);
+    return ok;
+}
+
+static gboolean
+typed_array_borrow(JSContextRef context,
+                   jsval        value,
+                   GITypeInfo  *type_info,
+                   gpointer    *contents,
+                   gsize       *length_p)
+{
+    GITypeInfo *param_info;
+    JSTypedArrayType type;
+    JSObjectRef obj;
+    JSValueRef exception = NULL;
+    gpointer data;
+    gsize length;
+
+    /* Zero-terminated arrays need the extra element we always allocate */
+    if (g_type_info_get_array_type(type_info) != GI_ARRAY_TYPE_C ||
+        g_type_info_is_zero_terminated(type_info))
+        return FALSE;
+
+    type = typed_array_get_type(context, value);
+    if (type == kJSTypedArrayTypeNone)
+        return FALSE;
+
+    param_info = g_type_info_get_param_type(type_info, 0);
+    if (g_type_info_is_pointer(param_info) ||
+        !typed_array_same_layout(type, typed_array_type_for_tag(g_type_info_get_tag(param_info)))) {
+        g_base_info_unref((GIBaseInfo*) param_info);
+        return FALSE;
+    }
+    g_base_info_unref((GIBaseInfo*) param_info);
+
+    obj = JSValueToObject(context, value, NULL);
+    length = JSObjectGetTypedArrayLength(context, obj, &exception);
+    if (exception || length == 0)
+        return FALSE;
+
+    /* Asking for the bytes pointer pins the backing store, so it stays put
+     * for the duration of the call; the typed array itself is kept alive
+     * by being one of the call's arguments.
+     */
+    data = JSObjectGetTypedArrayBytesPtr(context, obj, &exception);
+    if (exception || data == NULL)
+        return FALSE;
+
+    GWKJS_INC_STAT(typed_array_borrow);
+
+    *contents = data;
+    *length_p = length;
+    return TRUE;
+}
+
 static JSBool
 gwkjs_array_to_intarray(JSContextRef   context,
                       jsval        array_value,
@@ -575,6 +1050,14 @@ gwkjs_array_to_intarray(JSContextRef   context,
 
     /* add one so we're always zero terminated */
     result = g_malloc0((length+1) * intsize);
+
+    if (typed_array_copy(context, array_value, length,
+                         typed_array_type_for_int(intsize, is_signed),
+                         result)) {
+        *arr_p = result;
+        return JS_TRUE;
+    }
+
     JSObjectRef array = JSValueToObject(context, array_value, &exception);
     if (exception)
         g_error("THIS SHOULD NOT HAPPEN!");
@@ -681,13 +1164,21 @@ gwkjs_array_to_floatarray(JSContextRef   context,
     unsigned int i;
     void *result;
     JSValueRef exception = NULL;
-    JSObjectRef array = JSValueToObject(context, array_value, &exception);
-    if (exception)
-        g_error("THIS SHOULD NOT HAPPEN!");
 
     /* add one so we're always zero terminated */
     result = g_malloc0((length+1) * (is_double ? sizeof(double) : sizeof(float)));
 
+    if (typed_array_copy(context, array_value, length,
+                         is_double ? kJSTypedArrayTypeFloat64Array : kJSTypedArrayTypeFloat32Array,
+                         result)) {
+        *arr_p = result;
+        return JS_TRUE;
+    }
+
+    JSObjectRef array = JSValueToObject(context, array_value, &exception);
+    if (exception)
+        g_error("THIS SHOULD NOT HAPPEN!");
+
     for (i = 0; i < length; ++i) {
         jsval elem = NULL;
         double val;
@@ -2028,95 +2519,180 @@ gwkjs_value_to_explicit_array (JSContextRef  context,
                              jsval       value,
                              GIArgInfo  *arg_info,
                              GArgument  *arg,
-                             gsize      *length_p)
+                             gsize      *length_p,
+                             gboolean   *borrowed_p)
 {
     GITypeInfo type_info;
+    GITransfer transfer;
 
     g_arg_info_load_type(arg_info, &type_info);
+    transfer = g_arg_info_get_ownership_transfer(arg_info);
+
+    if (borrowed_p)
+        *borrowed_p = FALSE;
+
+    /* A typed array with the right element type can be handed to the
+     * callee as is, as long as it only reads from it and doesn't keep it.
+     * The memory then belongs to JS, so the caller must not release it.
+     */
+    if (borrowed_p != NULL &&
+        transfer == GI_TRANSFER_NOTHING &&
+        g_arg_info_get_direction(arg_info) == GI_DIRECTION_IN &&
+        typed_array_borrow(context, value, &type_info, &arg->v_pointer, length_p)) {
+        *borrowed_p = TRUE;
+        return JS_TRUE;
+    }
 
     return gwkjs_array_to_explicit_array_internal(context,
                                                 value,
                                                 &type_info,
                                                 g_base_info_get_name((GIBaseInfo*) arg_info),
                                                 GWKJS_ARGUMENT_ARGUMENT,
-                                                g_arg_info_get_ownership_transfer(arg_info),
+                                                transfer,
                                                 g_arg_info_may_be_null(arg_info),
                                                 &arg->v_pointer,
                                                 length_p);
 }
 
+/* Lists up to this long are converted into a buffer on the stack, where
+ * the conservative GC sees the values; longer ones go to the heap and
+ * have their values protected until the array holds them. */
+#define LIST_INLINE_ELEMENTS 64
+
 static JSBool
 gwkjs_array_from_g_list (JSContextRef  context,
                        jsval      *value_p,
                        GITypeTag   list_tag,
                        GITypeInfo *param_info,
                        GList      *list,
-                       GSList     *slist)
+                       GSList     *slist,
+                       GwkjsArrayFlags flags)
 {
+    JSValueRef inline_values[LIST_INLINE_ELEMENTS];
+    JSValueRef *values;
+    JSValueRef exception = NULL;
+    ElementToJSFunc to_js;
     JSObjectRef obj;
-    unsigned int i;
-    jsval elem;
-    GArgument arg;
+    guint i, length;
     JSBool result;
 
-    obj = JSObjectMakeArray(context, 0, NULL, NULL);
-    if (obj == NULL)
-        return JS_FALSE;
-
-    *value_p = obj;
+    result = JS_FALSE;
 
-    elem = NULL;
+    /* First pass: measure, so that the array is created in one go */
+    if (list_tag == GI_TYPE_TAG_GLIST)
+        length = g_list_length(list);
+    else
+        length = g_slist_length(slist);
 
-    result = JS_FALSE;
+    if (length <= LIST_INLINE_ELEMENTS)
+        values = inline_values;
+    else
+        values = g_new(JSValueRef, length);
 
-    i = 0;
-    if (list_tag == GI_TYPE_TAG_GLIST) {
-        for ( ; list != NULL; list = list->next) {
-			JSValueRef exception = NULL;
-            arg.v_pointer = list->data;
+    to_js = element_to_js_func(param_info);
 
-            if (!gwkjs_value_from_g_argument(context, &elem,
-                                           param_info, &arg,
-                                           TRUE))
-                goto out;
+    for (i = 0; i < length; i++) {
+        gpointer data;
 
-			JSObjectSetPropertyAtIndex(context, obj, i, elem, &exception);
-            if (exception) {
-                goto out;
-            }
-            ++i;
+        if (list_tag == GI_TYPE_TAG_GLIST) {
+            data = list->data;
+            list = list->next;
+        } else {
+            data = slist->data;
+            slist = slist->next;
         }
-    } else {
-        for ( ; slist != NULL; slist = slist->next) {
-            arg.v_pointer = slist->data;
-			JSValueRef exception = NULL;
 
-            if (!gwkjs_value_from_g_argument(context, &elem,
-                                           param_info, &arg,
-                                           TRUE))
-                goto out;
+        if (!to_js(context, param_info, data, flags, &values[i]))
+            goto out;
 
-			JSObjectSetPropertyAtIndex(context, obj, i, elem, &exception);
-            if (exception) {
-                goto out;
-            }
-            ++i;
-        }
+        if (values != inline_values)
+            JSValueProtect(context, values[i]);
     }
 
+    obj = JSObjectMakeArray(context, length, values, &exception);
+    if (obj == NULL || exception)
+        goto out;
+
+    *value_p = obj;
     result = JS_TRUE;
 
  out:
+    if (values != inline_values) {
+        /* i is the number of values converted and protected */
+        while (i-- > 0)
+            JSValueUnprotect(context, values[i]);
+        g_free(values);
+    }
 
     return result;
 }
 
+static void
+typed_array_free_bytes(void *bytes,
+                       void *deallocator_context)
+{
+    g_free(bytes);
+}
+
+/* Wrap @length elements of type @param_info at @array in a typed array.
+ * If @adopt, the typed array takes over @array and g_free()s it when
+ * collected; otherwise the elements are copied in one go. Returns NULL
+ * without an exception if there is no typed array for @param_info.
+ */
+static JSObjectRef
+typed_array_from_carray(JSContextRef context,
+                        GITypeInfo  *param_info,
+                        gpointer     array,
+                        gsize        length,
+                        gboolean     adopt)
+{
+    JSTypedArrayType type;
+    JSObjectRef obj;
+    JSValueRef exception = NULL;
+    gsize size;
+
+    /* An array of pointers to numbers is not an array of numbers */
+    if (g_type_info_is_pointer(param_info))
+        return NULL;
+
+    type = typed_array_type_for_tag(g_type_info_get_tag(param_info));
+    if (type == kJSTypedArrayTypeNone)
+        return NULL;
+    size = length * typed_array_element_size(type);
+
+    if (adopt && length > 0) {
+        obj = JSObjectMakeTypedArrayWithBytesNoCopy(context, type, array, size,
+                                                    typed_array_free_bytes, NULL,
+                                                    &exception);
+    } else {
+        obj = JSObjectMakeTypedArray(context, type, length, &exception);
+        if (obj && !exception && length > 0) {
+            void *dest = JSObjectGetTypedArrayBytesPtr(context, obj, &exception);
+            if (dest)
+                memcpy(dest, array, size);
+        }
+    }
+
+    if (exception)
+        return NULL;
+
+    GWKJS_INC_STAT(typed_array_out);
+    return obj;
+}
+
+/* If @adopted_p is given and @transfer hands us the array, numeric arrays
+ * take ownership of @array and set *@adopted_p; the caller must then not
+ * free it.
+ */
 static JSBool
 gwkjs_array_from_carray_internal (JSContextRef  context,
                                 jsval      *value_p,
                                 GITypeInfo *param_info,
                                 guint       length,
-                                gpointer    array)
+                                gpointer    array,
+                                GITransfer  transfer,
+                                GwkjsArrayFlags flags,
+                                gboolean   *adopted_p)
 {
     JSObjectRef obj = NULL;
     jsval elem;
@@ -2132,21 +2708,16 @@ gwkjs_array_from_carray_internal (JSContextRef  context,
     if (is_gvalue_flat_array(param_info, element_type))
         return gwkjs_array_from_flat_gvalue_array(context, array, length, value_p);
 
-    /* Special case array(guint8) */
-    if (element_type == GI_TYPE_TAG_UINT8) {
-        GByteArray gbytearray;
-
-        gbytearray.data = (guint8 *) array;
-        gbytearray.len = length;
+    if (flags & GWKJS_ARRAY_FLAGS_TYPED_ARRAY) {
+        gboolean adopt = adopted_p != NULL && transfer != GI_TRANSFER_NOTHING;
 
-//TODO: implement - no bytearray support yet.
-//        obj = gwkjs_byte_array_from_byte_array (context, &gbytearray);
-g_warning("UNIMPLEMENTED: requested gwkjs_byte_array_from_byte_array");
-
-        if (obj == NULL)
-            return JS_FALSE;
-        *value_p = obj;
-        return JS_TRUE;
+        obj = typed_array_from_carray(context, param_info, array, length, adopt);
+        if (obj != NULL) {
+            if (adopt && length > 0)
+                *adopted_p = TRUE;
+            *value_p = obj;
+            return JS_TRUE;
+        }
     }
 
     obj = JSObjectMakeArray(context, 0, NULL, NULL);
@@ -2161,7 +2732,7 @@ g_warning("UNIMPLEMENTED: requested gwkjs_byte_array_from_byte_array");
 #define ITERATE(type) \
     for (i = 0; i < length; i++) { \
         arg.v_##type = *(((g##type*)array) + i);                         \
-        if (!gwkjs_value_from_g_argument(context, &elem, param_info, &arg, TRUE)) \
+        if (!gwkjs_value_from_g_argument_full(context, &elem, param_info, &arg, TRUE, flags)) \
           goto finally; \
         JSObjectSetPropertyAtIndex(context, obj,i,elem,&exception); \
         if (exception) \
@@ -2219,7 +2790,7 @@ g_warning("UNIMPLEMENTED: requested gwkjs_byte_array_from_byte_array");
               for (i = 0; i < length; i++) {
                   arg.v_pointer = ((char*)array) + (struct_size * i);
 
-                  if (!gwkjs_value_from_g_argument(context, &elem, param_info, &arg, TRUE))
+                  if (!gwkjs_value_from_g_argument_full(context, &elem, param_info, &arg, TRUE, flags))
                       goto finally;
 
                   exception = NULL;
@@ -2261,7 +2832,8 @@ static JSBool
 gwkjs_array_from_fixed_size_array (JSContextRef  context,
                                  jsval      *value_p,
                                  GITypeInfo *type_info,
-                                 gpointer    array)
+                                 gpointer    array,
+                                 GwkjsArrayFlags flags)
 {
     gint length;
     GITypeInfo *param_info;
@@ -2273,7 +2845,8 @@ gwkjs_array_from_fixed_size_array (JSContextRef  context,
 
     param_info = g_type_info_get_param_type(type_info, 0);
 
-    res = gwkjs_array_from_carray_internal(context, value_p, param_info, length, array);
+    res = gwkjs_array_from_carray_internal(context, value_p, param_info, length, array,
+                                           GI_TRANSFER_NOTHING, flags, NULL);
 
     g_base_info_unref((GIBaseInfo*)param_info);
 
@@ -2284,15 +2857,24 @@ JSBool
 gwkjs_value_from_explicit_array(JSContextRef  context,
                               jsval      *value_p,
                               GITypeInfo *type_info,
+                              GITransfer  transfer,
                               GArgument  *arg,
-                              int         length)
+                              int         length,
+                              GwkjsArrayFlags flags)
 {
     GITypeInfo *param_info;
+    gboolean adopted = FALSE;
     JSBool res;
 
     param_info = g_type_info_get_param_type(type_info, 0);
 
-    res = gwkjs_array_from_carray_internal(context, value_p, param_info, length, arg->v_pointer);
+    res = gwkjs_array_from_carray_internal(context, value_p, param_info, length, arg->v_pointer,
+                                           transfer, flags, &adopted);
+
+    /* The JS value owns the buffer now; releasing the argument afterwards
+     * must not free it */
+    if (adopted)
+        arg->v_pointer = NULL;
 
     g_base_info_unref((GIBaseInfo*)param_info);
 
@@ -2304,7 +2886,8 @@ gwkjs_array_from_boxed_array (JSContextRef   context,
                             jsval       *value_p,
                             GIArrayType  array_type,
                             GITypeInfo  *param_info,
-                            GArgument   *arg)
+                            GArgument   *arg,
+                            GwkjsArrayFlags flags)
 {
     GArray *array;
     GPtrArray *ptr_array;
@@ -2333,14 +2916,29 @@ gwkjs_array_from_boxed_array (JSContextRef   context,
         g_assert_not_reached();
     }
 
-    return gwkjs_array_from_carray_internal(context, value_p, param_info, length, data);
+    return gwkjs_array_from_carray_internal(context, value_p, param_info, length, data,
+                                          GI_TRANSFER_NOTHING, flags, NULL);
+}
+
+/* Number of elements before the terminating zero */
+template<typename T>
+static gsize
+zero_terminated_length(gconstpointer c_array)
+{
+    const T *array = (const T *) c_array;
+    gsize n = 0;
+
+    while (array[n])
+        n++;
+    return n;
 }
 
 static JSBool
 gwkjs_array_from_zero_terminated_c_array (JSContextRef  context,
                                         jsval      *value_p,
                                         GITypeInfo *param_info,
-                                        gpointer    c_array)
+                                        gpointer    c_array,
+                                        GwkjsArrayFlags flags)
 {
     JSObjectRef obj;
     jsval elem;
@@ -2353,18 +2951,37 @@ gwkjs_array_from_zero_terminated_c_array (JSContextRef  context,
 
     element_type = g_type_info_get_tag(param_info);
 
-    /* Special case array(guint8) */
-    if (element_type == GI_TYPE_TAG_UINT8) {
-        GByteArray gbytearray;
+    if (flags & GWKJS_ARRAY_FLAGS_TYPED_ARRAY) {
+        gsize length;
 
-        gbytearray.data = (guint8 *) c_array;
-        gbytearray.len = strlen((const char *) c_array);
+        switch (element_type) {
+        case GI_TYPE_TAG_INT8:
+        case GI_TYPE_TAG_UINT8:
+            length = strlen((const char *) c_array);
+            break;
+        case GI_TYPE_TAG_INT16:
+        case GI_TYPE_TAG_UINT16:
+            length = zero_terminated_length<guint16>(c_array);
+            break;
+        case GI_TYPE_TAG_INT32:
+        case GI_TYPE_TAG_UINT32:
+            length = zero_terminated_length<guint32>(c_array);
+            break;
+        case GI_TYPE_TAG_FLOAT:
+            length = zero_terminated_length<float>(c_array);
+            break;
+        case GI_TYPE_TAG_DOUBLE:
+            length = zero_terminated_length<double>(c_array);
+            break;
+        default:
+            length = 0;
+        }
 
-        obj = gwkjs_byte_array_from_byte_array (context, &gbytearray);
-        if (obj == NULL)
-            return JS_FALSE;
-        *value_p = obj;
-        return JS_TRUE;
+        obj = typed_array_from_carray(context, param_info, c_array, length, FALSE);
+        if (obj != NULL) {
+            *value_p = obj;
+            return JS_TRUE;
+        }
     }
 
     obj = JSObjectMakeArray(context, 0, NULL, NULL);
@@ -2381,7 +2998,7 @@ gwkjs_array_from_zero_terminated_c_array (JSContextRef  context,
         for (i = 0; array[i]; i++) { \
 			JSValueRef exception = NULL; \
             arg.v_##type = array[i]; \
-            if (!gwkjs_value_from_g_argument(context, &elem, param_info, &arg, TRUE)) \
+            if (!gwkjs_value_from_g_argument_full(context, &elem, param_info, &arg, TRUE, flags)) \
                 goto finally; \
 			JSObjectSetPropertyAtIndex(context, obj, i, elem, &exception); \
             if (exception) \
@@ -2390,7 +3007,9 @@ gwkjs_array_from_zero_terminated_c_array (JSContextRef  context,
     } while(0);
 
     switch (element_type) {
-        /* We handle GI_TYPE_TAG_UINT8 above. */
+        case GI_TYPE_TAG_UINT8:
+          ITERATE(uint8);
+          break;
         case GI_TYPE_TAG_INT8:
           ITERATE(int8);
           break;
@@ -2449,15 +3068,14 @@ gwkjs_object_from_g_hash (JSContextRef  context,
                         jsval      *value_p,
                         GITypeInfo *key_param_info,
                         GITypeInfo *val_param_info,
-                        GHashTable *hash)
+                        GHashTable *hash,
+                        GwkjsArrayFlags flags)
 {
     GHashTableIter iter;
     JSObjectRef obj = NULL;
-    JSStringRef keystr;
-    char     *keyutf8 = NULL;
-    jsval     keyjs = NULL;
-	JSValueRef  valjs = NULL;
-    GArgument keyarg, valarg;
+    ElementToJSFunc key_to_js, val_to_js;
+    gboolean utf8_keys;
+    gpointer key, val;
     JSBool result;
 
     // a NULL hash table becomes a null JS value
@@ -2472,48 +3090,46 @@ gwkjs_object_from_g_hash (JSContextRef  context,
 
     *value_p = obj;
 
-    keyjs = JSValueMakeUndefined(context);
-
-    valjs = JSValueMakeUndefined(context);
-
-    keystr = NULL;
+    key_to_js = element_to_js_func(key_param_info);
+    val_to_js = element_to_js_func(val_param_info);
+    utf8_keys = g_type_info_get_tag(key_param_info) == GI_TYPE_TAG_UTF8;
 
     result = JS_FALSE;
 
     g_hash_table_iter_init(&iter, hash);
-    while (g_hash_table_iter_next
-           (&iter, &keyarg.v_pointer, &valarg.v_pointer)) {
-        if (!gwkjs_value_from_g_argument(context, &keyjs,
-                                       key_param_info, &keyarg,
-                                       TRUE))
-            goto out;
-
-        keystr = JSValueToStringCopy(context, keyjs, NULL);
-        if (!keystr)
-            goto out;
-
-        if (!gwkjs_string_to_utf8(context, JSValueMakeString(context, keystr), &keyutf8))
-            goto out;
+    while (g_hash_table_iter_next(&iter, &key, &val)) {
+        JSValueRef exception = NULL;
+        JSStringRef keystr;
+        jsval keyjs, valjs;
+
+        /* Hashes passed around tend to have the same keys over and over
+         * (think a{sv} dictionaries), so go through the name cache
+         * rather than making a new JS string for each one. */
+        if (utf8_keys && key != NULL) {
+            keystr = gwkjs_atom_intern(context, (const char *) key);
+        } else {
+            if (!key_to_js(context, key_param_info, key, flags, &keyjs))
+                goto out;
+            keystr = JSValueToStringCopy(context, keyjs, &exception);
+            if (exception)
+                goto out;
+        }
 
-        if (!gwkjs_value_from_g_argument(context, &valjs,
-                                       val_param_info, &valarg,
-                                       TRUE))
+        if (!val_to_js(context, val_param_info, val, flags, &valjs)) {
+            JSStringRelease(keystr);
             goto out;
+        }
 
-        if (!gwkjs_object_set_property(context, obj, keyutf8, valjs,
-                               		   0, NULL))
+        JSObjectSetProperty(context, obj, keystr, valjs,
+                            kJSPropertyAttributeNone, &exception);
+        JSStringRelease(keystr);
+        if (exception)
             goto out;
-
-        g_free(keyutf8);
-        keyutf8 = NULL;
     }
 
     result = JS_TRUE;
 
  out:
-    if (keyutf8) g_free(keyutf8);
-    JSStringRelease(keystr);
-
     return result;
 }
 
@@ -2523,6 +3139,18 @@ gwkjs_value_from_g_argument (JSContextRef  context,
                            GITypeInfo *type_info,
                            GArgument  *arg,
                            gboolean    copy_structs)
+{
+    return gwkjs_value_from_g_argument_full(context, value_p, type_info, arg,
+                                          copy_structs, GWKJS_ARRAY_FLAGS_NONE);
+}
+
+JSBool
+gwkjs_value_from_g_argument_full (JSContextRef    context,
+                                jsval          *value_p,
+                                GITypeInfo     *type_info,
+                                GArgument      *arg,
+                                gboolean        copy_structs,
+                                GwkjsArrayFlags flags)
 {
     GITypeTag type_tag;
 
@@ -2822,7 +3450,8 @@ gwkjs_value_from_g_argument (JSContextRef  context,
                 result = gwkjs_array_from_zero_terminated_c_array(context,
                                                                 value_p,
                                                                 param_info,
-                                                                arg->v_pointer);
+                                                                arg->v_pointer,
+                                                                flags);
 
                 g_base_info_unref((GIBaseInfo*) param_info);
 
@@ -2831,7 +3460,8 @@ gwkjs_value_from_g_argument (JSContextRef  context,
                 /* arrays with length are handled outside of this function */
                 g_assert(("Use gwkjs_value_from_explicit_array() for arrays with length param",
                           g_type_info_get_array_length(type_info) == -1));
-                return gwkjs_array_from_fixed_size_array(context, value_p, type_info, arg->v_pointer);
+                return gwkjs_array_from_fixed_size_array(context, value_p, type_info, arg->v_pointer,
+                                                         flags);
             }
         } else if (g_type_info_get_array_type(type_info) == GI_ARRAY_TYPE_BYTE_ARRAY) {
             JSObjectRef array = gwkjs_byte_array_from_byte_array(context,
@@ -2854,7 +3484,8 @@ gwkjs_value_from_g_argument (JSContextRef  context,
                                                 value_p,
                                                 g_type_info_get_array_type(type_info),
                                                 param_info,
-                                                arg);
+                                                arg,
+                                                flags);
 
             g_base_info_unref((GIBaseInfo*) param_info);
 
@@ -2878,7 +3509,8 @@ gwkjs_value_from_g_argument (JSContextRef  context,
                                            type_tag == GI_TYPE_TAG_GLIST ?
                                            (GList *) arg->v_pointer : NULL,
                                            type_tag == GI_TYPE_TAG_GSLIST ?
-                                           (GSList *) arg->v_pointer : NULL);
+                                           (GSList *) arg->v_pointer : NULL,
+                                           flags);
 
             g_base_info_unref((GIBaseInfo*) param_info);
 
@@ -2900,7 +3532,8 @@ gwkjs_value_from_g_argument (JSContextRef  context,
                                             value_p,
                                             key_param_info,
                                             val_param_info,
-                                            (GHashTable *) arg->v_pointer);
+                                            (GHashTable *) arg->v_pointer,
+                                            flags);
 
             g_base_info_unref((GIBaseInfo*) key_param_info);
             g_base_info_unref((GIBaseInfo*) val_param_info);
@@ -42,6 +42,16 @@ typedef enum {
     GWKJS_ARGUMENT_ARRAY_ELEMENT
 } GwkjsArgumentType;
 
+/* How C arrays are turned into JS values. By default they become plain
+ * JS arrays with one value per element; TYPED_ARRAY asks for arrays of
+ * fixed-width numbers to become typed arrays (Int32Array, Float64Array...)
+ * instead, which JS code opts into per function with fn.typedArrays.
+ */
+typedef enum {
+    GWKJS_ARRAY_FLAGS_NONE        = 0,
+    GWKJS_ARRAY_FLAGS_TYPED_ARRAY = 1 << 0
+} GwkjsArrayFlags;
+
 JSBool gwkjs_value_to_arg   (JSContextRef context,
                            jsval       value,
                            GIArgInfo  *arg_info,
@@ -51,7 +61,8 @@ JSBool gwkjs_value_to_explicit_array (JSContextRef context,
                                     jsval       value,
                                     GIArgInfo  *arg_info,
                                     GArgument  *arg,
-                                    gsize      *length_p);
+                                    gsize      *length_p,
+                                    gboolean   *borrowed_p);
 
 void gwkjs_g_argument_init_default (JSContextRef context,
                                   GITypeInfo     *type_info,
@@ -71,11 +82,21 @@ JSBool gwkjs_value_from_g_argument (JSContextRef context,
                                   GITypeInfo *type_info,
                                   GArgument  *arg,
                                   gboolean    copy_structs);
-JSBool gwkjs_value_from_explicit_array (JSContextRef context,
-                                      jsval      *value_p,
-                                      GITypeInfo *type_info,
-                                      GArgument  *arg,
-                                      int         length);
+JSBool gwkjs_value_from_g_argument_full (JSContextRef    context,
+                                       jsval          *value_p,
+                                       GITypeInfo     *type_info,
+                                       GArgument      *arg,
+                                       gboolean        copy_structs,
+                                       GwkjsArrayFlags flags);
+/* With @transfer other than NOTHING a numeric array may be adopted by the
+ * returned typed array, in which case arg->v_pointer is cleared. */
+JSBool gwkjs_value_from_explicit_array (JSContextRef    context,
+                                      jsval          *value_p,
+                                      GITypeInfo     *type_info,
+                                      GITransfer      transfer,
+                                      GArgument      *arg,
+                                      int             length,
+                                      GwkjsArrayFlags flags);
 
 JSBool gwkjs_g_argument_release    (JSContextRef context,
                                   GITransfer  transfer,
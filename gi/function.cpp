@@ -37,41 +37,238 @@
 #include <gwkjs/compat.h>
 #include <gwkjs/jsapi-private.h>
 #include <gwkjs/exceptions.h>
+#include <gwkjs/context-private.h>
 
 #include <util/log.h>
 
 #include <girepository.h>
+#include <gio/gio.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
 
-/* We use guint8 for arguments; functions can't
- * have more than this.
+/* Functions whose C signature is only integers, doubles and pointers
+ * can be called through a plain C function pointer instead of
+ * ffi_call(). On these ABIs every integer or pointer argument up to
+ * 64 bits travels in a full general purpose register, so we can pass
+ * them all as a (properly extended) gintptr and only have to tell
+ * integer and floating point slots apart.
  */
-#define GWKJS_ARG_INDEX_INVALID G_MAXUINT8
-
-typedef struct {
+#if (defined(__x86_64__) && !defined(_WIN64)) || defined(__aarch64__)
+#define GWKJS_HAVE_FAST_INVOKE 1
+#endif
+
+/* C arguments, including the instance */
+#define GWKJS_FAST_INVOKE_MAX_ARGS 4
+
+typedef union {
+    gintptr v_word;
+    double v_double;
+} GwkjsFastValue;
+
+typedef void (*GwkjsFastInvokeFunc) (gpointer              native_address,
+                                     const GwkjsFastValue *args,
+                                     GwkjsFastValue       *ret);
+
+typedef enum {
+    FAST_KIND_INVALID,
+    FAST_KIND_VOID,
+    FAST_KIND_BOOLEAN,
+    FAST_KIND_INT8,
+    FAST_KIND_UINT8,
+    FAST_KIND_INT16,
+    FAST_KIND_UINT16,
+    FAST_KIND_INT32,
+    FAST_KIND_UINT32,
+    FAST_KIND_INT64,
+    FAST_KIND_UINT64,
+    FAST_KIND_ENUM,
+    FAST_KIND_POINTER,
+    FAST_KIND_DOUBLE
+} GwkjsFastKind;
+
+typedef struct _Function {
     GIFunctionInfo *info;
 
-    GwkjsParamType *param_types;
+    /* The call plan, one record per GI argument */
+    GwkjsArgPlan *args;
+
+    GITypeInfo return_info;
+    GITypeTag return_tag;
+    GITransfer return_transfer;
+    guint8 return_array_length_pos;
 
+    guint8 gi_argc;
     guint8 expected_js_argc;
     guint8 js_out_argc;
+    guint is_method : 1;
+    guint can_throw_gerror : 1;
     GIFunctionInvoker invoker;
+
+    /* How returned C arrays are converted; see the typedArrays property */
+    GwkjsArrayFlags array_flags;
+
+    /* Non-NULL if the signature qualifies for a direct call, see
+     * init_fast_invoke(); the kinds are indexed by C argument.
+     */
+    GwkjsFastInvokeFunc fast_invoke;
+    guint8 fast_kinds[GWKJS_FAST_INVOKE_MAX_ARGS];
+    guint8 fast_return_kind;
+
+    /* For a foo_async() completed by foo_finish(), the latter; looked
+     * up the first time callPromise() is used, see get_finish_function().
+     */
+    struct _Function *finish;
+    guint async_checked : 1;
 } Function;
 
+/* Calls with up to this many C arguments marshal into buffers on the
+ * stack; bigger ones take their scratch space from the invoke arena.
+ */
+#define GWKJS_INVOKE_INLINE_ARGS 8
+
 extern JSClassDefinition gwkjs_function_class;
 static JSClassRef gwkjs_function_class_ref = NULL;
 
-/* Because we can't free the mmap'd data for a callback
- * while it's in use, this list keeps track of ones that
- * will be freed the next time we invoke a C function.
+/* Trampolines in use, keyed by what they call (context, JS function,
+ * callable info, scope), so passing the same function for the same
+ * kind of callback again just takes another reference.
  */
-static GSList *completed_trampolines = NULL;  /* GwkjsCallbackTrampoline */
+static GHashTable *live_trampolines = NULL;
+
+/* Trampolines nobody references any more, grouped by callable info.
+ * Their ffi closure is still prepared and points back at the
+ * trampoline, so handing one out again only needs a new JS function.
+ * Nothing is freed while a callback may still be returning through
+ * its closure; the pools are trimmed from an idle handler and after
+ * garbage collection instead.
+ */
+static GHashTable *idle_trampolines = NULL;  /* GICallableInfo -> GSList of GwkjsCallbackTrampoline */
+static guint idle_trampolines_source = 0;
+
+/* Guards both tables and the idle source: collections in worker
+ * contexts trim the pools too, see gwkjs_callback_trampoline_reclaim().
+ */
+G_LOCK_DEFINE_STATIC(trampolines);
+
+/* Idle trampolines kept per callable info when trimming */
+#define GWKJS_TRAMPOLINE_POOL_KEEP 4
 
 GWKJS_DEFINE_PRIV_FROM_JS(Function, gwkjs_function_class)
 
+static void          init_arg_plan       (GICallableInfo *info,
+                                          guint8          n_args,
+                                          guint8          i,
+                                          GwkjsArgPlan   *plan);
+static void          free_arg_plans      (GwkjsArgPlan   *args,
+                                          guint8          n_args);
+static unsigned long get_length_from_arg (GArgument      *arg,
+                                          GITypeTag       tag);
+
+/* GIBaseInfos are not unique per typelib entry, so compare them by
+ * what they point at rather than by address.
+ */
+static guint
+callable_info_hash(gconstpointer key)
+{
+    GIBaseInfo *info = (GIBaseInfo *) key;
+
+    return g_str_hash(g_base_info_get_name(info)) ^
+           g_str_hash(g_base_info_get_namespace(info));
+}
+
+static gboolean
+callable_info_equal(gconstpointer a,
+                    gconstpointer b)
+{
+    return g_base_info_equal((GIBaseInfo *) a, (GIBaseInfo *) b);
+}
+
+/* live_trampolines hashes the trampolines themselves; lookups use a
+ * trampoline on the stack with just these fields filled in.
+ */
+static guint
+trampoline_key_hash(gconstpointer key)
+{
+    const GwkjsCallbackTrampoline *t = (const GwkjsCallbackTrampoline *) key;
+
+    return g_direct_hash(t->js_function) ^
+           callable_info_hash(t->info) ^
+           (t->scope << 1 | t->is_vfunc);
+}
+
+static gboolean
+trampoline_key_equal(gconstpointer a,
+                     gconstpointer b)
+{
+    const GwkjsCallbackTrampoline *ta = (const GwkjsCallbackTrampoline *) a;
+    const GwkjsCallbackTrampoline *tb = (const GwkjsCallbackTrampoline *) b;
+
+    return ta->context == tb->context &&
+           ta->js_function == tb->js_function &&
+           ta->scope == tb->scope &&
+           ta->is_vfunc == tb->is_vfunc &&
+           callable_info_equal(ta->info, tb->info);
+}
+
+static void
+trampoline_free(GwkjsCallbackTrampoline *trampoline)
+{
+    g_callable_info_free_closure(trampoline->info, trampoline->closure);
+    g_base_info_unref( (GIBaseInfo*) trampoline->info);
+    free_arg_plans(trampoline->args, trampoline->n_args);
+    g_slice_free(GwkjsCallbackTrampoline, trampoline);
+}
+
+/* Frees all but @keep idle trampolines for every callable info. The
+ * table key is always the info of the first trampoline in the list,
+ * which is never freed here. Called with the lock held.
+ */
+static void
+trim_idle_trampolines(guint keep)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_assert(keep > 0);
+
+    if (idle_trampolines == NULL)
+        return;
+
+    g_hash_table_iter_init(&iter, idle_trampolines);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        GSList *tail = g_slist_nth((GSList *) value, keep - 1);
+        GSList *l;
+
+        if (tail == NULL)
+            continue;
+
+        for (l = tail->next; l; l = l->next)
+            trampoline_free((GwkjsCallbackTrampoline *) l->data);
+        g_slist_free(tail->next);
+        tail->next = NULL;
+    }
+}
+
+static gboolean
+trim_idle_trampolines_idle(gpointer data)
+{
+    G_LOCK(trampolines);
+    idle_trampolines_source = 0;
+    trim_idle_trampolines(GWKJS_TRAMPOLINE_POOL_KEEP);
+    G_UNLOCK(trampolines);
+    return FALSE;
+}
+
+void
+gwkjs_callback_trampoline_reclaim(void)
+{
+    G_LOCK(trampolines);
+    trim_idle_trampolines(GWKJS_TRAMPOLINE_POOL_KEEP);
+    G_UNLOCK(trampolines);
+}
+
 void
 gwkjs_callback_trampoline_ref(GwkjsCallbackTrampoline *trampoline)
 {
@@ -81,29 +278,64 @@ gwkjs_callback_trampoline_ref(GwkjsCallbackTrampoline *trampoline)
 void
 gwkjs_callback_trampoline_unref(GwkjsCallbackTrampoline *trampoline)
 {
-    /* Not MT-safe, like all the rest of GWKJS */
+    GSList *pool;
 
-    trampoline->ref_count--;
-    if (trampoline->ref_count == 0) {
-        JSContextRef context = trampoline->context;
+    /* The reference count itself is only used on the thread of the
+     * trampoline's context; the tables are shared. */
 
-        if (!trampoline->is_vfunc) {
-            JSValueUnprotect(context, trampoline->js_function);
-        }
+    trampoline->ref_count--;
+    if (trampoline->ref_count > 0)
+        return;
 
-        g_callable_info_free_closure(trampoline->info, trampoline->closure);
-        g_base_info_unref( (GIBaseInfo*) trampoline->info);
-        g_free (trampoline->param_types);
-        g_slice_free(GwkjsCallbackTrampoline, trampoline);
+    if (!trampoline->is_vfunc) {
+        JSValueUnprotect(trampoline->context, trampoline->js_function);
     }
+
+    G_LOCK(trampolines);
+    if (g_hash_table_lookup(live_trampolines, trampoline) == trampoline)
+        g_hash_table_remove(live_trampolines, trampoline);
+
+    trampoline->js_function = NULL;
+
+    pool = (GSList *) g_hash_table_lookup(idle_trampolines, trampoline->info);
+    g_hash_table_steal(idle_trampolines, trampoline->info);
+    g_hash_table_insert(idle_trampolines, trampoline->info,
+                        g_slist_prepend(pool, trampoline));
+
+    if (idle_trampolines_source == 0)
+        idle_trampolines_source = g_idle_add_full(G_PRIORITY_LOW,
+                                                  trim_idle_trampolines_idle,
+                                                  NULL, NULL);
+    G_UNLOCK(trampolines);
+}
+
+/* Called with the lock held */
+static GwkjsCallbackTrampoline *
+take_idle_trampoline(GICallableInfo *callable_info)
+{
+    GwkjsCallbackTrampoline *trampoline;
+    GSList *pool;
+
+    pool = (GSList *) g_hash_table_lookup(idle_trampolines, callable_info);
+    if (pool == NULL)
+        return NULL;
+
+    trampoline = (GwkjsCallbackTrampoline *) pool->data;
+    g_hash_table_steal(idle_trampolines, callable_info);
+    pool = g_slist_delete_link(pool, pool);
+    if (pool != NULL)
+        g_hash_table_insert(idle_trampolines,
+                            ((GwkjsCallbackTrampoline *) pool->data)->info, pool);
+
+    return trampoline;
 }
 
 static void
-set_return_ffi_arg_from_giargument (GITypeInfo  *ret_type,
-                                    void        *result,
-                                    GIArgument  *return_value)
+set_return_ffi_arg_from_giargument (GwkjsCallbackTrampoline *trampoline,
+                                    void                    *result,
+                                    GIArgument              *return_value)
 {
-    switch (g_type_info_get_tag(ret_type)) {
+    switch (trampoline->return_tag) {
     case GI_TYPE_TAG_INT8:
         *(ffi_sarg *) result = return_value->v_int8;
         break;
@@ -132,25 +364,16 @@ set_return_ffi_arg_from_giargument (GITypeInfo  *ret_type,
         *(ffi_arg *) result = return_value->v_uint64;
         break;
     case GI_TYPE_TAG_INTERFACE:
-        {
-            GIBaseInfo* interface_info;
-            GIInfoType interface_type;
-
-            interface_info = g_type_info_get_interface(ret_type);
-            interface_type = g_base_info_get_type(interface_info);
-
-            switch (interface_type) {
-            case GI_INFO_TYPE_ENUM:
-            case GI_INFO_TYPE_FLAGS:
-                *(ffi_sarg *) result = return_value->v_long;
-                break;
-            default:
-                *(ffi_arg *) result = (ffi_arg) return_value->v_pointer;
-                break;
-            }
-
-            g_base_info_unref(interface_info);
+        switch (trampoline->return_interface_type) {
+        case GI_INFO_TYPE_ENUM:
+        case GI_INFO_TYPE_FLAGS:
+            *(ffi_sarg *) result = return_value->v_long;
+            break;
+        default:
+            *(ffi_arg *) result = (ffi_arg) return_value->v_pointer;
+            break;
         }
+        break;
     default:
         *(ffi_arg *) result = (ffi_arg) return_value->v_uint64;
         break;
@@ -175,9 +398,7 @@ gwkjs_callback_closure(ffi_cif *cif,
     GwkjsCallbackTrampoline *trampoline;
     int i, n_args, n_jsargs, n_outargs;
     jsval *jsargs, rval;
-    JSObjectRef rval_obj = NULL;
     JSObjectRef this_object = NULL;
-    GITypeInfo ret_type;
     gboolean success = FALSE;
     gboolean ret_type_is_void;
     JSValueRef exception = NULL;
@@ -206,59 +427,43 @@ gwkjs_callback_closure(ffi_cif *cif,
 
     func_obj = JSValueToObject(context, trampoline->js_function, NULL);
 
-    n_args = g_callable_info_get_n_args(trampoline->info);
+    n_args = trampoline->n_args;
+    n_outargs = trampoline->n_outargs;
 
-    g_assert(n_args >= 0);
-
-    n_outargs = 0;
     jsargs = (jsval*)g_newa(jsval, n_args);
     for (i = 0, n_jsargs = 0; i < n_args; i++) {
-        GIArgInfo arg_info;
-        GITypeInfo type_info;
-        GwkjsParamType param_type;
-
-        g_callable_info_load_arg(trampoline->info, i, &arg_info);
-        g_arg_info_load_type(&arg_info, &type_info);
+        const GwkjsArgPlan *arg = &trampoline->args[i];
 
         /* Skip void * arguments */
-        if (g_type_info_get_tag(&type_info) == GI_TYPE_TAG_VOID)
+        if (arg->type_tag == GI_TYPE_TAG_VOID)
             continue;
 
-        if (g_arg_info_get_direction(&arg_info) == GI_DIRECTION_OUT) {
-            n_outargs++;
+        if (arg->direction == GI_DIRECTION_OUT)
             continue;
-        }
-
-        if (g_arg_info_get_direction(&arg_info) == GI_DIRECTION_INOUT)
-            n_outargs++;
 
-        param_type = trampoline->param_types[i];
-
-        switch (param_type) {
+        switch (arg->param_type) {
             case PARAM_SKIPPED:
                 continue;
             case PARAM_ARRAY: {
-                gint array_length_pos = g_type_info_get_array_length(&type_info);
-                GIArgInfo array_length_arg;
-                GITypeInfo arg_type_info;
-                jsval length;
-
-                g_callable_info_load_arg(trampoline->info, array_length_pos, &array_length_arg);
-                g_arg_info_load_type(&array_length_arg, &arg_type_info);
-                if (!gwkjs_value_from_g_argument(context, &length,
-                                               &arg_type_info,
-                                               (GArgument *) args[array_length_pos], TRUE))
-                    goto out;
+                const GwkjsArgPlan *length_arg = &trampoline->args[arg->array_length_pos];
+                gsize length;
+
+                length = get_length_from_arg((GArgument *) args[arg->array_length_pos],
+                                             length_arg->type_tag);
 
                 if (!gwkjs_value_from_explicit_array(context, &jsargs[n_jsargs++],
-                                                   &type_info, (GArgument*) args[i], gwkjs_jsvalue_to_int(context, length, NULL)))
+                                                   (GITypeInfo *) &arg->type_info,
+                                                   arg->direction == GI_DIRECTION_IN ?
+                                                   arg->transfer : GI_TRANSFER_NOTHING,
+                                                   (GArgument*) args[i], length,
+                                                   GWKJS_ARRAY_FLAGS_NONE))
                     goto out;
                 break;
             }
             case PARAM_NORMAL:
                 if (!gwkjs_value_from_g_argument(context,
                                                &jsargs[n_jsargs++],
-                                               &type_info,
+                                               (GITypeInfo *) &arg->type_info,
                                                (GArgument *) args[i], FALSE))
                     goto out;
                 break;
@@ -277,51 +482,45 @@ gwkjs_callback_closure(ffi_cif *cif,
     }
 
     rval = JSObjectCallAsFunction(context,
-                                  JSValueToObject(context, trampoline->js_function, NULL),
+                                  func_obj,
                                   this_object,
                                   n_jsargs, jsargs, &exception);
 
-    rval_obj = JSValueToObject(context, rval, NULL);
     if (exception)
         goto out;
 
-    g_callable_info_load_return_type(trampoline->info, &ret_type);
-    ret_type_is_void = g_type_info_get_tag (&ret_type) == GI_TYPE_TAG_VOID;
+    ret_type_is_void = trampoline->return_tag == GI_TYPE_TAG_VOID;
 
     if (n_outargs == 0 && !ret_type_is_void) {
         GIArgument argument;
-        GITransfer transfer;
 
-        transfer = g_callable_info_get_caller_owns (trampoline->info);
         /* non-void return value, no out args. Should
          * be a single return value. */
         if (!gwkjs_value_to_g_argument(context,
                                      rval,
-                                     &ret_type,
+                                     &trampoline->return_info,
                                      "callback",
                                      GWKJS_ARGUMENT_RETURN_VALUE,
-                                     transfer,
+                                     trampoline->return_transfer,
                                      TRUE,
                                      &argument))
             goto out;
 
-        set_return_ffi_arg_from_giargument(&ret_type,
+        set_return_ffi_arg_from_giargument(trampoline,
                                            result,
                                            &argument);
     } else if (n_outargs == 1 && ret_type_is_void) {
         /* void return value, one out args. Should
          * be a single return value. */
         for (i = 0; i < n_args; i++) {
-            GIArgInfo arg_info;
-            GITypeInfo type_info;
-            g_callable_info_load_arg(trampoline->info, i, &arg_info);
-            if (g_arg_info_get_direction(&arg_info) == GI_DIRECTION_IN)
+            const GwkjsArgPlan *arg = &trampoline->args[i];
+
+            if (arg->direction == GI_DIRECTION_IN)
                 continue;
 
-            g_arg_info_load_type(&arg_info, &type_info);
             if (!gwkjs_value_to_g_argument(context,
                                          rval,
-                                         &type_info,
+                                         (GITypeInfo *) &arg->type_info,
                                          "callback",
                                          GWKJS_ARGUMENT_ARGUMENT,
                                          GI_TRANSFER_NOTHING,
@@ -348,7 +547,7 @@ gwkjs_callback_closure(ffi_cif *cif,
 
             if (!gwkjs_value_to_g_argument(context,
                                          elem,
-                                         &ret_type,
+                                         &trampoline->return_info,
                                          "callback",
                                          GWKJS_ARGUMENT_ARGUMENT,
                                          GI_TRANSFER_NOTHING,
@@ -356,7 +555,7 @@ gwkjs_callback_closure(ffi_cif *cif,
                                          &argument))
                 goto out;
 
-            set_return_ffi_arg_from_giargument(&ret_type,
+            set_return_ffi_arg_from_giargument(trampoline,
                                                result,
                                                &argument);
 
@@ -364,13 +563,10 @@ gwkjs_callback_closure(ffi_cif *cif,
         }
 
         for (i = 0; i < n_args; i++) {
-            GIArgInfo arg_info;
-            GITypeInfo type_info;
-            g_callable_info_load_arg(trampoline->info, i, &arg_info);
-            if (g_arg_info_get_direction(&arg_info) == GI_DIRECTION_IN)
-                continue;
+            const GwkjsArgPlan *arg = &trampoline->args[i];
 
-            g_arg_info_load_type(&arg_info, &type_info);
+            if (arg->direction == GI_DIRECTION_IN)
+                continue;
 
             exception = NULL;
             elem = JSObjectGetPropertyAtIndex(context, rval_obj, elem_idx, &exception);
@@ -379,7 +575,7 @@ gwkjs_callback_closure(ffi_cif *cif,
 
             if (!gwkjs_value_to_g_argument(context,
                                          elem,
-                                         &type_info,
+                                         (GITypeInfo *) &arg->type_info,
                                          "callback",
                                          GWKJS_ARGUMENT_ARGUMENT,
                                          GI_TRANSFER_NOTHING,
@@ -398,16 +594,21 @@ out:
         gwkjs_log_exception (context, exception);
 
         /* Fill in the result with some hopefully neutral value */
-        g_callable_info_load_return_type(trampoline->info, &ret_type);
-        gwkjs_g_argument_init_default (context, &ret_type, (GArgument *) result);
+        gwkjs_g_argument_init_default (context, &trampoline->return_info, (GArgument *) result);
     }
 
+    /* Async callbacks are only called once; drop the reference taken
+     * for the call. We still hold our own, so this can't pool it yet.
+     */
     if (trampoline->scope == GI_SCOPE_TYPE_ASYNC) {
-        completed_trampolines = g_slist_prepend(completed_trampolines, trampoline);
+        gwkjs_callback_trampoline_unref(trampoline);
     }
 
-    gwkjs_callback_trampoline_unref(trampoline);
+    /* The C side may have dropped objects while running the callback;
+     * check from an idle whether that's worth a collection.
+     */
     gwkjs_schedule_gc_if_needed(context);
+    gwkjs_callback_trampoline_unref(trampoline);
 }
 
 /* The global entry point for any invocations of GDestroyNotify;
@@ -422,6 +623,77 @@ gwkjs_destroy_notify_callback(gpointer data)
     gwkjs_callback_trampoline_unref(trampoline);
 }
 
+/* Builds the descriptor table gwkjs_callback_closure() works from,
+ * working out how each argument is passed to JS similarly to
+ * init_cached_function_data. Returns FALSE with an exception set for
+ * callbacks we can't handle.
+ */
+static gboolean
+init_callback_descriptors(JSContextRef             context,
+                          GwkjsCallbackTrampoline *trampoline,
+                          GICallableInfo          *callable_info)
+{
+    GwkjsArgPlan *args;
+    guint8 n_args, i;
+
+    n_args = g_callable_info_get_n_args(callable_info);
+    args = g_new0(GwkjsArgPlan, n_args);
+
+    for (i = 0; i < n_args; i++)
+        init_arg_plan(callable_info, n_args, i, &args[i]);
+
+    for (i = 0; i < n_args; i++) {
+        GwkjsArgPlan *arg = &args[i];
+
+        if (arg->param_type == PARAM_SKIPPED)
+            continue;
+
+        if (arg->direction != GI_DIRECTION_IN) {
+            /* INOUT and OUT arguments are handled differently. */
+            continue;
+        }
+
+        if (arg->type_tag == GI_TYPE_TAG_INTERFACE) {
+            if (g_base_info_get_type(arg->interface_info) == GI_INFO_TYPE_CALLBACK) {
+                gwkjs_throw(context, "Callback accepts another callback as a parameter. This is not supported");
+                free_arg_plans(args, n_args);
+                return FALSE;
+            }
+        } else if (arg->array_length_pos != GWKJS_ARG_INDEX_INVALID) {
+            if (args[arg->array_length_pos].direction != arg->direction) {
+                gwkjs_throw(context, "Callback has an array with different-direction length arg, not supported");
+                free_arg_plans(args, n_args);
+                return FALSE;
+            }
+
+            args[arg->array_length_pos].param_type = PARAM_SKIPPED;
+            arg->param_type = PARAM_ARRAY;
+        }
+    }
+
+    trampoline->args = args;
+    trampoline->n_args = n_args;
+    trampoline->n_outargs = 0;
+    for (i = 0; i < n_args; i++) {
+        if (args[i].type_tag != GI_TYPE_TAG_VOID &&
+            args[i].direction != GI_DIRECTION_IN)
+            trampoline->n_outargs++;
+    }
+
+    g_callable_info_load_return_type(callable_info, &trampoline->return_info);
+    trampoline->return_tag = g_type_info_get_tag(&trampoline->return_info);
+    trampoline->return_transfer = g_callable_info_get_caller_owns(callable_info);
+    trampoline->return_interface_type = GI_INFO_TYPE_INVALID;
+    if (trampoline->return_tag == GI_TYPE_TAG_INTERFACE) {
+        GIBaseInfo *interface_info = g_type_info_get_interface(&trampoline->return_info);
+
+        trampoline->return_interface_type = g_base_info_get_type(interface_info);
+        g_base_info_unref(interface_info);
+    }
+
+    return TRUE;
+}
+
 GwkjsCallbackTrampoline*
 gwkjs_callback_trampoline_new(JSContextRef      context,
                             jsval           function_val,
@@ -430,7 +702,7 @@ gwkjs_callback_trampoline_new(JSContextRef      context,
                             gboolean        is_vfunc)
 {
     GwkjsCallbackTrampoline *trampoline;
-    int n_args, i;
+    GwkjsCallbackTrampoline key;
 
     if (JSVAL_IS_NULL(context, function_val)) {
         return NULL;
@@ -439,77 +711,59 @@ gwkjs_callback_trampoline_new(JSContextRef      context,
     JSObjectRef function = JSValueToObject(context, function_val, NULL);
     g_assert(function && JSObjectIsFunction(context, function));
 
-    trampoline = g_slice_new(GwkjsCallbackTrampoline);
-    trampoline->ref_count = 1;
-    trampoline->context = context;
-    trampoline->info = callable_info;
-    g_base_info_ref((GIBaseInfo*)trampoline->info);
-    trampoline->js_function = function;
-    if (!is_vfunc)
-        JSValueProtect(context, trampoline->js_function);
-
-    /* Analyze param types and directions, similarly to init_cached_function_data */
-    n_args = g_callable_info_get_n_args(trampoline->info);
-    trampoline->param_types = g_new0(GwkjsParamType, n_args);
-
-    for (i = 0; i < n_args; i++) {
-        GIDirection direction;
-        GIArgInfo arg_info;
-        GITypeInfo type_info;
-        GITypeTag type_tag;
-
-        if (trampoline->param_types[i] == PARAM_SKIPPED)
-            continue;
+    G_LOCK(trampolines);
+    if (live_trampolines == NULL) {
+        live_trampolines = g_hash_table_new(trampoline_key_hash, trampoline_key_equal);
+        idle_trampolines = g_hash_table_new(callable_info_hash, callable_info_equal);
+    }
 
-        g_callable_info_load_arg(trampoline->info, i, &arg_info);
-        g_arg_info_load_type(&arg_info, &type_info);
+    /* Same function, same kind of callback: share it */
+    memset(&key, 0, sizeof(key));
+    key.context = context;
+    key.js_function = function;
+    key.info = callable_info;
+    key.scope = scope;
+    key.is_vfunc = is_vfunc;
+
+    trampoline = (GwkjsCallbackTrampoline *) g_hash_table_lookup(live_trampolines, &key);
+    if (trampoline != NULL) {
+        GWKJS_INC_STAT(trampoline_reuse);
+        gwkjs_callback_trampoline_ref(trampoline);
+        G_UNLOCK(trampolines);
+        return trampoline;
+    }
 
-        direction = g_arg_info_get_direction(&arg_info);
-        type_tag = g_type_info_get_tag(&type_info);
+    trampoline = take_idle_trampoline(callable_info);
+    G_UNLOCK(trampolines);
 
-        if (direction != GI_DIRECTION_IN) {
-            /* INOUT and OUT arguments are handled differently. */
-            continue;
+    if (trampoline != NULL) {
+        GWKJS_INC_STAT(trampoline_reuse);
+    } else {
+        trampoline = g_slice_new0(GwkjsCallbackTrampoline);
+        if (!init_callback_descriptors(context, trampoline, callable_info)) {
+            g_slice_free(GwkjsCallbackTrampoline, trampoline);
+            return NULL;
         }
 
-        if (type_tag == GI_TYPE_TAG_INTERFACE) {
-            GIBaseInfo* interface_info;
-            GIInfoType interface_type;
-
-            interface_info = g_type_info_get_interface(&type_info);
-            interface_type = g_base_info_get_type(interface_info);
-            if (interface_type == GI_INFO_TYPE_CALLBACK) {
-                gwkjs_throw(context, "Callback accepts another callback as a parameter. This is not supported");
-                g_base_info_unref(interface_info);
-                return NULL;
-            }
-            g_base_info_unref(interface_info);
-        } else if (type_tag == GI_TYPE_TAG_ARRAY) {
-            if (g_type_info_get_array_type(&type_info) == GI_ARRAY_TYPE_C) {
-                int array_length_pos = g_type_info_get_array_length(&type_info);
-
-                if (array_length_pos >= 0 && array_length_pos < n_args) {
-                    GIArgInfo length_arg_info;
-
-                    g_callable_info_load_arg(trampoline->info, array_length_pos, &length_arg_info);
-                    if (g_arg_info_get_direction(&length_arg_info) != direction) {
-                        gwkjs_throw(context, "Callback has an array with different-direction length arg, not supported");
-                        return NULL;
-                    }
-
-                    trampoline->param_types[array_length_pos] = PARAM_SKIPPED;
-                    trampoline->param_types[i] = PARAM_ARRAY;
-                }
-            }
-        }
+        GWKJS_INC_STAT(trampoline_new);
+        trampoline->info = callable_info;
+        g_base_info_ref((GIBaseInfo*)trampoline->info);
+        trampoline->closure = g_callable_info_prepare_closure(callable_info, &trampoline->cif,
+                                                              gwkjs_callback_closure, trampoline);
     }
 
-    trampoline->closure = g_callable_info_prepare_closure(callable_info, &trampoline->cif,
-                                                          gwkjs_callback_closure, trampoline);
-
+    trampoline->ref_count = 1;
+    trampoline->context = context;
+    trampoline->js_function = function;
+    if (!is_vfunc)
+        JSValueProtect(context, trampoline->js_function);
     trampoline->scope = scope;
     trampoline->is_vfunc = is_vfunc;
 
+    G_LOCK(trampolines);
+    g_hash_table_insert(live_trampolines, trampoline, trampoline);
+    G_UNLOCK(trampolines);
+
     return trampoline;
 }
 
@@ -541,6 +795,62 @@ get_length_from_arg (GArgument *arg, GITypeTag tag)
     }
 }
 
+/* The inverse of get_length_from_arg(); used to fill in the explicit
+ * length argument of a C array without going through a jsval */
+static void
+set_length_to_arg (GArgument *arg, GITypeTag tag, gsize length)
+{
+    switch (tag) {
+    case GI_TYPE_TAG_INT8:
+        arg->v_int8 = length;
+        break;
+    case GI_TYPE_TAG_UINT8:
+        arg->v_uint8 = length;
+        break;
+    case GI_TYPE_TAG_INT16:
+        arg->v_int16 = length;
+        break;
+    case GI_TYPE_TAG_UINT16:
+        arg->v_uint16 = length;
+        break;
+    case GI_TYPE_TAG_INT32:
+        arg->v_int32 = length;
+        break;
+    case GI_TYPE_TAG_UINT32:
+        arg->v_uint32 = length;
+        break;
+    case GI_TYPE_TAG_INT64:
+        arg->v_int64 = length;
+        break;
+    case GI_TYPE_TAG_UINT64:
+        arg->v_uint64 = length;
+        break;
+    default:
+        g_assert_not_reached ();
+    }
+}
+
+/* Contexts that aren't a GwkjsContext's may be on any thread, so they
+ * share an arena per thread */
+static GPrivate fallback_arena = G_PRIVATE_INIT((GDestroyNotify) gwkjs_arena_free);
+
+static GwkjsArena *
+get_invoke_arena(JSContextRef context)
+{
+    GwkjsContext *js_context = gwkjs_get_private_context(context);
+    GwkjsArena *arena;
+
+    if (js_context != NULL)
+        return _gwkjs_context_get_invoke_arena(js_context);
+
+    arena = (GwkjsArena *) g_private_get(&fallback_arena);
+    if (arena == NULL) {
+        arena = gwkjs_arena_new(4096);
+        g_private_set(&fallback_arena, arena);
+    }
+    return arena;
+}
+
 static JSBool
 gwkjs_fill_method_instance (JSContextRef  context,
                           JSObjectRef   obj,
@@ -666,234 +976,438 @@ gwkjs_fill_method_instance (JSContextRef  context,
     return JS_TRUE;
 }
 
-/*
- * This function can be called in 2 different ways. You can either use
- * it to create javascript objects by providing a @js_rval argument or
- * you can decide to keep the return values in #GArgument format by
- * providing a @r_value argument.
- */
 static JSBool
-gwkjs_invoke_c_function(JSContextRef      context,
-                        Function          *function,
-                        JSObjectRef       obj, /* "this" object */
-                        unsigned          js_argc,
-                        const JSValueRef  js_argv[],
-                        jsval             *js_rval,
-                        GArgument         *r_value)
+check_js_argc(JSContextRef  context,
+              Function     *function,
+              unsigned      js_argc)
 {
-    /* These first four are arrays which hold argument pointers.
-     * @in_arg_cvalues: C values which are passed on input (in or inout)
-     * @out_arg_cvalues: C values which are returned as arguments (out or inout)
-     * @inout_original_arg_cvalues: For the special case of (inout) args, we need to
-     *  keep track of the original values we passed into the function, in case we
-     *  need to free it.
-     * @ffi_arg_pointers: For passing data to FFI, we need to create another layer
-     *  of indirection; this array is a pointer to an element in in_arg_cvalues
-     *  or out_arg_cvalues.
-     * @return_value: The actual return value of the C function, i.e. not an (out) param
-     */
-    GArgument *in_arg_cvalues;
-    GArgument *out_arg_cvalues;
-    GArgument *inout_original_arg_cvalues;
-    gpointer *ffi_arg_pointers;
-    GIFFIReturnValue return_value;
-    gpointer return_value_p; /* Will point inside the union return_value */
-    GArgument return_gargument;
-
-    guint8 processed_c_args = 0;
-    guint8 gi_argc, gi_arg_pos;
-    guint8 c_argc, c_arg_pos;
-    guint8 js_arg_pos;
-    gboolean can_throw_gerror;
-    gboolean did_throw_gerror = FALSE;
-    GError *local_error = NULL;
-    gboolean failed, postinvoke_release_failed;
-
-    gboolean is_method;
-    GITypeInfo return_info;
-    GITypeTag return_tag;
-    jsval *return_values = NULL;
-    guint8 next_rval = 0; /* index into return_values */
-    GSList *iter;
-
-    /* Because we can't free a closure while we're in it, we defer
-     * freeing until the next time a C function is invoked.  What
-     * we should really do instead is queue it for a GC thread.
-     */
-    if (completed_trampolines) {
-        for (iter = completed_trampolines; iter; iter = iter->next) {
-            GwkjsCallbackTrampoline *trampoline = (GwkjsCallbackTrampoline *) iter->data;
-            gwkjs_callback_trampoline_unref(trampoline);
-        }
-        g_slist_free(completed_trampolines);
-        completed_trampolines = NULL;
-    }
-
-    is_method = g_callable_info_is_method(function->info);
-    can_throw_gerror = g_callable_info_can_throw_gerror(function->info);
-
-    c_argc = function->invoker.cif.nargs;
-    gi_argc = g_callable_info_get_n_args( (GICallableInfo*) function->info);
-
-    /* @c_argc is the number of arguments that the underlying C
-     * function takes. @gi_argc is the number of arguments the
-     * GICallableInfo describes (which does not include "this" or
-     * GError**). @function->expected_js_argc is the number of
-     * arguments we expect the JS function to take (which does not
-     * include PARAM_SKIPPED args).
-     *
-     * @js_argc is the number of arguments that were actually passed;
-     * we allow this to be larger than @expected_js_argc for
-     * convenience, and simply ignore the extra arguments. But we
-     * don't allow too few args, since that would break.
-     */
-
     if (js_argc < function->expected_js_argc) {
         gwkjs_throw(context, "Too few arguments to %s %s.%s expected %d got %d",
-                  is_method ? "method" : "function",
+                  function->is_method ? "method" : "function",
                   g_base_info_get_namespace( (GIBaseInfo*) function->info),
                   g_base_info_get_name( (GIBaseInfo*) function->info),
                   function->expected_js_argc,
                   js_argc);
         return JS_FALSE;
     }
+    return JS_TRUE;
+}
 
-    g_callable_info_load_return_type( (GICallableInfo*) function->info, &return_info);
-    return_tag = g_type_info_get_tag(&return_info);
-
-    in_arg_cvalues = g_newa(GArgument, c_argc);
-    ffi_arg_pointers = g_newa(gpointer, c_argc);
-    out_arg_cvalues = g_newa(GArgument, c_argc);
-    inout_original_arg_cvalues = g_newa(GArgument, c_argc);
-
-    failed = FALSE;
-    c_arg_pos = 0; /* index into in_arg_cvalues, etc */
-    js_arg_pos = 0; /* index into argv */
+#ifdef GWKJS_HAVE_FAST_INVOKE
 
-    if (is_method) {
-        if (!gwkjs_fill_method_instance(context, obj,
-                                      function, &in_arg_cvalues[0]))
-            return JS_FALSE;
-        ffi_arg_pointers[0] = &in_arg_cvalues[0];
+static inline void
+fast_value_from_arg(guint8           kind,
+                    const GArgument *arg,
+                    GwkjsFastValue  *value)
+{
+    /* Extend to the full register; some compilers rely on the caller
+     * having done so for narrow integer arguments.
+     */
+    switch (kind) {
+    case FAST_KIND_BOOLEAN:
+    case FAST_KIND_ENUM:
+    case FAST_KIND_INT32:
+        value->v_word = arg->v_int32;
+        break;
+    case FAST_KIND_INT8:
+        value->v_word = arg->v_int8;
+        break;
+    case FAST_KIND_UINT8:
+        value->v_word = arg->v_uint8;
+        break;
+    case FAST_KIND_INT16:
+        value->v_word = arg->v_int16;
+        break;
+    case FAST_KIND_UINT16:
+        value->v_word = arg->v_uint16;
+        break;
+    case FAST_KIND_UINT32:
+        value->v_word = arg->v_uint32;
+        break;
+    case FAST_KIND_INT64:
+        value->v_word = (gintptr) arg->v_int64;
+        break;
+    case FAST_KIND_UINT64:
+        value->v_word = (gintptr) arg->v_uint64;
+        break;
+    case FAST_KIND_POINTER:
+        value->v_word = (gintptr) arg->v_pointer;
+        break;
+    case FAST_KIND_DOUBLE:
+        value->v_double = arg->v_double;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
+/* Only narrow integers are converted here; the return value of the
+ * callee only defines as many bits as its declared type has.
+ */
+static JSBool
+fast_value_to_js(JSContextRef          context,
+                 Function             *function,
+                 const GwkjsFastValue *value,
+                 jsval                *js_rval)
+{
+    GArgument return_gargument;
+
+    switch (function->fast_return_kind) {
+    case FAST_KIND_VOID:
+        *js_rval = JSValueMakeUndefined(context);
+        return JS_TRUE;
+    case FAST_KIND_BOOLEAN:
+        *js_rval = JSValueMakeBoolean(context, (gint32) value->v_word != 0);
+        return JS_TRUE;
+    case FAST_KIND_INT8:
+        *js_rval = JSValueMakeNumber(context, (gint8) value->v_word);
+        return JS_TRUE;
+    case FAST_KIND_UINT8:
+        *js_rval = JSValueMakeNumber(context, (guint8) value->v_word);
+        return JS_TRUE;
+    case FAST_KIND_INT16:
+        *js_rval = JSValueMakeNumber(context, (gint16) value->v_word);
+        return JS_TRUE;
+    case FAST_KIND_UINT16:
+        *js_rval = JSValueMakeNumber(context, (guint16) value->v_word);
+        return JS_TRUE;
+    case FAST_KIND_INT32:
+        *js_rval = JSValueMakeNumber(context, (gint32) value->v_word);
+        return JS_TRUE;
+    case FAST_KIND_UINT32:
+        *js_rval = JSValueMakeNumber(context, (guint32) value->v_word);
+        return JS_TRUE;
+    case FAST_KIND_INT64:
+        *js_rval = JSValueMakeNumber(context, (gint64) value->v_word);
+        return JS_TRUE;
+    case FAST_KIND_UINT64:
+        *js_rval = JSValueMakeNumber(context, (guint64) value->v_word);
+        return JS_TRUE;
+    case FAST_KIND_DOUBLE:
+        *js_rval = JSValueMakeNumber(context, value->v_double);
+        return JS_TRUE;
+    case FAST_KIND_ENUM:
+        return_gargument.v_int = (gint32) value->v_word;
+        break;
+    case FAST_KIND_POINTER:
+        return_gargument.v_pointer = (gpointer) value->v_word;
+        break;
+    default:
+        g_assert_not_reached();
+        return JS_FALSE;
+    }
+
+    /* Enums need validating and objects need wrapping, same as the
+     * generic path.
+     */
+    if (!gwkjs_value_from_g_argument(context, js_rval, &function->return_info,
+                                     &return_gargument, TRUE))
+        return JS_FALSE;
+
+    return gwkjs_g_argument_release(context, function->return_transfer,
+                                    &function->return_info, &return_gargument);
+}
+
+/* Used instead of gwkjs_invoke_c_function() when init_fast_invoke()
+ * found a signature it could bind. Nothing converted here needs
+ * releasing, objects being limited to (transfer none), so there is no
+ * cleanup pass when a later argument fails to convert.
+ */
+static JSBool
+gwkjs_invoke_c_function_fast(JSContextRef      context,
+                             Function          *function,
+                             JSObjectRef       obj,
+                             unsigned          js_argc,
+                             const JSValueRef  js_argv[],
+                             jsval             *js_rval)
+{
+    GwkjsFastValue args[GWKJS_FAST_INVOKE_MAX_ARGS];
+    GwkjsFastValue ret;
+    GArgument arg;
+    guint8 gi_arg_pos, c_arg_pos = 0;
+
+    if (!check_js_argc(context, function, js_argc))
+        return JS_FALSE;
+
+    if (function->is_method) {
+        if (!gwkjs_fill_method_instance(context, obj, function, &arg))
+            return JS_FALSE;
+        args[c_arg_pos++].v_word = (gintptr) arg.v_pointer;
+    }
+
+    /* Every argument is (in) and PARAM_NORMAL, so GI and JS positions match */
+    for (gi_arg_pos = 0; gi_arg_pos < function->gi_argc; gi_arg_pos++, c_arg_pos++) {
+        const GwkjsArgPlan *plan = &function->args[gi_arg_pos];
+
+        if (!plan->to_c(context, js_argv[gi_arg_pos], plan, &arg))
+            return JS_FALSE;
+        fast_value_from_arg(function->fast_kinds[c_arg_pos], &arg, &args[c_arg_pos]);
+    }
+
+    GWKJS_INC_STAT(fast_invoke);
+    function->fast_invoke(function->invoker.native_address, args, &ret);
+
+    return fast_value_to_js(context, function, &ret, js_rval);
+}
+
+#endif /* GWKJS_HAVE_FAST_INVOKE */
+
+/* One call through the generic path. Marshalling, the ffi call and
+ * converting the results back are separate steps, so that the ffi call
+ * can run on another thread (see function_call_in_thread()).
+ *
+ * @in_arg_cvalues: C values which are passed on input (in or inout)
+ * @out_arg_cvalues: C values which are returned as arguments (out or inout)
+ * @inout_original_arg_cvalues: For the special case of (inout) args, we need to
+ *  keep track of the original values we passed into the function, in case we
+ *  need to free it.
+ * @ffi_arg_pointers: For passing data to FFI, we need to create another layer
+ *  of indirection; this array is a pointer to an element in in_arg_cvalues
+ *  or out_arg_cvalues.
+ * @return_value: The actual return value of the C function, i.e. not an (out) param
+ */
+typedef struct {
+    GArgument *in_arg_cvalues;
+    GArgument *out_arg_cvalues;
+    GArgument *inout_original_arg_cvalues;
+    gpointer *ffi_arg_pointers;
+    GArgument inline_cvalues[3 * GWKJS_INVOKE_INLINE_ARGS];
+    gpointer inline_ffi_arg_pointers[GWKJS_INVOKE_INLINE_ARGS];
+    /* Per C argument: set if in_arg_cvalues holds a typed array's backing
+     * store lent by JS, which must not be released after the call. */
+    guint8 *borrowed;
+    guint8 inline_borrowed[GWKJS_INVOKE_INLINE_ARGS];
+    GwkjsArena *arena;
+    GwkjsArenaMark arena_mark;
+    GIFFIReturnValue return_value;
+    GError *local_error;
+    guint8 processed_c_args;
+
+    /* If set, passed for the callback argument instead of a trampoline
+     * for a JS function, which then isn't expected among the arguments;
+     * see function_call_promise(). */
+    GAsyncReadyCallback callback;
+    gpointer callback_data;
+
+    /* The call doesn't happen on the JS thread, so nothing may be
+     * borrowed from the context's invoke arena. */
+    guint in_thread : 1;
+} Invocation;
+
+static JSBool convert_arg_generic (JSContextRef        context,
+                                   JSValueRef          value,
+                                   const GwkjsArgPlan *plan,
+                                   GArgument          *arg);
+
+static void
+invocation_init(Invocation *invocation,
+                Function   *function,
+                GwkjsArena *arena,
+                gboolean    in_thread)
+{
+    guint8 c_argc = function->invoker.cif.nargs;
+
+    invocation->arena = arena;
+    invocation->arena_mark = gwkjs_arena_mark(arena);
+    invocation->local_error = NULL;
+    invocation->processed_c_args = function->is_method ? 1 : 0;
+    invocation->callback = NULL;
+    invocation->callback_data = NULL;
+    invocation->in_thread = in_thread;
+
+    /* Nothing allocated from here on is freed individually; everything
+     * goes away when we release the arena back to this mark.
+     */
+    if (c_argc <= GWKJS_INVOKE_INLINE_ARGS) {
+        invocation->in_arg_cvalues = invocation->inline_cvalues;
+        invocation->out_arg_cvalues = invocation->inline_cvalues + GWKJS_INVOKE_INLINE_ARGS;
+        invocation->inout_original_arg_cvalues = invocation->inline_cvalues + 2 * GWKJS_INVOKE_INLINE_ARGS;
+        invocation->ffi_arg_pointers = invocation->inline_ffi_arg_pointers;
+        invocation->borrowed = invocation->inline_borrowed;
+        memset(invocation->borrowed, 0, c_argc);
+        GWKJS_INC_STAT(arena_inline);
+    } else {
+        invocation->in_arg_cvalues = gwkjs_arena_new_n(arena, GArgument, 3 * c_argc);
+        invocation->out_arg_cvalues = invocation->in_arg_cvalues + c_argc;
+        invocation->inout_original_arg_cvalues = invocation->in_arg_cvalues + 2 * c_argc;
+        invocation->ffi_arg_pointers = gwkjs_arena_new_n(arena, gpointer, c_argc);
+        invocation->borrowed = (guint8 *) gwkjs_arena_alloc0(arena, c_argc);
+    }
+}
+
+static JSBool
+invocation_marshal_out_arg(JSContextRef  context,
+                           Invocation   *invocation,
+                           GwkjsArgPlan *arg,
+                           guint8        c_arg_pos)
+{
+    GArgument *in_arg_cvalues = invocation->in_arg_cvalues;
+    GArgument *out_arg_cvalues = invocation->out_arg_cvalues;
+
+    if (arg->caller_allocates) {
+        if (arg->caller_allocates_size == 0) {
+            gwkjs_throw(context, "Unsupported type %s for (out caller-allocates)",
+                        g_type_tag_to_string(arg->type_tag));
+            return JS_FALSE;
+        }
+        in_arg_cvalues[c_arg_pos].v_pointer = gwkjs_arena_alloc0(invocation->arena, arg->caller_allocates_size);
+        out_arg_cvalues[c_arg_pos].v_pointer = in_arg_cvalues[c_arg_pos].v_pointer;
+    } else {
+        out_arg_cvalues[c_arg_pos].v_pointer = NULL;
+        in_arg_cvalues[c_arg_pos].v_pointer = &out_arg_cvalues[c_arg_pos];
+    }
+    return JS_TRUE;
+}
+
+/* Sets *@exception, unless something more specific already did */
+static void
+marshal_failed(JSContextRef        context,
+               Function           *function,
+               const GwkjsArgPlan *arg,
+               JSValueRef         *exception)
+{
+    if (exception == NULL || *exception != NULL)
+        return;
+
+    if (arg == NULL)
+        gwkjs_make_exception(context, exception, "TypeError",
+                             "%s.%s needs a valid instance to be called on",
+                             g_base_info_get_namespace((GIBaseInfo *) function->info),
+                             g_base_info_get_name((GIBaseInfo *) function->info));
+    else
+        gwkjs_make_exception(context, exception, "TypeError",
+                             "Error invoking %s.%s: could not convert argument %s",
+                             g_base_info_get_namespace((GIBaseInfo *) function->info),
+                             g_base_info_get_name((GIBaseInfo *) function->info),
+                             g_base_info_get_name((GIBaseInfo *) &arg->arg_info));
+}
+
+/* Converts the JS arguments to C; returns FALSE if that failed, in
+ * which case the call must be skipped and invocation_finish() will
+ * release the arguments converted so far. The reason is stored in
+ * @exception, if given.
+ */
+static JSBool
+invocation_marshal(JSContextRef      context,
+                   Function         *function,
+                   Invocation       *invocation,
+                   JSObjectRef       obj, /* "this" object */
+                   unsigned          js_argc,
+                   const JSValueRef  js_argv[],
+                   JSValueRef       *exception)
+{
+    GArgument *in_arg_cvalues = invocation->in_arg_cvalues;
+    GArgument *out_arg_cvalues = invocation->out_arg_cvalues;
+    GArgument *inout_original_arg_cvalues = invocation->inout_original_arg_cvalues;
+    gpointer *ffi_arg_pointers = invocation->ffi_arg_pointers;
+    guint8 gi_argc, gi_arg_pos;
+    guint8 c_argc, c_arg_pos;
+    guint8 js_arg_pos;
+    gboolean is_method;
+    gboolean failed;
+
+    /* Everything below runs from the call plan built by
+     * init_cached_function_data(); we don't go back to the typelib.
+     */
+    is_method = function->is_method;
+
+    c_argc = function->invoker.cif.nargs;
+    gi_argc = function->gi_argc;
+
+    failed = FALSE;
+    c_arg_pos = 0; /* index into in_arg_cvalues, etc */
+    js_arg_pos = 0; /* index into argv */
+
+    if (is_method) {
+        if (!gwkjs_fill_method_instance(context, obj,
+                                      function, &in_arg_cvalues[0])) {
+            marshal_failed(context, function, NULL, exception);
+            return JS_FALSE;
+        }
+        ffi_arg_pointers[0] = &in_arg_cvalues[0];
         ++c_arg_pos;
     }
 
-    processed_c_args = c_arg_pos;
     for (gi_arg_pos = 0; gi_arg_pos < gi_argc; gi_arg_pos++, c_arg_pos++) {
-        GIDirection direction;
-        GIArgInfo arg_info;
+        GwkjsArgPlan *arg = &function->args[gi_arg_pos];
+        GIDirection direction = arg->direction;
         gboolean arg_removed = FALSE;
 
         /* gwkjs_debug(GWKJS_DEBUG_GFUNCTION, "gi_arg_pos: %d c_arg_pos: %d js_arg_pos: %d", gi_arg_pos, c_arg_pos, js_arg_pos); */
 
-        g_callable_info_load_arg( (GICallableInfo*) function->info, gi_arg_pos, &arg_info);
-        direction = g_arg_info_get_direction(&arg_info);
-
         g_assert_cmpuint(c_arg_pos, <, c_argc);
         ffi_arg_pointers[c_arg_pos] = &in_arg_cvalues[c_arg_pos];
 
         if (direction == GI_DIRECTION_OUT) {
-            if (g_arg_info_is_caller_allocates(&arg_info)) {
-                GITypeTag type_tag;
-                GITypeInfo ainfo;
-
-                g_arg_info_load_type(&arg_info, &ainfo);
-                type_tag = g_type_info_get_tag(&ainfo);
-
-                switch (type_tag) {
-                case GI_TYPE_TAG_INTERFACE:
-                    {
-                        GIBaseInfo* interface_info;
-                        GIInfoType interface_type;
-                        gsize size;
-
-                        interface_info = g_type_info_get_interface(&ainfo);
-                        g_assert(interface_info != NULL);
-
-                        interface_type = g_base_info_get_type(interface_info);
-
-                        if (interface_type == GI_INFO_TYPE_STRUCT) {
-                            size = g_struct_info_get_size((GIStructInfo*)interface_info);
-                        } else if (interface_type == GI_INFO_TYPE_UNION) {
-                            size = g_union_info_get_size((GIUnionInfo*)interface_info);
-                        } else {
-                            failed = TRUE;
-                        }
-
-                        g_base_info_unref((GIBaseInfo*)interface_info);
-
-                        if (!failed) {
-                            in_arg_cvalues[c_arg_pos].v_pointer = g_slice_alloc0(size);
-                            out_arg_cvalues[c_arg_pos].v_pointer = in_arg_cvalues[c_arg_pos].v_pointer;
-                        }
-                        break;
-                    }
-                default:
-                    failed = TRUE;
-                }
-                if (failed)
-                    gwkjs_throw(context, "Unsupported type %s for (out caller-allocates)", g_type_tag_to_string(type_tag));
-            } else {
-                out_arg_cvalues[c_arg_pos].v_pointer = NULL;
-                in_arg_cvalues[c_arg_pos].v_pointer = &out_arg_cvalues[c_arg_pos];
-            }
+            if (!invocation_marshal_out_arg(context, invocation, arg, c_arg_pos))
+                failed = TRUE;
         } else {
             GArgument *in_value;
-            GITypeInfo ainfo;
-            GwkjsParamType param_type;
-
-            g_arg_info_load_type(&arg_info, &ainfo);
 
             in_value = &in_arg_cvalues[c_arg_pos];
 
-            param_type = function->param_types[gi_arg_pos];
-
-            switch (param_type) {
+            switch (arg->param_type) {
             case PARAM_CALLBACK: {
-                GICallableInfo *callable_info;
-                GIScopeType scope = g_arg_info_get_scope(&arg_info);
                 GwkjsCallbackTrampoline *trampoline;
                 ffi_closure *closure;
-                jsval value = js_argv[js_arg_pos];
+                jsval value;
+
+                if (invocation->callback != NULL) {
+                    if (arg->destroy_pos != GWKJS_ARG_INDEX_INVALID) {
+                        gint c_pos = is_method ? arg->destroy_pos + 1 : arg->destroy_pos;
+                        in_arg_cvalues[c_pos].v_pointer = NULL;
+                    }
+                    if (arg->closure_pos != GWKJS_ARG_INDEX_INVALID) {
+                        gint c_pos = is_method ? arg->closure_pos + 1 : arg->closure_pos;
+                        in_arg_cvalues[c_pos].v_pointer = invocation->callback_data;
+                    }
+                    in_value->v_pointer = (gpointer) invocation->callback;
+                    arg_removed = TRUE;
+                    break;
+                }
 
-                if (JSVAL_IS_NULL(context, value) && g_arg_info_may_be_null(&arg_info)) {
+                value = js_argv[js_arg_pos];
+                if (JSVAL_IS_NULL(context, value) && arg->may_be_null) {
                     closure = NULL;
                     trampoline = NULL;
                 } else {
                     if (!GWKJS_VALUE_IS_FUNCTION(context, value)) {
-                        gwkjs_throw(context, "Error invoking %s.%s: Expected function for callback argument %s, got %s",
-                                  g_base_info_get_namespace( (GIBaseInfo*) function->info),
-                                  g_base_info_get_name( (GIBaseInfo*) function->info),
-                                  g_base_info_get_name( (GIBaseInfo*) &arg_info),
-                                  gwkjs_get_type_name(context, value));
+                        char *message;
+
+                        message = g_strdup_printf("Error invoking %s.%s: Expected function for callback argument %s, got %s",
+                                                  g_base_info_get_namespace( (GIBaseInfo*) function->info),
+                                                  g_base_info_get_name( (GIBaseInfo*) function->info),
+                                                  g_base_info_get_name( (GIBaseInfo*) &arg->arg_info),
+                                                  gwkjs_get_type_name(context, value));
+                        if (exception)
+                            gwkjs_make_exception(context, exception, "TypeError", "%s", message);
+                        else
+                            gwkjs_throw(context, "%s", message);
+                        g_free(message);
                         failed = TRUE;
                         break;
                     }
 
-                    callable_info = (GICallableInfo*) g_type_info_get_interface(&ainfo);
                     trampoline = gwkjs_callback_trampoline_new(context,
                                                              value,
-                                                             callable_info,
-                                                             scope,
+                                                             (GICallableInfo *) arg->interface_info,
+                                                             arg->scope,
                                                              FALSE);
                     closure = trampoline->closure;
-                    g_base_info_unref(callable_info);
                 }
 
-                gint destroy_pos = g_arg_info_get_destroy(&arg_info);
-                gint closure_pos = g_arg_info_get_closure(&arg_info);
-                if (destroy_pos >= 0) {
-                    gint c_pos = is_method ? destroy_pos + 1 : destroy_pos;
-                    g_assert (function->param_types[destroy_pos] == PARAM_SKIPPED);
+                if (arg->destroy_pos != GWKJS_ARG_INDEX_INVALID) {
+                    gint c_pos = is_method ? arg->destroy_pos + 1 : arg->destroy_pos;
+                    g_assert (function->args[arg->destroy_pos].param_type == PARAM_SKIPPED);
                     in_arg_cvalues[c_pos].v_pointer = trampoline ? (gpointer) gwkjs_destroy_notify_callback : NULL;
                 }
-                if (closure_pos >= 0) {
-                    gint c_pos = is_method ? closure_pos + 1 : closure_pos;
-                    g_assert (function->param_types[closure_pos] == PARAM_SKIPPED);
+                if (arg->closure_pos != GWKJS_ARG_INDEX_INVALID) {
+                    gint c_pos = is_method ? arg->closure_pos + 1 : arg->closure_pos;
+                    g_assert (function->args[arg->closure_pos].param_type == PARAM_SKIPPED);
                     in_arg_cvalues[c_pos].v_pointer = trampoline;
                 }
 
-                if (trampoline && scope != GI_SCOPE_TYPE_CALL) {
+                if (trampoline && arg->scope != GI_SCOPE_TYPE_CALL) {
                     /* Add an extra reference that will be cleared when collecting
                        async calls, or when GDestroyNotify is called */
                     gwkjs_callback_trampoline_ref(trampoline);
@@ -905,27 +1419,26 @@ gwkjs_invoke_c_function(JSContextRef      context,
                 arg_removed = TRUE;
                 break;
             case PARAM_ARRAY: {
-                GIArgInfo array_length_arg;
-
-                gint array_length_pos = g_type_info_get_array_length(&ainfo);
+                GwkjsArgPlan *length_arg;
+                guint8 array_length_pos;
                 gsize length;
+                gboolean borrowed = FALSE;
 
-                if (!gwkjs_value_to_explicit_array(context, js_argv[js_arg_pos], &arg_info,
-                                                 in_value, &length)) {
+                /* JS keeps running while a threaded call is in flight, so
+                 * only a call on the JS thread may borrow a typed array */
+                if (!gwkjs_value_to_explicit_array(context, js_argv[js_arg_pos], &arg->arg_info,
+                                                 in_value, &length,
+                                                 invocation->in_thread ? NULL : &borrowed)) {
                     failed = TRUE;
                     break;
                 }
+                invocation->borrowed[c_arg_pos] = borrowed;
 
-                g_callable_info_load_arg(function->info, array_length_pos, &array_length_arg);
+                length_arg = &function->args[arg->array_length_pos];
+                array_length_pos = arg->array_length_pos + (is_method ? 1 : 0);
+                set_length_to_arg(in_arg_cvalues + array_length_pos,
+                                  length_arg->type_tag, length);
 
-                array_length_pos += is_method ? 1 : 0;
-                if (!gwkjs_value_to_arg(context,
-                                        gwkjs_int_to_jsvalue(context, length),
-                                        &array_length_arg,
-                                        in_arg_cvalues + array_length_pos)) {
-                    failed = TRUE;
-                    break;
-                }
                 /* Also handle the INOUT for the length here */
                 if (direction == GI_DIRECTION_INOUT) {
                     if (in_value->v_pointer == NULL) {
@@ -943,15 +1456,19 @@ gwkjs_invoke_c_function(JSContextRef      context,
                 }
                 break;
             }
-            case PARAM_NORMAL:
+            case PARAM_NORMAL: {
+                GwkjsArgConvertFunc to_c = arg->to_c;
+
                 /* Ok, now just convert argument normally */
                 g_assert_cmpuint(js_arg_pos, <, js_argc);
-                if (!gwkjs_value_to_arg(context, js_argv[js_arg_pos], &arg_info,
-                                      in_value)) {
+                if (arg->in_arena && invocation->in_thread)
+                    to_c = convert_arg_generic;
+                if (!to_c(context, js_argv[js_arg_pos], arg, in_value)) {
                     failed = TRUE;
                     break;
                 }
             }
+            }
 
             if (direction == GI_DIRECTION_INOUT && !arg_removed && !failed) {
                 out_arg_cvalues[c_arg_pos] = inout_original_arg_cvalues[c_arg_pos] = in_arg_cvalues[c_arg_pos];
@@ -967,22 +1484,22 @@ gwkjs_invoke_c_function(JSContextRef      context,
                 ++js_arg_pos;
         }
 
-        if (failed)
+        if (failed) {
+            marshal_failed(context, function, arg, exception);
             break;
+        }
 
-        processed_c_args++;
+        invocation->processed_c_args++;
     }
 
     /* Did argument conversion fail?  In that case, skip invocation and jump to release
      * processing. */
-    if (failed) {
-        did_throw_gerror = FALSE;
-        goto release;
-    }
+    if (failed)
+        return JS_FALSE;
 
-    if (can_throw_gerror) {
+    if (function->can_throw_gerror) {
         g_assert_cmpuint(c_arg_pos, <, c_argc);
-        in_arg_cvalues[c_arg_pos].v_pointer = &local_error;
+        in_arg_cvalues[c_arg_pos].v_pointer = &invocation->local_error;
         ffi_arg_pointers[c_arg_pos] = &(in_arg_cvalues[c_arg_pos]);
         c_arg_pos++;
 
@@ -993,22 +1510,81 @@ gwkjs_invoke_c_function(JSContextRef      context,
     g_assert_cmpuint(c_arg_pos, ==, c_argc);
     g_assert_cmpuint(gi_arg_pos, ==, gi_argc);
 
+    return JS_TRUE;
+}
+
+/* Doesn't touch JS, so it may run on any thread */
+static void
+invocation_call(Function   *function,
+                Invocation *invocation)
+{
+    GITypeTag return_tag = function->return_tag;
+    gpointer return_value_p; /* Will point inside the union return_value */
+
     /* See comment for GwkjsFFIReturnValue above */
     if (return_tag == GI_TYPE_TAG_FLOAT)
-        return_value_p = &return_value.v_float;
+        return_value_p = &invocation->return_value.v_float;
     else if (return_tag == GI_TYPE_TAG_DOUBLE)
-        return_value_p = &return_value.v_double;
+        return_value_p = &invocation->return_value.v_double;
     else if (return_tag == GI_TYPE_TAG_INT64 || return_tag == GI_TYPE_TAG_UINT64)
-        return_value_p = &return_value.v_uint64;
+        return_value_p = &invocation->return_value.v_uint64;
     else
-        return_value_p = &return_value.v_long;
-    ffi_call(&(function->invoker.cif), FFI_FN(function->invoker.native_address), return_value_p, ffi_arg_pointers);
+        return_value_p = &invocation->return_value.v_long;
+    ffi_call(&(function->invoker.cif), FFI_FN(function->invoker.native_address),
+             return_value_p, invocation->ffi_arg_pointers);
+}
+
+/*
+ * Converts the results of the call to JS and releases the arguments.
+ * Pass @failed if marshalling failed and the call was skipped.
+ *
+ * This function can be called in 2 different ways. You can either use
+ * it to create javascript objects by providing a @js_rval argument or
+ * you can decide to keep the return values in #GArgument format by
+ * providing a @r_value argument.
+ *
+ * If the callee set a #GError it is thrown, unless @error is non-NULL,
+ * in which case it is handed over there instead.
+ */
+static JSBool
+invocation_finish(JSContextRef      context,
+                  Function          *function,
+                  Invocation        *invocation,
+                  gboolean           failed,
+                  jsval             *js_rval,
+                  GArgument         *r_value,
+                  GError           **error)
+{
+    GArgument *in_arg_cvalues = invocation->in_arg_cvalues;
+    GArgument *out_arg_cvalues = invocation->out_arg_cvalues;
+    GArgument *inout_original_arg_cvalues = invocation->inout_original_arg_cvalues;
+    guint8 processed_c_args = invocation->processed_c_args;
+    jsval inline_return_values[GWKJS_INVOKE_INLINE_ARGS];
+    JSBool retval;
+    GArgument return_gargument;
+
+    guint8 gi_argc, gi_arg_pos;
+    guint8 c_arg_pos;
+    gboolean did_throw_gerror = FALSE;
+    gboolean postinvoke_release_failed;
+
+    gboolean is_method;
+    GITypeTag return_tag;
+    jsval *return_values = NULL;
+    guint8 next_rval = 0; /* index into return_values */
+
+    is_method = function->is_method;
+    gi_argc = function->gi_argc;
+    return_tag = function->return_tag;
+
+    if (failed)
+        goto release;
 
     /* Return value and out arguments are valid only if invocation doesn't
      * return error. In arguments need to be released always.
      */
-    if (can_throw_gerror) {
-        did_throw_gerror = local_error != NULL;
+    if (function->can_throw_gerror) {
+        did_throw_gerror = invocation->local_error != NULL;
     } else {
         did_throw_gerror = FALSE;
     }
@@ -1018,59 +1594,62 @@ gwkjs_invoke_c_function(JSContextRef      context,
 
     /* Only process return values if the function didn't throw */
     if (function->js_out_argc > 0 && !did_throw_gerror) {
-        return_values = g_newa(jsval, function->js_out_argc);
+        /* These hold JS values that nothing else roots until we hand
+         * them back, so they must live on the stack where the collector
+         * scans conservatively, never in the arena.
+         */
+        if (function->js_out_argc <= GWKJS_INVOKE_INLINE_ARGS)
+            return_values = inline_return_values;
+        else
+            return_values = g_newa(jsval, function->js_out_argc);
         gwkjs_set_values(context, return_values, function->js_out_argc, kJSTypeUndefined);
 // TODO: I guess the following is not necessary
 //        gwkjs_root_value_locations(context, return_values, function->js_out_argc);
 
         if (return_tag != GI_TYPE_TAG_VOID) {
-            GITransfer transfer = g_callable_info_get_caller_owns((GICallableInfo*) function->info);
+            GITransfer transfer = function->return_transfer;
             gboolean arg_failed = FALSE;
-            gint array_length_pos;
 
             g_assert_cmpuint(next_rval, <, function->js_out_argc);
 
-            gi_type_info_extract_ffi_return_value(&return_info, &return_value, &return_gargument);
-
-            array_length_pos = g_type_info_get_array_length(&return_info);
-            if (array_length_pos >= 0) {
-                GIArgInfo array_length_arg;
-                GITypeInfo arg_type_info;
-                JSValueRef length = NULL;
-
-                g_callable_info_load_arg(function->info, array_length_pos, &array_length_arg);
-                g_arg_info_load_type(&array_length_arg, &arg_type_info);
-                array_length_pos += is_method ? 1 : 0;
-                arg_failed = !gwkjs_value_from_g_argument(context, &length,
-                                                        &arg_type_info,
-                                                        &out_arg_cvalues[array_length_pos],
-                                                        TRUE);
-                if (!arg_failed && js_rval) {
+            gi_type_info_extract_ffi_return_value(&function->return_info, &invocation->return_value, &return_gargument);
+
+            if (function->return_array_length_pos != GWKJS_ARG_INDEX_INVALID) {
+                GwkjsArgPlan *length_arg = &function->args[function->return_array_length_pos];
+                guint8 array_length_pos;
+                gsize length;
+
+                array_length_pos = function->return_array_length_pos + (is_method ? 1 : 0);
+                length = get_length_from_arg(&out_arg_cvalues[array_length_pos],
+                                             length_arg->type_tag);
+                if (js_rval) {
                     arg_failed = !gwkjs_value_from_explicit_array(context,
                                                                 &return_values[next_rval],
-                                                                &return_info,
+                                                                &function->return_info,
+                                                                r_value ? GI_TRANSFER_NOTHING : transfer,
                                                                 &return_gargument,
-                                                                gwkjs_jsvalue_to_int(context, length, NULL));
+                                                                length,
+                                                                function->array_flags);
                 }
                 if (!arg_failed &&
                     !r_value &&
                     !gwkjs_g_argument_release_out_array(context,
                                                       transfer,
-                                                      &return_info,
-                                                      gwkjs_jsvalue_to_int(context, length, NULL),
+                                                      &function->return_info,
+                                                      length,
                                                       &return_gargument))
                     failed = TRUE;
             } else {
                 if (js_rval)
-                    arg_failed = !gwkjs_value_from_g_argument(context, &return_values[next_rval],
-                                                            &return_info, &return_gargument,
-                                                            TRUE);
+                    arg_failed = !gwkjs_value_from_g_argument_full(context, &return_values[next_rval],
+                                                                 &function->return_info, &return_gargument,
+                                                                 TRUE, function->array_flags);
                 /* Free GArgument, the jsval should have ref'd or copied it */
                 if (!arg_failed &&
                     !r_value &&
                     !gwkjs_g_argument_release(context,
                                             transfer,
-                                            &return_info,
+                                            &function->return_info,
                                             &return_gargument))
                     failed = TRUE;
             }
@@ -1088,16 +1667,9 @@ release:
     c_arg_pos = is_method ? 1 : 0;
     postinvoke_release_failed = FALSE;
     for (gi_arg_pos = 0; gi_arg_pos < gi_argc && c_arg_pos < processed_c_args; gi_arg_pos++, c_arg_pos++) {
-        GIDirection direction;
-        GIArgInfo arg_info;
-        GITypeInfo arg_type_info;
-        GwkjsParamType param_type;
-
-        g_callable_info_load_arg( (GICallableInfo*) function->info, gi_arg_pos, &arg_info);
-        direction = g_arg_info_get_direction(&arg_info);
-
-        g_arg_info_load_type(&arg_info, &arg_type_info);
-        param_type = function->param_types[gi_arg_pos];
+        GwkjsArgPlan *plan = &function->args[gi_arg_pos];
+        GIDirection direction = plan->direction;
+        GwkjsParamType param_type = plan->param_type;
 
         if (direction == GI_DIRECTION_IN || direction == GI_DIRECTION_INOUT) {
             GArgument *arg;
@@ -1105,7 +1677,7 @@ release:
 
             if (direction == GI_DIRECTION_IN) {
                 arg = &in_arg_cvalues[c_arg_pos];
-                transfer = g_arg_info_get_ownership_transfer(&arg_info);
+                transfer = plan->transfer;
             } else {
                 arg = &inout_original_arg_cvalues[c_arg_pos];
                 /* For inout, transfer refers to what we get back from the function; for
@@ -1116,7 +1688,7 @@ release:
             }
             if (param_type == PARAM_CALLBACK) {
                 ffi_closure *closure = (ffi_closure *) arg->v_pointer;
-                if (closure) {
+                if (closure && invocation->callback == NULL) {
                     GwkjsCallbackTrampoline *trampoline = (GwkjsCallbackTrampoline *) closure->user_data;
                     /* CallbackTrampolines are refcounted because for notified/async closures
                        it is possible to destroy it while in call, and therefore we cannot check
@@ -1126,31 +1698,28 @@ release:
                 }
             } else if (param_type == PARAM_ARRAY) {
                 gsize length;
-                GIArgInfo array_length_arg;
-                GITypeInfo array_length_type;
-                gint array_length_pos = g_type_info_get_array_length(&arg_type_info);
-
-                g_assert(array_length_pos >= 0);
+                guint8 array_length_pos;
 
-                g_callable_info_load_arg(function->info, array_length_pos, &array_length_arg);
-                g_arg_info_load_type(&array_length_arg, &array_length_type);
+                g_assert(plan->array_length_pos != GWKJS_ARG_INDEX_INVALID);
 
-                array_length_pos += is_method ? 1 : 0;
+                array_length_pos = plan->array_length_pos + (is_method ? 1 : 0);
 
                 length = get_length_from_arg(in_arg_cvalues + array_length_pos,
-                                             g_type_info_get_tag(&array_length_type));
+                                             function->args[plan->array_length_pos].type_tag);
 
-                if (!gwkjs_g_argument_release_in_array(context,
+                if (!invocation->borrowed[c_arg_pos] &&
+                    !gwkjs_g_argument_release_in_array(context,
                                                      transfer,
-                                                     &arg_type_info,
+                                                     &plan->type_info,
                                                      length,
                                                      arg)) {
                     postinvoke_release_failed = TRUE;
                 }
-            } else if (param_type == PARAM_NORMAL) {
+            } else if (param_type == PARAM_NORMAL &&
+                       !(plan->in_arena && !invocation->in_thread)) {
                 if (!gwkjs_g_argument_release_in_arg(context,
                                                    transfer,
-                                                   &arg_type_info,
+                                                   &plan->type_info,
                                                    arg)) {
                     postinvoke_release_failed = TRUE;
                 }
@@ -1167,41 +1736,35 @@ release:
         if ((direction == GI_DIRECTION_OUT || direction == GI_DIRECTION_INOUT) && param_type != PARAM_SKIPPED) {
             GArgument *arg;
             gboolean arg_failed = FALSE;
-            gint array_length_pos;
-            JSValueRef array_length = NULL;
-            GITransfer transfer;
+            gsize array_length = 0;
 
             g_assert(next_rval < function->js_out_argc);
 
             arg = &out_arg_cvalues[c_arg_pos];
 
-            array_length_pos = g_type_info_get_array_length(&arg_type_info);
+            if (plan->array_length_pos != GWKJS_ARG_INDEX_INVALID) {
+                guint8 array_length_pos = plan->array_length_pos + (is_method ? 1 : 0);
+
+                array_length = get_length_from_arg(&out_arg_cvalues[array_length_pos],
+                                                   function->args[plan->array_length_pos].type_tag);
+            }
 
             if (js_rval) {
-                if (array_length_pos >= 0) {
-                    GIArgInfo array_length_arg;
-                    GITypeInfo array_length_type_info;
-
-                    g_callable_info_load_arg(function->info, array_length_pos, &array_length_arg);
-                    g_arg_info_load_type(&array_length_arg, &array_length_type_info);
-                    array_length_pos += is_method ? 1 : 0;
-                    arg_failed = !gwkjs_value_from_g_argument(context, &array_length,
-                                                            &array_length_type_info,
-                                                            &out_arg_cvalues[array_length_pos],
-                                                            TRUE);
-                    if (!arg_failed) {
-                        arg_failed = !gwkjs_value_from_explicit_array(context,
-                                                                    &return_values[next_rval],
-                                                                    &arg_type_info,
-                                                                    arg,
-                                                                    gwkjs_jsvalue_to_int(context, array_length, NULL));
-                    }
+                if (plan->array_length_pos != GWKJS_ARG_INDEX_INVALID) {
+                    arg_failed = !gwkjs_value_from_explicit_array(context,
+                                                                &return_values[next_rval],
+                                                                &plan->type_info,
+                                                                plan->transfer,
+                                                                arg,
+                                                                array_length,
+                                                                function->array_flags);
                 } else {
-                    arg_failed = !gwkjs_value_from_g_argument(context,
-                                                            &return_values[next_rval],
-                                                            &arg_type_info,
-                                                            arg,
-                                                            TRUE);
+                    arg_failed = !gwkjs_value_from_g_argument_full(context,
+                                                                 &return_values[next_rval],
+                                                                 &plan->type_info,
+                                                                 arg,
+                                                                 TRUE,
+                                                                 function->array_flags);
                 }
             }
 
@@ -1209,49 +1772,27 @@ release:
                 postinvoke_release_failed = TRUE;
 
             /* For caller-allocates, what happens here is we allocate
-             * a structure above, then gwkjs_value_from_g_argument calls
-             * g_boxed_copy on it, and takes ownership of that.  So
-             * here we release the memory allocated above.  It would be
-             * better to special case this and directly hand JS the boxed
-             * object and tell gwkjs_boxed it owns the memory, but for now
-             * this works OK.  We could also alloca() the structure instead
-             * of slice allocating.
+             * a structure above from the arena, then
+             * gwkjs_value_from_g_argument calls g_boxed_copy on it, and
+             * takes ownership of that.  The arena memory goes away with
+             * the rest of the scratch space at the end of the call.  It
+             * would be better to special case this and directly hand JS
+             * the boxed object and tell gwkjs_boxed it owns the memory,
+             * but for now this works OK.
              */
-            if (g_arg_info_is_caller_allocates(&arg_info)) {
-                GITypeTag type_tag;
-                GIBaseInfo* interface_info;
-                GIInfoType interface_type;
-                gsize size;
-
-                type_tag = g_type_info_get_tag(&arg_type_info);
-                g_assert(type_tag == GI_TYPE_TAG_INTERFACE);
-                interface_info = g_type_info_get_interface(&arg_type_info);
-                interface_type = g_base_info_get_type(interface_info);
-                if (interface_type == GI_INFO_TYPE_STRUCT) {
-                    size = g_struct_info_get_size((GIStructInfo*)interface_info);
-                } else if (interface_type == GI_INFO_TYPE_UNION) {
-                    size = g_union_info_get_size((GIUnionInfo*)interface_info);
-                } else {
-                    g_assert_not_reached();
-                }
-
-                g_slice_free1(size, out_arg_cvalues[c_arg_pos].v_pointer);
-                g_base_info_unref((GIBaseInfo*)interface_info);
-            }
 
             /* Free GArgument, the jsval should have ref'd or copied it */
-            transfer = g_arg_info_get_ownership_transfer(&arg_info);
             if (!arg_failed) {
-                if (array_length_pos >= 0) {
+                if (plan->array_length_pos != GWKJS_ARG_INDEX_INVALID) {
                     gwkjs_g_argument_release_out_array(context,
-                                                     transfer,
-                                                     &arg_type_info,
-                                                     gwkjs_jsvalue_to_int(context, array_length, NULL),
+                                                     plan->transfer,
+                                                     &plan->type_info,
+                                                     array_length,
                                                      arg);
                 } else {
                     gwkjs_g_argument_release(context,
-                                           transfer,
-                                           &arg_type_info,
+                                           plan->transfer,
+                                           &plan->type_info,
                                            arg);
                 }
             }
@@ -1298,14 +1839,67 @@ release:
     }
 
     if (!failed && did_throw_gerror) {
+        if (error != NULL) {
+            *error = invocation->local_error;
+        } else {
 // TODO: Error handling sucks here!
-        gwkjs_throw_g_error(context, local_error);
-        return JS_FALSE;
+            gwkjs_throw_g_error(context, invocation->local_error);
+        }
+        invocation->local_error = NULL;
+        retval = JS_FALSE;
     } else if (failed) {
-        return JS_FALSE;
+        retval = JS_FALSE;
     } else {
-        return JS_TRUE;
+        retval = JS_TRUE;
     }
+
+    gwkjs_arena_release(invocation->arena, invocation->arena_mark);
+    return retval;
+}
+
+static JSBool
+gwkjs_invoke_c_function(JSContextRef      context,
+                        Function          *function,
+                        JSObjectRef       obj, /* "this" object */
+                        unsigned          js_argc,
+                        const JSValueRef  js_argv[],
+                        jsval             *js_rval,
+                        GArgument         *r_value)
+{
+    Invocation invocation;
+    gboolean failed;
+
+#ifdef GWKJS_HAVE_FAST_INVOKE
+    if (function->fast_invoke != NULL && js_rval != NULL && r_value == NULL)
+        return gwkjs_invoke_c_function_fast(context, function, obj,
+                                            js_argc, js_argv, js_rval);
+#endif
+
+    /* @c_argc is the number of arguments that the underlying C
+     * function takes. @gi_argc is the number of arguments the
+     * GICallableInfo describes (which does not include "this" or
+     * GError**). @function->expected_js_argc is the number of
+     * arguments we expect the JS function to take (which does not
+     * include PARAM_SKIPPED args).
+     *
+     * @js_argc is the number of arguments that were actually passed;
+     * we allow this to be larger than @expected_js_argc for
+     * convenience, and simply ignore the extra arguments. But we
+     * don't allow too few args, since that would break.
+     */
+
+    if (!check_js_argc(context, function, js_argc))
+        return JS_FALSE;
+
+    invocation_init(&invocation, function, get_invoke_arena(context), FALSE);
+
+    failed = !invocation_marshal(context, function, &invocation,
+                                 obj, js_argc, js_argv, NULL);
+    if (!failed)
+        invocation_call(function, &invocation);
+
+    return invocation_finish(context, function, &invocation, failed,
+                             js_rval, r_value, NULL);
 }
 
 static JSValueRef
@@ -1338,26 +1932,664 @@ function_call(JSContextRef context,
     return NULL;
 }
 
-GWKJS_NATIVE_CONSTRUCTOR_DEFINE_ABSTRACT(function)
+/* Calls made with callInThread() share one pool, so that a burst of
+ * them doesn't start a thread each; the rest wait in its queue.
+ */
+#define GWKJS_INVOKE_THREADS_MAX 4
 
-/* Does not actually free storage for structure, just
- * reverses init_cached_function_data
+/* Scratch space of a call made in a thread; the context's invoke arena
+ * can't be used because its marks are released in LIFO order.
  */
-static void
-uninit_cached_function_data (Function *function)
-{
-    if (function->info)
-        g_base_info_unref( (GIBaseInfo*) function->info);
-    if (function->param_types)
-        g_free(function->param_types);
+#define GWKJS_INVOKE_THREAD_ARENA_CHUNK_SIZE 256
 
-    g_function_invoker_destroy(&function->invoker);
-}
+/* The resolving functions of a promise we settle from C; protected
+ * while set.
+ */
+typedef struct {
+    JSObjectRef resolve;
+    JSObjectRef reject;
+} PromiseResolvers;
 
-static void
-function_finalize(JSObjectRef obj)
+static JSClassRef promise_executor_class_ref = NULL;
+
+/* The executor passed to the Promise constructor; it only hands us the
+ * resolving functions.
+ */
+static JSValueRef
+promise_executor(JSContextRef     context,
+                 JSObjectRef      executor,
+                 JSObjectRef      self,
+                 size_t           argc,
+                 const JSValueRef argv[],
+                 JSValueRef      *exception)
 {
-    Function *priv;
+    PromiseResolvers *resolvers = (PromiseResolvers *) JSObjectGetPrivate(executor);
+
+    if (resolvers != NULL && resolvers->resolve == NULL && argc >= 2 &&
+        JSValueIsObject(context, argv[0]) && JSValueIsObject(context, argv[1])) {
+        resolvers->resolve = JSValueToObject(context, argv[0], NULL);
+        resolvers->reject = JSValueToObject(context, argv[1], NULL);
+        JSValueProtect(context, resolvers->resolve);
+        JSValueProtect(context, resolvers->reject);
+    }
+    return JSValueMakeUndefined(context);
+}
+
+static JSObjectRef
+make_promise(JSContextRef      context,
+             PromiseResolvers *resolvers,
+             JSValueRef       *exception)
+{
+    JSObjectRef promise_ctor, promise, executor;
+    JSValueRef value;
+
+    if (promise_executor_class_ref == NULL) {
+        JSClassDefinition definition = kJSClassDefinitionEmpty;
+
+        definition.className = "GIRepositoryPromiseExecutor";
+        definition.callAsFunction = promise_executor;
+        promise_executor_class_ref = JSClassCreate(&definition);
+    }
+
+    value = gwkjs_object_get_property(context, JSContextGetGlobalObject(context),
+                                      "Promise", exception);
+    if (value == NULL || !JSValueIsObject(context, value))
+        return NULL;
+    promise_ctor = JSValueToObject(context, value, exception);
+    if (promise_ctor == NULL)
+        return NULL;
+
+    executor = JSObjectMake(context, promise_executor_class_ref, resolvers);
+    promise = JSObjectCallAsConstructor(context, promise_ctor, 1,
+                                        (const JSValueRef *) &executor, exception);
+    /* The executor may outlive @resolvers */
+    JSObjectSetPrivate(executor, NULL);
+
+    if (resolvers->resolve == NULL)
+        return NULL;
+    return promise;
+}
+
+static void
+promise_resolvers_clear(JSContextRef      context,
+                        PromiseResolvers *resolvers)
+{
+    if (resolvers->resolve != NULL)
+        JSValueUnprotect(context, resolvers->resolve);
+    if (resolvers->reject != NULL)
+        JSValueUnprotect(context, resolvers->reject);
+    resolvers->resolve = NULL;
+    resolvers->reject = NULL;
+}
+
+/* Settles the promise with the results of @invocation, converted by
+ * invocation_finish(); a #GError set by the callee rejects it.
+ */
+static void
+promise_settle_from_invocation(JSContextRef      context,
+                               PromiseResolvers *resolvers,
+                               Function         *function,
+                               Invocation       *invocation,
+                               gboolean          failed)
+{
+    JSValueRef result = NULL;
+    JSValueRef exception = NULL;
+    GError *error = NULL;
+
+    if (invocation_finish(context, function, invocation, failed,
+                          &result, NULL, &error)) {
+        JSObjectCallAsFunction(context, resolvers->resolve, NULL, 1, &result, NULL);
+    } else {
+        if (error != NULL) {
+            gwkjs_make_exception_from_gerror(context, &exception, error);
+            g_error_free(error);
+        } else {
+            gwkjs_make_exception(context, &exception, "Error",
+                                 "Error converting the results of %s.%s",
+                                 g_base_info_get_namespace((GIBaseInfo *) function->info),
+                                 g_base_info_get_name((GIBaseInfo *) function->info));
+        }
+        JSObjectCallAsFunction(context, resolvers->reject, NULL, 1, &exception, NULL);
+    }
+    promise_resolvers_clear(context, resolvers);
+}
+
+typedef struct {
+    JSGlobalContextRef context;
+    GMainContext *main_context;     /* where the promise is settled */
+    Function *function;
+
+    /* Protected until the call completes, so that neither the function
+     * nor anything the C arguments point into goes away meanwhile.
+     */
+    JSObjectRef function_obj;
+    JSValueRef *js_values;          /* "this" and the arguments */
+    size_t n_js_values;
+
+    PromiseResolvers resolvers;
+    Invocation invocation;
+} ThreadCall;
+
+static void
+thread_call_free(ThreadCall *call)
+{
+    JSContextRef context = call->context;
+    size_t i;
+
+    for (i = 0; i < call->n_js_values; i++)
+        JSValueUnprotect(context, call->js_values[i]);
+    g_free(call->js_values);
+    JSValueUnprotect(context, call->function_obj);
+    promise_resolvers_clear(context, &call->resolvers);
+
+    if (call->invocation.arena != NULL)
+        gwkjs_arena_free(call->invocation.arena);
+    g_main_context_unref(call->main_context);
+    JSGlobalContextRelease(call->context);
+    g_slice_free(ThreadCall, call);
+}
+
+/* Runs on the JS thread once the call has returned */
+static gboolean
+thread_call_complete(gpointer data)
+{
+    ThreadCall *call = (ThreadCall *) data;
+
+    promise_settle_from_invocation(call->context, &call->resolvers,
+                                   call->function, &call->invocation, FALSE);
+    thread_call_free(call);
+    return G_SOURCE_REMOVE;
+}
+
+/* Runs in the pool; only the C call itself happens here */
+static void
+thread_call_run(gpointer data,
+                gpointer user_data)
+{
+    ThreadCall *call = (ThreadCall *) data;
+    GSource *source;
+
+    invocation_call(call->function, &call->invocation);
+
+    source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, thread_call_complete, call, NULL);
+    g_source_attach(source, call->main_context);
+    g_source_unref(source);
+}
+
+static GThreadPool *
+get_invoke_pool(void)
+{
+    static gsize pool = 0;
+
+    if (g_once_init_enter(&pool)) {
+        GThreadPool *new_pool = g_thread_pool_new(thread_call_run, NULL,
+                                                  GWKJS_INVOKE_THREADS_MAX,
+                                                  FALSE, NULL);
+        g_once_init_leave(&pool, (gsize) new_pool);
+    }
+    return (GThreadPool *) pool;
+}
+
+/* fn.callInThread(thisObj, args...) calls fn like fn.call() would, but
+ * makes the C call from a pool thread and returns a Promise of what
+ * fn would have returned. The arguments are converted right away and
+ * the results once the call is done, both on the calling thread.
+ *
+ * This is for blocking functions, like synchronous I/O. The function
+ * must be safe to call from another thread, and JS shouldn't use the
+ * arguments in the meantime. Functions taking callbacks are refused.
+ */
+static JSValueRef
+function_call_in_thread(JSContextRef     context,
+                        JSObjectRef      function,
+                        JSObjectRef      self,
+                        size_t           argc,
+                        const JSValueRef arguments[],
+                        JSValueRef      *exception)
+{
+    Function *priv;
+    ThreadCall *call;
+    JSObjectRef this_obj = NULL;
+    JSObjectRef promise;
+    unsigned js_argc;
+    size_t i;
+
+    priv = self != NULL ? priv_from_js(self) : NULL;
+    if (priv == NULL) {
+        gwkjs_make_exception(context, exception, "TypeError",
+                             "callInThread() must be called on an introspected function");
+        return NULL;
+    }
+
+    for (i = 0; i < priv->gi_argc; i++) {
+        if (priv->args[i].param_type == PARAM_CALLBACK) {
+            gwkjs_make_exception(context, exception, "Error",
+                                 "%s.%s takes a callback and can't be called in a thread",
+                                 g_base_info_get_namespace((GIBaseInfo *) priv->info),
+                                 g_base_info_get_name((GIBaseInfo *) priv->info));
+            return NULL;
+        }
+    }
+
+    js_argc = argc > 0 ? argc - 1 : 0;
+    if (js_argc < priv->expected_js_argc) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "Too few arguments to %s %s.%s expected %d got %d",
+                             priv->is_method ? "method" : "function",
+                             g_base_info_get_namespace((GIBaseInfo *) priv->info),
+                             g_base_info_get_name((GIBaseInfo *) priv->info),
+                             priv->expected_js_argc, js_argc);
+        return NULL;
+    }
+
+    if (priv->is_method) {
+        if (argc < 1 || !JSValueIsObject(context, arguments[0])) {
+            gwkjs_make_exception(context, exception, "TypeError",
+                                 "%s.%s needs an instance to be called on",
+                                 g_base_info_get_namespace((GIBaseInfo *) priv->info),
+                                 g_base_info_get_name((GIBaseInfo *) priv->info));
+            return NULL;
+        }
+        this_obj = JSValueToObject(context, arguments[0], NULL);
+    }
+
+    call = g_slice_new0(ThreadCall);
+    call->context = JSGlobalContextRetain(JSContextGetGlobalContext(context));
+    call->main_context = g_main_context_ref_thread_default();
+    call->function = priv;
+    call->function_obj = self;
+    JSValueProtect(context, self);
+    call->n_js_values = argc;
+    call->js_values = g_new(JSValueRef, argc);
+    for (i = 0; i < argc; i++) {
+        call->js_values[i] = arguments[i];
+        JSValueProtect(context, arguments[i]);
+    }
+
+    promise = make_promise(context, &call->resolvers, exception);
+    if (promise == NULL) {
+        thread_call_free(call);
+        return NULL;
+    }
+
+    invocation_init(&call->invocation, priv,
+                    gwkjs_arena_new(GWKJS_INVOKE_THREAD_ARENA_CHUNK_SIZE), TRUE);
+    if (!invocation_marshal(context, priv, &call->invocation,
+                            this_obj, js_argc, arguments + 1, exception)) {
+        invocation_finish(context, priv, &call->invocation, TRUE, NULL, NULL, NULL);
+        thread_call_free(call);
+        return NULL;
+    }
+
+    g_thread_pool_push(get_invoke_pool(), call, NULL);
+    return promise;
+}
+
+static gboolean init_cached_function_data   (JSContextRef    context,
+                                             Function       *function,
+                                             GType           gtype,
+                                             GICallableInfo *info);
+static void     uninit_cached_function_data (Function       *function);
+
+/* Completion records of callPromise() calls stay around for reuse, so
+ * that a stream of async calls doesn't allocate one each.
+ */
+#define GWKJS_ASYNC_CALL_POOL_KEEP 64
+
+typedef struct _AsyncCall AsyncCall;
+struct _AsyncCall {
+    AsyncCall *next;                /* in the pool */
+    JSGlobalContextRef context;
+    Function *function;
+    JSObjectRef function_obj;       /* protected; keeps @function alive */
+    PromiseResolvers resolvers;
+};
+
+/* Shared by the contexts of all threads */
+G_LOCK_DEFINE_STATIC(async_call_pool);
+static AsyncCall *async_call_pool = NULL;
+static guint async_call_pool_size = 0;
+
+static AsyncCall *
+async_call_new(JSContextRef  context,
+               Function     *function,
+               JSObjectRef   function_obj)
+{
+    AsyncCall *call;
+
+    G_LOCK(async_call_pool);
+    call = async_call_pool;
+    if (call != NULL) {
+        async_call_pool = call->next;
+        async_call_pool_size--;
+    }
+    G_UNLOCK(async_call_pool);
+
+    if (call != NULL) {
+        GWKJS_INC_STAT(async_call_reuse);
+    } else {
+        call = g_slice_new0(AsyncCall);
+        GWKJS_INC_STAT(async_call_new);
+    }
+
+    call->next = NULL;
+    call->context = JSGlobalContextRetain(JSContextGetGlobalContext(context));
+    call->function = function;
+    call->function_obj = function_obj;
+    JSValueProtect(context, function_obj);
+    return call;
+}
+
+static void
+async_call_release(AsyncCall *call)
+{
+    JSContextRef context = call->context;
+
+    promise_resolvers_clear(context, &call->resolvers);
+    JSValueUnprotect(context, call->function_obj);
+    JSGlobalContextRelease(call->context);
+
+    G_LOCK(async_call_pool);
+    if (async_call_pool_size < GWKJS_ASYNC_CALL_POOL_KEEP) {
+        call->next = async_call_pool;
+        async_call_pool = call;
+        async_call_pool_size++;
+        call = NULL;
+    }
+    G_UNLOCK(async_call_pool);
+
+    if (call != NULL)
+        g_slice_free(AsyncCall, call);
+}
+
+static gboolean
+is_gio_type(GIBaseInfo *info,
+            const char *name)
+{
+    return info != NULL &&
+        strcmp(g_base_info_get_namespace(info), "Gio") == 0 &&
+        strcmp(g_base_info_get_name(info), name) == 0;
+}
+
+/* A _finish function we can call with just the source object and the
+ * GAsyncResult: the latter is its only in argument, the rest are out.
+ */
+static gboolean
+is_finish_function(Function *finish)
+{
+    guint8 i;
+
+    if (finish->gi_argc == 0 ||
+        finish->args[0].direction != GI_DIRECTION_IN ||
+        !is_gio_type(finish->args[0].interface_info, "AsyncResult"))
+        return FALSE;
+
+    for (i = 1; i < finish->gi_argc; i++) {
+        if (finish->args[i].direction != GI_DIRECTION_OUT)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Returns the foo_finish() completing @function if it is a foo_async()
+ * whose only callback is a GAsyncReadyCallback, or NULL. If there is a
+ * foo_finish() but it can't be called, NULL is returned with the reason
+ * in @exception, and the lookup is tried again next time.
+ */
+static Function *
+get_finish_function(JSContextRef  context,
+                    Function     *function,
+                    JSValueRef   *exception)
+{
+    GIBaseInfo *info = (GIBaseInfo *) function->info;
+    GIBaseInfo *container;
+    GIBaseInfo *finish_info = NULL;
+    const char *name;
+    char *finish_name;
+    gboolean has_ready_callback = FALSE;
+    Function *finish;
+    guint8 i;
+
+    if (function->async_checked)
+        return function->finish;
+    function->async_checked = TRUE;
+
+    name = g_base_info_get_name(info);
+    if (!g_str_has_suffix(name, "_async"))
+        return NULL;
+
+    for (i = 0; i < function->gi_argc; i++) {
+        GwkjsArgPlan *arg = &function->args[i];
+
+        if (arg->param_type != PARAM_CALLBACK)
+            continue;
+        if (has_ready_callback ||
+            !is_gio_type(arg->interface_info, "AsyncReadyCallback") ||
+            arg->closure_pos == GWKJS_ARG_INDEX_INVALID)
+            return NULL;
+        has_ready_callback = TRUE;
+    }
+    if (!has_ready_callback)
+        return NULL;
+
+    finish_name = g_strdup_printf("%.*s_finish", (int) (strlen(name) - strlen("_async")), name);
+    container = g_base_info_get_container(info);
+    if (container != NULL && g_base_info_get_type(container) == GI_INFO_TYPE_OBJECT)
+        finish_info = (GIBaseInfo *) g_object_info_find_method((GIObjectInfo *) container, finish_name);
+    else if (container != NULL && g_base_info_get_type(container) == GI_INFO_TYPE_INTERFACE)
+        finish_info = (GIBaseInfo *) g_interface_info_find_method((GIInterfaceInfo *) container, finish_name);
+    else if (container == NULL)
+        finish_info = g_irepository_find_by_name(NULL, g_base_info_get_namespace(info), finish_name);
+    g_free(finish_name);
+
+    if (finish_info == NULL)
+        return NULL;
+    if (g_base_info_get_type(finish_info) != GI_INFO_TYPE_FUNCTION) {
+        g_base_info_unref(finish_info);
+        return NULL;
+    }
+
+    finish = g_slice_new0(Function);
+    if (!init_cached_function_data(context, finish, 0, (GICallableInfo *) finish_info)) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "%s.%s can't be called",
+                             g_base_info_get_namespace(finish_info),
+                             g_base_info_get_name(finish_info));
+        uninit_cached_function_data(finish);
+        g_slice_free(Function, finish);
+        g_base_info_unref(finish_info);
+        function->async_checked = FALSE;
+        return NULL;
+    }
+
+    if (!is_finish_function(finish)) {
+        uninit_cached_function_data(finish);
+        g_slice_free(Function, finish);
+        finish = NULL;
+    } else {
+        /* callPromise() results follow the _async function's setting */
+        finish->array_flags = function->array_flags;
+    }
+    g_base_info_unref(finish_info);
+
+    function->finish = finish;
+    return finish;
+}
+
+/* Like invocation_marshal(), but for a _finish function and straight
+ * from C; see is_finish_function().
+ */
+static JSBool
+invocation_marshal_finish(JSContextRef  context,
+                          Function     *finish,
+                          Invocation   *invocation,
+                          GObject      *source,
+                          GAsyncResult *result)
+{
+    GArgument *in_arg_cvalues = invocation->in_arg_cvalues;
+    gpointer *ffi_arg_pointers = invocation->ffi_arg_pointers;
+    guint8 gi_arg_pos, c_arg_pos = 0;
+
+    if (finish->is_method) {
+        in_arg_cvalues[0].v_pointer = source;
+        ffi_arg_pointers[0] = &in_arg_cvalues[0];
+        ++c_arg_pos;
+    }
+
+    for (gi_arg_pos = 0; gi_arg_pos < finish->gi_argc; gi_arg_pos++, c_arg_pos++) {
+        ffi_arg_pointers[c_arg_pos] = &in_arg_cvalues[c_arg_pos];
+        if (gi_arg_pos == 0)
+            in_arg_cvalues[c_arg_pos].v_pointer = result;
+        else if (!invocation_marshal_out_arg(context, invocation,
+                                             &finish->args[gi_arg_pos], c_arg_pos))
+            return JS_FALSE;
+        invocation->processed_c_args++;
+    }
+
+    if (finish->can_throw_gerror) {
+        in_arg_cvalues[c_arg_pos].v_pointer = &invocation->local_error;
+        ffi_arg_pointers[c_arg_pos] = &in_arg_cvalues[c_arg_pos];
+        c_arg_pos++;
+    }
+
+    g_assert_cmpuint(c_arg_pos, ==, finish->invoker.cif.nargs);
+    return JS_TRUE;
+}
+
+/* The GAsyncReadyCallback of every callPromise() call */
+static void
+async_call_ready(GObject      *source,
+                 GAsyncResult *result,
+                 gpointer      data)
+{
+    AsyncCall *call = (AsyncCall *) data;
+    JSContextRef context = call->context;
+    Function *finish = call->function->finish;
+    Invocation invocation;
+    gboolean failed;
+
+    invocation_init(&invocation, finish, get_invoke_arena(context), FALSE);
+    failed = !invocation_marshal_finish(context, finish, &invocation, source, result);
+    if (!failed)
+        invocation_call(finish, &invocation);
+
+    promise_settle_from_invocation(context, &call->resolvers,
+                                   finish, &invocation, failed);
+    async_call_release(call);
+}
+
+/* fn.callPromise(thisObj, args...), for a foo_async() function, calls
+ * it like fn.call() would without the callback argument, and returns a
+ * Promise of what foo_finish() returns.
+ *
+ * The callback passed to foo_async() is async_call_ready() itself,
+ * with a pooled completion record as its data, rather than a
+ * trampoline for a JS function.
+ */
+static JSValueRef
+function_call_promise(JSContextRef     context,
+                      JSObjectRef      function,
+                      JSObjectRef      self,
+                      size_t           argc,
+                      const JSValueRef arguments[],
+                      JSValueRef      *exception)
+{
+    Function *priv;
+    AsyncCall *call;
+    Invocation invocation;
+    JSObjectRef this_obj = NULL;
+    JSObjectRef promise;
+    unsigned js_argc;
+
+    priv = self != NULL ? priv_from_js(self) : NULL;
+    if (priv == NULL) {
+        gwkjs_make_exception(context, exception, "TypeError",
+                             "callPromise() must be called on an introspected function");
+        return NULL;
+    }
+
+    if (get_finish_function(context, priv, exception) == NULL) {
+        if (exception && *exception)
+            return NULL;
+        gwkjs_make_exception(context, exception, "Error",
+                             "%s.%s has no matching _finish function",
+                             g_base_info_get_namespace((GIBaseInfo *) priv->info),
+                             g_base_info_get_name((GIBaseInfo *) priv->info));
+        return NULL;
+    }
+
+    /* The callback isn't passed */
+    js_argc = argc > 0 ? argc - 1 : 0;
+    if (js_argc + 1 < priv->expected_js_argc) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "Too few arguments to %s %s.%s expected %d got %d",
+                             priv->is_method ? "method" : "function",
+                             g_base_info_get_namespace((GIBaseInfo *) priv->info),
+                             g_base_info_get_name((GIBaseInfo *) priv->info),
+                             priv->expected_js_argc - 1, js_argc);
+        return NULL;
+    }
+
+    if (priv->is_method) {
+        if (argc < 1 || !JSValueIsObject(context, arguments[0])) {
+            gwkjs_make_exception(context, exception, "TypeError",
+                                 "%s.%s needs an instance to be called on",
+                                 g_base_info_get_namespace((GIBaseInfo *) priv->info),
+                                 g_base_info_get_name((GIBaseInfo *) priv->info));
+            return NULL;
+        }
+        this_obj = JSValueToObject(context, arguments[0], NULL);
+    }
+
+    call = async_call_new(context, priv, self);
+    promise = make_promise(context, &call->resolvers, exception);
+    if (promise == NULL) {
+        async_call_release(call);
+        return NULL;
+    }
+
+    invocation_init(&invocation, priv, get_invoke_arena(context), FALSE);
+    invocation.callback = async_call_ready;
+    invocation.callback_data = call;
+    if (!invocation_marshal(context, priv, &invocation,
+                            this_obj, js_argc, arguments + 1, exception)) {
+        invocation_finish(context, priv, &invocation, TRUE, NULL, NULL, NULL);
+        async_call_release(call);
+        return NULL;
+    }
+
+    /* GIO never calls back from within foo_async() itself */
+    invocation_call(priv, &invocation);
+    invocation_finish(context, priv, &invocation, FALSE, NULL, NULL, NULL);
+    return promise;
+}
+
+GWKJS_NATIVE_CONSTRUCTOR_DEFINE_ABSTRACT(function)
+
+/* Does not actually free storage for structure, just
+ * reverses init_cached_function_data
+ */
+static void
+uninit_cached_function_data (Function *function)
+{
+    if (function->args)
+        free_arg_plans(function->args, function->gi_argc);
+    if (function->info)
+        g_base_info_unref( (GIBaseInfo*) function->info);
+    if (function->finish) {
+        uninit_cached_function_data(function->finish);
+        g_slice_free(Function, function->finish);
+    }
+
+    g_function_invoker_destroy(&function->invoker);
+}
+
+static void
+function_finalize(JSObjectRef obj)
+{
+    Function *priv;
 
     priv = (Function *) JSObjectGetPrivate(obj);
     gwkjs_debug_lifecycle(GWKJS_DEBUG_GFUNCTION,
@@ -1386,17 +2618,13 @@ get_num_arguments (JSContextRef context,
     if (priv == NULL)
         return NULL;
 
-    n_args = g_callable_info_get_n_args(priv->info);
+    n_args = priv->gi_argc;
     n_jsargs = 0;
     for (i = 0; i < n_args; i++) {
-        GIArgInfo arg_info;
-
-        if (priv->param_types[i] == PARAM_SKIPPED)
+        if (priv->args[i].param_type == PARAM_SKIPPED)
             continue;
 
-        g_callable_info_load_arg(priv->info, i, &arg_info);
-
-        if (g_arg_info_get_direction(&arg_info) == GI_DIRECTION_OUT)
+        if (priv->args[i].direction == GI_DIRECTION_OUT)
             continue;
     }
 
@@ -1435,25 +2663,21 @@ function_to_string (JSContextRef context,
 
     free = TRUE;
 
-    n_args = g_callable_info_get_n_args(priv->info);
+    n_args = priv->gi_argc;
     n_jsargs = 0;
     arg_names_str = g_string_new("");
     for (i = 0; i < n_args; i++) {
-        GIArgInfo arg_info;
-
-        if (priv->param_types[i] == PARAM_SKIPPED)
+        if (priv->args[i].param_type == PARAM_SKIPPED)
             continue;
 
-        g_callable_info_load_arg(priv->info, i, &arg_info);
-
-        if (g_arg_info_get_direction(&arg_info) == GI_DIRECTION_OUT)
+        if (priv->args[i].direction == GI_DIRECTION_OUT)
             continue;
 
         if (n_jsargs > 0)
             g_string_append(arg_names_str, ", ");
 
         n_jsargs++;
-        g_string_append(arg_names_str, g_base_info_get_name(&arg_info));
+        g_string_append(arg_names_str, g_base_info_get_name((GIBaseInfo *) &priv->args[i].arg_info));
     }
     arg_names = g_string_free(arg_names_str, FALSE);
 
@@ -1479,6 +2703,49 @@ function_to_string (JSContextRef context,
     return retval;
 }
 
+/* fn.typedArrays = true makes fn return numeric C arrays (return value
+ * and out arguments) as typed arrays instead of plain JS arrays. The
+ * setting belongs to the function object, so it applies to every caller
+ * of that method or namespace function in this context.
+ */
+static JSValueRef
+get_typed_arrays(JSContextRef context,
+                 JSObjectRef  obj,
+                 JSStringRef  propertyName,
+                 JSValueRef  *exception)
+{
+    Function *priv;
+
+    priv = priv_from_js(obj);
+    if (priv == NULL)
+        return JSValueMakeUndefined(context);
+
+    return JSValueMakeBoolean(context,
+                              (priv->array_flags & GWKJS_ARRAY_FLAGS_TYPED_ARRAY) != 0);
+}
+
+static bool
+set_typed_arrays(JSContextRef context,
+                 JSObjectRef  obj,
+                 JSStringRef  propertyName,
+                 JSValueRef   value,
+                 JSValueRef  *exception)
+{
+    Function *priv;
+
+    priv = priv_from_js(obj);
+    if (priv == NULL)
+        return false;
+
+    if (JSValueToBoolean(context, value))
+        priv->array_flags = (GwkjsArrayFlags) (priv->array_flags | GWKJS_ARRAY_FLAGS_TYPED_ARRAY);
+    else
+        priv->array_flags = (GwkjsArrayFlags) (priv->array_flags & ~GWKJS_ARRAY_FLAGS_TYPED_ARRAY);
+    if (priv->finish)
+        priv->finish->array_flags = priv->array_flags;
+    return true;
+}
+
 JSStaticValue gwkjs_function_proto_props[] = {
     { "length",
       get_num_arguments,
@@ -1487,6 +2754,12 @@ JSStaticValue gwkjs_function_proto_props[] = {
       kJSPropertyAttributeDontEnum |
       kJSPropertyAttributeDontDelete,
     },
+    { "typedArrays",
+      get_typed_arrays,
+      set_typed_arrays,
+      kJSPropertyAttributeDontEnum |
+      kJSPropertyAttributeDontDelete,
+    },
     { 0,0,0,0 }
 };
 
@@ -1494,6 +2767,8 @@ JSStaticValue gwkjs_function_proto_props[] = {
    given a GIRepository function as an argument */
 JSStaticFunction gwkjs_function_proto_funcs[] = {
     { "toString", function_to_string, kJSPropertyAttributeNone },
+    { "callInThread", function_call_in_thread, kJSPropertyAttributeDontEnum },
+    { "callPromise", function_call_promise, kJSPropertyAttributeDontEnum },
     {0,0,0}
 };
 
@@ -1524,6 +2799,506 @@ JSClassDefinition gwkjs_function_class = {
 
 
 
+/* Generic in-argument converter; everything gwkjs_value_to_arg() would
+ * look up from the GIArgInfo is already in the plan.
+ */
+static JSBool
+convert_arg_generic(JSContextRef        context,
+                    JSValueRef          value,
+                    const GwkjsArgPlan *plan,
+                    GArgument          *arg)
+{
+    return gwkjs_value_to_g_argument(context, value,
+                                     (GITypeInfo *) &plan->type_info,
+                                     g_base_info_get_name((GIBaseInfo *) &plan->arg_info),
+                                     GWKJS_ARGUMENT_ARGUMENT,
+                                     plan->transfer,
+                                     plan->may_be_null,
+                                     arg);
+}
+
+/* The following have the same semantics as the matching branches of
+ * gwkjs_value_to_g_argument(), minus the type switch.
+ */
+static JSBool
+convert_arg_boolean(JSContextRef        context,
+                    JSValueRef          value,
+                    const GwkjsArgPlan *plan,
+                    GArgument          *arg)
+{
+    arg->v_boolean = JSValueToBoolean(context, value);
+    return JS_TRUE;
+}
+
+static JSBool
+convert_arg_int32(JSContextRef        context,
+                  JSValueRef          value,
+                  const GwkjsArgPlan *plan,
+                  GArgument          *arg)
+{
+    JSValueRef exception = NULL;
+
+    arg->v_int = gwkjs_jsvalue_to_int(context, value, &exception);
+    return exception == NULL;
+}
+
+static JSBool
+convert_arg_double(JSContextRef        context,
+                   JSValueRef          value,
+                   const GwkjsArgPlan *plan,
+                   GArgument          *arg)
+{
+    JSValueRef exception = NULL;
+
+    arg->v_double = JSValueToNumber(context, value, &exception);
+    return exception == NULL;
+}
+
+static JSBool
+convert_arg_uint32(JSContextRef        context,
+                   JSValueRef          value,
+                   const GwkjsArgPlan *plan,
+                   GArgument          *arg)
+{
+    JSValueRef exception = NULL;
+    gdouble i = JSValueToNumber(context, value, &exception);
+
+    if (exception)
+        return JS_FALSE;
+    if (i > G_MAXUINT32 || i < 0) {
+        /* Let the generic path report it */
+        return convert_arg_generic(context, value, plan, arg);
+    }
+    arg->v_uint32 = (guint32) i;
+    return JS_TRUE;
+}
+
+/* Strings the callee only borrows for the duration of the call are
+ * written into the invoke arena instead of a g_malloc()ed copy, so they
+ * go away with the rest of the call's scratch memory and are skipped
+ * when releasing. null and non-strings take the generic path, which
+ * doesn't allocate for them.
+ */
+static JSBool
+convert_arg_utf8_scratch(JSContextRef        context,
+                         JSValueRef          value,
+                         const GwkjsArgPlan *plan,
+                         GArgument          *arg)
+{
+    JSStringRef str;
+    gsize length;
+    char *bytes;
+
+    if (!JSValueIsString(context, value))
+        return convert_arg_generic(context, value, plan, arg);
+
+    str = JSValueToStringCopy(context, value, NULL);
+    length = gwkjs_jsstring_get_utf8_length(str);
+    bytes = (char *) gwkjs_arena_alloc(get_invoke_arena(context), length + 1);
+    gwkjs_jsstring_write_utf8(str, bytes, length);
+    JSStringRelease(str);
+
+    arg->v_pointer = bytes;
+    return JS_TRUE;
+}
+
+/* GObject instances are the only pointer arguments taken on the fast
+ * path; null and anything that isn't an object is left to the generic
+ * converter so the error messages stay the same.
+ */
+static JSBool
+convert_arg_object(JSContextRef        context,
+                   JSValueRef          value,
+                   const GwkjsArgPlan *plan,
+                   GArgument          *arg)
+{
+    JSObjectRef obj;
+
+    if (!JSValueIsObject(context, value) || JSVAL_IS_NULL(context, value))
+        return convert_arg_generic(context, value, plan, arg);
+
+    obj = JSValueToObject(context, value, NULL);
+    if (!gwkjs_typecheck_object(context, obj, plan->interface_gtype, JS_TRUE)) {
+        arg->v_pointer = NULL;
+        return JS_FALSE;
+    }
+
+    arg->v_pointer = gwkjs_g_object_from_object(context, obj);
+    if (arg->v_pointer == NULL)
+        return convert_arg_generic(context, value, plan, arg);
+
+    if (plan->transfer != GI_TRANSFER_NOTHING)
+        g_object_ref(G_OBJECT(arg->v_pointer));
+    return JS_TRUE;
+}
+
+static gboolean
+plan_is_gobject(const GwkjsArgPlan *plan)
+{
+    GIInfoType interface_type;
+
+    if (plan->interface_info == NULL)
+        return FALSE;
+
+    interface_type = g_base_info_get_type(plan->interface_info);
+    return (interface_type == GI_INFO_TYPE_OBJECT ||
+            interface_type == GI_INFO_TYPE_INTERFACE) &&
+           plan->interface_gtype != G_TYPE_NONE &&
+           g_type_is_a(plan->interface_gtype, G_TYPE_OBJECT);
+}
+
+static GwkjsArgConvertFunc
+select_arg_converter(GwkjsArgPlan *plan)
+{
+    switch (plan->type_tag) {
+    case GI_TYPE_TAG_BOOLEAN:
+        return convert_arg_boolean;
+    case GI_TYPE_TAG_INT32:
+        return convert_arg_int32;
+    case GI_TYPE_TAG_UINT32:
+        return convert_arg_uint32;
+    case GI_TYPE_TAG_DOUBLE:
+        return convert_arg_double;
+    case GI_TYPE_TAG_UTF8:
+        if (plan->direction == GI_DIRECTION_IN &&
+            plan->transfer == GI_TRANSFER_NOTHING)
+            return convert_arg_utf8_scratch;
+        return convert_arg_generic;
+    case GI_TYPE_TAG_INTERFACE:
+        if (plan_is_gobject(plan))
+            return convert_arg_object;
+        return convert_arg_generic;
+    default:
+        return convert_arg_generic;
+    }
+}
+
+static inline guint8
+arg_index_from_int(int pos, guint8 n_args)
+{
+    return (pos >= 0 && pos < n_args) ? (guint8) pos : GWKJS_ARG_INDEX_INVALID;
+}
+
+/* Fills in the part of the plan that depends only on the argument
+ * itself; param_type is worked out afterwards since it depends on the
+ * other arguments (array lengths, closures, destroy notifies).
+ */
+static void
+init_arg_plan(GICallableInfo *info,
+              guint8          n_args,
+              guint8          i,
+              GwkjsArgPlan   *plan)
+{
+    g_callable_info_load_arg(info, i, &plan->arg_info);
+    /* Must be loaded in place: the type info keeps a pointer to its container */
+    g_arg_info_load_type(&plan->arg_info, &plan->type_info);
+
+    plan->param_type = PARAM_NORMAL;
+    plan->direction = g_arg_info_get_direction(&plan->arg_info);
+    plan->type_tag = g_type_info_get_tag(&plan->type_info);
+    plan->transfer = g_arg_info_get_ownership_transfer(&plan->arg_info);
+    plan->scope = g_arg_info_get_scope(&plan->arg_info);
+    plan->may_be_null = g_arg_info_may_be_null(&plan->arg_info);
+    plan->caller_allocates = plan->direction == GI_DIRECTION_OUT &&
+                             g_arg_info_is_caller_allocates(&plan->arg_info);
+    plan->destroy_pos = arg_index_from_int(g_arg_info_get_destroy(&plan->arg_info), n_args);
+    plan->closure_pos = arg_index_from_int(g_arg_info_get_closure(&plan->arg_info), n_args);
+    plan->array_length_pos = GWKJS_ARG_INDEX_INVALID;
+    plan->interface_info = NULL;
+    plan->caller_allocates_size = 0;
+
+    plan->interface_gtype = G_TYPE_NONE;
+
+    if (plan->type_tag == GI_TYPE_TAG_INTERFACE) {
+        plan->interface_info = g_type_info_get_interface(&plan->type_info);
+
+        switch (g_base_info_get_type(plan->interface_info)) {
+        case GI_INFO_TYPE_ENUM:
+        case GI_INFO_TYPE_FLAGS:
+        case GI_INFO_TYPE_OBJECT:
+        case GI_INFO_TYPE_INTERFACE:
+        case GI_INFO_TYPE_STRUCT:
+        case GI_INFO_TYPE_UNION:
+        case GI_INFO_TYPE_BOXED:
+            plan->interface_gtype = g_registered_type_info_get_g_type((GIRegisteredTypeInfo *) plan->interface_info);
+            break;
+        default:
+            break;
+        }
+    } else if (plan->type_tag == GI_TYPE_TAG_ARRAY &&
+               g_type_info_get_array_type(&plan->type_info) == GI_ARRAY_TYPE_C) {
+        plan->array_length_pos = arg_index_from_int(g_type_info_get_array_length(&plan->type_info),
+                                                    n_args);
+    }
+
+    if (plan->caller_allocates && plan->interface_info) {
+        GIInfoType interface_type = g_base_info_get_type(plan->interface_info);
+
+        if (interface_type == GI_INFO_TYPE_STRUCT)
+            plan->caller_allocates_size = g_struct_info_get_size((GIStructInfo*) plan->interface_info);
+        else if (interface_type == GI_INFO_TYPE_UNION)
+            plan->caller_allocates_size = g_union_info_get_size((GIUnionInfo*) plan->interface_info);
+    }
+
+    plan->to_c = select_arg_converter(plan);
+    plan->in_arena = plan->to_c == convert_arg_utf8_scratch;
+}
+
+static void
+free_arg_plans(GwkjsArgPlan *args,
+               guint8        n_args)
+{
+    guint8 i;
+
+    for (i = 0; i < n_args; i++) {
+        if (args[i].interface_info)
+            g_base_info_unref(args[i].interface_info);
+    }
+    g_free(args);
+}
+
+#ifdef GWKJS_HAVE_FAST_INVOKE
+
+/* One direct caller is instantiated per signature: every combination
+ * of gintptr/double for up to GWKJS_FAST_INVOKE_MAX_ARGS arguments,
+ * returning void, gintptr or double.
+ */
+enum {
+    FAST_CLASS_VOID,
+    FAST_CLASS_WORD,
+    FAST_CLASS_DOUBLE
+};
+
+template<typename T> struct FastSlot;
+
+template<> struct FastSlot<gintptr> {
+    static inline gintptr get(const GwkjsFastValue &v) { return v.v_word; }
+    static inline void set(GwkjsFastValue *v, gintptr x) { v->v_word = x; }
+};
+
+template<> struct FastSlot<double> {
+    static inline double get(const GwkjsFastValue &v) { return v.v_double; }
+    static inline void set(GwkjsFastValue *v, double x) { v->v_double = x; }
+};
+
+template<unsigned... I> struct FastIndices {};
+
+template<unsigned N, unsigned... I>
+struct FastMakeIndices : FastMakeIndices<N - 1, N - 1, I...> {};
+
+template<unsigned... I>
+struct FastMakeIndices<0, I...> {
+    typedef FastIndices<I...> type;
+};
+
+template<typename R, typename... A>
+struct FastCall {
+    template<unsigned... I>
+    static inline void call(gpointer addr, const GwkjsFastValue *args,
+                            GwkjsFastValue *ret, FastIndices<I...>)
+    {
+        (void) args;
+        FastSlot<R>::set(ret, ((R (*)(A...)) addr)(FastSlot<A>::get(args[I])...));
+    }
+
+    static void invoke(gpointer addr, const GwkjsFastValue *args, GwkjsFastValue *ret)
+    {
+        call(addr, args, ret, typename FastMakeIndices<sizeof...(A)>::type());
+    }
+};
+
+template<typename... A>
+struct FastCall<void, A...> {
+    template<unsigned... I>
+    static inline void call(gpointer addr, const GwkjsFastValue *args, FastIndices<I...>)
+    {
+        (void) args;
+        ((void (*)(A...)) addr)(FastSlot<A>::get(args[I])...);
+    }
+
+    static void invoke(gpointer addr, const GwkjsFastValue *args, GwkjsFastValue *ret)
+    {
+        (void) ret;
+        call(addr, args, typename FastMakeIndices<sizeof...(A)>::type());
+    }
+};
+
+/* Consumes one argument class per step, appending the matching C type
+ * to the pack, until the classes run out.
+ */
+template<bool CanGrow, typename R, typename... A>
+struct FastSignature {
+    static GwkjsFastInvokeFunc lookup(const guint8 *classes, guint n_classes)
+    {
+        const bool can_grow = sizeof...(A) + 1 < GWKJS_FAST_INVOKE_MAX_ARGS;
+
+        if (n_classes == 0)
+            return FastCall<R, A...>::invoke;
+        if (classes[0] == FAST_CLASS_DOUBLE)
+            return FastSignature<can_grow, R, A..., double>::lookup(classes + 1, n_classes - 1);
+        return FastSignature<can_grow, R, A..., gintptr>::lookup(classes + 1, n_classes - 1);
+    }
+};
+
+template<typename R, typename... A>
+struct FastSignature<false, R, A...> {
+    static GwkjsFastInvokeFunc lookup(const guint8 *classes, guint n_classes)
+    {
+        (void) classes;
+        return n_classes == 0 ? FastCall<R, A...>::invoke : NULL;
+    }
+};
+
+static GwkjsFastInvokeFunc
+fast_invoker_lookup(guint8        return_class,
+                    const guint8 *classes,
+                    guint         n_classes)
+{
+    switch (return_class) {
+    case FAST_CLASS_VOID:
+        return FastSignature<true, void>::lookup(classes, n_classes);
+    case FAST_CLASS_WORD:
+        return FastSignature<true, gintptr>::lookup(classes, n_classes);
+    case FAST_CLASS_DOUBLE:
+        return FastSignature<true, double>::lookup(classes, n_classes);
+    default:
+        g_assert_not_reached();
+        return NULL;
+    }
+}
+
+static guint8
+fast_kind_for_type(GITypeTag   type_tag,
+                   GIBaseInfo *interface_info)
+{
+    switch (type_tag) {
+    case GI_TYPE_TAG_VOID:
+        return FAST_KIND_VOID;
+    case GI_TYPE_TAG_BOOLEAN:
+        return FAST_KIND_BOOLEAN;
+    case GI_TYPE_TAG_INT8:
+        return FAST_KIND_INT8;
+    case GI_TYPE_TAG_UINT8:
+        return FAST_KIND_UINT8;
+    case GI_TYPE_TAG_INT16:
+        return FAST_KIND_INT16;
+    case GI_TYPE_TAG_UINT16:
+        return FAST_KIND_UINT16;
+    case GI_TYPE_TAG_INT32:
+        return FAST_KIND_INT32;
+    case GI_TYPE_TAG_UINT32:
+        return FAST_KIND_UINT32;
+    case GI_TYPE_TAG_INT64:
+        return FAST_KIND_INT64;
+    case GI_TYPE_TAG_UINT64:
+        return FAST_KIND_UINT64;
+    case GI_TYPE_TAG_DOUBLE:
+        return FAST_KIND_DOUBLE;
+    case GI_TYPE_TAG_INTERFACE: {
+        GIInfoType interface_type = g_base_info_get_type(interface_info);
+        GType gtype;
+
+        if (interface_type == GI_INFO_TYPE_ENUM ||
+            interface_type == GI_INFO_TYPE_FLAGS)
+            return FAST_KIND_ENUM;
+
+        if (interface_type != GI_INFO_TYPE_OBJECT &&
+            interface_type != GI_INFO_TYPE_INTERFACE)
+            return FAST_KIND_INVALID;
+
+        gtype = g_registered_type_info_get_g_type((GIRegisteredTypeInfo *) interface_info);
+        if (gtype != G_TYPE_NONE && g_type_is_a(gtype, G_TYPE_OBJECT))
+            return FAST_KIND_POINTER;
+        return FAST_KIND_INVALID;
+    }
+    default:
+        /* float would need its own class; everything else needs
+         * allocation, release or more than one register.
+         */
+        return FAST_KIND_INVALID;
+    }
+}
+
+static inline guint8
+fast_class_for_kind(guint8 kind)
+{
+    if (kind == FAST_KIND_VOID)
+        return FAST_CLASS_VOID;
+    if (kind == FAST_KIND_DOUBLE)
+        return FAST_CLASS_DOUBLE;
+    return FAST_CLASS_WORD;
+}
+
+#endif /* GWKJS_HAVE_FAST_INVOKE */
+
+/* Binds a direct caller if every argument is a plain (in) scalar or
+ * (transfer none) GObject, nothing can throw and the return value needs no array
+ * length. Setting GWKJS_DISABLE_FAST_INVOKE in the environment forces
+ * everything through ffi_call(), which is handy for comparisons.
+ */
+static void
+init_fast_invoke(Function *function)
+{
+#ifdef GWKJS_HAVE_FAST_INVOKE
+    guint8 classes[GWKJS_FAST_INVOKE_MAX_ARGS];
+    guint8 c_argc, c_arg_pos = 0, i;
+    GIBaseInfo *return_interface = NULL;
+    guint8 kind;
+
+    function->fast_invoke = NULL;
+
+    if (g_getenv("GWKJS_DISABLE_FAST_INVOKE") != NULL)
+        return;
+
+    c_argc = function->invoker.cif.nargs;
+    if (function->can_throw_gerror || c_argc > GWKJS_FAST_INVOKE_MAX_ARGS)
+        return;
+
+    if (function->is_method) {
+        if (g_callable_info_get_instance_ownership_transfer(function->info) != GI_TRANSFER_NOTHING)
+            return;
+        function->fast_kinds[c_arg_pos] = FAST_KIND_POINTER;
+        classes[c_arg_pos++] = FAST_CLASS_WORD;
+    }
+
+    for (i = 0; i < function->gi_argc; i++, c_arg_pos++) {
+        GwkjsArgPlan *plan = &function->args[i];
+
+        if (plan->direction != GI_DIRECTION_IN ||
+            plan->param_type != PARAM_NORMAL)
+            return;
+
+        kind = fast_kind_for_type(plan->type_tag, plan->interface_info);
+        if (kind == FAST_KIND_INVALID || kind == FAST_KIND_VOID)
+            return;
+
+        /* The reference taken for a (transfer full) object would leak
+         * if a later argument failed to convert */
+        if (kind == FAST_KIND_POINTER && plan->transfer != GI_TRANSFER_NOTHING)
+            return;
+
+        function->fast_kinds[c_arg_pos] = kind;
+        classes[c_arg_pos] = fast_class_for_kind(kind);
+    }
+
+    g_assert_cmpuint(c_arg_pos, ==, c_argc);
+
+    if (function->return_array_length_pos != GWKJS_ARG_INDEX_INVALID)
+        return;
+
+    if (function->return_tag == GI_TYPE_TAG_INTERFACE)
+        return_interface = g_type_info_get_interface(&function->return_info);
+    kind = fast_kind_for_type(function->return_tag, return_interface);
+    if (return_interface)
+        g_base_info_unref(return_interface);
+    if (kind == FAST_KIND_INVALID)
+        return;
+
+    function->fast_return_kind = kind;
+    function->fast_invoke = fast_invoker_lookup(fast_class_for_kind(kind), classes, c_argc);
+#endif
+}
+
 static gboolean
 init_cached_function_data (JSContextRef      context,
                            Function       *function,
@@ -1533,7 +3308,6 @@ init_cached_function_data (JSContextRef      context,
     guint8 i, n_args;
     int array_length_pos;
     GError *error = NULL;
-    GITypeInfo return_type;
     GIInfoType info_type;
 
     info_type = g_base_info_get_type((GIBaseInfo *)info);
@@ -1565,99 +3339,92 @@ init_cached_function_data (JSContextRef      context,
         }
     }
 
-    g_callable_info_load_return_type((GICallableInfo*)info, &return_type);
-    if (g_type_info_get_tag(&return_type) != GI_TYPE_TAG_VOID)
+    function->info = info;
+    g_base_info_ref((GIBaseInfo*) function->info);
+
+    function->is_method = g_callable_info_is_method(info);
+    function->can_throw_gerror = g_callable_info_can_throw_gerror(info);
+
+    g_callable_info_load_return_type(info, &function->return_info);
+    function->return_tag = g_type_info_get_tag(&function->return_info);
+    function->return_transfer = g_callable_info_get_caller_owns(info);
+    if (function->return_tag != GI_TYPE_TAG_VOID)
         function->js_out_argc += 1;
 
-    n_args = g_callable_info_get_n_args((GICallableInfo*) info);
-    function->param_types = g_new0(GwkjsParamType, n_args);
+    n_args = g_callable_info_get_n_args(info);
+    function->gi_argc = n_args;
+    function->args = g_new0(GwkjsArgPlan, n_args);
+
+    for (i = 0; i < n_args; i++)
+        init_arg_plan(info, n_args, i, &function->args[i]);
 
-    array_length_pos = g_type_info_get_array_length(&return_type);
-    if (array_length_pos >= 0 && array_length_pos < n_args)
-        function->param_types[array_length_pos] = PARAM_SKIPPED;
+    array_length_pos = g_type_info_get_array_length(&function->return_info);
+    function->return_array_length_pos = arg_index_from_int(array_length_pos, n_args);
+    if (function->return_array_length_pos != GWKJS_ARG_INDEX_INVALID)
+        function->args[array_length_pos].param_type = PARAM_SKIPPED;
 
     for (i = 0; i < n_args; i++) {
+        GwkjsArgPlan *arg = &function->args[i];
         GIDirection direction;
-        GIArgInfo arg_info;
-        GITypeInfo type_info;
-        int destroy = -1;
-        int closure = -1;
         GITypeTag type_tag;
 
-        if (function->param_types[i] == PARAM_SKIPPED)
+        if (arg->param_type == PARAM_SKIPPED)
             continue;
 
-        g_callable_info_load_arg((GICallableInfo*) info, i, &arg_info);
-        g_arg_info_load_type(&arg_info, &type_info);
-
-        direction = g_arg_info_get_direction(&arg_info);
-        type_tag = g_type_info_get_tag(&type_info);
+        direction = arg->direction;
+        type_tag = arg->type_tag;
 
         if (type_tag == GI_TYPE_TAG_INTERFACE) {
-            GIBaseInfo* interface_info;
-            GIInfoType interface_type;
+            GIBaseInfo* interface_info = arg->interface_info;
 
-            interface_info = g_type_info_get_interface(&type_info);
-            interface_type = g_base_info_get_type(interface_info);
-            if (interface_type == GI_INFO_TYPE_CALLBACK) {
+            if (g_base_info_get_type(interface_info) == GI_INFO_TYPE_CALLBACK) {
                 if (strcmp(g_base_info_get_name(interface_info), "DestroyNotify") == 0 &&
                     strcmp(g_base_info_get_namespace(interface_info), "GLib") == 0) {
                     /* Skip GDestroyNotify if they appear before the respective callback */
-                    function->param_types[i] = PARAM_SKIPPED;
+                    arg->param_type = PARAM_SKIPPED;
                 } else {
-                    function->param_types[i] = PARAM_CALLBACK;
+                    arg->param_type = PARAM_CALLBACK;
                     function->expected_js_argc += 1;
 
-                    destroy = g_arg_info_get_destroy(&arg_info);
-                    closure = g_arg_info_get_closure(&arg_info);
+                    if (arg->destroy_pos != GWKJS_ARG_INDEX_INVALID)
+                        function->args[arg->destroy_pos].param_type = PARAM_SKIPPED;
 
-                    if (destroy >= 0 && destroy < n_args)
-                        function->param_types[destroy] = PARAM_SKIPPED;
+                    if (arg->closure_pos != GWKJS_ARG_INDEX_INVALID)
+                        function->args[arg->closure_pos].param_type = PARAM_SKIPPED;
 
-                    if (closure >= 0 && closure < n_args)
-                        function->param_types[closure] = PARAM_SKIPPED;
-
-                    if (destroy >= 0 && closure < 0) {
+                    if (arg->destroy_pos != GWKJS_ARG_INDEX_INVALID &&
+                        arg->closure_pos == GWKJS_ARG_INDEX_INVALID) {
                         gwkjs_throw(context, "Function %s.%s has a GDestroyNotify but no user_data, not supported",
                                   g_base_info_get_namespace( (GIBaseInfo*) info),
                                   g_base_info_get_name( (GIBaseInfo*) info));
-                        g_base_info_unref(interface_info);
                         return JS_FALSE;
                     }
                 }
             }
-            g_base_info_unref(interface_info);
-        } else if (type_tag == GI_TYPE_TAG_ARRAY) {
-            if (g_type_info_get_array_type(&type_info) == GI_ARRAY_TYPE_C) {
-                array_length_pos = g_type_info_get_array_length(&type_info);
-
-                if (array_length_pos >= 0 && array_length_pos < n_args) {
-                    GIArgInfo length_arg_info;
+        } else if (arg->array_length_pos != GWKJS_ARG_INDEX_INVALID) {
+            array_length_pos = arg->array_length_pos;
 
-                    g_callable_info_load_arg((GICallableInfo*) info, array_length_pos, &length_arg_info);
-                    if (g_arg_info_get_direction(&length_arg_info) != direction) {
-                        gwkjs_throw(context, "Function %s.%s has an array with different-direction length arg, not supported",
-                                  g_base_info_get_namespace( (GIBaseInfo*) info),
-                                  g_base_info_get_name( (GIBaseInfo*) info));
-                        return JS_FALSE;
-                    }
+            if (function->args[array_length_pos].direction != direction) {
+                gwkjs_throw(context, "Function %s.%s has an array with different-direction length arg, not supported",
+                          g_base_info_get_namespace( (GIBaseInfo*) info),
+                          g_base_info_get_name( (GIBaseInfo*) info));
+                return JS_FALSE;
+            }
 
-                    function->param_types[array_length_pos] = PARAM_SKIPPED;
-                    function->param_types[i] = PARAM_ARRAY;
+            function->args[array_length_pos].param_type = PARAM_SKIPPED;
+            arg->param_type = PARAM_ARRAY;
 
-                    if (array_length_pos < i) {
-                        /* we already collected array_length_pos, remove it */
-                        if (direction == GI_DIRECTION_IN || direction == GI_DIRECTION_INOUT)
-                            function->expected_js_argc -= 1;
-                        if (direction == GI_DIRECTION_OUT || direction == GI_DIRECTION_INOUT)
-                            function->js_out_argc -= 1;
-                    }
-                }
+            if (array_length_pos < i) {
+                /* we already collected array_length_pos, remove it */
+                if (direction == GI_DIRECTION_IN || direction == GI_DIRECTION_INOUT)
+                    function->expected_js_argc -= 1;
+                if (direction == GI_DIRECTION_OUT || direction == GI_DIRECTION_INOUT)
+                    function->js_out_argc -= 1;
             }
         }
 
-        if (function->param_types[i] == PARAM_NORMAL ||
-            function->param_types[i] == PARAM_ARRAY) {
+        if (arg->param_type == PARAM_NORMAL ||
+            arg->param_type == PARAM_ARRAY) {
             if (direction == GI_DIRECTION_IN || direction == GI_DIRECTION_INOUT)
                 function->expected_js_argc += 1;
             if (direction == GI_DIRECTION_OUT || direction == GI_DIRECTION_INOUT)
@@ -1665,9 +3432,7 @@ init_cached_function_data (JSContextRef      context,
         }
     }
 
-    function->info = info;
-
-    g_base_info_ref((GIBaseInfo*) function->info);
+    init_fast_invoke(function);
 
     return JS_TRUE;
 }
@@ -1819,8 +3584,10 @@ gwkjs_invoke_c_function_uncached (JSContextRef      context,
   JSBool result;
 
   memset (&function, 0, sizeof (Function));
-  if (!init_cached_function_data (context, &function, 0, info))
+  if (!init_cached_function_data (context, &function, 0, info)) {
+    uninit_cached_function_data (&function);
     return JS_FALSE;
+  }
 
   result = gwkjs_invoke_c_function (context, &function, obj, argc, argv, rval, NULL);
   uninit_cached_function_data (&function);
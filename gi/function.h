@@ -33,6 +33,11 @@
 
 G_BEGIN_DECLS
 
+/* We use guint8 for arguments; functions can't
+ * have more than this.
+ */
+#define GWKJS_ARG_INDEX_INVALID G_MAXUINT8
+
 typedef enum {
     PARAM_NORMAL,
     PARAM_SKIPPED,
@@ -40,6 +45,40 @@ typedef enum {
     PARAM_CALLBACK
 } GwkjsParamType;
 
+typedef struct _GwkjsArgPlan GwkjsArgPlan;
+
+typedef JSBool (*GwkjsArgConvertFunc) (JSContextRef        context,
+                                       JSValueRef          value,
+                                       const GwkjsArgPlan *plan,
+                                       GArgument          *arg);
+
+/* Everything we need to know about a single argument of a callable,
+ * read once from the typelib when the function is first wrapped so
+ * that invocations don't have to go back to the introspection data.
+ * The GIArgInfo/GITypeInfo members are stack-style infos pointing into
+ * the typelib; they stay valid as long as the owning GICallableInfo is
+ * referenced and the plan array is not moved.
+ */
+struct _GwkjsArgPlan {
+    GIArgInfo arg_info;
+    GITypeInfo type_info;
+    GIBaseInfo *interface_info;     /* owned; NULL unless type_tag is INTERFACE */
+    GType interface_gtype;          /* G_TYPE_NONE unless interface_info is registered */
+    GwkjsParamType param_type;
+    GIDirection direction;
+    GITypeTag type_tag;
+    GITransfer transfer;
+    GIScopeType scope;
+    guint8 array_length_pos;        /* GWKJS_ARG_INDEX_INVALID if none */
+    guint8 destroy_pos;             /* GWKJS_ARG_INDEX_INVALID if none */
+    guint8 closure_pos;             /* GWKJS_ARG_INDEX_INVALID if none */
+    guint may_be_null : 1;
+    guint caller_allocates : 1;
+    guint in_arena : 1;             /* to_c converts into the invoke arena; nothing to release */
+    gsize caller_allocates_size;    /* 0 if caller-allocates is unsupported */
+    GwkjsArgConvertFunc to_c;       /* for PARAM_NORMAL in/inout args */
+};
+
 typedef struct {
     gint ref_count;
     JSContextRef context;
@@ -49,7 +88,17 @@ typedef struct {
     ffi_closure *closure;
     GIScopeType scope;
     gboolean is_vfunc;
-    GwkjsParamType *param_types;
+
+    /* Read once when the closure is prepared; the callback path
+     * doesn't touch the typelib.
+     */
+    GwkjsArgPlan *args;
+    guint8 n_args;
+    guint8 n_outargs;               /* out and inout args, not counting void ones */
+    GITypeInfo return_info;
+    GITypeTag return_tag;
+    GIInfoType return_interface_type;  /* if return_tag is INTERFACE */
+    GITransfer return_transfer;
 } GwkjsCallbackTrampoline;
 
 GwkjsCallbackTrampoline* gwkjs_callback_trampoline_new(JSContextRef     context,
@@ -60,6 +109,7 @@ GwkjsCallbackTrampoline* gwkjs_callback_trampoline_new(JSContextRef     context,
 
 void gwkjs_callback_trampoline_unref(GwkjsCallbackTrampoline *trampoline);
 void gwkjs_callback_trampoline_ref(GwkjsCallbackTrampoline *trampoline);
+void gwkjs_callback_trampoline_reclaim(void);
 
 JSObjectRef gwkjs_define_function   (JSContextRef    context,
                                      JSObjectRef     in_object,
@@ -42,6 +42,7 @@
 
 #include <gwkjs/gwkjs-module.h>
 #include <gwkjs/compat.h>
+#include <gwkjs/exceptions.h>
 #include <gwkjs/type-module.h>
 #include <gwkjs/context-private.h>
 
@@ -54,6 +55,7 @@ typedef struct {
     GIObjectInfo *info;
     GObject *gobj; /* NULL if we are the prototype and not an instance */
     JSObjectRef keep_alive; /* NULL if we are not added to it */
+    JSGlobalContextRef context; /* whose keep-alive holds the wrapper */
     GType gtype;
 
     /* a list of all signal connections, used when tracing */
@@ -63,7 +65,12 @@ typedef struct {
        prototypes) */
     GTypeClass *klass;
 
-    GHashTable *modules;
+    /* Names already run through object_instance_new_resolve() on this
+     * prototype, GQuark -> the value it defined (NULL if none). Every
+     * instance resolves through its prototype chain, so only
+     * prototypes carry one.
+     */
+    GHashTable *resolved;
 } ObjectInstance;
 // TODO: Remove this later
 static guint64 ObjectInstanceSignature = 123456789;
@@ -85,8 +92,25 @@ typedef struct
     GObject         *gobj;
     ToggleDirection  direction;
     guint            needs_unref : 1;
+    guint            cancelled : 1;
 } ToggleRefNotifyOperation;
 
+/* Toggle notifications that have to wait for the JS thread. Any thread
+ * appends to the ring; a single idle callback on the JS thread drains
+ * it in batches, instead of each object getting its own main loop
+ * source.
+ */
+typedef struct
+{
+    GMutex                     lock;
+    ToggleRefNotifyOperation **ops;
+    guint                      capacity;       /* 0 or a power of two */
+    guint                      head;
+    guint                      length;
+    guint                      idle_id;        /* 0 if no drain is scheduled */
+    gint64                     scheduled_at;   /* when the drain was scheduled */
+} ToggleQueue;
+
 enum {
     PROP_0,
     PROP_JS_HANDLED,
@@ -98,7 +122,7 @@ static GHashTable *class_init_properties;
 extern JSClassDefinition gwkjs_object_instance_class;
 static JSClassRef gwkjs_object_instance_class_ref = NULL;
 static GThread *gwkjs_eval_thread;
-static volatile gint pending_idle_toggles;
+static ToggleQueue toggle_queue;
 
 GWKJS_DEFINE_PRIV_FROM_JS(ObjectInstance, gwkjs_object_instance_class)
 
@@ -185,6 +209,127 @@ g_type_query_dynamic_safe (GType       type,
     g_type_query(type, query);
 }
 
+/* What a JS property name means on a given GType, looked up once per
+ * class instead of on every access.
+ */
+typedef struct {
+    GParamSpec *pspec;          /* NULL if the name isn't a GObject property */
+    GType value_type;
+    guint readable : 1;
+    guint writable : 1;
+    guint custom : 1;           /* defined by a JS subclass */
+    GwkjsValueToJSFunc to_js;
+    GwkjsValueFromJSFunc from_js;
+} PropDesc;
+
+static GQuark
+gwkjs_prop_cache_quark (void)
+{
+    static GQuark val = 0;
+    if (G_UNLIKELY (!val))
+        val = g_quark_from_static_string ("gwkjs::prop-cache");
+
+    return val;
+}
+
+/* Names that are properties are cached for good, there being only so
+ * many; other names can be anything JS sets on an instance, so only the
+ * most recent ones are remembered.
+ */
+#define PROP_CACHE_MAX_MISSES 256
+
+typedef struct {
+    GHashTable *props;          /* name quark -> PropDesc */
+    GHashTable *misses;         /* names that aren't GObject properties */
+} PropCache;
+
+static const PropDesc no_such_prop = { NULL, };
+
+/* Look up @js_prop_name on @gtype, caching the answer on the GType.
+ * The result is valid forever: GTypes and their pspecs are never
+ * unregistered while we run.
+ */
+static const PropDesc *
+lookup_prop_desc(GType       gtype,
+                 const char *js_prop_name)
+{
+    PropCache *cache;
+    GParamSpec *pspec;
+    PropDesc *desc;
+    GQuark key;
+    char *gname;
+    void *klass;
+
+    cache = (PropCache *) g_type_get_qdata(gtype, gwkjs_prop_cache_quark());
+    if (cache == NULL) {
+        cache = g_slice_new(PropCache);
+        cache->props = g_hash_table_new(NULL, NULL);
+        cache->misses = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_type_set_qdata(gtype, gwkjs_prop_cache_quark(), cache);
+    }
+
+    /* Only names of properties are interned, so a name without a quark
+     * isn't one of them */
+    key = g_quark_try_string(js_prop_name);
+    if (key != 0) {
+        desc = (PropDesc *) g_hash_table_lookup(cache->props, GUINT_TO_POINTER(key));
+        if (desc != NULL)
+            return desc;
+    }
+    if (g_hash_table_contains(cache->misses, js_prop_name))
+        return &no_such_prop;
+
+    gname = gwkjs_hyphen_from_camel(js_prop_name);
+    gwkjs_debug_jsprop(GWKJS_DEBUG_GOBJECT,
+                     "Hyphen name %s on %s", gname, g_type_name(gtype));
+
+    klass = g_type_class_ref(gtype);
+    pspec = g_object_class_find_property(G_OBJECT_CLASS(klass), gname);
+    g_type_class_unref(klass);
+    g_free(gname);
+
+    if (pspec == NULL) {
+        if (g_hash_table_size(cache->misses) >= PROP_CACHE_MAX_MISSES)
+            g_hash_table_remove_all(cache->misses);
+        g_hash_table_add(cache->misses, g_strdup(js_prop_name));
+        return &no_such_prop;
+    }
+
+    desc = g_slice_new0(PropDesc);
+    desc->pspec = pspec;
+    desc->value_type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+    desc->readable = (pspec->flags & G_PARAM_READABLE) != 0;
+    desc->writable = (pspec->flags & G_PARAM_WRITABLE) != 0;
+    desc->custom = g_param_spec_get_qdata(pspec,
+                                          gwkjs_is_custom_property_quark()) != NULL;
+    if (!gwkjs_value_get_direct_converters(desc->value_type,
+                                           &desc->to_js, &desc->from_js)) {
+        desc->to_js = gwkjs_value_from_g_value;
+        desc->from_js = gwkjs_value_to_g_value;
+    }
+
+    key = g_quark_from_string(js_prop_name);
+    g_hash_table_insert(cache->props, GUINT_TO_POINTER(key), desc);
+    return desc;
+}
+
+/* Property names are nearly always short, so convert them on the
+ * stack. Returns @buf, or a string to g_free() if it didn't fit.
+ */
+static char *
+prop_name_to_cstring(JSStringRef  property_name,
+                     char        *buf,
+                     gsize        buf_size)
+{
+    if (JSStringGetMaximumUTF8CStringSize(property_name) > buf_size)
+        return gwkjs_jsstring_to_cstring(property_name);
+
+    JSStringGetUTF8CString(property_name, buf, buf_size);
+    return buf;
+}
+
+#define PROP_NAME_BUF_SIZE 256
+
 static void
 throw_priv_is_null_error(JSContextRef context)
 {
@@ -202,50 +347,39 @@ init_g_param_from_property(JSContextRef  context,
                            GParameter *parameter,
                            gboolean    constructing)
 {
-    char *gname;
-    GParamSpec *param_spec;
-    void *klass;
+    const PropDesc *desc;
 
-    gname = gwkjs_hyphen_from_camel(js_prop_name);
-    gwkjs_debug_jsprop(GWKJS_DEBUG_GOBJECT,
-                     "Hyphen name %s on %s", gname, g_type_name(gtype));
+    desc = lookup_prop_desc(gtype, js_prop_name);
 
-    klass = g_type_class_ref(gtype);
-    param_spec = g_object_class_find_property(G_OBJECT_CLASS(klass),
-                                              gname);
-    g_type_class_unref(klass);
-    g_free(gname);
-
-    if (param_spec == NULL) {
+    if (desc->pspec == NULL) {
         /* not a GObject prop, so nothing else to do */
         return NO_SUCH_G_PROPERTY;
     }
 
     /* Do not set JS overridden properties through GObject, to avoid
      * infinite recursion (but set them when constructing) */
-    if (!constructing &&
-        g_param_spec_get_qdata(param_spec, gwkjs_is_custom_property_quark()))
+    if (!constructing && desc->custom)
         return NO_SUCH_G_PROPERTY;
 
 
-    if ((param_spec->flags & G_PARAM_WRITABLE) == 0) {
+    if (!desc->writable) {
         /* prevent setting the prop even in JS */
         gwkjs_throw(context, "Property %s (GObject %s) is not writable",
-                     js_prop_name, param_spec->name);
+                     js_prop_name, desc->pspec->name);
         return SOME_ERROR_OCCURRED;
     }
 
     gwkjs_debug_jsprop(GWKJS_DEBUG_GOBJECT,
                      "Syncing %s to GObject prop %s",
-                     js_prop_name, param_spec->name);
+                     js_prop_name, desc->pspec->name);
 
-    g_value_init(&parameter->value, G_PARAM_SPEC_VALUE_TYPE(param_spec));
-    if (!gwkjs_value_to_g_value(context, js_value, &parameter->value)) {
+    g_value_init(&parameter->value, desc->value_type);
+    if (!desc->from_js(context, js_value, &parameter->value)) {
         g_value_unset(&parameter->value);
         return SOME_ERROR_OCCURRED;
     }
 
-    parameter->name = param_spec->name;
+    parameter->name = desc->pspec->name;
 
     return VALUE_WAS_SET;
 }
@@ -267,6 +401,40 @@ proto_priv_from_js(JSContextRef context,
     return priv_from_js(proto);
 }
 
+/* Resolution only defines things on prototypes (see
+ * object_instance_new_resolve()), so the answer for a name is the same
+ * for every instance and is kept on the prototype.
+ */
+static JSValueRef
+resolve_prototype_prop(JSContextRef    context,
+                       JSObjectRef     obj,
+                       ObjectInstance *priv,
+                       const char     *name)
+{
+    JSValueRef resolved = NULL;
+    gpointer cached;
+    GQuark key;
+
+    /* An instance whose GObject isn't set up yet */
+    if (priv->resolved == NULL) {
+        object_instance_new_resolve(context, obj, name, &resolved);
+        return resolved;
+    }
+
+    key = g_quark_from_string(name);
+    if (g_hash_table_lookup_extended(priv->resolved, GUINT_TO_POINTER(key),
+                                     NULL, &cached))
+        return (JSValueRef) cached;
+
+    /* Defining a method can come back here for the same name */
+    g_hash_table_insert(priv->resolved, GUINT_TO_POINTER(key), NULL);
+    object_instance_new_resolve(context, obj, name, &resolved);
+    if (resolved)
+        g_hash_table_insert(priv->resolved, GUINT_TO_POINTER(key), (gpointer) resolved);
+
+    return resolved;
+}
+
 static JSValueRef
 object_instance_get_prop(JSContextRef context,
                       JSObjectRef obj,
@@ -274,14 +442,13 @@ object_instance_get_prop(JSContextRef context,
                       JSValueRef* exception)
 {
     ObjectInstance *priv;
+    char name_buf[PROP_NAME_BUF_SIZE];
     char *name;
-    char *gname;
-    GParamSpec *param;
+    const PropDesc *desc;
     GValue gvalue = { 0, };
     JSValueRef ret = NULL;
-    JSValueRef tryOut = NULL;
 
-    name = gwkjs_jsstring_to_cstring(property_name);
+    name = prop_name_to_cstring(property_name, name_buf, sizeof(name_buf));
 
     priv = priv_from_js(obj);
     gwkjs_debug_jsprop(GWKJS_DEBUG_GOBJECT,
@@ -296,49 +463,34 @@ object_instance_get_prop(JSContextRef context,
     }
     g_assert(priv->signature == ObjectInstanceSignature);
 
-    if (g_hash_table_contains(priv->modules, name)) {
-        ret = (JSValueRef) g_hash_table_lookup(priv->modules, name);
+    if (priv->gobj == NULL) { /* prototype, not an instance. */
+        ret = resolve_prototype_prop(context, obj, priv, name);
         goto out;
     }
 
-    g_hash_table_replace(priv->modules, g_strdup(name), NULL);
-    object_instance_new_resolve(context, obj, name, &tryOut);
-    if (tryOut) {
-        g_hash_table_replace(priv->modules, g_strdup(name), (void*)tryOut);
-        ret = tryOut;
-        goto out;
-    }
-
-
-    if (priv->gobj == NULL) /* prototype, not an instance. */
-        goto out;
+    desc = lookup_prop_desc(G_TYPE_FROM_INSTANCE(priv->gobj), name);
 
-    gname = gwkjs_hyphen_from_camel(name);
-    param = g_object_class_find_property(G_OBJECT_GET_CLASS(priv->gobj),
-                                         gname);
-    g_free(gname);
-
-    if (param == NULL) {
+    if (desc->pspec == NULL) {
         /* leave value_p as it was */
         goto out;
     }
 
     /* Do not fetch JS overridden properties from GObject, to avoid
      * infinite recursion. */
-    if (g_param_spec_get_qdata(param, gwkjs_is_custom_property_quark()))
+    if (desc->custom)
         goto out;
 
-    if ((param->flags & G_PARAM_READABLE) == 0)
+    if (!desc->readable)
         goto out;
 
     gwkjs_debug_jsprop(GWKJS_DEBUG_GOBJECT,
                      "Overriding %s with GObject prop %s",
-                     name, param->name);
+                     name, desc->pspec->name);
 
-    g_value_init(&gvalue, G_PARAM_SPEC_VALUE_TYPE(param));
-    g_object_get_property(priv->gobj, param->name,
+    g_value_init(&gvalue, desc->value_type);
+    g_object_get_property(priv->gobj, desc->pspec->name,
                           &gvalue);
-    if (!gwkjs_value_from_g_value(context, &ret, &gvalue)) {
+    if (!desc->to_js(context, &ret, &gvalue)) {
         g_value_unset(&gvalue);
         goto out;
     }
@@ -350,7 +502,8 @@ object_instance_get_prop(JSContextRef context,
 //    else
 //        g_warning("object_instance_get_prop is NOT! NULL for %p %s", obj, name);
 
-    g_free(name);
+    if (name != name_buf)
+        g_free(name);
     return ret;
 }
 
@@ -365,11 +518,12 @@ object_instance_set_prop(JSContextRef ctx,
                          JSValueRef* exception)
 {
     ObjectInstance *priv = NULL;
+    char name_buf[PROP_NAME_BUF_SIZE];
     char *name = NULL;
     GParameter param = { NULL, { 0, }};
     JSBool ret = FALSE;
 
-    name = gwkjs_jsstring_to_cstring(propertyName);
+    name = prop_name_to_cstring(propertyName, name_buf, sizeof(name_buf));
 
     priv = priv_from_js(obj);
     gwkjs_debug_jsprop(GWKJS_DEBUG_GOBJECT,
@@ -409,7 +563,8 @@ object_instance_set_prop(JSContextRef ctx,
 
  out:
 //    g_warning("object_instance_SET_prop for %s %p == %p   |  %d", name, obj, value, ret);
-    g_free(name);
+    if (name != name_buf)
+        g_free(name);
     return ret;
 }
 
@@ -853,16 +1008,18 @@ cancel_toggle_idle(GObject         *gobj,
                    ToggleDirection  direction)
 {
     GQuark qdata_key;
-    GSource *source;
+    ToggleRefNotifyOperation *operation;
 
     qdata_key = get_qdata_key_for_toggle_direction(direction);
 
-    source = (GSource*) g_object_steal_qdata(gobj, qdata_key);
+    operation = (ToggleRefNotifyOperation *) g_object_steal_qdata(gobj, qdata_key);
 
-    if (source)
-        g_source_destroy(source);
+    /* It stays in the queue, but the drain will skip it without
+     * touching the object */
+    if (operation)
+        operation->cancelled = TRUE;
 
-    return source != 0;
+    return operation != NULL;
 }
 
 static void
@@ -919,11 +1076,10 @@ handle_toggle_up(GObject   *gobj)
      * in case the wrapper has data in it that the app cares about
      */
     if (priv->keep_alive == NULL) {
-        /* FIXME: thread the context through somehow. Maybe by looking up
-         * the compartment that obj belongs to. */
-        GwkjsContext *context = gwkjs_context_get_current();
+        /* Back into the keep-alive of the context the wrapper was
+         * made in, not whichever context is current */
         gwkjs_debug_lifecycle(GWKJS_DEBUG_GOBJECT, "Adding object to keep alive");
-        priv->keep_alive = gwkjs_keep_alive_get_global((JSContextRef) gwkjs_context_get_native_context(context));
+        priv->keep_alive = gwkjs_keep_alive_get_global(priv->context);
         gwkjs_keep_alive_add_child(priv->keep_alive,
                                  gobj_no_longer_kept_alive_func,
                                  obj,
@@ -931,14 +1087,15 @@ handle_toggle_up(GObject   *gobj)
     }
 }
 
-static gboolean
-idle_handle_toggle(gpointer data)
+static void
+handle_queued_toggle(ToggleRefNotifyOperation *operation)
 {
-    ToggleRefNotifyOperation *operation = (ToggleRefNotifyOperation *) data;
+    if (operation->cancelled)
+        return;
 
     if (!clear_toggle_idle_source(operation->gobj, operation->direction)) {
         /* Already cleared, the JSObject is going away, abort mission */
-        goto out;
+        return;
     }
 
     switch (operation->direction) {
@@ -951,9 +1108,6 @@ idle_handle_toggle(gpointer data)
         default:
             g_assert_not_reached();
     }
-
-out:
-    return FALSE;
 }
 
 static void
@@ -962,7 +1116,115 @@ toggle_ref_notify_operation_free(ToggleRefNotifyOperation *operation)
     if (operation->needs_unref)
         g_object_unref (operation->gobj);
     g_slice_free(ToggleRefNotifyOperation, operation);
-    g_atomic_int_add(&pending_idle_toggles, -1);
+}
+
+#define TOGGLE_QUEUE_INITIAL_SIZE 64
+
+/* Operations taken off the queue per lock acquisition */
+#define TOGGLE_DRAIN_BATCH 64
+
+/* Operations handled per idle dispatch, so that a burst of toggles
+ * doesn't keep the rest of the main loop waiting */
+#define TOGGLE_DRAIN_MAX 4096
+
+/* Handles up to @max queued toggles on the JS thread; returns the
+ * number handled. */
+static guint
+toggle_queue_drain(guint max)
+{
+    ToggleQueue *queue = &toggle_queue;
+    ToggleRefNotifyOperation *batch[TOGGLE_DRAIN_BATCH];
+    guint drained = 0;
+
+    while (drained < max) {
+        guint n, i;
+
+        g_mutex_lock(&queue->lock);
+        n = MIN(queue->length, MIN(max - drained, TOGGLE_DRAIN_BATCH));
+        for (i = 0; i < n; i++) {
+            batch[i] = queue->ops[queue->head];
+            queue->head = (queue->head + 1) & (queue->capacity - 1);
+        }
+        queue->length -= n;
+        g_mutex_unlock(&queue->lock);
+
+        if (n == 0)
+            break;
+
+        /* Handling a toggle can queue another one (e.g. by dropping
+         * the last extra ref of some other object), so the lock
+         * is not held here */
+        for (i = 0; i < n; i++) {
+            handle_queued_toggle(batch[i]);
+            toggle_ref_notify_operation_free(batch[i]);
+        }
+
+        drained += n;
+    }
+
+    return drained;
+}
+
+static gboolean
+toggle_queue_drain_idle(gpointer data)
+{
+    ToggleQueue *queue = &toggle_queue;
+    gint64 now = g_get_monotonic_time();
+    gboolean more;
+
+    g_mutex_lock(&queue->lock);
+    GWKJS_MAX_STAT(toggle_max_wait_usec, (gint) MIN(now - queue->scheduled_at, G_MAXINT));
+    g_mutex_unlock(&queue->lock);
+
+    GWKJS_INC_STAT(toggle_drains);
+    toggle_queue_drain(TOGGLE_DRAIN_MAX);
+
+    g_mutex_lock(&queue->lock);
+    more = queue->length > 0;
+    if (more)
+        queue->scheduled_at = now;
+    else
+        queue->idle_id = 0;
+    g_mutex_unlock(&queue->lock);
+
+    return more;
+}
+
+static void
+toggle_queue_push(ToggleRefNotifyOperation *operation)
+{
+    ToggleQueue *queue = &toggle_queue;
+
+    g_mutex_lock(&queue->lock);
+
+    if (queue->length == queue->capacity) {
+        guint new_capacity = queue->capacity ? queue->capacity * 2 : TOGGLE_QUEUE_INITIAL_SIZE;
+        ToggleRefNotifyOperation **ops = g_new(ToggleRefNotifyOperation *, new_capacity);
+        guint i;
+
+        for (i = 0; i < queue->length; i++)
+            ops[i] = queue->ops[(queue->head + i) & (queue->capacity - 1)];
+
+        g_free(queue->ops);
+        queue->ops = ops;
+        queue->capacity = new_capacity;
+        queue->head = 0;
+    }
+
+    queue->ops[(queue->head + queue->length) & (queue->capacity - 1)] = operation;
+    queue->length++;
+
+    GWKJS_INC_STAT(toggle_queued);
+    GWKJS_MAX_STAT(toggle_queue_peak, (gint) queue->length);
+
+    if (queue->idle_id == 0) {
+        queue->scheduled_at = g_get_monotonic_time();
+        queue->idle_id = g_idle_add_full(G_PRIORITY_HIGH,
+                                         toggle_queue_drain_idle,
+                                         NULL, NULL);
+    }
+
+    g_mutex_unlock(&queue->lock);
 }
 
 static void
@@ -971,7 +1233,6 @@ queue_toggle_idle(GObject         *gobj,
 {
     ToggleRefNotifyOperation *operation;
     GQuark qdata_key;
-    GSource *source;
 
     operation = g_slice_new0(ToggleRefNotifyOperation);
     operation->direction = direction;
@@ -1003,19 +1264,9 @@ queue_toggle_idle(GObject         *gobj,
 
     qdata_key = get_qdata_key_for_toggle_direction(direction);
 
-    source = g_idle_source_new();
-    g_source_set_priority(source, G_PRIORITY_HIGH);
-    g_source_set_callback(source,
-                          idle_handle_toggle,
-                          operation,
-                          (GDestroyNotify) toggle_ref_notify_operation_free);
-
-    g_atomic_int_inc(&pending_idle_toggles);
-    g_object_set_qdata (gobj, qdata_key, source);
-    g_source_attach (source, NULL);
-
-    /* object qdata is piggy-backing off the main loop's ref of the source */
-    g_source_unref (source);
+    /* The qdata marks the object as queued; the queue owns the operation */
+    g_object_set_qdata (gobj, qdata_key, operation);
+    toggle_queue_push(operation);
 }
 
 static void
@@ -1149,11 +1400,8 @@ gwkjs_object_prepare_shutdown (JSContextRef context)
     if (!keep_alive)
         return;
 
-    /* First, get rid of anything left over on the main context */
-    while (g_main_context_pending(NULL) &&
-           g_atomic_int_get(&pending_idle_toggles) > 0) {
-        g_main_context_iteration(NULL, FALSE);
-    }
+    /* First, get rid of any toggles still waiting in the queue */
+    toggle_queue_drain(G_MAXUINT);
 
     /* Now, we iterate over all of the objects, breaking the JS <-> C
      * associaton.  We avoid the potential recursion implied in:
@@ -1170,6 +1418,11 @@ gwkjs_object_prepare_shutdown (JSContextRef context)
     }
 }
 
+/* Rough cost of the per-instance name table wrappers used to carry:
+ * an empty GHashTable plus its initial 8 buckets.
+ */
+#define INSTANCE_RESOLVE_TABLE_SIZE (sizeof(gpointer) * 12 + 8 * (2 * sizeof(gpointer) + sizeof(guint)))
+
 static ObjectInstance *
 init_object_private (JSContextRef context,
                      JSObjectRef  object)
@@ -1179,9 +1432,9 @@ init_object_private (JSContextRef context,
 
     priv = g_slice_new0(ObjectInstance);
     priv->signature = ObjectInstanceSignature;
-    priv->modules = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
     GWKJS_INC_COUNTER(object);
+    GWKJS_ADD_STAT(resolve_bytes_saved, (gint) INSTANCE_RESOLVE_TABLE_SIZE);
 
     g_assert(priv_from_js(object) == NULL);
     JSObjectSetPrivate(object, priv);
@@ -1230,6 +1483,7 @@ associate_js_gobject (JSContextRef      context,
      * the wrapper to be garbage collected (and thus unref the
      * wrappee).
      */
+    priv->context = JSContextGetGlobalContext(context);
     priv->keep_alive = gwkjs_keep_alive_get_global(context);
     gwkjs_keep_alive_add_child(priv->keep_alive,
                              gobj_no_longer_kept_alive_func,
@@ -1238,6 +1492,7 @@ associate_js_gobject (JSContextRef      context,
 
     g_object_add_toggle_ref(gobj, wrapped_gobj_toggle_notify, NULL);
 
+    gwkjs_report_native_size(context, G_OBJECT_TYPE(gobj), gobj);
 }
 
 //static void
@@ -1595,100 +1850,169 @@ signal_connection_invalidated (gpointer  user_data,
     g_slice_free(ConnectData, connect_data);
 }
 
+/* A signal name as parsed on a given GType, cached on the type so that
+ * connect() and emit() don't parse it again. */
+typedef struct {
+    guint signal_id;            /* 0 if there is no such signal */
+    GQuark detail;
+} SignalName;
+
+static GQuark
+gwkjs_signal_cache_quark (void)
+{
+    static GQuark val = 0;
+    if (G_UNLIKELY (!val))
+        val = g_quark_from_static_string ("gwkjs::signal-cache");
+
+    return val;
+}
+
+static const SignalName *
+lookup_signal_name(GType       gtype,
+                   const char *signal_name)
+{
+    GHashTable *cache;
+    SignalName *entry;
+    GQuark key;
+
+    cache = (GHashTable *) g_type_get_qdata(gtype, gwkjs_signal_cache_quark());
+    if (cache == NULL) {
+        cache = g_hash_table_new(NULL, NULL);
+        g_type_set_qdata(gtype, gwkjs_signal_cache_quark(), cache);
+    }
+
+    key = g_quark_from_string(signal_name);
+    entry = (SignalName *) g_hash_table_lookup(cache, GUINT_TO_POINTER(key));
+    if (entry != NULL)
+        return entry;
+
+    entry = g_slice_new0(SignalName);
+    if (!g_signal_parse_name(signal_name, gtype,
+                             &entry->signal_id, &entry->detail, TRUE))
+        entry->signal_id = 0;
+
+    g_hash_table_insert(cache, GUINT_TO_POINTER(key), entry);
+    return entry;
+}
+
+/* Common checks for connect() and emit(); returns the instance private
+ * and the signal name (@buf, or a string to g_free()) on success.
+ */
+static ObjectInstance *
+signal_func_setup(JSContextRef     context,
+                  JSObjectRef      obj,
+                  const char      *what,
+                  size_t           argumentCount,
+                  const JSValueRef arguments[],
+                  JSValueRef      *exception,
+                  char            *buf,
+                  gsize            buf_size,
+                  char           **signal_name_p)
+{
+    ObjectInstance *priv;
+    JSStringRef signal_name;
+
+    if (!do_base_typecheck(context, obj, JS_TRUE))
+        return NULL;
+
+    priv = priv_from_js(obj);
+    gwkjs_debug_gsignal("%s obj %p priv %p argc %d", what, obj, priv, (int) argumentCount);
+
+    if (priv == NULL) {
+        throw_priv_is_null_error(context);
+        return NULL; /* wrong class passed in */
+    }
+
+    if (priv->gobj == NULL) {
+        /* prototype, not an instance. */
+        gwkjs_make_exception(context, exception, "Error",
+                             "Can't %s signals on %s.%s.prototype; only on instances",
+                             what,
+                             priv->info ? g_base_info_get_namespace( (GIBaseInfo*) priv->info) : "",
+                             priv->info ? g_base_info_get_name( (GIBaseInfo*) priv->info) : g_type_name(priv->gtype));
+        return NULL;
+    }
+
+    if (argumentCount < 1 || !JSValueIsString(context, arguments[0])) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "%s() first arg is the signal name", what);
+        return NULL;
+    }
+
+    signal_name = JSValueToStringCopy(context, arguments[0], NULL);
+    *signal_name_p = prop_name_to_cstring(signal_name, buf, buf_size);
+    JSStringRelease(signal_name);
+
+    return priv;
+}
+
 static JSValueRef
 real_connect_func(JSContextRef context,
-                  JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception, gboolean after)
+                  JSObjectRef function, JSObjectRef obj, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception, gboolean after)
 {
-    g_warning("real_connect_func NOT IMPLEMENTED");
-    return JSValueMakeUndefined(context);
+    ObjectInstance *priv;
+    char name_buf[PROP_NAME_BUF_SIZE];
+    char *signal_name = NULL;
+    const SignalName *signal;
+    GClosure *closure;
+    ConnectData *connect_data;
+    gulong id;
+    JSValueRef retval = NULL;
 
-//    JS::CallArgs argv = JS::CallArgsFromVp (argc, vp);
-//    JSObjectRef obj = JSVAL_TO_OBJECT(argv.thisv());
-//
-//    ObjectInstance *priv;
-//    GClosure *closure;
-//    gulong id;
-//    guint signal_id;
-//    char *signal_name;
-//    GQuark signal_detail;
-//    jsval retval;
-//    ConnectData *connect_data;
-//    JSBool ret = JS_FALSE;
-//
-//    if (!do_base_typecheck(context, obj, JS_TRUE))
-//        return JS_FALSE;
-//
-//    priv = priv_from_js(context, obj);
-//    gwkjs_debug_gsignal("connect obj %p priv %p argc %d", obj, priv, argc);
-//    if (priv == NULL) {
-//        throw_priv_is_null_error(context);
-//        return JS_FALSE; /* wrong class passed in */
-//    }
-//    if (priv->gobj == NULL) {
-//        /* prototype, not an instance. */
-//        gwkjs_throw(context, "Can't connect to signals on %s.%s.prototype; only on instances",
-//                  priv->info ? g_base_info_get_namespace( (GIBaseInfo*) priv->info) : "",
-//                  priv->info ? g_base_info_get_name( (GIBaseInfo*) priv->info) : g_type_name(priv->gtype));
-//        return JS_FALSE;
-//    }
-//
-//    /* Best I can tell, there is no way to know if argv[1] is really
-//     * callable other than to just try it. Checking whether it's a
-//     * function will not detect native objects that provide
-//     * JSClass::call, for example.
-//     */
-//
-//    if (argc != 2 ||
-//        !JSVAL_IS_STRING(argv[0]) ||
-//        !JSVAL_IS_OBJECT(argv[1])) {
-//        gwkjs_throw(context, "connect() takes two args, the signal name and the callback");
-//        return JS_FALSE;
-//    }
-//
-//    if (!gwkjs_string_to_utf8(context, argv[0], &signal_name)) {
-//        return JS_FALSE;
-//    }
-//
-//    if (!g_signal_parse_name(signal_name,
-//                             G_OBJECT_TYPE(priv->gobj),
-//                             &signal_id,
-//                             &signal_detail,
-//                             TRUE)) {
-//        gwkjs_throw(context, "No signal '%s' on object '%s'",
-//                     signal_name,
-//                     g_type_name(G_OBJECT_TYPE(priv->gobj)));
-//        goto out;
-//    }
-//
-//    closure = gwkjs_closure_new_for_signal(context, JSVAL_TO_OBJECT(argv[1]), "signal callback", signal_id);
-//    if (closure == NULL)
-//        goto out;
-//
-//    connect_data = g_slice_new(ConnectData);
-//    priv->signals = g_list_prepend(priv->signals, connect_data);
-//    connect_data->obj = priv;
-//    connect_data->link = priv->signals;
-//    /* This is a weak reference, and will be cleared when the closure is invalidated */
-//    connect_data->closure = closure;
-//    g_closure_add_invalidate_notifier(closure, connect_data, signal_connection_invalidated);
-//
-//    id = g_signal_connect_closure_by_id(priv->gobj,
-//                                        signal_id,
-//                                        signal_detail,
-//                                        closure,
-//                                        after);
-//
-//    if (!JS_NewNumberValue(context, id, &retval)) {
-//        g_signal_handler_disconnect(priv->gobj, id);
-//        goto out;
-//    }
-//    
-//    argv.rval().set(retval);
-//
-//    ret = JS_TRUE;
-// out:
-//    g_free(signal_name);
-//    return ret;
+    priv = signal_func_setup(context, obj, "connect", argumentCount, arguments,
+                             exception, name_buf, sizeof(name_buf), &signal_name);
+    if (priv == NULL)
+        return NULL;
+
+    /* Best I can tell, there is no way to know if argv[1] is really
+     * callable other than to just try it.
+     */
+    if (argumentCount != 2 ||
+        !JSValueIsObject(context, arguments[1])) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "connect() takes two args, the signal name and the callback");
+        goto out;
+    }
+
+    signal = lookup_signal_name(G_OBJECT_TYPE(priv->gobj), signal_name);
+    if (signal->signal_id == 0) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "No signal '%s' on object '%s'",
+                             signal_name,
+                             g_type_name(G_OBJECT_TYPE(priv->gobj)));
+        goto out;
+    }
+
+    /* The callable stays rooted until the handler is disconnected or the
+     * emitter is finalized; a handler that refers to its own emitter
+     * therefore keeps both alive until disconnect() (see closure.cpp).
+     */
+    closure = gwkjs_closure_new_for_signal(context,
+                                           JSValueToObject(context, arguments[1], NULL),
+                                           "signal callback", signal->signal_id);
+    if (closure == NULL)
+        goto out;
+
+    connect_data = g_slice_new(ConnectData);
+    priv->signals = g_list_prepend(priv->signals, connect_data);
+    connect_data->obj = priv;
+    connect_data->link = priv->signals;
+    /* This is a weak reference, and will be cleared when the closure is invalidated */
+    connect_data->closure = closure;
+    g_closure_add_invalidate_notifier(closure, connect_data, signal_connection_invalidated);
+
+    id = g_signal_connect_closure_by_id(priv->gobj,
+                                        signal->signal_id,
+                                        signal->detail,
+                                        closure,
+                                        after);
+
+    retval = JSValueMakeNumber(context, id);
+
+ out:
+    if (signal_name != name_buf)
+        g_free(signal_name);
+    return retval;
 }
 
 static JSValueRef
@@ -1704,127 +2028,97 @@ connect_func(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, siz
 }
 
 static JSValueRef
-emit_func(JSContextRef ctx, JSObjectRef function, JSObjectRef thisObject, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
+emit_func(JSContextRef context, JSObjectRef function, JSObjectRef obj, size_t argumentCount, const JSValueRef arguments[], JSValueRef* exception)
 {
-    g_warning("emit_func NOT IMPLEMENTED");
-    return NULL;
-//    JS::CallArgs argv = JS::CallArgsFromVp (argc, vp);
-//    JSObjectRef obj = JSVAL_TO_OBJECT(argv.thisv());
-//
-//    ObjectInstance *priv;
-//    guint signal_id;
-//    GQuark signal_detail;
-//    GSignalQuery signal_query;
-//    char *signal_name;
-//    GValue *instance_and_args;
-//    GValue rvalue = G_VALUE_INIT;
-//    unsigned int i;
-//    gboolean failed;
-//    jsval retval;
-//    JSBool ret = JS_FALSE;
-//
-//    if (!do_base_typecheck(context, obj, JS_TRUE))
-//        return JS_FALSE;
-//
-//    priv = priv_from_js(context, obj);
-//    gwkjs_debug_gsignal("emit obj %p priv %p argc %d", obj, priv, argc);
-//
-//    if (priv == NULL) {
-//        throw_priv_is_null_error(context);
-//        return JS_FALSE; /* wrong class passed in */
-//    }
-//
-//    if (priv->gobj == NULL) {
-//        /* prototype, not an instance. */
-//        gwkjs_throw(context, "Can't emit signal on %s.%s.prototype; only on instances",
-//                  priv->info ? g_base_info_get_namespace( (GIBaseInfo*) priv->info) : "",
-//                  priv->info ? g_base_info_get_name( (GIBaseInfo*) priv->info) : g_type_name(priv->gtype));
-//        return JS_FALSE;
-//    }
-//
-//    if (argc < 1 ||
-//        !JSVAL_IS_STRING(argv[0])) {
-//        gwkjs_throw(context, "emit() first arg is the signal name");
-//        return JS_FALSE;
-//    }
-//
-//    if (!gwkjs_string_to_utf8(context, argv[0], &signal_name))
-//        return JS_FALSE;
-//
-//    if (!g_signal_parse_name(signal_name,
-//                             G_OBJECT_TYPE(priv->gobj),
-//                             &signal_id,
-//                             &signal_detail,
-//                             FALSE)) {
-//        gwkjs_throw(context, "No signal '%s' on object '%s'",
-//                     signal_name,
-//                     g_type_name(G_OBJECT_TYPE(priv->gobj)));
-//        goto out;
-//    }
-//
-//    g_signal_query(signal_id, &signal_query);
-//
-//    if ((argc - 1) != signal_query.n_params) {
-//        gwkjs_throw(context, "Signal '%s' on %s requires %d args got %d",
-//                     signal_name,
-//                     g_type_name(G_OBJECT_TYPE(priv->gobj)),
-//                     signal_query.n_params,
-//                     argc - 1);
-//        goto out;
-//    }
-//
-//    if (signal_query.return_type != G_TYPE_NONE) {
-//        g_value_init(&rvalue, signal_query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE);
-//    }
-//
-//    instance_and_args = g_newa(GValue, signal_query.n_params + 1);
-//    memset(instance_and_args, 0, sizeof(GValue) * (signal_query.n_params + 1));
-//
-//    g_value_init(&instance_and_args[0], G_TYPE_FROM_INSTANCE(priv->gobj));
-//    g_value_set_instance(&instance_and_args[0], priv->gobj);
-//
-//    failed = FALSE;
-//    for (i = 0; i < signal_query.n_params; ++i) {
-//        GValue *value;
-//        value = &instance_and_args[i + 1];
-//
-//        g_value_init(value, signal_query.param_types[i] & ~G_SIGNAL_TYPE_STATIC_SCOPE);
-//        if ((signal_query.param_types[i] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0)
-//            failed = !gwkjs_value_to_g_value_no_copy(context, argv[i+1], value);
-//        else
-//            failed = !gwkjs_value_to_g_value(context, argv[i+1], value);
-//
-//        if (failed)
-//            break;
-//    }
-//
-//    if (!failed) {
-//        g_signal_emitv(instance_and_args, signal_id, signal_detail,
-//                       &rvalue);
-//    }
-//
-//    if (signal_query.return_type != G_TYPE_NONE) {
-//        if (!gwkjs_value_from_g_value(context,
-//                                    &retval,
-//                                    &rvalue))
-//            failed = TRUE;
-//
-//        g_value_unset(&rvalue);
-//    } else {
-//        retval = JSVAL_VOID;
-//    }
-//
-//    for (i = 0; i < (signal_query.n_params + 1); ++i) {
-//        g_value_unset(&instance_and_args[i]);
-//    }
-//
-//    if (!failed)
-//        argv.rval().set(retval);
-//
-//    ret = !failed;
-// out:
-//    g_free(signal_name);
-//    return ret;
+    ObjectInstance *priv;
+    char name_buf[PROP_NAME_BUF_SIZE];
+    char *signal_name = NULL;
+    const SignalName *signal;
+    const GwkjsSignalDesc *desc;
+    GValue *instance_and_args;
+    GValue rvalue = G_VALUE_INIT;
+    guint n_params;
+    guint i;
+    gboolean failed;
+    jsval retval = NULL;
+
+    priv = signal_func_setup(context, obj, "emit", argumentCount, arguments,
+                             exception, name_buf, sizeof(name_buf), &signal_name);
+    if (priv == NULL)
+        return NULL;
+
+    signal = lookup_signal_name(G_OBJECT_TYPE(priv->gobj), signal_name);
+    if (signal->signal_id == 0) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "No signal '%s' on object '%s'",
+                             signal_name,
+                             g_type_name(G_OBJECT_TYPE(priv->gobj)));
+        goto out;
+    }
+
+    desc = gwkjs_signal_desc_get(signal->signal_id);
+    n_params = desc->query.n_params;
+
+    if ((argumentCount - 1) != n_params) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "Signal '%s' on %s requires %d args got %d",
+                             signal_name,
+                             g_type_name(G_OBJECT_TYPE(priv->gobj)),
+                             n_params,
+                             (int) argumentCount - 1);
+        goto out;
+    }
+
+    if (desc->return_type != G_TYPE_NONE) {
+        g_value_init(&rvalue, desc->return_type);
+    }
+
+    instance_and_args = g_newa(GValue, n_params + 1);
+    memset(instance_and_args, 0, sizeof(GValue) * (n_params + 1));
+
+    g_value_init(&instance_and_args[0], G_TYPE_FROM_INSTANCE(priv->gobj));
+    g_value_set_instance(&instance_and_args[0], priv->gobj);
+
+    failed = FALSE;
+    for (i = 0; i < n_params; ++i) {
+        const GwkjsSignalParam *param = &desc->params[i];
+        GValue *value = &instance_and_args[i + 1];
+
+        g_value_init(value, param->gtype);
+        if (!param->from_js(context, arguments[i + 1], value)) {
+            failed = TRUE;
+            break;
+        }
+    }
+
+    if (!failed) {
+        g_signal_emitv(instance_and_args, signal->signal_id, signal->detail,
+                       &rvalue);
+    }
+
+    if (desc->return_type != G_TYPE_NONE) {
+        if (!failed &&
+            !gwkjs_value_from_g_value(context,
+                                      &retval,
+                                      &rvalue))
+            failed = TRUE;
+
+        g_value_unset(&rvalue);
+    } else {
+        retval = JSValueMakeUndefined(context);
+    }
+
+    for (i = 0; i < (n_params + 1); ++i) {
+        g_value_unset(&instance_and_args[i]);
+    }
+
+    if (failed)
+        retval = NULL;
+
+ out:
+    if (signal_name != name_buf)
+        g_free(signal_name);
+    return retval;
 }
 
 static JSValueRef
@@ -2082,7 +2376,7 @@ gwkjs_define_object_class(JSContextRef      context,
     GWKJS_INC_COUNTER(object);
     priv = g_slice_new0(ObjectInstance);
     priv->signature = ObjectInstanceSignature;
-    priv->modules = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    priv->resolved = g_hash_table_new(NULL, NULL);
     priv->info = info;
     if (info)
         g_base_info_ref((GIBaseInfo*) info);
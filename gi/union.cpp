@@ -245,6 +245,7 @@ GWKJS_NATIVE_CONSTRUCTOR_DECLARE(union)
      * owned by us.
      */
     priv->gboxed = g_boxed_copy(priv->gtype, gboxed);
+    gwkjs_report_native_size(context, priv->gtype, priv->gboxed);
 
     gwkjs_debug_lifecycle(GWKJS_DEBUG_GBOXED,
                         "JSObject created with union instance %p type %s",
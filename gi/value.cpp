@@ -107,236 +107,354 @@ gwkjs_value_from_array_and_length_values(JSContextRef    context,
     array_arg.v_pointer = g_value_get_pointer(array_value);
 
     return gwkjs_value_from_explicit_array(context, value_p, array_type_info,
-                                         &array_arg, gwkjs_jsvalue_to_int(context, array_length, NULL));
+                                         GI_TRANSFER_NOTHING, &array_arg,
+                                         gwkjs_jsvalue_to_int(context, array_length, NULL),
+                                         GWKJS_ARRAY_FLAGS_NONE);
+}
+
+static JSBool
+value_int_to_js(JSContextRef context, jsval *value_p, const GValue *gvalue)
+{
+    *value_p = JSValueMakeNumber(context, g_value_get_int(gvalue));
+    return JS_TRUE;
+}
+
+static JSBool
+value_uint_to_js(JSContextRef context, jsval *value_p, const GValue *gvalue)
+{
+    *value_p = JSValueMakeNumber(context, g_value_get_uint(gvalue));
+    return JS_TRUE;
+}
+
+static JSBool
+value_double_to_js(JSContextRef context, jsval *value_p, const GValue *gvalue)
+{
+    *value_p = JSValueMakeNumber(context, g_value_get_double(gvalue));
+    return JS_TRUE;
+}
+
+static JSBool
+value_float_to_js(JSContextRef context, jsval *value_p, const GValue *gvalue)
+{
+    *value_p = JSValueMakeNumber(context, g_value_get_float(gvalue));
+    return JS_TRUE;
+}
+
+static JSBool
+value_boolean_to_js(JSContextRef context, jsval *value_p, const GValue *gvalue)
+{
+    *value_p = JSValueMakeBoolean(context, !!g_value_get_boolean(gvalue));
+    return JS_TRUE;
+}
+
+/* The from-JS converters only handle the kind of value they expect and
+ * defer anything else to gwkjs_value_to_g_value() for its type checks
+ * and error reporting.
+ */
+static JSBool
+value_int_from_js(JSContextRef context, jsval value, GValue *gvalue)
+{
+    if (!JSValueIsNumber(context, value))
+        return gwkjs_value_to_g_value(context, value, gvalue);
+
+    g_value_set_int(gvalue, (gint) JSValueToNumber(context, value, NULL));
+    return JS_TRUE;
+}
+
+static JSBool
+value_uint_from_js(JSContextRef context, jsval value, GValue *gvalue)
+{
+    if (!JSValueIsNumber(context, value))
+        return gwkjs_value_to_g_value(context, value, gvalue);
+
+    g_value_set_uint(gvalue, (guint32) (JSValueToNumber(context, value, NULL) + 0.5));
+    return JS_TRUE;
+}
+
+static JSBool
+value_double_from_js(JSContextRef context, jsval value, GValue *gvalue)
+{
+    if (!JSValueIsNumber(context, value))
+        return gwkjs_value_to_g_value(context, value, gvalue);
+
+    g_value_set_double(gvalue, JSValueToNumber(context, value, NULL));
+    return JS_TRUE;
+}
+
+static JSBool
+value_float_from_js(JSContextRef context, jsval value, GValue *gvalue)
+{
+    if (!JSValueIsNumber(context, value))
+        return gwkjs_value_to_g_value(context, value, gvalue);
+
+    g_value_set_float(gvalue, JSValueToNumber(context, value, NULL));
+    return JS_TRUE;
+}
+
+static JSBool
+value_boolean_from_js(JSContextRef context, jsval value, GValue *gvalue)
+{
+    if (!JSValueIsBoolean(context, value))
+        return gwkjs_value_to_g_value(context, value, gvalue);
+
+    g_value_set_boolean(gvalue, JSValueToBoolean(context, value));
+    return JS_TRUE;
+}
+
+/**
+ * gwkjs_value_get_direct_converters:
+ * @gtype: a #GValue type
+ * @to_js: (out): converter from a #GValue holding @gtype
+ * @from_js: (out): converter into a #GValue initialized to @gtype
+ *
+ * For scalar types, picks converters that skip the type dispatch in
+ * gwkjs_value_{from,to}_g_value(). Callers that convert values of a
+ * known type over and over can look them up once.
+ *
+ * Returns: %FALSE (leaving @to_js and @from_js alone) if @gtype has
+ *  to go through the generic conversion.
+ */
+gboolean
+gwkjs_value_get_direct_converters(GType                 gtype,
+                                  GwkjsValueToJSFunc   *to_js,
+                                  GwkjsValueFromJSFunc *from_js)
+{
+    switch (gtype) {
+    case G_TYPE_INT:
+        *to_js = value_int_to_js;
+        *from_js = value_int_from_js;
+        return TRUE;
+    case G_TYPE_UINT:
+        *to_js = value_uint_to_js;
+        *from_js = value_uint_from_js;
+        return TRUE;
+    case G_TYPE_DOUBLE:
+        *to_js = value_double_to_js;
+        *from_js = value_double_from_js;
+        return TRUE;
+    case G_TYPE_FLOAT:
+        *to_js = value_float_to_js;
+        *from_js = value_float_from_js;
+        return TRUE;
+    case G_TYPE_BOOLEAN:
+        *to_js = value_boolean_to_js;
+        *from_js = value_boolean_from_js;
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+/* signal id -> GwkjsSignalDesc; signals are never unregistered, so
+ * neither are these. Only used from the JS thread. */
+static GHashTable *signal_descs;
+
+static GwkjsSignalDesc *
+signal_desc_new(guint signal_id)
+{
+    GwkjsSignalDesc *desc;
+    GISignalInfo *signal_info;
+    guint i;
+
+    desc = g_slice_new0(GwkjsSignalDesc);
+    g_signal_query(signal_id, &desc->query);
+    desc->return_type = desc->query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE;
+    desc->params = g_new0(GwkjsSignalParam, desc->query.n_params);
+
+    for (i = 0; i < desc->query.n_params; i++) {
+        GwkjsSignalParam *param = &desc->params[i];
+        GType param_type = desc->query.param_types[i];
+
+        param->gtype = param_type & ~G_SIGNAL_TYPE_STATIC_SCOPE;
+        param->no_copy = (param_type & G_SIGNAL_TYPE_STATIC_SCOPE) != 0;
+        param->array_length_pos = -1;
+
+        if (!gwkjs_value_get_direct_converters(param->gtype,
+                                               &param->to_js,
+                                               &param->from_js))
+            param->from_js = param->no_copy ? gwkjs_value_to_g_value_no_copy
+                                            : gwkjs_value_to_g_value;
+    }
+
+    /* Arrays with a separate length parameter need the introspection
+     * data, which is only available for signals on introspected types */
+    signal_info = get_signal_info_if_available(&desc->query);
+    if (signal_info) {
+        for (i = 0; i < desc->query.n_params; i++) {
+            GIArgInfo *arg_info;
+            GITypeInfo *type_info;
+            int array_len_pos;
+
+            arg_info = g_callable_info_get_arg(signal_info, i);
+            type_info = g_arg_info_get_type(arg_info);
+            g_base_info_unref((GIBaseInfo *)arg_info);
+
+            array_len_pos = g_type_info_get_array_length(type_info);
+            if (array_len_pos >= 0 && (guint) array_len_pos < desc->query.n_params) {
+                desc->params[i].array_type_info = type_info;
+                desc->params[i].array_length_pos = array_len_pos;
+                desc->params[array_len_pos].is_array_length = TRUE;
+            } else {
+                g_base_info_unref((GIBaseInfo *)type_info);
+            }
+        }
+
+        g_base_info_unref((GIBaseInfo *)signal_info);
+    }
+
+    return desc;
+}
+
+/**
+ * gwkjs_signal_desc_get:
+ * @signal_id: a valid signal id
+ *
+ * Returns: (transfer none): the marshalling description of
+ *  @signal_id, built the first time it is asked for.
+ */
+const GwkjsSignalDesc *
+gwkjs_signal_desc_get(guint signal_id)
+{
+    GwkjsSignalDesc *desc;
+
+    if (G_UNLIKELY(signal_descs == NULL))
+        signal_descs = g_hash_table_new(NULL, NULL);
+
+    desc = (GwkjsSignalDesc *) g_hash_table_lookup(signal_descs,
+                                                   GUINT_TO_POINTER(signal_id));
+    if (desc == NULL) {
+        desc = signal_desc_new(signal_id);
+        g_hash_table_insert(signal_descs, GUINT_TO_POINTER(signal_id), desc);
+    }
+
+    return desc;
+}
+
+static void
+closure_marshal(GClosure        *closure,
+                GValue          *return_value,
+                guint            n_param_values,
+                const GValue    *param_values,
+                gpointer         invocation_hint,
+                gpointer         marshal_data)
+{
+    const GwkjsSignalDesc *desc = (const GwkjsSignalDesc *) marshal_data;
+    GSignalQuery *signal_query = NULL;
+    JSContextRef context;
+    JSValueRef *argv;
+    jsval rval = NULL;
+    int argc;
+    guint i;
+
+    gwkjs_debug_marshal(GWKJS_DEBUG_GCLOSURE,
+                      "Marshal closure %p",
+                      closure);
+
+    if (!gwkjs_closure_is_valid(closure)) {
+        /* We were destroyed; become a no-op */
+        return;
+    }
+
+    context = gwkjs_closure_get_context(closure);
+
+    if (desc) {
+        /* we are used for a signal handler */
+        if (desc->query.n_params + 1 != n_param_values) {
+            gwkjs_debug(GWKJS_DEBUG_GCLOSURE,
+                      "Signal handler being called with wrong number of parameters");
+            return;
+        }
+        signal_query = (GSignalQuery *) &desc->query;
+    }
+
+    argv = g_newa(JSValueRef, n_param_values > 0 ? n_param_values : 1);
+    argc = 0;
+
+    for (i = 0; i < n_param_values; ++i) {
+        const GValue *gval = &param_values[i];
+        const GwkjsSignalParam *param = NULL;
+        JSBool res;
+
+        /* Parameter 0 is the instance */
+        if (desc && i > 0)
+            param = &desc->params[i - 1];
+
+        if (param && param->is_array_length)
+            continue;
+
+        if (param && param->array_type_info) {
+            guint array_len_index = param->array_length_pos + 1;
+
+            res = gwkjs_value_from_array_and_length_values(context,
+                                                         &argv[argc],
+                                                         param->array_type_info,
+                                                         gval,
+                                                         &param_values[array_len_index],
+                                                         param->no_copy, signal_query,
+                                                         array_len_index);
+        } else if (param && param->to_js) {
+            res = param->to_js(context, &argv[argc], gval);
+        } else {
+            res = gwkjs_value_from_g_value_internal(context, &argv[argc], gval,
+                                                  param ? param->no_copy : FALSE,
+                                                  signal_query, i);
+        }
+
+        if (!res) {
+            gwkjs_debug(GWKJS_DEBUG_GCLOSURE,
+                      "Unable to convert arg %d in order to invoke closure",
+                      i);
+            return;
+        }
+
+        argc++;
+    }
+
+    gwkjs_closure_invoke(closure, argc, argv, &rval);
+
+    if (return_value != NULL) {
+        if (rval == NULL) {
+            /* something went wrong invoking, error should be logged already */
+            return;
+        }
+
+        if (!gwkjs_value_to_g_value(context, rval, return_value)) {
+            gwkjs_debug(GWKJS_DEBUG_GCLOSURE,
+                      "Unable to convert return value when invoking closure");
+        }
+    }
+}
+
+GClosure*
+gwkjs_closure_new_for_signal(JSContextRef  context,
+                           JSObjectRef   callable,
+                           const char *description,
+                           guint       signal_id)
+{
+    GClosure *closure;
+
+    closure = gwkjs_closure_new(context, callable, description, FALSE);
+
+    /* Resolve the parameter converters now so that emissions don't */
+    g_closure_set_meta_marshal(closure,
+                               (gpointer) gwkjs_signal_desc_get(signal_id),
+                               closure_marshal);
+
+    return closure;
 }
 
-//static void
-//closure_marshal(GClosure        *closure,
-//                GValue          *return_value,
-//                guint            n_param_values,
-//                const GValue    *param_values,
-//                gpointer         invocation_hint,
-//                gpointer         marshal_data)
-//{
-//    JSContextRef context;
-//    JSRuntime *runtime;
-//    JSObjectRef obj;
-//    int argc;
-//    jsval *argv;
-//    jsval rval;
-//    int i;
-//    GSignalQuery signal_query = { 0, };
-//    GISignalInfo *signal_info;
-//    gboolean *skip;
-//    int *array_len_indices_for;
-//    GITypeInfo **type_info_for;
-//    int argv_index;
-//
-//    gwkjs_debug_marshal(GWKJS_DEBUG_GCLOSURE,
-//                      "Marshal closure %p",
-//                      closure);
-//
-//    if (!gwkjs_closure_is_valid(closure)) {
-//        /* We were destroyed; become a no-op */
-//        return;
-//    }
-//
-//    context = gwkjs_closure_get_context(closure);
-//    runtime = JS_GetRuntime(context);
-//    if (G_UNLIKELY (gwkjs_runtime_is_sweeping(runtime))) {
-//        GSignalInvocationHint *hint = (GSignalInvocationHint*) invocation_hint;
-//
-//        g_critical("Attempting to call back into JSAPI during the sweeping phase of GC. "
-//                   "This is most likely caused by not destroying a Clutter actor or Gtk+ "
-//                   "widget with ::destroy signals connected, but can also be caused by "
-//                   "using the destroy() or dispose() vfuncs. Because it would crash the "
-//                   "application, it has been blocked and the JS callback not invoked.");
-//        if (hint) {
-//            gpointer instance;
-//            g_signal_query(hint->signal_id, &signal_query);
-//
-//            instance = g_value_peek_pointer(&param_values[0]);
-//            g_critical("The offending signal was %s on %s %p.", signal_query.signal_name,
-//                       g_type_name(G_TYPE_FROM_INSTANCE(instance)), instance);
-//        }
-//        /* A gwkjs_dumpstack() would be nice here, but we can't,
-//           because that works by creating a new Error object and
-//           reading the stack property, which is the worst possible
-//           idea during a GC session.
-//        */
-//        return;
-//    }
-//
-//    obj = gwkjs_closure_get_callable(closure);
-//    JS_BeginRequest(context);
-//    JSAutoCompartment ac(context, obj);
-//
-//    argc = n_param_values;
-//    rval = JSVAL_VOID;
-//    if (argc > 0) {
-//        argv = g_newa(jsval, n_param_values);
-//
-//        gwkjs_set_values(context, argv, argc, JSVAL_VOID);
-//        gwkjs_root_value_locations(context, argv, argc);
-//    } else {
-//        /* squash a compiler warning */
-//        argv = NULL;
-//    }
-//    JS_AddValueRoot(context, &rval);
-//
-//    if (marshal_data) {
-//        /* we are used for a signal handler */
-//        guint signal_id;
-//
-//        signal_id = GPOINTER_TO_UINT(marshal_data);
-//
-//        g_signal_query(signal_id, &signal_query);
-//
-//        if (!signal_query.signal_id) {
-//            gwkjs_debug(GWKJS_DEBUG_GCLOSURE,
-//                      "Signal handler being called on invalid signal");
-//            goto cleanup;
-//        }
-//
-//        if (signal_query.n_params + 1 != n_param_values) {
-//            gwkjs_debug(GWKJS_DEBUG_GCLOSURE,
-//                      "Signal handler being called with wrong number of parameters");
-//            goto cleanup;
-//        }
-//    }
-//
-//    /* Check if any parameters, such as array lengths, need to be eliminated
-//     * before we invoke the closure.
-//     */
-//    skip = g_newa(gboolean, argc);
-//    memset(skip, 0, sizeof (gboolean) * argc);
-//    array_len_indices_for = g_newa(int, argc);
-//    for(i = 0; i < argc; i++)
-//        array_len_indices_for[i] = -1;
-//    type_info_for = g_newa(GITypeInfo *, argc);
-//    memset(type_info_for, 0, sizeof (gpointer) * argc);
-//
-//    signal_info = get_signal_info_if_available(&signal_query);
-//    if (signal_info) {
-//        /* Start at argument 1, skip the instance parameter */
-//        for (i = 1; i < argc; ++i) {
-//            GIArgInfo *arg_info;
-//            int array_len_pos;
-//
-//            arg_info = g_callable_info_get_arg(signal_info, i - 1);
-//            type_info_for[i] = g_arg_info_get_type(arg_info);
-//
-//            array_len_pos = g_type_info_get_array_length(type_info_for[i]);
-//            if (array_len_pos != -1) {
-//                skip[array_len_pos + 1] = TRUE;
-//                array_len_indices_for[i] = array_len_pos + 1;
-//            }
-//
-//            g_base_info_unref((GIBaseInfo *)arg_info);
-//        }
-//
-//        g_base_info_unref((GIBaseInfo *)signal_info);
-//    }
-//
-//    argv_index = 0;
-//    for (i = 0; i < argc; ++i) {
-//        const GValue *gval = &param_values[i];
-//        gboolean no_copy;
-//        int array_len_index;
-//        JSBool res;
-//
-//        if (skip[i])
-//            continue;
-//
-//        no_copy = FALSE;
-//
-//        if (i >= 1 && signal_query.signal_id) {
-//            no_copy = (signal_query.param_types[i - 1] & G_SIGNAL_TYPE_STATIC_SCOPE) != 0;
-//        }
-//
-//        array_len_index = array_len_indices_for[i];
-//        if (array_len_index != -1) {
-//            const GValue *array_len_gval = &param_values[array_len_index];
-//            res = gwkjs_value_from_array_and_length_values(context,
-//                                                         &argv[argv_index],
-//                                                         type_info_for[i],
-//                                                         gval, array_len_gval,
-//                                                         no_copy, &signal_query,
-//                                                         array_len_index);
-//        } else {
-//            res = gwkjs_value_from_g_value_internal(context, &argv[argv_index],
-//                                                  gval, no_copy, &signal_query,
-//                                                  i);
-//        }
-//
-//        if (!res) {
-//            gwkjs_debug(GWKJS_DEBUG_GCLOSURE,
-//                      "Unable to convert arg %d in order to invoke closure",
-//                      i);
-//            gwkjs_log_exception(context);
-//            goto cleanup;
-//        }
-//
-//        argv_index++;
-//    }
-//
-//    for (i = 1; i < argc; i++)
-//        if (type_info_for[i])
-//            g_base_info_unref((GIBaseInfo *)type_info_for[i]);
-//
-//    gwkjs_closure_invoke(closure, argv_index, argv, &rval);
-//
-//    if (return_value != NULL) {
-//        if (JSVAL_IS_VOID(rval)) {
-//            /* something went wrong invoking, error should be set already */
-//            goto cleanup;
-//        }
-//
-//        if (!gwkjs_value_to_g_value(context, rval, return_value)) {
-//            gwkjs_debug(GWKJS_DEBUG_GCLOSURE,
-//                      "Unable to convert return value when invoking closure");
-//            gwkjs_log_exception(context);
-//            goto cleanup;
-//        }
-//    }
-//
-// cleanup:
-//    if (argc > 0)
-//        gwkjs_unroot_value_locations(context, argv, argc);
-//    JS_RemoveValueRoot(context, &rval);
-//    JS_EndRequest(context);
-//}
-//
-//GClosure*
-//gwkjs_closure_new_for_signal(JSContextRef  context,
-//                           JSObjectRef   callable,
-//                           const char *description,
-//                           guint       signal_id)
-//{
-//    GClosure *closure;
-//
-//    closure = gwkjs_closure_new(context, callable, description, FALSE);
-//
-//    g_closure_set_meta_marshal(closure, GUINT_TO_POINTER(signal_id), closure_marshal);
-//
-//    return closure;
-//}
-//
 GClosure*
 gwkjs_closure_new_marshaled (JSContextRef    context,
                            JSObjectRef     callable,
                            const char   *description)
 {
-    gwkjs_throw(context, " gwkjs_closure_new_marshaled  not implemented");
-    return NULL;
-//TODO: implement
-//    GClosure *closure;
-//
-//    closure = gwkjs_closure_new(context, callable, description, TRUE);
-//
-//    g_closure_set_marshal(closure, closure_marshal);
-//
-//    return closure;
+    GClosure *closure;
+
+    closure = gwkjs_closure_new(context, callable, description, TRUE);
+
+    g_closure_set_marshal(closure, closure_marshal);
+
+    return closure;
 }
 
 // XXX: Hack-ish, as there's no way to know
@@ -25,10 +25,42 @@
 #define __GWKJS_VALUE_H__
 
 #include <glib-object.h>
+#include <girepository.h>
 #include "gwkjs/jsapi-util.h"
 
 G_BEGIN_DECLS
 
+typedef JSBool (*GwkjsValueToJSFunc)   (JSContextRef  context,
+                                        jsval        *value_p,
+                                        const GValue *gvalue);
+typedef JSBool (*GwkjsValueFromJSFunc) (JSContextRef  context,
+                                        jsval         value,
+                                        GValue       *gvalue);
+
+/* Everything needed to marshal one signal parameter, worked out once
+ * per signal rather than on every emission.
+ */
+typedef struct {
+    GType gtype;                    /* without G_SIGNAL_TYPE_STATIC_SCOPE */
+    GITypeInfo *array_type_info;    /* C array with a length parameter, else NULL */
+    gint array_length_pos;          /* parameter holding the length, or -1 */
+    guint no_copy : 1;              /* G_SIGNAL_TYPE_STATIC_SCOPE */
+    guint is_array_length : 1;      /* consumed by an array; not passed to JS */
+    GwkjsValueToJSFunc to_js;       /* NULL: use the generic conversion */
+    GwkjsValueFromJSFunc from_js;
+} GwkjsSignalParam;
+
+typedef struct {
+    GSignalQuery query;
+    GType return_type;              /* without G_SIGNAL_TYPE_STATIC_SCOPE */
+    GwkjsSignalParam *params;       /* query.n_params entries */
+} GwkjsSignalDesc;
+
+gboolean   gwkjs_value_get_direct_converters (GType                 gtype,
+                                              GwkjsValueToJSFunc   *to_js,
+                                              GwkjsValueFromJSFunc *from_js);
+const GwkjsSignalDesc *gwkjs_signal_desc_get (guint signal_id);
+
 JSBool     gwkjs_value_to_g_value         (JSContextRef    context,
                                          jsval         value,
                                          GValue       *gvalue);
@@ -0,0 +1,138 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include "atoms.h"
+#include "mem.h"
+
+typedef struct {
+    char *name;
+    JSStringRef atom;
+    GList link;     /* in GwkjsAtomTable.lru, data points back here */
+} DynamicAtom;
+
+struct _GwkjsAtomTable {
+    JSStringRef *const_atoms;
+    guint n_const_atoms;
+
+    GHashTable *dynamic;    /* name -> DynamicAtom */
+    GQueue lru;             /* most recently used first */
+    guint max_dynamic;
+};
+
+GwkjsAtomTable *
+gwkjs_atom_table_new(const char * const *const_names,
+                     guint               n_const_names,
+                     guint               max_dynamic)
+{
+    GwkjsAtomTable *table;
+    guint i;
+
+    g_return_val_if_fail(max_dynamic > 0, NULL);
+
+    table = g_slice_new0(GwkjsAtomTable);
+    table->const_atoms = g_new(JSStringRef, n_const_names);
+    table->n_const_atoms = n_const_names;
+    for (i = 0; i < n_const_names; i++)
+        table->const_atoms[i] = JSStringCreateWithUTF8CString(const_names[i]);
+
+    table->dynamic = g_hash_table_new(g_str_hash, g_str_equal);
+    g_queue_init(&table->lru);
+    table->max_dynamic = max_dynamic;
+
+    return table;
+}
+
+static void
+dynamic_atom_free(DynamicAtom *entry)
+{
+    JSStringRelease(entry->atom);
+    g_free(entry->name);
+    g_slice_free(DynamicAtom, entry);
+}
+
+void
+gwkjs_atom_table_free(GwkjsAtomTable *table)
+{
+    guint i;
+    GList *l, *next;
+
+    for (i = 0; i < table->n_const_atoms; i++)
+        JSStringRelease(table->const_atoms[i]);
+    g_free(table->const_atoms);
+
+    for (l = table->lru.head; l; l = next) {
+        next = l->next;
+        dynamic_atom_free((DynamicAtom *) l->data);
+    }
+    g_hash_table_destroy(table->dynamic);
+
+    g_slice_free(GwkjsAtomTable, table);
+}
+
+JSStringRef
+gwkjs_atom_table_get_const(GwkjsAtomTable  *table,
+                           GwkjsConstString name)
+{
+    g_assert((guint) name < table->n_const_atoms);
+
+    return table->const_atoms[name];
+}
+
+JSStringRef
+gwkjs_atom_table_intern(GwkjsAtomTable *table,
+                        const char     *name)
+{
+    DynamicAtom *entry;
+
+    entry = (DynamicAtom *) g_hash_table_lookup(table->dynamic, name);
+    if (entry != NULL) {
+        GWKJS_INC_STAT(atom_hit);
+        if (table->lru.head != &entry->link) {
+            g_queue_unlink(&table->lru, &entry->link);
+            g_queue_push_head_link(&table->lru, &entry->link);
+        }
+        return JSStringRetain(entry->atom);
+    }
+
+    GWKJS_INC_STAT(atom_miss);
+
+    if (table->lru.length >= table->max_dynamic) {
+        DynamicAtom *oldest = (DynamicAtom *) table->lru.tail->data;
+
+        g_queue_unlink(&table->lru, &oldest->link);
+        g_hash_table_remove(table->dynamic, oldest->name);
+        /* Anyone still using it holds their own reference */
+        dynamic_atom_free(oldest);
+    }
+
+    entry = g_slice_new0(DynamicAtom);
+    entry->name = g_strdup(name);
+    entry->atom = JSStringCreateWithUTF8CString(name);
+    entry->link.data = entry;
+    g_hash_table_insert(table->dynamic, entry->name, entry);
+    g_queue_push_head_link(&table->lru, &entry->link);
+
+    return JSStringRetain(entry->atom);
+}
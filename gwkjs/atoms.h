@@ -0,0 +1,57 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GWKJS_ATOMS_H__
+#define __GWKJS_ATOMS_H__
+
+#include <glib.h>
+
+#include "jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* Interned property names. JSStringRefs aren't tied to a JS context,
+ * so a table can hand out the same string for every lookup of a name
+ * instead of creating (and, too often, leaking) one per access.
+ *
+ * Names from GwkjsConstString live as long as the table. Any other
+ * name goes into a cache that keeps only the most recently used
+ * @max_dynamic entries; gwkjs_atom_table_intern() therefore returns a
+ * new reference that the caller must JSStringRelease().
+ */
+
+typedef struct _GwkjsAtomTable GwkjsAtomTable;
+
+GwkjsAtomTable *gwkjs_atom_table_new       (const char * const *const_names,
+                                            guint               n_const_names,
+                                            guint               max_dynamic);
+void            gwkjs_atom_table_free      (GwkjsAtomTable     *table);
+
+JSStringRef     gwkjs_atom_table_get_const (GwkjsAtomTable     *table,
+                                            GwkjsConstString    name);
+JSStringRef     gwkjs_atom_table_intern    (GwkjsAtomTable     *table,
+                                            const char         *name);
+
+G_END_DECLS
+
+#endif  /* __GWKJS_ATOMS_H__ */
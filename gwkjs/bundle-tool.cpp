@@ -0,0 +1,171 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <gio/gio.h>
+
+#include "gwkjs/bundle.h"
+
+/* Packs the modules found in one or more directories into a bundle that
+ * can be put on the search path in their place; see gwkjs/bundle.h.
+ * Directories are merged like the search path would: a module in an
+ * earlier directory hides one with the same path in a later one. Any
+ * directory GIO can list works, including resource:/// URIs.
+ */
+
+static char *output = NULL;
+static char **directories = NULL;
+
+static GOptionEntry entries[] = {
+    { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the bundle to FILE", "FILE" },
+    { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &directories, NULL, "DIRECTORY..." },
+    { NULL }
+};
+
+static gboolean
+collect_modules(GFile       *root,
+                GFile       *dir,
+                GHashTable  *modules,
+                GError     **error)
+{
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    gboolean ret = TRUE;
+
+    enumerator = g_file_enumerate_children(dir,
+                                           G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                           G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                           G_FILE_QUERY_INFO_NONE,
+                                           NULL, error);
+    if (enumerator == NULL)
+        return FALSE;
+
+    while (ret && (info = g_file_enumerator_next_file(enumerator, NULL, error))) {
+        const char *name = g_file_info_get_name(info);
+        GFile *child = g_file_get_child(dir, name);
+
+        /* Skip hidden files and directories (.git, ...) like the
+         * importer does */
+        if (name[0] == '.') {
+            /* nothing */
+        } else if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+            ret = collect_modules(root, child, modules, error);
+        } else if (g_str_has_suffix(name, ".js")) {
+            char *path = g_file_get_relative_path(root, child);
+
+            if (!g_hash_table_contains(modules, path))
+                g_hash_table_insert(modules, path, g_object_ref(child));
+            else
+                g_free(path);
+        }
+
+        g_object_unref(child);
+        g_object_unref(info);
+    }
+
+    if (ret && error && *error)
+        ret = FALSE;
+
+    g_object_unref(enumerator);
+    return ret;
+}
+
+static int
+compare_strings(gconstpointer a,
+                gconstpointer b)
+{
+    return strcmp(*(const char * const *) a, *(const char * const *) b);
+}
+
+int
+main(int argc, char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GHashTable *modules;
+    GHashTableIter iter;
+    gpointer key;
+    GPtrArray *paths, *sources;
+    char **dir;
+    guint i;
+    int code = 0;
+
+    context = g_option_context_new(NULL);
+    g_option_context_set_summary(context, "Pack the JS modules in DIRECTORY... into one bundle file.");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+        g_error("option parsing failed: %s", error->message);
+    g_option_context_free(context);
+
+    if (output == NULL || directories == NULL) {
+        g_printerr("Usage: %s -o FILE DIRECTORY...\n", g_get_prgname());
+        exit(1);
+    }
+
+    modules = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+    for (dir = directories; *dir; dir++) {
+        GFile *root = g_file_new_for_commandline_arg(*dir);
+
+        if (!collect_modules(root, root, modules, &error)) {
+            g_printerr("%s: %s\n", *dir, error->message);
+            exit(1);
+        }
+        g_object_unref(root);
+    }
+
+    /* Sorted, so that the same modules always give the same bundle */
+    paths = g_ptr_array_new();
+    g_hash_table_iter_init(&iter, modules);
+    while (g_hash_table_iter_next(&iter, &key, NULL))
+        g_ptr_array_add(paths, key);
+    g_ptr_array_sort(paths, compare_strings);
+
+    sources = g_ptr_array_new_with_free_func((GDestroyNotify) g_bytes_unref);
+    for (i = 0; i < paths->len; i++) {
+        GFile *file = (GFile *) g_hash_table_lookup(modules, paths->pdata[i]);
+        char *contents;
+        gsize length;
+
+        if (!g_file_load_contents(file, NULL, &contents, &length, NULL, &error)) {
+            g_printerr("%s\n", error->message);
+            exit(1);
+        }
+        g_ptr_array_add(sources, g_bytes_new_take(contents, length));
+    }
+
+    if (!gwkjs_bundle_write(output, paths->len,
+                            (const char * const *) paths->pdata,
+                            (GBytes * const *) sources->pdata,
+                            &error)) {
+        g_printerr("%s\n", error->message);
+        code = 1;
+    }
+
+    g_ptr_array_unref(sources);
+    g_ptr_array_unref(paths);
+    g_hash_table_unref(modules);
+    exit(code);
+}
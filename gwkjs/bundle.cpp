@@ -0,0 +1,386 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "bundle.h"
+
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 16
+
+struct _GwkjsBundle {
+    char *filename;             /* without a trailing separator */
+    GBytes *bytes;              /* the mapped file */
+    GHashTable *files;          /* path -> entry index + 1; paths point into bytes */
+    GHashTable *directories;    /* path -> itself, "" for the root */
+};
+
+typedef struct {
+    guint32 path_offset;
+    guint32 path_length;
+    guint32 data_offset;
+    guint32 data_length;
+} Entry;
+
+G_LOCK_DEFINE_STATIC(bundles);
+static GPtrArray *bundles = NULL;
+
+static guint32
+read_uint32(const guint8 *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((guint32) p[3] << 24);
+}
+
+static void
+write_uint32(GByteArray *array,
+             guint32     value)
+{
+    guint8 p[4] = {
+        (guint8) value, (guint8) (value >> 8),
+        (guint8) (value >> 16), (guint8) (value >> 24),
+    };
+
+    g_byte_array_append(array, p, 4);
+}
+
+static void
+read_entry(GwkjsBundle *bundle,
+           guint        i,
+           Entry       *entry)
+{
+    const guint8 *p = (const guint8 *) g_bytes_get_data(bundle->bytes, NULL);
+
+    p += HEADER_SIZE + i * ENTRY_SIZE;
+    entry->path_offset = read_uint32(p);
+    entry->path_length = read_uint32(p + 4);
+    entry->data_offset = read_uint32(p + 8);
+    entry->data_length = read_uint32(p + 12);
+}
+
+static void
+bundle_free(GwkjsBundle *bundle)
+{
+    g_hash_table_destroy(bundle->directories);
+    g_hash_table_destroy(bundle->files);
+    g_bytes_unref(bundle->bytes);
+    g_free(bundle->filename);
+    g_slice_free(GwkjsBundle, bundle);
+}
+
+static gboolean
+bundle_index(GwkjsBundle *bundle)
+{
+    gsize size;
+    const char *data = (const char *) g_bytes_get_data(bundle->bytes, &size);
+    guint32 n_entries, i;
+
+    if (size < HEADER_SIZE ||
+        memcmp(data, GWKJS_BUNDLE_MAGIC, 8) != 0 ||
+        read_uint32((const guint8 *) data + 8) != GWKJS_BUNDLE_VERSION)
+        return FALSE;
+
+    n_entries = read_uint32((const guint8 *) data + 12);
+    if (n_entries > (size - HEADER_SIZE) / ENTRY_SIZE)
+        return FALSE;
+
+    g_hash_table_add(bundle->directories, g_strdup(""));
+
+    for (i = 0; i < n_entries; i++) {
+        Entry entry;
+        const char *path, *slash;
+
+        read_entry(bundle, i, &entry);
+        if (entry.path_offset >= size || entry.path_length >= size - entry.path_offset ||
+            entry.data_offset > size || entry.data_length > size - entry.data_offset)
+            return FALSE;
+
+        path = data + entry.path_offset;
+        if (path[entry.path_length] != '\0' || strlen(path) != entry.path_length)
+            return FALSE;
+
+        g_hash_table_insert(bundle->files, (gpointer) path, GUINT_TO_POINTER(i + 1));
+
+        for (slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+            char *directory = g_strndup(path, slash - path);
+
+            if (!g_hash_table_add(bundle->directories, directory))
+                g_free(directory);
+        }
+    }
+
+    return TRUE;
+}
+
+/* Called with the lock held */
+static GwkjsBundle *
+find_bundle(const char  *path,
+            const char **relative_path)
+{
+    guint i;
+
+    if (bundles == NULL)
+        return NULL;
+
+    for (i = 0; i < bundles->len; i++) {
+        GwkjsBundle *bundle = (GwkjsBundle *) bundles->pdata[i];
+        gsize len = strlen(bundle->filename);
+
+        if (strncmp(path, bundle->filename, len) != 0 ||
+            (path[len] != '\0' && path[len] != G_DIR_SEPARATOR))
+            continue;
+
+        path += len;
+        while (*path == G_DIR_SEPARATOR)
+            path++;
+        if (relative_path)
+            *relative_path = path;
+        return bundle;
+    }
+
+    return NULL;
+}
+
+/**
+ * gwkjs_bundle_mount:
+ * @filename: a bundle file
+ * @error: return location for an error
+ *
+ * Maps and indexes @filename, unless it is mounted already.
+ *
+ * Returns: (transfer none): the bundle, or %NULL if @filename can't be
+ * read or isn't a bundle.
+ */
+GwkjsBundle *
+gwkjs_bundle_mount(const char  *filename,
+                   GError     **error)
+{
+    GwkjsBundle *bundle;
+    GMappedFile *mapped;
+    char *canonical;
+    gsize len;
+
+    canonical = g_strdup(filename);
+    len = strlen(canonical);
+    while (len > 1 && canonical[len - 1] == G_DIR_SEPARATOR)
+        canonical[--len] = '\0';
+
+    G_LOCK(bundles);
+
+    bundle = find_bundle(canonical, NULL);
+    if (bundle != NULL && strcmp(bundle->filename, canonical) == 0)
+        goto out;
+    bundle = NULL;
+
+    mapped = g_mapped_file_new(canonical, FALSE, error);
+    if (mapped == NULL)
+        goto out;
+
+    bundle = g_slice_new0(GwkjsBundle);
+    bundle->filename = canonical;
+    bundle->bytes = g_mapped_file_get_bytes(mapped);
+    bundle->files = g_hash_table_new(g_str_hash, g_str_equal);
+    bundle->directories = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_mapped_file_unref(mapped);
+    canonical = NULL;
+
+    if (!bundle_index(bundle)) {
+        g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                    "%s is not a valid module bundle", bundle->filename);
+        bundle_free(bundle);
+        bundle = NULL;
+        goto out;
+    }
+
+    if (bundles == NULL)
+        bundles = g_ptr_array_new();
+    g_ptr_array_add(bundles, bundle);
+
+ out:
+    G_UNLOCK(bundles);
+    g_free(canonical);
+    return bundle;
+}
+
+/**
+ * gwkjs_bundle_lookup:
+ * @path: a file name
+ * @relative_path: (out) (allow-none): the part of @path inside the bundle
+ *
+ * Returns: (transfer none): the mounted bundle @path points into, or
+ * %NULL if it doesn't point into one.
+ */
+GwkjsBundle *
+gwkjs_bundle_lookup(const char  *path,
+                    const char **relative_path)
+{
+    GwkjsBundle *bundle;
+
+    G_LOCK(bundles);
+    bundle = find_bundle(path, relative_path);
+    G_UNLOCK(bundles);
+
+    return bundle;
+}
+
+/**
+ * gwkjs_bundle_query_type:
+ * @bundle: a bundle
+ * @directory: a directory in @bundle, "" for the root
+ * @name: an entry of @directory
+ *
+ * Returns: %G_FILE_TYPE_REGULAR or %G_FILE_TYPE_DIRECTORY, or
+ * %G_FILE_TYPE_UNKNOWN if there is no such entry.
+ */
+GFileType
+gwkjs_bundle_query_type(GwkjsBundle *bundle,
+                        const char  *directory,
+                        const char  *name)
+{
+    char *path;
+    gsize len;
+    GFileType type = G_FILE_TYPE_UNKNOWN;
+
+    len = strlen(directory);
+    while (len > 0 && directory[len - 1] == G_DIR_SEPARATOR)
+        len--;
+
+    if (len == 0)
+        path = g_strdup(name);
+    else
+        path = g_strdup_printf("%.*s/%s", (int) len, directory, name);
+
+    /* The tables are never changed once the bundle is mounted */
+    if (g_hash_table_contains(bundle->files, path))
+        type = G_FILE_TYPE_REGULAR;
+    else if (g_hash_table_contains(bundle->directories, path))
+        type = G_FILE_TYPE_DIRECTORY;
+
+    g_free(path);
+    return type;
+}
+
+/**
+ * gwkjs_bundle_get_source:
+ * @bundle: a bundle
+ * @relative_path: a file in @bundle
+ * @error: return location for an error
+ *
+ * Returns: (transfer full): the contents of @relative_path, pointing
+ * into the mapped bundle, or %NULL with a G_IO_ERROR if there is no
+ * such file.
+ */
+GBytes *
+gwkjs_bundle_get_source(GwkjsBundle  *bundle,
+                        const char   *relative_path,
+                        GError      **error)
+{
+    guint index;
+    Entry entry;
+
+    index = GPOINTER_TO_UINT(g_hash_table_lookup(bundle->files, relative_path));
+    if (index == 0) {
+        if (g_hash_table_contains(bundle->directories, relative_path))
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY,
+                        "%s in %s is a directory", relative_path, bundle->filename);
+        else
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                        "No %s in %s", relative_path, bundle->filename);
+        return NULL;
+    }
+
+    read_entry(bundle, index - 1, &entry);
+    return g_bytes_new_from_bytes(bundle->bytes, entry.data_offset, entry.data_length);
+}
+
+/**
+ * gwkjs_bundle_write:
+ * @filename: the file to write
+ * @n_entries: number of @paths and @sources
+ * @paths: paths relative to the root of the bundle
+ * @sources: the contents of each of @paths
+ * @error: return location for an error
+ *
+ * Writes a bundle of @sources; see bundle.h for the format.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gwkjs_bundle_write(const char          *filename,
+                   guint                n_entries,
+                   const char * const  *paths,
+                   GBytes * const      *sources,
+                   GError             **error)
+{
+    GByteArray *array;
+    guint64 path_offset, data_offset;
+    gboolean ret;
+    guint i;
+
+    /* Paths come right after the table, sources after the paths */
+    path_offset = HEADER_SIZE + (guint64) n_entries * ENTRY_SIZE;
+    data_offset = path_offset;
+    for (i = 0; i < n_entries; i++)
+        data_offset += strlen(paths[i]) + 1;
+
+    array = g_byte_array_new();
+    g_byte_array_append(array, (const guint8 *) GWKJS_BUNDLE_MAGIC, 8);
+    write_uint32(array, GWKJS_BUNDLE_VERSION);
+    write_uint32(array, n_entries);
+
+    for (i = 0; i < n_entries; i++) {
+        gsize path_length = strlen(paths[i]);
+        gsize data_length = g_bytes_get_size(sources[i]);
+
+        if (data_offset + data_length + 1 > G_MAXUINT32) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE,
+                        "Too much data for a module bundle");
+            g_byte_array_unref(array);
+            return FALSE;
+        }
+
+        write_uint32(array, path_offset);
+        write_uint32(array, path_length);
+        write_uint32(array, data_offset);
+        write_uint32(array, data_length);
+        path_offset += path_length + 1;
+        data_offset += data_length + 1;
+    }
+
+    for (i = 0; i < n_entries; i++)
+        g_byte_array_append(array, (const guint8 *) paths[i], strlen(paths[i]) + 1);
+
+    for (i = 0; i < n_entries; i++) {
+        gsize data_length;
+        gconstpointer data = g_bytes_get_data(sources[i], &data_length);
+
+        g_byte_array_append(array, (const guint8 *) data, data_length);
+        g_byte_array_append(array, (const guint8 *) "", 1);
+    }
+
+    ret = g_file_set_contents(filename, (const char *) array->data, array->len, error);
+    g_byte_array_unref(array);
+
+    return ret;
+}
@@ -0,0 +1,78 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef __GWKJS_BUNDLE_H__
+#define __GWKJS_BUNDLE_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+/* A bundle packs a tree of modules into one file that is mapped and
+ * indexed once, so that imports from it take a hash lookup instead of
+ * file system probes. It is mounted by putting the path of the file
+ * on the search path; "<bundle>/dir" then names a directory inside it.
+ *
+ * The format is little-endian:
+ *
+ *   char    magic[8]       "GWKJSBDL"
+ *   guint32 version        1
+ *   guint32 n_entries
+ *   n_entries times:
+ *     guint32 path_offset, path_length
+ *     guint32 data_offset, data_length
+ *
+ * followed by the nul-terminated paths and then the sources, each also
+ * followed by a nul. Paths are relative to the root of the bundle and
+ * use "/" as separator, like "lang.js" or "overrides/Gio.js"; offsets
+ * are from the start of the file. Directories are implied by the
+ * paths.
+ *
+ * Mounted bundles stay mapped for the life of the process.
+ */
+typedef struct _GwkjsBundle GwkjsBundle;
+
+#define GWKJS_BUNDLE_MAGIC "GWKJSBDL"
+#define GWKJS_BUNDLE_VERSION 1
+
+GwkjsBundle *gwkjs_bundle_mount        (const char   *filename,
+                                        GError      **error);
+GwkjsBundle *gwkjs_bundle_lookup       (const char   *path,
+                                        const char  **relative_path);
+GFileType    gwkjs_bundle_query_type   (GwkjsBundle  *bundle,
+                                        const char   *directory,
+                                        const char   *name);
+GBytes      *gwkjs_bundle_get_source   (GwkjsBundle  *bundle,
+                                        const char   *relative_path,
+                                        GError      **error);
+
+gboolean     gwkjs_bundle_write        (const char          *filename,
+                                        guint                n_entries,
+                                        const char * const  *paths,
+                                        GBytes * const      *sources,
+                                        GError             **error);
+
+G_END_DECLS
+
+#endif  /* __GWKJS_BUNDLE_H__ */
@@ -26,6 +26,9 @@
 
 #include "context.h"
 #include "compat.h"
+#include "atoms.h"
+#include "script-cache.h"
+#include <util/arena.h>
 
 G_BEGIN_DECLS
 
@@ -33,6 +36,24 @@ gboolean     _gwkjs_context_destroying                  (GwkjsContext *js_contex
 
 void         _gwkjs_context_schedule_gc_if_needed       (GwkjsContext *js_context);
 
+GwkjsArena  *_gwkjs_context_get_invoke_arena           (GwkjsContext *js_context);
+
+GwkjsAtomTable *_gwkjs_context_get_atoms               (GwkjsContext *js_context);
+
+gboolean     _gwkjs_context_get_module_globals          (GwkjsContext *js_context);
+
+GwkjsScriptCache *_gwkjs_context_get_script_cache       (GwkjsContext *js_context);
+
+JSValueRef  *_gwkjs_context_get_global_slots           (GwkjsContext *js_context);
+
+JSGlobalContextRef _gwkjs_context_new_module_global     (GwkjsContext *js_context);
+
+const char * const *_gwkjs_context_get_search_path     (GwkjsContext *js_context);
+
+gboolean     _gwkjs_context_is_worker                   (GwkjsContext *js_context);
+void         _gwkjs_context_set_worker                  (GwkjsContext *js_context);
+void         _gwkjs_context_destroy_worker              (GwkjsContext *js_context);
+
 G_END_DECLS
 
 #endif  /* __GWKJS_CONTEXT_PRIVATE_H__ */
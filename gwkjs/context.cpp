@@ -29,10 +29,13 @@
 #include "importer.h"
 #include "jsapi-private.h"
 #include "jsapi-util.h"
+#include "mem.h"
 #include "native.h"
 #include "byteArray.h"
 #include "compat.h"
 #include "runtime.h"
+#include "script-source.h"
+#include "worker.h"
 
 #include "gi.h"
 #include "gi/object.h"
@@ -67,17 +70,56 @@ struct _GwkjsContext {
 
     char **search_path;
 
+    /* Evaluate each imported module in a global object of its own; if
+     * not set, in a function scope on the shared global (module-scope.h) */
+    gboolean module_globals;
+
+    /* Runs a worker script; see gwkjs/worker.h */
+    gboolean is_worker;
+
     gboolean destroying;
 
+    /* Scratch memory for argument marshalling in GI calls */
+    GwkjsArena *invoke_arena;
+
+    /* JSStringRefs for const_strings and recently used property names */
+    GwkjsAtomTable *atoms;
+
+    /* Scripts passed to gwkjs_context_eval() repeatedly */
+    GwkjsScriptCache *script_cache;
+
+    /* Protected values for gwkjs_get_global_slot() */
+    JSValueRef global_slots[GWKJS_GLOBAL_SLOT_LAST];
+
+    /* Globals from _gwkjs_context_new_module_global(), whose private
+     * data points back here */
+    GSList *module_global_contexts;
+
+    /* Pending low priority check for a full GC, see gwkjs_gc_if_needed() */
+    guint    auto_gc_id;
+
 //TODO: IMPLEMENT
 //    JSRuntime *runtime;
-//    guint    auto_gc_id;
-//
-//    jsid const_strings[GWKJS_STRING_LAST];
 };
 
-// XXX: Do we want only one context group?
-static JSContextGroupRef ContextGroup = NULL;
+/* Contexts created on the same thread share a group, so that values
+ * can be passed between them. Workers run on threads of their own and
+ * so get groups of their own, which JSC can run in parallel.
+ */
+static GPrivate context_group = G_PRIVATE_INIT((GDestroyNotify) JSContextGroupRelease);
+
+/* The global object has a class only so that it can hold the
+ * GwkjsContext as its private data, which is how the GwkjsContext is
+ * found from a JSContextRef; see gwkjs_get_private_context(). A global
+ * created without a class can't have private data.
+ */
+static JSClassDefinition gwkjs_global_class = {
+    0,                         //     Version
+    kJSClassAttributeNone,     //     JSClassAttributes
+    "GwkjsGlobal",             //     const char* className;
+};
+
+static JSClassRef gwkjs_global_class_ref = NULL;
 
 /* Keep this consistent with GwkjsConstString */
 static const char *const_strings[] = {
@@ -105,6 +147,7 @@ enum {
     PROP_0,
     PROP_SEARCH_PATH,
     PROP_PROGRAM_NAME,
+    PROP_MODULE_GLOBALS,
 };
 
 // TODO: Is this really necessary?
@@ -240,10 +283,27 @@ out:
 }
 
 
+/* Large enough for the marshalling state of any ordinary GI call,
+ * including a couple of caller-allocates structs */
+#define INVOKE_ARENA_CHUNK_SIZE 4096
+
+/* Property names other than const_strings that stay interned */
+#define ATOM_CACHE_SIZE 1024
+
+/* Distinct scripts kept compiled for gwkjs_context_eval() */
+#define SCRIPT_CACHE_SIZE 128
+
 static void
 gwkjs_context_init(GwkjsContext *js_context)
 {
-    gwkjs_context_make_current(js_context);
+    js_context->invoke_arena = gwkjs_arena_new(INVOKE_ARENA_CHUNK_SIZE);
+    js_context->atoms = gwkjs_atom_table_new(const_strings, GWKJS_STRING_LAST,
+                                             ATOM_CACHE_SIZE);
+    js_context->script_cache = gwkjs_script_cache_new(SCRIPT_CACHE_SIZE);
+
+    /* Other contexts on the thread are found through their globals */
+    if (gwkjs_context_get_current() == NULL)
+        gwkjs_context_make_current(js_context);
 }
 
 static void
@@ -254,7 +314,7 @@ gwkjs_context_class_init(GwkjsContextClass *klass)
 
     // TODO: uncomment eventually
     //object_class->dispose = gwkjs_context_dispose;
-    //object_class->finalize = gwkjs_context_finalize;
+    object_class->finalize = gwkjs_context_finalize;
 
     object_class->constructed = gwkjs_context_constructed;
     object_class->get_property = gwkjs_context_get_property;
@@ -280,6 +340,17 @@ gwkjs_context_class_init(GwkjsContextClass *klass)
                                     PROP_PROGRAM_NAME,
                                     pspec);
 
+    pspec = g_param_spec_boolean("module-globals",
+                                 "Module globals",
+                                 "Whether each imported module gets a global object of its own, "
+                                 "rather than a scope on the shared global",
+                                 TRUE,
+                                 (GParamFlags) (G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+
+    g_object_class_install_property(object_class,
+                                    PROP_MODULE_GLOBALS,
+                                    pspec);
+
     /* For GwkjsPrivate */
     {
         char *priv_typelib_dir = g_build_filename (PKGLIBDIR, "girepository-1.0", NULL);
@@ -291,6 +362,9 @@ gwkjs_context_class_init(GwkjsContextClass *klass)
     //gwkjs_register_native_module("byteArray", gwkjs_define_byte_array_stuff);
     //gwkjs_register_native_module("_gi", gwkjs_define_private_gi_stuff);
     gwkjs_register_native_module("gi", gwkjs_define_gi_stuff);
+    gwkjs_register_native_module("worker", gwkjs_define_worker_stuff);
+
+    gwkjs_global_class_ref = JSClassCreate(&gwkjs_global_class);
 
     gwkjs_register_static_modules();
 }
@@ -340,34 +414,66 @@ gwkjs_context_class_init(GwkjsContextClass *klass)
 //
 //    G_OBJECT_CLASS(gwkjs_context_parent_class)->dispose(object);
 //}
-//
-//static void
-//gwkjs_context_finalize(GObject *object)
-//{
-//    GwkjsContext *js_context;
-//
-//    js_context = GWKJS_CONTEXT(object);
-//
-//    if (js_context->search_path != NULL) {
-//        g_strfreev(js_context->search_path);
-//        js_context->search_path = NULL;
-//    }
-//
-//    if (js_context->program_name != NULL) {
-//        g_free(js_context->program_name);
-//        js_context->program_name = NULL;
-//    }
-//
-//    if (gwkjs_context_get_current() == (GwkjsContext*)object)
-//        gwkjs_context_make_current(NULL);
-//
-//    g_mutex_lock(&contexts_lock);
-//    all_contexts = g_list_remove(all_contexts, object);
-//    g_mutex_unlock(&contexts_lock);
-//
-//    G_OBJECT_CLASS(gwkjs_context_parent_class)->finalize(object);
-//}
-//
+
+/* The JS side of the context isn't torn down yet, see
+ * gwkjs_context_dispose(); but nothing in it can reach the GwkjsContext
+ * any more, and what the GwkjsContext held is released.
+ */
+static void
+gwkjs_context_finalize(GObject *object)
+{
+    GwkjsContext *js_context;
+    GSList *l;
+    int i;
+
+    js_context = GWKJS_CONTEXT(object);
+
+    if (js_context->context != NULL) {
+        for (i = 0; i < GWKJS_GLOBAL_SLOT_LAST; i++) {
+            if (js_context->global_slots[i] != NULL)
+                JSValueUnprotect(js_context->context, js_context->global_slots[i]);
+        }
+        JSObjectSetPrivate(js_context->global, NULL);
+    }
+
+    /* Functions from modules can outlive the context; they must not find
+     * it through their globals any more */
+    for (l = js_context->module_global_contexts; l != NULL; l = l->next) {
+        JSGlobalContextRef module_context = (JSGlobalContextRef) l->data;
+
+        JSObjectSetPrivate(JSContextGetGlobalObject(module_context), NULL);
+        JSGlobalContextRelease(module_context);
+    }
+    g_slist_free(js_context->module_global_contexts);
+    js_context->module_global_contexts = NULL;
+
+    if (js_context->script_cache != NULL)
+        gwkjs_script_cache_free(js_context->script_cache);
+    if (js_context->atoms != NULL)
+        gwkjs_atom_table_free(js_context->atoms);
+    if (js_context->invoke_arena != NULL)
+        gwkjs_arena_free(js_context->invoke_arena);
+
+    if (js_context->search_path != NULL) {
+        g_strfreev(js_context->search_path);
+        js_context->search_path = NULL;
+    }
+
+    if (js_context->program_name != NULL) {
+        g_free(js_context->program_name);
+        js_context->program_name = NULL;
+    }
+
+    if (gwkjs_context_get_current() == (GwkjsContext*)object)
+        gwkjs_context_make_current(NULL);
+
+    g_mutex_lock(&contexts_lock);
+    all_contexts = g_list_remove(all_contexts, object);
+    g_mutex_unlock(&contexts_lock);
+
+    G_OBJECT_CLASS(gwkjs_context_parent_class)->finalize(object);
+}
+
 static void
 _gwkjs_create_global_function(JSContextRef context,
                               JSObjectRef global,
@@ -386,35 +492,29 @@ static void
 gwkjs_context_constructed(GObject *object)
 {
     GwkjsContext *js_context = GWKJS_CONTEXT(object);
-    int i;
 
     G_OBJECT_CLASS(gwkjs_context_parent_class)->constructed(object);
 
     // NO RUNTIME in JSC
     //js_context->runtime = gwkjs_runtime_for_current_thread();
 
-    if (ContextGroup == NULL)
-        ContextGroup = JSContextGroupCreate();
+    JSContextGroupRef group = (JSContextGroupRef) g_private_get(&context_group);
+    if (group == NULL) {
+        group = JSContextGroupCreate();
+        g_private_set(&context_group, (gpointer) group);
+    }
 
-    js_context->context = JSGlobalContextCreateInGroup(ContextGroup, NULL);
+    js_context->context = JSGlobalContextCreateInGroup(group, gwkjs_global_class_ref);
     if (js_context->context == NULL)
         g_error("Failed to create javascript context");
 
-// TODO: sounds unecessary
-//    for (i = 0; i < GWKJS_STRING_LAST; i++)
-//        js_context->const_strings[i] = gwkjs_intern_string_to_id(js_context->context, const_strings[i]);
-
-    /* set ourselves as the private data */
-    // XXX: Works for now, but it might be the root of future issues:
-    // SpiderMonkey sets the JSContext private to be the GwkjsContext. JSC doesn't
-    // have a JSContextSetPrivate. So, as the global doesn't have a private object
-    // we can set the GwkjsContext in the global object
-    //JSObjectSetPrivate(js_context->context, js_context);
-
+    /* SpiderMonkey sets the JSContext private to be the GwkjsContext.
+     * JSC doesn't have a JSContextSetPrivate(), so the GwkjsContext is
+     * the private data of the global object instead.
+     */
     js_context->global = JSContextGetGlobalObject(js_context->context);
-
-    // XXX: ^^ here we're setting the private object mentioned before.
-    JSObjectSetPrivate(js_context->global, js_context);
+    if (!JSObjectSetPrivate(js_context->global, js_context))
+        g_error("Failed to attach the context to its global object");
 
     JSValueRef exception = NULL;
     gwkjs_object_set_property(js_context->context, js_context->global,
@@ -476,6 +576,9 @@ gwkjs_context_get_property (GObject     *object,
     case PROP_PROGRAM_NAME:
         g_value_set_string(value, js_context->program_name);
         break;
+    case PROP_MODULE_GLOBALS:
+        g_value_set_boolean(value, js_context->module_globals);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -499,6 +602,9 @@ gwkjs_context_set_property (GObject      *object,
     case PROP_PROGRAM_NAME:
         js_context->program_name = g_value_dup_string(value);
         break;
+    case PROP_MODULE_GLOBALS:
+        js_context->module_globals = g_value_get_boolean(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
         break;
@@ -526,66 +632,168 @@ _gwkjs_context_destroying (GwkjsContext *context)
     return context->destroying;
 }
 
-//static gboolean
-//trigger_gc_if_needed (gpointer user_data)
-//{
-//    GwkjsContext *js_context = GWKJS_CONTEXT(user_data);
-//    js_context->auto_gc_id = 0;
-//    gwkjs_gc_if_needed(js_context->context);
-//    return FALSE;
-//}
-//
-//void
-//_gwkjs_context_schedule_gc_if_needed (GwkjsContext *js_context)
-//{
-//    if (js_context->auto_gc_id > 0)
-//        return;
-//
-//    js_context->auto_gc_id = g_idle_add_full(G_PRIORITY_LOW,
-//                                             trigger_gc_if_needed,
-//                                             js_context, NULL);
-//}
-//
-///**
-// * gwkjs_context_maybe_gc:
-// * @context: a #GwkjsContext
-// * 
-// * Similar to the Spidermonkey JS_MaybeGC() call which
-// * heuristically looks at JS runtime memory usage and
-// * may initiate a garbage collection. 
-// *
-// * This function always unconditionally invokes JS_MaybeGC(), but
-// * additionally looks at memory usage from the system malloc()
-// * when available, and if the delta has grown since the last run
-// * significantly, also initiates a full JavaScript garbage
-// * collection.  The idea is that since GWKJS is a bridge between
-// * JavaScript and system libraries, and JS objects act as proxies
-// * for these system memory objects, GWKJS consumers need a way to
-// * hint to the runtime that it may be a good idea to try a
-// * collection.
-// *
-// * A good time to call this function is when your application
-// * transitions to an idle state.
-// */ 
-//void
-//gwkjs_context_maybe_gc (GwkjsContext  *context)
-//{
-//    gwkjs_maybe_gc(context->context);
-//}
-//
-///**
-// * gwkjs_context_gc:
-// * @context: a #GwkjsContext
-// * 
-// * Initiate a full GC; may or may not block until complete.  This
-// * function just calls Spidermonkey JS_GC().
-// */ 
-//void
-//gwkjs_context_gc (GwkjsContext  *context)
-//{
-//    JS_GC(context->runtime);
-//}
-//
+GwkjsArena *
+_gwkjs_context_get_invoke_arena (GwkjsContext *context)
+{
+    return context->invoke_arena;
+}
+
+GwkjsAtomTable *
+_gwkjs_context_get_atoms (GwkjsContext *context)
+{
+    return context->atoms;
+}
+
+gboolean
+_gwkjs_context_get_module_globals (GwkjsContext *context)
+{
+    return context->module_globals;
+}
+
+GwkjsScriptCache *
+_gwkjs_context_get_script_cache (GwkjsContext *context)
+{
+    return context->script_cache;
+}
+
+JSValueRef *
+_gwkjs_context_get_global_slots (GwkjsContext *context)
+{
+    return context->global_slots;
+}
+
+/* Modules evaluated in a global object of their own still belong to
+ * the context that imported them */
+JSGlobalContextRef
+_gwkjs_context_new_module_global (GwkjsContext *context)
+{
+    JSGlobalContextRef module_context;
+
+    module_context = JSGlobalContextCreateInGroup(JSContextGetGroup(context->context),
+                                                  gwkjs_global_class_ref);
+    JSObjectSetPrivate(JSContextGetGlobalObject(module_context), context);
+    context->module_global_contexts = g_slist_prepend(context->module_global_contexts,
+                                                      JSGlobalContextRetain(module_context));
+
+    return module_context;
+}
+
+const char * const *
+_gwkjs_context_get_search_path (GwkjsContext *context)
+{
+    return (const char * const *) context->search_path;
+}
+
+gboolean
+_gwkjs_context_is_worker (GwkjsContext *context)
+{
+    return context->is_worker;
+}
+
+void
+_gwkjs_context_set_worker (GwkjsContext *context)
+{
+    context->is_worker = TRUE;
+}
+
+/* Unlike the main context, a worker context goes away while the
+ * process keeps running, so its heap can't be leaked. This tears it
+ * down on its own thread, and drops the caller's reference.
+ */
+void
+_gwkjs_context_destroy_worker (GwkjsContext *context)
+{
+    g_return_if_fail(context->is_worker);
+
+    context->destroying = TRUE;
+
+    if (context->auto_gc_id > 0) {
+        GSource *source =
+            g_main_context_find_source_by_id(g_main_context_get_thread_default(),
+                                             context->auto_gc_id);
+        if (source)
+            g_source_destroy(source);
+        context->auto_gc_id = 0;
+    }
+
+    JSGlobalContextRef native_context = (JSGlobalContextRef) context->context;
+
+    /* The rest of the heap goes away with the thread's context group,
+     * once the global is released */
+    g_object_unref(context);
+    JSGlobalContextRelease(native_context);
+}
+
+static gboolean
+trigger_gc_if_needed (gpointer user_data)
+{
+    GwkjsContext *js_context = GWKJS_CONTEXT(user_data);
+    js_context->auto_gc_id = 0;
+    gwkjs_gc_if_needed(js_context->context);
+    return FALSE;
+}
+
+void
+_gwkjs_context_schedule_gc_if_needed (GwkjsContext *js_context)
+{
+    if (js_context->auto_gc_id > 0)
+        return;
+
+    GWKJS_INC_STAT(gc_scheduled);
+
+    /* The check must run on the thread the context belongs to, which
+     * isn't the one of the default main context for workers */
+    GSource *source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_LOW);
+    g_source_set_callback(source, trigger_gc_if_needed,
+                          g_object_ref(js_context), g_object_unref);
+    js_context->auto_gc_id = g_source_attach(source,
+                                             g_main_context_get_thread_default());
+    g_source_unref(source);
+}
+
+/**
+ * gwkjs_context_maybe_gc:
+ * @context: a #GwkjsContext
+ *
+ * Heuristically looks at memory usage and may initiate a garbage
+ * collection.
+ *
+ * JavaScriptCore schedules collections by itself based on its own
+ * heap, but it can't see memory held by the system libraries.
+ * This function looks at memory usage from the system malloc()
+ * when available, and at the number of live GWKJS wrappers, and if
+ * either has grown significantly since the last collection, or
+ * wrappers have been piling up for a while, initiates a full
+ * JavaScript garbage collection.  The idea is that since GWKJS is a
+ * bridge between JavaScript and system libraries, and JS objects act
+ * as proxies for these system memory objects, GWKJS consumers need
+ * a way to hint to the runtime that it may be a good idea to try a
+ * collection.
+ *
+ * A good time to call this function is when your application
+ * transitions to an idle state.
+ */
+void
+gwkjs_context_maybe_gc (GwkjsContext  *context)
+{
+    gwkjs_maybe_gc(context->context);
+}
+
+/**
+ * gwkjs_context_gc:
+ * @context: a #GwkjsContext
+ *
+ * Initiate a full GC; may or may not block until complete.  This
+ * function calls JavaScriptCore JSGarbageCollect() and resets the
+ * thresholds used by gwkjs_context_maybe_gc().
+ */
+void
+gwkjs_context_gc (GwkjsContext  *context)
+{
+    gwkjs_force_gc(context->context);
+}
+
 ///**
 // * gwkjs_context_get_all:
 // *
@@ -667,7 +875,8 @@ gwkjs_context_eval_file(GwkjsContext    *js_context,
                       int           *exit_status_p,
                       GError       **error)
 {
-    char     *script = NULL;
+    GBytes   *source = NULL;
+    const char *script;
     gsize    script_len;
     gboolean ret = TRUE;
 
@@ -678,18 +887,23 @@ gwkjs_context_eval_file(GwkjsContext    *js_context,
         goto out;
     }
 
-    if (!g_file_load_contents(file, NULL, &script, &script_len, NULL, error)) {
+    if (!(source = gwkjs_script_source_load(file, error))) {
         ret = FALSE;
         goto out;
     }
 
+    script = (const char *) g_bytes_get_data(source, &script_len);
+    if (script == NULL)
+        script = "";
+
     if (!gwkjs_context_eval(js_context, script, script_len, filename, exit_status_p, error)) {
         ret = FALSE;
         goto out;
     }
 
 out:
-    g_free(script);
+    if (source)
+        g_bytes_unref(source);
     g_object_unref(file);
     return ret;
 }
@@ -719,12 +933,13 @@ gwkjs_context_define_string_array(GwkjsContext  *js_context,
     return TRUE;
 }
 
-static GwkjsContext *current_context;
+/* Each thread running JS has a current context of its own */
+static GPrivate current_context;
 
 GwkjsContext *
 gwkjs_context_get_current (void)
 {
-    return current_context;
+    return (GwkjsContext *) g_private_get(&current_context);
 }
 
 
@@ -732,9 +947,9 @@ gwkjs_context_get_current (void)
 void
 gwkjs_context_make_current (GwkjsContext *context)
 {
-    g_assert (context == NULL || current_context == NULL);
+    g_assert (context == NULL || g_private_get(&current_context) == NULL);
 
-    current_context = context;
+    g_private_set(&current_context, context);
 }
 
 const gchar *
@@ -744,17 +959,73 @@ gwkjs_context_get_const_string(JSContextRef      context,
     return const_strings[name];
 }
 
+/* JSStringRefs aren't bound to a JS context, so code running in a
+ * global that isn't a GwkjsContext's can share one table per thread.
+ */
+static GPrivate fallback_atoms = G_PRIVATE_INIT((GDestroyNotify) gwkjs_atom_table_free);
+
+static GwkjsAtomTable *
+get_atoms(JSContextRef context)
+{
+    GwkjsContext *gwkjs_context = gwkjs_get_private_context(context);
+    GwkjsAtomTable *atoms;
+
+    if (gwkjs_context != NULL)
+        return gwkjs_context->atoms;
+
+    atoms = (GwkjsAtomTable *) g_private_get(&fallback_atoms);
+    if (atoms == NULL) {
+        atoms = gwkjs_atom_table_new(const_strings, GWKJS_STRING_LAST,
+                                     ATOM_CACHE_SIZE);
+        g_private_set(&fallback_atoms, atoms);
+    }
+    return atoms;
+}
+
+/**
+ * gwkjs_context_get_const_atom:
+ * @context: a #JSContextRef
+ * @name: one of the #GwkjsConstString names
+ *
+ * Returns: (transfer none): an interned #JSStringRef for @name, valid
+ *  as long as the #GwkjsContext of @context.
+ */
+JSStringRef
+gwkjs_context_get_const_atom(JSContextRef      context,
+                             GwkjsConstString  name)
+{
+    return gwkjs_atom_table_get_const(get_atoms(context), name);
+}
+
+/**
+ * gwkjs_atom_intern:
+ * @context: a #JSContextRef
+ * @name: a property name
+ *
+ * Looks @name up in the per-context cache of recently used names,
+ * converting it only on a miss.
+ *
+ * Returns: (transfer full): a #JSStringRef for @name; release it with
+ *  JSStringRelease().
+ */
+JSStringRef
+gwkjs_atom_intern(JSContextRef  context,
+                  const char   *name)
+{
+    return gwkjs_atom_table_intern(get_atoms(context), name);
+}
+
 gboolean
 gwkjs_object_get_property_const(JSContextRef      context,
                               JSObjectRef       obj,
                               GwkjsConstString  property_name,
                               jsval          *value_p)
 {
-    const char* pname = gwkjs_context_get_const_string(context, property_name);
+    JSStringRef pname = gwkjs_context_get_const_atom(context, property_name);
     JSValueRef ret = NULL;
     JSValueRef exception = NULL;
 
-    ret = gwkjs_object_get_property(context, obj, pname, &exception);
+    ret = JSObjectGetProperty(context, obj, pname, &exception);
     if (!exception)
         *value_p = ret;
 
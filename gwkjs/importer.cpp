@@ -35,6 +35,10 @@
 
 #include <string.h>
 #include "exceptions.h"
+#include "bundle.h"
+#include "context-private.h"
+#include "mem.h"
+#include "script-source.h"
 
 #define MODULE_INIT_FILENAME "__init__.js"
 
@@ -262,13 +266,13 @@ import_file(JSContextRef  context,
             JSObjectRef   *module_obj)
 {
     JSBool ret = JS_FALSE;
-    char *script = NULL;
+    GBytes *source;
+    const char *script;
     char *full_path = NULL;
     gsize script_len = 0;
-    jsval script_retval;
     GError *error = NULL;
 
-    if (!(g_file_load_contents(file, NULL, &script, &script_len, NULL, &error))) {
+    if (!(source = gwkjs_script_source_load(file, &error))) {
         if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_IS_DIRECTORY) &&
             !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY) &&
             !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
@@ -276,10 +280,13 @@ import_file(JSContextRef  context,
         else
             g_error_free(error);
 
-        goto out;
+        return JS_FALSE;
     }
 
-    g_assert(script != NULL);
+    /* An empty file maps to no data at all */
+    script = (const char *) g_bytes_get_data(source, &script_len);
+    if (script == NULL)
+        script = "";
 
     full_path = g_file_get_parse_name (file);
 
@@ -290,7 +297,7 @@ import_file(JSContextRef  context,
     ret = JS_TRUE;
 
  out:
-    g_free(script);
+    g_bytes_unref(source);
     g_free(full_path);
     return ret;
 }
@@ -394,6 +401,211 @@ import_file_on_module(JSContextRef context,
     return module_obj;
 }
 
+/* Looking a name up on the search path used to take a few file system
+ * probes per directory: __init__.js, a subdirectory and name.js. The
+ * entries of each search path directory are instead listed once and
+ * kept in a hash table, shared by all importers. A file monitor marks
+ * the listing stale when the directory changes; see also
+ * gwkjs_importer_invalidate_search_path_cache().
+ *
+ * A search path entry can also be a bundle file, or a directory inside
+ * one; see bundle.h. Those are looked up in the bundle's own index.
+ */
+typedef struct {
+    GFile *dir;
+    GHashTable *entries;    /* name -> GFileType, or NULL if not listed yet */
+    GFileMonitor *monitor;
+    gulong changed_id;
+    gboolean listable;      /* FALSE if listing failed; probe instead */
+    GwkjsBundle *bundle;
+    const char *bundle_dir; /* points into the key of dir_indexes */
+} DirIndex;
+
+G_LOCK_DEFINE_STATIC(dir_indexes);
+static GHashTable *dir_indexes = NULL;   /* directory -> DirIndex */
+
+static void
+dir_index_free(DirIndex *index)
+{
+    if (index->monitor) {
+        g_signal_handler_disconnect(index->monitor, index->changed_id);
+        g_file_monitor_cancel(index->monitor);
+        g_object_unref(index->monitor);
+    }
+    if (index->entries)
+        g_hash_table_unref(index->entries);
+    g_object_unref(index->dir);
+    g_slice_free(DirIndex, index);
+}
+
+/* Runs in the main thread, while the index may be dropped from any
+ * thread at the same time; so the handler only gets the directory
+ * name, and looks the index up again with the lock held.
+ */
+static void
+on_search_path_dir_changed(GFileMonitor      *monitor,
+                           GFile             *file,
+                           GFile             *other_file,
+                           GFileMonitorEvent  event_type,
+                           const char        *dirname)
+{
+    DirIndex *index;
+
+    if (event_type != G_FILE_MONITOR_EVENT_CREATED &&
+        event_type != G_FILE_MONITOR_EVENT_DELETED &&
+        event_type != G_FILE_MONITOR_EVENT_MOVED_IN &&
+        event_type != G_FILE_MONITOR_EVENT_MOVED_OUT &&
+        event_type != G_FILE_MONITOR_EVENT_RENAMED)
+        return;
+
+    G_LOCK(dir_indexes);
+    index = dir_indexes ? (DirIndex *) g_hash_table_lookup(dir_indexes, dirname) : NULL;
+    if (index && index->monitor == monitor && index->entries) {
+        g_hash_table_unref(index->entries);
+        index->entries = NULL;
+    }
+    G_UNLOCK(dir_indexes);
+}
+
+/* Called with the lock held. The index is shared by all contexts, and
+ * a worker thread may be the first to import from a directory, so the
+ * monitor is attached to the global default main context rather than
+ * to the importing thread's, which goes away with the worker.
+ */
+static void
+dir_index_monitor(DirIndex   *index,
+                  const char *dirname)
+{
+    g_main_context_push_thread_default(g_main_context_default());
+    index->monitor = g_file_monitor_directory(index->dir, G_FILE_MONITOR_NONE,
+                                              NULL, NULL);
+    g_main_context_pop_thread_default(g_main_context_default());
+
+    if (index->monitor)
+        index->changed_id = g_signal_connect_data(index->monitor, "changed",
+                                                  G_CALLBACK(on_search_path_dir_changed),
+                                                  g_strdup(dirname),
+                                                  (GClosureNotify) g_free,
+                                                  (GConnectFlags) 0);
+}
+
+/* Called with the lock held */
+static void
+dir_index_list(DirIndex *index)
+{
+    GFileEnumerator *enumerator;
+    GFileInfo *info;
+    GError *error = NULL;
+
+    GWKJS_INC_STAT(import_dir_scan);
+
+    index->entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    index->listable = TRUE;
+
+    enumerator = g_file_enumerate_children(index->dir,
+                                           G_FILE_ATTRIBUTE_STANDARD_NAME ","
+                                           G_FILE_ATTRIBUTE_STANDARD_TYPE,
+                                           G_FILE_QUERY_INFO_NONE,
+                                           NULL, &error);
+    if (enumerator == NULL) {
+        /* A directory that isn't there simply has no entries; a file
+         * may be a bundle */
+        if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_DIRECTORY) &&
+            g_file_is_native(index->dir)) {
+            char *path = g_file_get_path(index->dir);
+
+            index->bundle = gwkjs_bundle_mount(path, NULL);
+            index->bundle_dir = "";
+            g_free(path);
+        } else if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+            index->listable = FALSE;
+        }
+        g_error_free(error);
+        return;
+    }
+
+    while ((info = g_file_enumerator_next_file(enumerator, NULL, NULL))) {
+        g_hash_table_insert(index->entries,
+                            g_strdup(g_file_info_get_name(info)),
+                            GINT_TO_POINTER(g_file_info_get_file_type(info)));
+        g_object_unref(info);
+    }
+
+    g_object_unref(enumerator);
+}
+
+/* Looks @name up in the listing of @dirname and stores its type, or
+ * G_FILE_TYPE_UNKNOWN if there is no such entry, in @type_p. Returns
+ * FALSE if the directory can't be listed and the caller has to probe.
+ */
+static gboolean
+search_path_lookup(const char *dirname,
+                   const char *name,
+                   GFileType  *type_p)
+{
+    DirIndex *index;
+    gboolean ret = FALSE;
+
+    G_LOCK(dir_indexes);
+
+    if (dir_indexes == NULL)
+        dir_indexes = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, (GDestroyNotify) dir_index_free);
+
+    index = (DirIndex *) g_hash_table_lookup(dir_indexes, dirname);
+    if (index == NULL) {
+        char *key = g_strdup(dirname);
+
+        index = g_slice_new0(DirIndex);
+        index->dir = g_file_new_for_commandline_arg(dirname);
+        /* Bundles don't change once mounted */
+        index->bundle = gwkjs_bundle_lookup(key, &index->bundle_dir);
+        if (index->bundle == NULL)
+            dir_index_monitor(index, dirname);
+        g_hash_table_insert(dir_indexes, key, index);
+    }
+
+    if (index->bundle == NULL && index->entries == NULL)
+        dir_index_list(index);
+
+    if (index->bundle != NULL) {
+        *type_p = gwkjs_bundle_query_type(index->bundle, index->bundle_dir, name);
+        GWKJS_INC_STAT(import_dir_lookup);
+        ret = TRUE;
+    } else if (index->listable) {
+        *type_p = (GFileType) GPOINTER_TO_INT(g_hash_table_lookup(index->entries, name));
+        GWKJS_INC_STAT(import_dir_lookup);
+        ret = TRUE;
+    }
+
+    G_UNLOCK(dir_indexes);
+
+    return ret;
+}
+
+/**
+ * gwkjs_importer_invalidate_search_path_cache:
+ * @directory: (allow-none): a search path directory, or %NULL for all
+ *
+ * Forgets the listing of @directory that imports are looked up in, so
+ * that it is read again on the next import. Changes are normally
+ * noticed by a file monitor, but only once the main loop runs, so
+ * this is for changes the program makes itself and wants to import
+ * right away.
+ */
+void
+gwkjs_importer_invalidate_search_path_cache(const char *directory)
+{
+    G_LOCK(dir_indexes);
+    if (dir_indexes != NULL) {
+        if (directory != NULL)
+            g_hash_table_remove(dir_indexes, directory);
+        else
+            g_hash_table_remove_all(dir_indexes);
+    }
+    G_UNLOCK(dir_indexes);
+}
+
 static JSValueRef
 do_import(JSContextRef context,
           JSObjectRef  obj,
@@ -412,6 +624,7 @@ do_import(JSContextRef context,
     GPtrArray *directories;
     const gchar * search_path_name;
     GFile *gfile;
+    GFileType file_type;
     gboolean exists;
 
     search_path_name = gwkjs_context_get_const_string(context, GWKJS_STRING_SEARCH_PATH);
@@ -441,6 +654,16 @@ do_import(JSContextRef context,
     full_path = NULL;
     directories = NULL;
 
+    /* GObjects and their wrappers belong to the main thread */
+    if (priv->is_root && strcmp(name, "gi") == 0) {
+        GwkjsContext *gwkjs_context = gwkjs_get_private_context(context);
+
+        if (gwkjs_context && _gwkjs_context_is_worker(gwkjs_context)) {
+            gwkjs_throw(context, "imports.gi is not available in workers");
+            goto out;
+        }
+    }
+
     /* First try importing an internal module like byteArray */
     if (priv->is_root &&
         gwkjs_is_registered_native_module(context, obj, name) &&
@@ -484,7 +707,11 @@ do_import(JSContextRef context,
         full_path = g_build_filename(dirname, MODULE_INIT_FILENAME,
                                      NULL);
 
-        module_obj = load_module_init(context, obj, full_path);
+        if (search_path_lookup(dirname, MODULE_INIT_FILENAME, &file_type) &&
+            file_type == G_FILE_TYPE_UNKNOWN)
+            module_obj = NULL;
+        else
+            module_obj = load_module_init(context, obj, full_path);
         if (module_obj != NULL) {
             JSValueRef obj_val = NULL;
 
@@ -505,9 +732,14 @@ do_import(JSContextRef context,
             g_free(full_path);
         full_path = g_build_filename(dirname, name,
                                      NULL);
-        gfile = g_file_new_for_commandline_arg(full_path);
 
-        if (g_file_query_file_type(gfile, (GFileQueryInfoFlags) 0, NULL) == G_FILE_TYPE_DIRECTORY) {
+        if (!search_path_lookup(dirname, name, &file_type)) {
+            gfile = g_file_new_for_commandline_arg(full_path);
+            file_type = g_file_query_file_type(gfile, (GFileQueryInfoFlags) 0, NULL);
+            g_object_unref(gfile);
+        }
+
+        if (file_type == G_FILE_TYPE_DIRECTORY) {
             gwkjs_debug(GWKJS_DEBUG_IMPORTER,
                       "Adding directory '%s' to child importer '%s'",
                       full_path, name);
@@ -519,8 +751,6 @@ do_import(JSContextRef context,
             full_path = NULL;
         }
 
-        g_object_unref(gfile);
-
         /* If we just added to directories, we know we don't need to
          * check for a file.  If we added to directories on an earlier
          * iteration, we want to ignore any files later in the
@@ -536,7 +766,10 @@ do_import(JSContextRef context,
         full_path = g_build_filename(dirname, filename,
                                      NULL);
         gfile = g_file_new_for_commandline_arg(full_path);
-        exists = g_file_query_exists(gfile, NULL);
+        if (search_path_lookup(dirname, filename, &file_type))
+            exists = file_type != G_FILE_TYPE_UNKNOWN;
+        else
+            exists = g_file_query_exists(gfile, NULL);
 
         if (!exists) {
             gwkjs_debug(GWKJS_DEBUG_IMPORTER,
@@ -1065,10 +1298,10 @@ importer_new(JSContextRef context,
     JSObjectRef proto = NULL;
     JSValueRef exception = NULL;
 
-    // XXX: NOT THREAD SAFE?
-    if (!gwkjs_importer_class_ref) {
-        gwkjs_importer_class_ref = JSClassCreate(&gwkjs_importer_class);
-    }
+    /* Worker threads create importers too */
+    if (g_once_init_enter(&gwkjs_importer_class_ref))
+        g_once_init_leave(&gwkjs_importer_class_ref,
+                          JSClassCreate(&gwkjs_importer_class));
 
     global = gwkjs_get_import_global(context);
     if (!(found = gwkjs_object_has_property(context,
@@ -51,6 +51,8 @@ JSObjectRef gwkjs_define_importer      (JSContextRef   context,
                                     const char **initial_search_path,
                                     gboolean     add_standard_search_path);
 
+void      gwkjs_importer_invalidate_search_path_cache (const char *directory);
+
 G_END_DECLS
 
 #endif  /* __GWKJS_IMPORTER_H__ */
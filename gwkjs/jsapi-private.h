@@ -38,6 +38,8 @@ G_BEGIN_DECLS
 
 void gwkjs_schedule_gc_if_needed (JSContextRef context);
 void gwkjs_gc_if_needed          (JSContextRef context);
+void gwkjs_gc_report_external_size (JSContextRef context,
+                                    gsize        size);
 
 GwkjsContext* gwkjs_get_private_context (JSContextRef ctx);
 
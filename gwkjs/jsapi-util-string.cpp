@@ -24,19 +24,362 @@
 #include <config.h>
 
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "jsapi-util.h"
 #include "compat.h"
 
+/* Most strings crossing the JS/C boundary (labels, property names, log
+ * lines, markup) are plain ASCII, so each direction first measures the
+ * ASCII prefix 8 or 16 code units at a time and copies it with a straight
+ * narrow/widen, only falling back to real transcoding for the rest.
+ */
+
+/* Strings up to this many code units are widened on the stack */
+#define UTF16_STACK_SIZE 256
+
+static gsize
+utf16_ascii_prefix(const JSChar *s,
+                   gsize         len)
+{
+    gsize i = 0;
+
+#ifdef __SSE2__
+    const __m128i high = _mm_set1_epi16((short) 0xff80);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= len; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, high), zero)) != 0xffff)
+            break;
+    }
+#endif
+    while (i < len && s[i] < 0x80)
+        i++;
+    return i;
+}
+
+static gsize
+utf8_ascii_prefix(const char *s,
+                  gsize       len)
+{
+    gsize i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        if (_mm_movemask_epi8(v) != 0)
+            break;
+    }
+#endif
+    while (i < len && (guchar) s[i] < 0x80)
+        i++;
+    return i;
+}
+
+/* @s must be all ASCII */
+static void
+utf16_narrow_ascii(const JSChar *s,
+                   gsize         len,
+                   char         *dest)
+{
+    gsize i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i *) (s + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *) (s + i + 8));
+        _mm_storeu_si128((__m128i *) (dest + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < len; i++)
+        dest[i] = (char) s[i];
+}
+
+/* @s must be all ASCII */
+static void
+utf8_widen_ascii(const char *s,
+                 gsize       len,
+                 JSChar     *dest)
+{
+    gsize i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        _mm_storeu_si128((__m128i *) (dest + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i *) (dest + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#endif
+    for (; i < len; i++)
+        dest[i] = (guchar) s[i];
+}
+
+static inline gboolean
+utf16_is_pair(const JSChar *s,
+              gsize         i,
+              gsize         len)
+{
+    return s[i] >= 0xd800 && s[i] < 0xdc00 &&
+           i + 1 < len && s[i + 1] >= 0xdc00 && s[i + 1] < 0xe000;
+}
+
+/* Exact UTF-8 size of @s; unpaired surrogates become U+FFFD */
+static gsize
+utf16_utf8_length(const JSChar *s,
+                  gsize         len)
+{
+    gsize i, n;
+
+    i = n = utf16_ascii_prefix(s, len);
+    while (i < len) {
+        JSChar c = s[i];
+
+        if (c < 0x80) {
+            n += 1;
+        } else if (c < 0x800) {
+            n += 2;
+        } else if (utf16_is_pair(s, i, len)) {
+            n += 4;
+            i++;
+        } else {
+            n += 3;
+        }
+        i++;
+    }
+    return n;
+}
+
+static void
+utf16_to_utf8(const JSChar *s,
+              gsize         len,
+              char         *dest)
+{
+    gsize i;
+
+    i = utf16_ascii_prefix(s, len);
+    utf16_narrow_ascii(s, i, dest);
+    dest += i;
+
+    while (i < len) {
+        gunichar c = s[i];
+
+        if (c >= 0xd800 && c < 0xe000) {
+            if (utf16_is_pair(s, i, len)) {
+                c = 0x10000 + ((c - 0xd800) << 10) + (s[i + 1] - 0xdc00);
+                i++;
+            } else {
+                c = 0xfffd;
+            }
+        }
+        dest += g_unichar_to_utf8(c, dest);
+        i++;
+    }
+}
+
+/**
+ * gwkjs_jsstring_get_utf8_length:
+ * @str: a JS string
+ *
+ * Returns: the number of bytes gwkjs_jsstring_write_utf8() will write for
+ * @str, not counting the terminating nul.
+ */
+gsize
+gwkjs_jsstring_get_utf8_length(JSStringRef str)
+{
+    return utf16_utf8_length(JSStringGetCharactersPtr(str), JSStringGetLength(str));
+}
+
+/**
+ * gwkjs_jsstring_write_utf8:
+ * @str: a JS string
+ * @dest: buffer of at least @utf8_length + 1 bytes
+ * @utf8_length: what gwkjs_jsstring_get_utf8_length() returned for @str
+ *
+ * Writes @str to @dest as nul-terminated UTF-8. Together with
+ * gwkjs_jsstring_get_utf8_length() this lets callers convert into
+ * memory they manage themselves.
+ */
+void
+gwkjs_jsstring_write_utf8(JSStringRef str,
+                          char       *dest,
+                          gsize       utf8_length)
+{
+    utf16_to_utf8(JSStringGetCharactersPtr(str), JSStringGetLength(str), dest);
+    dest[utf8_length] = '\0';
+}
+
+/**
+ * gwkjs_jsstring_to_utf8:
+ * @str: a JS string
+ * @length_p: (out) (allow-none): length in bytes, without the nul
+ *
+ * Returns: @str as a newly allocated, exactly sized UTF-8 string.
+ */
+char *
+gwkjs_jsstring_to_utf8(JSStringRef str,
+                       gsize      *length_p)
+{
+    const JSChar *chars = JSStringGetCharactersPtr(str);
+    gsize len = JSStringGetLength(str);
+    gsize ascii = utf16_ascii_prefix(chars, len);
+    gsize utf8_length;
+    char *bytes;
+
+    if (ascii == len)
+        utf8_length = len;
+    else
+        utf8_length = ascii + utf16_utf8_length(chars + ascii, len - ascii);
+
+    bytes = (char *) g_malloc(utf8_length + 1);
+    utf16_narrow_ascii(chars, ascii, bytes);
+    if (ascii < len)
+        utf16_to_utf8(chars + ascii, len - ascii, bytes + ascii);
+    bytes[utf8_length] = '\0';
+
+    if (length_p)
+        *length_p = utf8_length;
+    return bytes;
+}
+
+/* Like g_utf8_validate(), but nul bytes are characters like any other,
+ * as they are on the ASCII path */
+static gboolean
+utf8_validate(const char *s,
+              gsize       len)
+{
+    const char *end = s + len;
+    const char *stop;
+
+    while (!g_utf8_validate(s, end - s, &stop)) {
+        if (stop == end || *stop != '\0')
+            return FALSE;
+        s = stop + 1;
+    }
+    return TRUE;
+}
+
+/* Decodes valid UTF-8 into @dest and returns the number of
+ * code units written */
+static gsize
+utf8_to_utf16(const char *s,
+              gsize       len,
+              JSChar     *dest)
+{
+    const char *end = s + len;
+    gsize n;
+
+    n = utf8_ascii_prefix(s, len);
+    utf8_widen_ascii(s, n, dest);
+    s += n;
+
+    while (s < end) {
+        gunichar c = g_utf8_get_char(s);
+
+        if (c >= 0x10000) {
+            dest[n++] = 0xd800 + ((c - 0x10000) >> 10);
+            dest[n++] = 0xdc00 + ((c - 0x10000) & 0x3ff);
+        } else {
+            dest[n++] = c;
+        }
+        s = g_utf8_next_char(s);
+    }
+    return n;
+}
+
+/**
+ * gwkjs_jsstring_new_from_utf8_pieces:
+ * @pieces: UTF-8 strings, not necessarily nul-terminated
+ * @lengths: the length in bytes of each of @pieces
+ * @n_pieces: number of @pieces
+ * @error: return location for a conversion error
+ *
+ * Creates a JS string of @pieces put together, converting each one
+ * straight into the JS string's buffer. Scripts are built this way from
+ * a mapped file and the code around it, without a UTF-8 copy of the
+ * whole.
+ *
+ * Returns: a new JS string (release with JSStringRelease()), or %NULL if
+ * one of @pieces isn't valid UTF-8.
+ */
+JSStringRef
+gwkjs_jsstring_new_from_utf8_pieces(const char * const *pieces,
+                                    const gsize        *lengths,
+                                    guint               n_pieces,
+                                    GError            **error)
+{
+    JSChar stack_buf[UTF16_STACK_SIZE];
+    JSChar *u16_string;
+    gsize u16_string_length = 0;
+    gsize total = 0;
+    JSStringRef str;
+    guint i;
+
+    /* UTF-8 never takes fewer bytes than UTF-16 takes code units */
+    for (i = 0; i < n_pieces; i++)
+        total += lengths[i];
+    u16_string = total <= UTF16_STACK_SIZE ? stack_buf : g_new(JSChar, total);
+
+    for (i = 0; i < n_pieces; i++) {
+        const char *piece = pieces[i];
+        gsize len = lengths[i];
+        gsize ascii = utf8_ascii_prefix(piece, len);
+
+        if (ascii == len) {
+            utf8_widen_ascii(piece, len, u16_string + u16_string_length);
+            u16_string_length += len;
+            continue;
+        }
+
+        if (!utf8_validate(piece + ascii, len - ascii)) {
+            g_set_error_literal(error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                                "Invalid byte sequence in conversion input");
+            if (u16_string != stack_buf)
+                g_free(u16_string);
+            return NULL;
+        }
+        u16_string_length += utf8_to_utf16(piece, len, u16_string + u16_string_length);
+    }
+
+    /* JSStringCreateWithCharacters() copies */
+    str = JSStringCreateWithCharacters(u16_string, u16_string_length);
+    if (u16_string != stack_buf)
+        g_free(u16_string);
+
+    return str;
+}
+
+/**
+ * gwkjs_jsstring_new_from_utf8:
+ * @utf8_string: UTF-8 data
+ * @n_bytes: length of @utf8_string, or -1 if nul-terminated
+ * @error: return location for a conversion error
+ *
+ * Returns: a new JS string (release with JSStringRelease()), or %NULL if
+ * @utf8_string isn't valid UTF-8.
+ */
+JSStringRef
+gwkjs_jsstring_new_from_utf8(const char *utf8_string,
+                             gssize      n_bytes,
+                             GError    **error)
+{
+    gsize len;
+
+    len = n_bytes < 0 ? strlen(utf8_string) : (gsize) n_bytes;
+
+    return gwkjs_jsstring_new_from_utf8_pieces(&utf8_string, &len, 1, error);
+}
+
 gboolean
 gwkjs_string_to_utf8 (JSContextRef  context,
                     const jsval value,
                     char      **utf8_string_p)
 {
     JSStringRef str;
-    gsize len;
-    char *bytes;
-
 
     if (!JSValueIsString(context, value)) {
         gwkjs_throw(context,
@@ -44,16 +387,10 @@ gwkjs_string_to_utf8 (JSContextRef  context,
         return JS_FALSE;
     }
 
-    str = JSValueToStringCopy(context, value, NULL);
-    len = JSStringGetMaximumUTF8CStringSize(str);
-    if (len == (gsize)(-1)) {
-        return JS_FALSE;
-    }
-
     if (utf8_string_p) {
-        bytes = (gchar *)g_malloc(len * sizeof(gchar));
-        JSStringGetUTF8CString(str, bytes, len);
-        *utf8_string_p = bytes;
+        str = JSValueToStringCopy(context, value, NULL);
+        *utf8_string_p = gwkjs_jsstring_to_utf8(str, NULL);
+        JSStringRelease(str);
     }
 
     return JS_TRUE;
@@ -65,38 +402,25 @@ gwkjs_string_from_utf8(JSContextRef  context,
                      gssize          n_bytes,
                      JSValueRef      *value_p)
 {
-    JSChar *u16_string;
-    glong u16_string_length;
     JSStringRef str;
     GError *error;
 
-    /* intentionally using n_bytes even though glib api suggests n_chars; with
-    * n_chars (from g_utf8_strlen()) the result appears truncated
-    */
-
     error = NULL;
-    u16_string = g_utf8_to_utf16(utf8_string,
-                                 n_bytes,
-                                 NULL,
-                                 &u16_string_length,
-                                 &error);
-    if (!u16_string) {
+    str = gwkjs_jsstring_new_from_utf8(utf8_string, n_bytes, &error);
+    if (!str) {
         gwkjs_throw(context,
                   "Failed to convert UTF-8 string to "
                   "JS string: %s",
                   error->message);
-                  g_error_free(error);
+        g_error_free(error);
         return JS_FALSE;
     }
 
-
-    /* Avoid a copy - assumes that g_malloc == js_malloc == malloc */
-    str = JSStringCreateWithCharacters(u16_string, u16_string_length);
-
-    if (str && value_p)
+    if (value_p)
         *value_p = JSValueMakeString(context, str);
+    JSStringRelease(str);
 
-    return str != NULL;
+    return JS_TRUE;
 }
 
 gboolean
@@ -34,15 +34,34 @@
 #include "compat.h"
 #include "context-private.h"
 #include "jsapi-private.h"
+#include "mem.h"
+#include "module-scope.h"
 #include <gi/boxed.h>
+#include <gi/function.h>
 
 #include <string.h>
+#include <stdio.h>
 #include <math.h>
+#include <unistd.h>
+#ifdef HAVE_MALLOC_H
+#include <malloc.h>
+#endif
 
 static GMutex gc_lock;
-static JSClassRef empty_class_ref = NULL;
 
-static JSValueRef* global_slots = NULL;
+/* Shared by all contexts, which may live on worker threads */
+static JSClassRef
+get_empty_class(void)
+{
+    static gsize empty_class_ref = 0;
+
+    if (g_once_init_enter(&empty_class_ref)) {
+        JSClassDefinition definition = kJSClassDefinitionEmpty;
+
+        g_once_init_leave(&empty_class_ref, (gsize) JSClassCreate(&definition));
+    }
+    return (JSClassRef) empty_class_ref;
+}
 
 JSObjectRef gwkjs_new_object(JSContextRef context,
                              JSClassRef clas,
@@ -50,15 +69,11 @@ JSObjectRef gwkjs_new_object(JSContextRef context,
                              JSObjectRef parent)
 {
     JSObjectRef ret = NULL;
-    if (!empty_class_ref) {
-        JSClassDefinition definition = kJSClassDefinitionEmpty;
-        empty_class_ref = JSClassCreate(&definition);
-    }
 
     if (clas)
         ret = JSObjectMake(context, clas, NULL);
     else
-        ret = JSObjectMake(context, empty_class_ref, NULL);
+        ret = JSObjectMake(context, get_empty_class(), NULL);
 
     if (parent)
         gwkjs_object_set_property(context, ret,
@@ -74,23 +89,30 @@ JSObjectRef gwkjs_new_object(JSContextRef context,
 JSValueRef
 gwkjs_cstring_to_jsvalue(JSContextRef context, const gchar *str)
 {
-    return JSValueMakeString(context, gwkjs_cstring_to_jsstring(str));
+    JSStringRef jsstr = gwkjs_cstring_to_jsstring(str);
+    JSValueRef value = JSValueMakeString(context, jsstr);
+
+    JSStringRelease(jsstr);
+    return value;
 }
 
 gchar *
 gwkjs_jsstring_to_cstring (JSStringRef property_name)
 {
-    gint length = JSStringGetMaximumUTF8CStringSize(property_name);
-    gchar *cproperty_name = (gchar *) g_new(gchar, length + 1);
-    JSStringGetUTF8CString(property_name, cproperty_name, length);
-
-    return (cproperty_name);
+    return gwkjs_jsstring_to_utf8(property_name, NULL);
 }
 
 JSStringRef
 gwkjs_cstring_to_jsstring(const char* str)
 {
-    return JSStringCreateWithUTF8CString(str);
+    JSStringRef jsstr = NULL;
+
+    if (str != NULL)
+        jsstr = gwkjs_jsstring_new_from_utf8(str, -1, NULL);
+    /* NULL and invalid UTF-8 are left to JSC, as before */
+    if (jsstr == NULL)
+        jsstr = JSStringCreateWithUTF8CString(str);
+    return jsstr;
 }
 
 gboolean
@@ -100,17 +122,33 @@ gwkjs_object_set_property(JSContextRef ctx,
                           JSValueRef value,
                           JSPropertyAttributes attributes,
                           JSValueRef* exception)
+{
+    JSStringRef prop = gwkjs_atom_intern(ctx, propertyName);
+    gboolean ret;
+
+    ret = gwkjs_object_set_property_atom(ctx, object, prop, value, attributes, exception);
+    JSStringRelease(prop);
+
+    return ret;
+}
+
+gboolean
+gwkjs_object_set_property_atom(JSContextRef ctx,
+                               JSObjectRef object,
+                               JSStringRef atom,
+                               JSValueRef value,
+                               JSPropertyAttributes attributes,
+                               JSValueRef* exception)
 {
     JSValueRef localEx = NULL;
-    JSStringRef prop = gwkjs_cstring_to_jsstring(propertyName);
 
-    JSObjectSetProperty(ctx, object, prop, value, attributes, &localEx);
+    JSObjectSetProperty(ctx, object, atom, value, attributes, &localEx);
     if (localEx) {
         *exception = localEx;
         return FALSE;
     }
 
-    g_assert(value == gwkjs_object_get_property(ctx, object, propertyName, 0));
+    g_assert(value == JSObjectGetProperty(ctx, object, atom, NULL));
 
     return TRUE;
 }
@@ -158,8 +196,11 @@ gwkjs_object_get_property(JSContextRef ctx,
                           const gchar* propertyName,
                           JSValueRef* exception)
 {
-    JSStringRef prop = gwkjs_cstring_to_jsstring(propertyName);
-    return (JSObjectGetProperty(ctx, object, prop, exception));
+    JSStringRef prop = gwkjs_atom_intern(ctx, propertyName);
+    JSValueRef value = JSObjectGetProperty(ctx, object, prop, exception);
+
+    JSStringRelease(prop);
+    return value;
 }
 
 const gboolean
@@ -167,8 +208,28 @@ gwkjs_object_has_property(JSContextRef ctx,
                           JSObjectRef object,
                           const gchar* propertyName)
 {
-    JSStringRef prop = gwkjs_cstring_to_jsstring(propertyName);
-    return (JSObjectHasProperty(ctx, object, prop));
+    JSStringRef prop = gwkjs_atom_intern(ctx, propertyName);
+    gboolean found = JSObjectHasProperty(ctx, object, prop);
+
+    JSStringRelease(prop);
+    return found;
+}
+
+JSValueRef
+gwkjs_object_get_property_atom(JSContextRef ctx,
+                               JSObjectRef object,
+                               JSStringRef atom,
+                               JSValueRef* exception)
+{
+    return JSObjectGetProperty(ctx, object, atom, exception);
+}
+
+gboolean
+gwkjs_object_has_property_atom(JSContextRef ctx,
+                               JSObjectRef object,
+                               JSStringRef atom)
+{
+    return JSObjectHasProperty(ctx, object, atom);
 }
 
 gchar*
@@ -177,7 +238,6 @@ gwkjs_jsvalue_to_cstring(JSContextRef ctx, JSValueRef val, JSValueRef* exception
     JSStringRef jsstr = NULL;
     JSValueRef func;
     gchar* buf = NULL;
-    gint length;
 
     if (val == NULL)
         return NULL;
@@ -201,13 +261,10 @@ gwkjs_jsvalue_to_cstring(JSContextRef ctx, JSValueRef val, JSValueRef* exception
         }
 
         jsstr = JSValueToStringCopy(ctx, val, NULL);
-        length = JSStringGetMaximumUTF8CStringSize(jsstr);
-        if (length > 0) {
-            buf = (gchar *)g_malloc(length * sizeof(gchar));
-            JSStringGetUTF8CString(jsstr, buf, length);
-        }
-        if (jsstr)
+        if (jsstr) {
+            buf = gwkjs_jsstring_to_utf8(jsstr, NULL);
             JSStringRelease(jsstr);
+        }
     }
 
     return buf;
@@ -299,29 +356,24 @@ gwkjs_make_function(JSContextRef ctx, const gchar *name, JSObjectCallAsFunctionC
 //    return TRUE;
 //}
 
-void
-inline init_global_slots()
-{
-    if (!global_slots) {
-        global_slots = g_new0(JSValueRef, GWKJS_GLOBAL_SLOT_LAST);
-        int i;
-        for (i = 0; i< GWKJS_GLOBAL_SLOT_LAST; i++) {
-            global_slots[i] = NULL;
-        }
-    }
-}
-
+/* Slots belong to the GwkjsContext that @context runs in, so that
+ * contexts never see each other's importer or keep-alive object */
 void
 gwkjs_set_global_slot (JSContextRef     context,
                      GwkjsGlobalSlot  slot,
                      JSValueRef          value)
 {
-    init_global_slots();
-    if (global_slots[slot] != NULL) {
-        JSValueUnprotect(context, global_slots[slot]);
+    GwkjsContext *gwkjs_context = gwkjs_get_private_context(context);
+    JSValueRef *slots;
+
+    g_return_if_fail(gwkjs_context != NULL);
+
+    slots = _gwkjs_context_get_global_slots(gwkjs_context);
+    if (slots[slot] != NULL) {
+        JSValueUnprotect(context, slots[slot]);
     }
 
-    global_slots[slot] = value;
+    slots[slot] = value;
     JSValueProtect(context, value);
 }
 
@@ -329,9 +381,15 @@ jsval
 gwkjs_get_global_slot (JSContextRef     context,
                      GwkjsGlobalSlot  slot)
 {
-    init_global_slots();
-    if (global_slots[slot] != NULL) {
-        return global_slots[slot];
+    GwkjsContext *gwkjs_context = gwkjs_get_private_context(context);
+    JSValueRef *slots;
+
+    if (gwkjs_context == NULL)
+        return JSValueMakeUndefined(context);
+
+    slots = _gwkjs_context_get_global_slots(gwkjs_context);
+    if (slots[slot] != NULL) {
+        return slots[slot];
     }
     return JSValueMakeUndefined(context);
 }
@@ -389,9 +447,9 @@ gwkjs_array_get_length(JSContextRef context,
 {
     gboolean ret = FALSE;
     JSValueRef exception = NULL;
-    const gchar *lengthstr = gwkjs_context_get_const_string(context, GWKJS_STRING_LENGTH);
+    JSStringRef length_atom = gwkjs_context_get_const_atom(context, GWKJS_STRING_LENGTH);
 
-    JSValueRef num_val = gwkjs_object_get_property(context, array, lengthstr, &exception);
+    JSValueRef num_val = JSObjectGetProperty(context, array, length_atom, &exception);
     if (exception) {
         gwkjs_throw(context,
                     "No length in array %p", array);
@@ -1498,115 +1556,212 @@ gwkjs_value_to_boolean(JSContextRef ctx, JSValueRef val, JSValueRef* exception)
 //    va_end (args);
 //    return ret;
 //}
-//
-//#ifdef __linux__
-//static void
-//_linux_get_self_process_size (gulong *vm_size,
-//                              gulong *rss_size)
-//{
-//    char *contents;
-//    char *iter;
-//    gsize len;
-//    int i;
-//
-//    *vm_size = *rss_size = 0;
-//
-//    if (!g_file_get_contents ("/proc/self/stat", &contents, &len, NULL))
-//        return;
-//
-//    iter = contents;
-//    /* See "man proc" for where this 22 comes from */
-//    for (i = 0; i < 22; i++) {
-//        iter = strchr (iter, ' ');
-//        if (!iter)
-//            goto out;
-//        iter++;
-//    }
-//    sscanf (iter, " %lu", vm_size);
-//    iter = strchr (iter, ' ');
-//    if (iter)
-//        sscanf (iter, " %lu", rss_size);
-//
-// out:
-//    g_free (contents);
-//}
-//
-//static gulong linux_rss_trigger;
-//static gint64 last_gc_time;
-//#endif
-//
-//void
-//gwkjs_gc_if_needed (JSContextRef context)
-//{
-//#ifdef __linux__
-//    {
-//        /* We initiate a GC if VM or RSS has grown by this much */
-//        gulong vmsize;
-//        gulong rss_size;
-//        gint64 now;
-//
-//        /* We rate limit GCs to at most one per 5 frames.
-//           One frame is 16666 microseconds (1000000/60)*/
-//        now = g_get_monotonic_time();
-//        if (now - last_gc_time < 5 * 16666)
-//            return;
-//
-//        _linux_get_self_process_size (&vmsize, &rss_size);
-//
-//        /* linux_rss_trigger is initialized to 0, so currently
-//         * we always do a full GC early.
-//         *
-//         * Here we see if the RSS has grown by 25% since
-//         * our last look; if so, initiate a full GC.  In
-//         * theory using RSS is bad if we get swapped out,
-//         * since we may be overzealous in GC, but on the
-//         * other hand, if swapping is going on, better
-//         * to GC.
-//         */
-//        if (rss_size > linux_rss_trigger) {
-//            linux_rss_trigger = (gulong) MIN(G_MAXULONG, rss_size * 1.25);
-//            JS_GC(JS_GetRuntime(context));
-//            last_gc_time = now;
-//        } else if (rss_size < (0.75 * linux_rss_trigger)) {
-//            /* If we've shrunk by 75%, lower the trigger */
-//            linux_rss_trigger = (rss_size * 1.25);
-//        }
-//    }
-//#endif
-//}
-//
-///**
-// * gwkjs_maybe_gc:
-// *
-// * Low level version of gwkjs_context_maybe_gc().
-// */
-//void
-//gwkjs_maybe_gc (JSContextRef context)
-//{
-//    JS_MaybeGC(context);
-//    gwkjs_gc_if_needed(context);
-//}
-//
+
+/* Collection scheduling.
+ *
+ * JSC collects on its own as its heap grows, but it can't see the C
+ * memory kept alive by our wrappers: a small JS object may hold a large
+ * pixbuf or a whole widget tree. Calls into C therefore schedule a check
+ * from a low priority idle, which decides from four signals whether a
+ * full collection is worth it: growth of the malloc heap (the RSS where
+ * mallinfo() is not available), growth of the number of live wrappers,
+ * native memory reported for new wrappers, and the time since the last
+ * collection.
+ */
+
+/* We rate limit GCs to at most one per 5 frames.
+ * One frame is 16666 microseconds (1000000/60) */
+#define GC_MIN_INTERVAL_USEC (5 * 16666)
+/* Wrappers created since the last GC are collected at least this often */
+#define GC_MAX_INTERVAL_USEC (10 * G_USEC_PER_SEC)
+/* A signal triggers a GC once it has grown by 25% */
+#define GC_GROWTH_RATIO 1.25
+/* ...and for wrappers, by at least this many objects */
+#define GC_MIN_WRAPPER_GROWTH 1024
+/* ...and for native memory reported for new wrappers, by at least this much */
+#define GC_MIN_EXTERNAL_GROWTH (8 * 1024 * 1024)
+
+/* The heap is the process's, so there is one set of triggers for all
+ * contexts; worker threads use it too, so it is only touched with
+ * gc_lock held. */
+static struct {
+    gint64 last_gc_time;
+    gsize heap_trigger;
+    int wrappers_at_gc;
+    gsize external_since_gc;
+} gc_state;
+
+#ifdef HAVE_JSREPORTEXTRAMEMORYCOST
+/* From JSBasePrivate.h, which is not installed */
+extern "C" JS_EXPORT void JSReportExtraMemoryCost(JSContextRef ctx, size_t size);
+#endif
+
+static gsize
+get_heap_size(void)
+{
+#if defined(HAVE_MALLINFO2)
+    struct mallinfo2 info = mallinfo2();
+
+    return info.uordblks + info.hblkhd;
+#elif defined(HAVE_MALLINFO)
+    /* The fields are ints; treat them as unsigned so that heaps
+     * between 2 and 4 GB still work */
+    struct mallinfo info = mallinfo();
+
+    return (gsize) (guint) info.uordblks + (gsize) (guint) info.hblkhd;
+#elif defined(__linux__)
+    char *contents;
+    gulong vm_pages, rss_pages;
+    gsize rss_size = 0;
+
+    if (!g_file_get_contents("/proc/self/statm", &contents, NULL, NULL))
+        return 0;
+
+    /* See "man proc": sizes are in pages, the second one is the RSS */
+    if (sscanf(contents, "%lu %lu", &vm_pages, &rss_pages) == 2)
+        rss_size = (gsize) rss_pages * sysconf(_SC_PAGESIZE);
+
+    g_free(contents);
+    return rss_size;
+#else
+    return 0;
+#endif
+}
+
+static void
+gc_now(JSContextRef context)
+{
+    gsize heap_size;
+
+    JSGarbageCollect(context);
+
+    /* Unused callback closures are only freed outside of the
+     * callbacks themselves; a collection is a good moment. */
+    gwkjs_callback_trampoline_reclaim();
+
+    GWKJS_INC_STAT(gc_run);
+
+    /* Measure what survived, so that the next triggers are
+     * relative to the live set rather than to the garbage. */
+    heap_size = get_heap_size();
+    g_mutex_lock(&gc_lock);
+    gc_state.last_gc_time = g_get_monotonic_time();
+    gc_state.heap_trigger = (gsize) MIN((double) G_MAXSIZE,
+                                        heap_size * GC_GROWTH_RATIO);
+    gc_state.wrappers_at_gc = GWKJS_GET_COUNTER(everything);
+    gc_state.external_since_gc = 0;
+    g_mutex_unlock(&gc_lock);
+}
+
+/* heap_trigger is 125% of the heap after the last GC, so this is 25%
+ * of that heap. Called with gc_lock held. */
+static gsize
+external_trigger(void)
+{
+    return MAX(GC_MIN_EXTERNAL_GROWTH, gc_state.heap_trigger / 5);
+}
+
+void
+gwkjs_gc_if_needed (JSContextRef context)
+{
+    gint64 since_gc;
+    gsize heap_size;
+    int wrapper_growth;
+    gboolean collect;
+
+    GWKJS_INC_STAT(gc_check);
+
+    g_mutex_lock(&gc_lock);
+    since_gc = g_get_monotonic_time() - gc_state.last_gc_time;
+    g_mutex_unlock(&gc_lock);
+    if (since_gc < GC_MIN_INTERVAL_USEC)
+        return;
+
+    /* heap_trigger is initialized to 0, so currently
+     * we always do a full GC early. */
+    heap_size = get_heap_size();
+
+    g_mutex_lock(&gc_lock);
+    collect = heap_size > gc_state.heap_trigger;
+
+    wrapper_growth = GWKJS_GET_COUNTER(everything) - gc_state.wrappers_at_gc;
+    if (wrapper_growth >= MAX(GC_MIN_WRAPPER_GROWTH,
+                              gc_state.wrappers_at_gc * (GC_GROWTH_RATIO - 1)))
+        collect = TRUE;
+    else if (wrapper_growth > 0 && since_gc >= GC_MAX_INTERVAL_USEC)
+        collect = TRUE;
+
+    if (gc_state.external_since_gc >= external_trigger())
+        collect = TRUE;
+
+    if (!collect && heap_size < 0.75 * gc_state.heap_trigger) {
+        /* If we've shrunk by 75%, lower the trigger */
+        gc_state.heap_trigger = (gsize) (heap_size * GC_GROWTH_RATIO);
+    }
+    g_mutex_unlock(&gc_lock);
+
+    if (collect)
+        gc_now(context);
+}
+
+/**
+ * gwkjs_maybe_gc:
+ *
+ * Low level version of gwkjs_context_maybe_gc().
+ */
+void
+gwkjs_maybe_gc (JSContextRef context)
+{
+    gwkjs_gc_if_needed(context);
+}
+
+/**
+ * gwkjs_force_gc:
+ *
+ * Low level version of gwkjs_context_gc().
+ */
+void
+gwkjs_force_gc (JSContextRef context)
+{
+    gc_now(context);
+}
+
+/* Wrappers are cheap for JSC, but they may keep a lot of native memory
+ * alive; see gwkjs_report_native_bytes(). The size is passed on to JSC,
+ * when it lets us, so that its own scheduling accounts for it, and is
+ * one of the signals gwkjs_gc_if_needed() looks at.
+ */
+void
+gwkjs_gc_report_external_size (JSContextRef context,
+                               gsize        size)
+{
+    gboolean schedule;
+
+#ifdef HAVE_JSREPORTEXTRAMEMORYCOST
+    JSReportExtraMemoryCost(context, size);
+#endif
+
+    g_mutex_lock(&gc_lock);
+    gc_state.external_since_gc += size;
+    schedule = gc_state.external_since_gc >= external_trigger();
+    g_mutex_unlock(&gc_lock);
+
+    if (schedule)
+        gwkjs_schedule_gc_if_needed(context);
+}
 
 void
 gwkjs_schedule_gc_if_needed (JSContextRef context)
 {
+    GwkjsContext *gwkjs_context;
 
-    JSGarbageCollect(context);
-//TODO: Check if it's OK. we don't have a 
-//      Maybe_GC in JSC
-//
-//
-//    GwkjsContext *gwkjs_context;
-//
-//    /* We call JS_MaybeGC immediately, but defer a check for a full
-//     * GC cycle to an idle handler.
-//     */
-//    JS_MaybeGC(context);
-//
-//    gwkjs_context = (GwkjsContext *) JS_GetContextPrivate(context);
-//    if (gwkjs_context)
-//        _gwkjs_context_schedule_gc_if_needed(gwkjs_context);
+    /* JSC has no JS_MaybeGC(); it keeps an eye on its own heap. The
+     * check for a full GC cycle is deferred to an idle handler, so a
+     * burst of calls into C costs one check at most.
+     */
+    gwkjs_context = gwkjs_get_private_context(context);
+    if (gwkjs_context)
+        _gwkjs_context_schedule_gc_if_needed(gwkjs_context);
 }
 
 
@@ -1631,12 +1786,17 @@ gwkjs_strip_unix_shebang(const char  *script,
                        gssize      *script_len,
                        int         *start_line_number_out)
 {
+    gsize len;
+
     g_assert(script_len);
 
+    /* @script need not be nul-terminated if the length is given */
+    len = *script_len < 0 ? strlen(script) : (gsize) *script_len;
+
     /* handle scripts with UNIX shebangs */
-    if (strncmp(script, "#!", 2) == 0) {
+    if (len >= 2 && script[0] == '#' && script[1] == '!') {
         /* If we found a newline, advance the script by one line */
-        const char *s = (const char *) strstr (script, "\n");
+        const char *s = (const char *) memchr (script, '\n', len);
         if (s != NULL) {
             if (*script_len > 0)
                 *script_len -= (s + 1 - script);
@@ -1690,38 +1850,71 @@ void prepare_global(JSContextRef old_context,
 #undef COPY_OBJ
 }
 
-JSBool
-gwkjs_eval_with_scope(JSContextRef context,
+/* Evaluates the UTF-8 @pieces put together as one script. A script
+ * that isn't valid UTF-8 throws an Error like a syntax error would. */
+static JSValueRef
+evaluate_utf8_pieces(JSContextRef        context,
+                     const char * const *pieces,
+                     const gsize        *lengths,
+                     guint               n_pieces,
+                     JSObjectRef         object,
+                     const char         *filename,
+                     int                 start_line_number,
+                     JSValueRef         *exception)
+{
+    JSStringRef jsscript;
+    JSStringRef jsfilename = NULL;
+    JSValueRef retval;
+    GError *error = NULL;
+
+    jsscript = gwkjs_jsstring_new_from_utf8_pieces(pieces, lengths, n_pieces, &error);
+    if (jsscript == NULL) {
+        char *message = g_strdup_printf("%s: %s", filename ? filename : "<script>",
+                                        error->message);
+        JSStringRef jsmessage = gwkjs_cstring_to_jsstring(message);
+        JSValueRef message_val = JSValueMakeString(context, jsmessage);
+
+        *exception = JSObjectMakeError(context, 1, &message_val, NULL);
+        JSStringRelease(jsmessage);
+        g_free(message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    if (filename)
+        jsfilename = gwkjs_cstring_to_jsstring(filename);
+
+    retval = JSEvaluateScript(context, jsscript, object, jsfilename, start_line_number, exception);
+    JSStringRelease(jsscript);
+    if (jsfilename)
+        JSStringRelease(jsfilename);
+
+    return retval;
+}
+
+/* Evaluates a module in a global object of its own, which becomes
+ * the module object */
+static JSBool
+eval_in_module_global(JSContextRef context,
+                      GwkjsContext *gwkjs_context,
                       JSObjectRef  object,
                       const char   *script,
                       gssize       script_len,
                       const char   *filename,
+                      int          start_line_number,
                       JSValueRef   *retval_p,
-                      JSObjectRef   *ret_module,
-					  JSValueRef   *exception)
+                      JSObjectRef  *ret_module,
+                      JSValueRef   *exception)
 {
-    JSBool ret = FALSE;
-    int start_line_number = 1;
     JSValueRef retval = NULL;
     JSValueRef locException = NULL;
 
-    if (script_len < 0)
-        script_len = strlen(script);
-
-    script = gwkjs_strip_unix_shebang(script,
-                                    &script_len,
-                                    &start_line_number);
-
-// TODO: check if it's necessary, I guess not
-//    /* log and clear exception if it's set (should not be, normally...) */
-//    if (JS_IsExceptionPending(context)) {
-//        g_warning("gwkjs_eval_in_scope called with a pending exception");
-//        return JS_FALSE;
-//    }
-
-    JSContextGroupRef context_group =  JSContextGetGroup(context);
+    JSContextRef new_context;
 
-    JSContextRef new_context = JSGlobalContextCreateInGroup(context_group, 0);
+    if (gwkjs_context)
+        new_context = _gwkjs_context_new_module_global(gwkjs_context);
+    else
+        new_context = JSGlobalContextCreateInGroup(JSContextGetGroup(context), NULL);
     JSObjectRef new_global = JSContextGetGlobalObject(new_context);
     // Protects new_global in the original context.
     // Looks the be the way seed used to do.
@@ -1731,27 +1924,145 @@ gwkjs_eval_with_scope(JSContextRef context,
     if (ret_module)
         *ret_module = new_global;
 
-    JSStringRef jsscript = gwkjs_cstring_to_jsstring(script);
-    JSStringRef jsfilename = NULL;
-    if (filename)
-        jsfilename = gwkjs_cstring_to_jsstring(filename);
+    gsize length = script_len;
+    retval = evaluate_utf8_pieces(new_context, &script, &length, 1, object,
+                                  filename, start_line_number, &locException);
 
+    if (locException) {
+        if (exception)
+            *exception = locException;
 
-    retval = JSEvaluateScript(new_context, jsscript, object, jsfilename, start_line_number, &locException);
-	if (locException) {
-	    if (exception)
-	        *exception = locException;
+        g_warning("Exception when importing \"%s\"module: %s", filename,
+                  gwkjs_exception_to_string(context, locException));
 
-	    g_warning("Exception when importing \"%s\"module: %s", filename,
-	              gwkjs_exception_to_string(context, locException));
+        JSGlobalContextRelease((JSGlobalContextRef)new_context);
 
-	    JSGlobalContextRelease((JSGlobalContextRef)new_context);
+        // There was a problem during script execution,
+        // We will return an exception instead
+        return FALSE;
+    }
 
-		// There was a problem during script execution,
-		// We will return an exception instead
-		ret = FALSE;
-		goto out;
-	}
+    if (retval_p)
+        *retval_p = retval;
+    return TRUE;
+}
+
+/* Evaluates a module in a function scope on the shared global; see
+ * module-scope.h. The module object is a plain object that
+ * is also "this" for the module body. */
+static JSBool
+eval_in_module_scope(JSContextRef context,
+                     const char   *script,
+                     gssize       script_len,
+                     const char   *filename,
+                     int          start_line_number,
+                     JSValueRef   *retval_p,
+                     JSObjectRef  *ret_module,
+                     JSValueRef   *exception)
+{
+    JSValueRef locException = NULL;
+    JSObjectRef module = NULL;
+    JSValueRef function;
+    const char *pieces[3];
+    gsize lengths[3];
+    char *epilogue;
+
+    /* The script is usually a mapped file; don't copy it to put the
+     * wrapper around it */
+    epilogue = gwkjs_module_scope_get_epilogue(script, script_len);
+    pieces[0] = GWKJS_MODULE_SCOPE_PROLOGUE;
+    lengths[0] = strlen(GWKJS_MODULE_SCOPE_PROLOGUE);
+    pieces[1] = script;
+    lengths[1] = script_len;
+    pieces[2] = epilogue;
+    lengths[2] = strlen(epilogue);
+    function = evaluate_utf8_pieces(context, pieces, lengths, 3, NULL,
+                                    filename, start_line_number, &locException);
+    g_free(epilogue);
+
+    if (!locException) {
+        JSValueRef module_val;
+
+        module = JSObjectMake(context, NULL, NULL);
+        module_val = module;
+        JSObjectCallAsFunction(context, JSValueToObject(context, function, NULL),
+                               module, 1, &module_val, &locException);
+    }
+
+    if (locException) {
+        if (exception)
+            *exception = locException;
+
+        g_warning("Exception when importing \"%s\"module: %s", filename,
+                  gwkjs_exception_to_string(context, locException));
+        return FALSE;
+    }
+
+    if (ret_module)
+        *ret_module = module;
+    if (retval_p)
+        *retval_p = JSValueMakeUndefined(context);
+    return TRUE;
+}
+
+JSBool
+gwkjs_eval_with_scope(JSContextRef context,
+                      JSObjectRef  object,
+                      const char   *script,
+                      gssize       script_len,
+                      const char   *filename,
+                      JSValueRef   *retval_p,
+                      JSObjectRef   *ret_module,
+                      JSValueRef   *exception)
+{
+    GwkjsContext *gwkjs_context;
+    int start_line_number = 1;
+    JSBool ret;
+
+    if (script_len < 0)
+        script_len = strlen(script);
+
+    script = gwkjs_strip_unix_shebang(script,
+                                    &script_len,
+                                    &start_line_number);
+
+    /* Globals other than those of a GwkjsContext keep importing
+     * the old way, and so do modules unless the context asked for
+     * module scopes; see module-scope.h */
+    gwkjs_context = gwkjs_get_private_context(context);
+
+    if (gwkjs_context == NULL ||
+        (ret_module != NULL && _gwkjs_context_get_module_globals(gwkjs_context))) {
+        ret = eval_in_module_global(context, gwkjs_context, object, script, script_len,
+                                    filename, start_line_number, retval_p, ret_module,
+                                    exception);
+    } else if (ret_module != NULL) {
+        ret = eval_in_module_scope(context, script, script_len, filename,
+                                   start_line_number, retval_p, ret_module, exception);
+    } else {
+        /* The main program runs right on the shared global. Scripts
+         * are often evaluated over and over, so try the cache first */
+        JSValueRef locException = NULL;
+        JSValueRef retval = NULL;
+        gsize length = script_len;
+
+        if (!gwkjs_script_cache_evaluate(_gwkjs_context_get_script_cache(gwkjs_context),
+                                         context, script, length, filename,
+                                         start_line_number, object,
+                                         &retval, &locException))
+            retval = evaluate_utf8_pieces(context, &script, &length, 1, object,
+                                          filename, start_line_number, &locException);
+
+        if (locException) {
+            if (exception)
+                *exception = locException;
+            ret = FALSE;
+        } else {
+            if (retval_p)
+                *retval_p = retval;
+            ret = TRUE;
+        }
+    }
 
 // TODO: check if needs implementation
 //    gwkjs_schedule_gc_if_needed(context);
@@ -1762,14 +2073,9 @@ gwkjs_eval_with_scope(JSContextRef context,
 //        return JS_FALSE;
 //    }
 //
-    gwkjs_debug(GWKJS_DEBUG_CONTEXT,
-                "Script evaluation succeeded");
-
-    if (retval_p)
-        *retval_p = retval;
-    ret = TRUE;
-
-out:
+    if (ret)
+        gwkjs_debug(GWKJS_DEBUG_CONTEXT,
+                    "Script evaluation succeeded");
 
     return ret;
 }
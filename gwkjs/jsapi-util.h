@@ -248,8 +248,45 @@ gwkjs_object_set_property(JSContextRef ctx,
                           JSPropertyAttributes attributes,
                           JSValueRef* exception);
 
+/* Variants taking an interned name from gwkjs_context_get_const_atom()
+ * or gwkjs_atom_intern(), for callers that look up the same property
+ * repeatedly and don't want to convert the name every time.
+ */
+JSValueRef
+gwkjs_object_get_property_atom(JSContextRef ctx,
+                               JSObjectRef object,
+                               JSStringRef atom,
+                               JSValueRef* exception);
+gboolean
+gwkjs_object_has_property_atom(JSContextRef ctx,
+                               JSObjectRef object,
+                               JSStringRef atom);
+gboolean
+gwkjs_object_set_property_atom(JSContextRef ctx,
+                               JSObjectRef object,
+                               JSStringRef atom,
+                               JSValueRef value,
+                               JSPropertyAttributes attributes,
+                               JSValueRef* exception);
+
 gchar *     gwkjs_jsstring_to_cstring          (JSStringRef     property_name);
 
+/* UTF-16 <-> UTF-8 with an ASCII fast path and exactly sized results;
+ * see jsapi-util-string.cpp */
+char *      gwkjs_jsstring_to_utf8             (JSStringRef     str,
+                                                gsize          *length_p);
+gsize       gwkjs_jsstring_get_utf8_length     (JSStringRef     str);
+void        gwkjs_jsstring_write_utf8          (JSStringRef     str,
+                                                char           *dest,
+                                                gsize           utf8_length);
+JSStringRef gwkjs_jsstring_new_from_utf8       (const char     *utf8_string,
+                                                gssize          n_bytes,
+                                                GError        **error);
+JSStringRef gwkjs_jsstring_new_from_utf8_pieces (const char * const *pieces,
+                                                 const gsize        *lengths,
+                                                 guint               n_pieces,
+                                                 GError            **error);
+
 gboolean
 gwkjs_array_get_length(JSContextRef context,
                        JSObjectRef array,
@@ -513,11 +550,12 @@ void              gwkjs_set_values              (JSContextRef     context,
 //void              gwkjs_unroot_value_locations  (JSContextRef        context,
 //                                               jsval            *locations,
 //                                               int               n_locations);
-//
-///* Functions intended for more "internal" use */
-//
-//void gwkjs_maybe_gc (JSContextRef context);
-//
+
+/* Functions intended for more "internal" use */
+
+void gwkjs_maybe_gc (JSContextRef context);
+void gwkjs_force_gc (JSContextRef context);
+
 //JSBool            gwkjs_context_get_frame_info (JSContextRef  context,
 //                                              jsval      *stack,
 //                                              jsval      *fileName,
@@ -564,6 +602,10 @@ typedef enum {
 
 const gchar*              gwkjs_context_get_const_string  (JSContextRef       context,
                                                            GwkjsConstString   string);
+JSStringRef               gwkjs_context_get_const_atom    (JSContextRef       context,
+                                                           GwkjsConstString   string);
+JSStringRef               gwkjs_atom_intern               (JSContextRef       context,
+                                                           const char        *name);
 gboolean          gwkjs_object_get_property_const (JSContextRef       context,
                                                    JSObjectRef        obj,
                                                    GwkjsConstString   property_name,
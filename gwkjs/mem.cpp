@@ -25,8 +25,11 @@
 
 #include "mem.h"
 #include "compat.h"
+#include "jsapi-private.h"
 #include <util/log.h>
 
+#include <string.h>
+
 #define GWKJS_DEFINE_COUNTER(name)             \
     GwkjsMemCounter gwkjs_counter_ ## name = { \
         0, #name                                \
@@ -50,9 +53,44 @@ GWKJS_DEFINE_COUNTER(resultset)
 GWKJS_DEFINE_COUNTER(weakhash)
 GWKJS_DEFINE_COUNTER(interface)
 
+#define GWKJS_DEFINE_STAT(name)                \
+    GwkjsMemCounter gwkjs_stat_ ## name = {    \
+        0, #name                                \
+    };
+
+GWKJS_DEFINE_STAT(arena_inline)
+GWKJS_DEFINE_STAT(arena_hit)
+GWKJS_DEFINE_STAT(arena_miss)
+GWKJS_DEFINE_STAT(fast_invoke)
+GWKJS_DEFINE_STAT(trampoline_new)
+GWKJS_DEFINE_STAT(trampoline_reuse)
+GWKJS_DEFINE_STAT(async_call_new)
+GWKJS_DEFINE_STAT(async_call_reuse)
+GWKJS_DEFINE_STAT(atom_hit)
+GWKJS_DEFINE_STAT(atom_miss)
+GWKJS_DEFINE_STAT(resolve_bytes_saved)
+GWKJS_DEFINE_STAT(toggle_queued)
+GWKJS_DEFINE_STAT(toggle_drains)
+GWKJS_DEFINE_STAT(toggle_queue_peak)
+GWKJS_DEFINE_STAT(toggle_max_wait_usec)
+GWKJS_DEFINE_STAT(typed_array_borrow)
+GWKJS_DEFINE_STAT(typed_array_copy)
+GWKJS_DEFINE_STAT(typed_array_out)
+GWKJS_DEFINE_STAT(gc_scheduled)
+GWKJS_DEFINE_STAT(gc_check)
+GWKJS_DEFINE_STAT(gc_run)
+GWKJS_DEFINE_STAT(native_size_kb)
+GWKJS_DEFINE_STAT(import_dir_scan)
+GWKJS_DEFINE_STAT(import_dir_lookup)
+GWKJS_DEFINE_STAT(script_cache_hit)
+GWKJS_DEFINE_STAT(script_cache_miss)
+
 #define GWKJS_LIST_COUNTER(name) \
     & gwkjs_counter_ ## name
 
+#define GWKJS_LIST_STAT(name) \
+    & gwkjs_stat_ ## name
+
 static GwkjsMemCounter* counters[] = {
     GWKJS_LIST_COUNTER(boxed),
     GWKJS_LIST_COUNTER(gerror),
@@ -70,6 +108,45 @@ static GwkjsMemCounter* counters[] = {
     GWKJS_LIST_COUNTER(interface)
 };
 
+static GwkjsMemCounter* stats[] = {
+    GWKJS_LIST_STAT(arena_inline),
+    GWKJS_LIST_STAT(arena_hit),
+    GWKJS_LIST_STAT(arena_miss),
+    GWKJS_LIST_STAT(fast_invoke),
+    GWKJS_LIST_STAT(trampoline_new),
+    GWKJS_LIST_STAT(trampoline_reuse),
+    GWKJS_LIST_STAT(async_call_new),
+    GWKJS_LIST_STAT(async_call_reuse),
+    GWKJS_LIST_STAT(atom_hit),
+    GWKJS_LIST_STAT(atom_miss),
+    GWKJS_LIST_STAT(resolve_bytes_saved),
+    GWKJS_LIST_STAT(toggle_queued),
+    GWKJS_LIST_STAT(toggle_drains),
+    GWKJS_LIST_STAT(toggle_queue_peak),
+    GWKJS_LIST_STAT(toggle_max_wait_usec),
+    GWKJS_LIST_STAT(typed_array_borrow),
+    GWKJS_LIST_STAT(typed_array_copy),
+    GWKJS_LIST_STAT(typed_array_out),
+    GWKJS_LIST_STAT(gc_scheduled),
+    GWKJS_LIST_STAT(gc_check),
+    GWKJS_LIST_STAT(gc_run),
+    GWKJS_LIST_STAT(native_size_kb),
+    GWKJS_LIST_STAT(import_dir_scan),
+    GWKJS_LIST_STAT(import_dir_lookup),
+    GWKJS_LIST_STAT(script_cache_hit),
+    GWKJS_LIST_STAT(script_cache_miss)
+};
+
+/* Percentage of @hits over @hits + @misses, or 100 if nothing happened */
+static double
+stat_hit_rate(int hits,
+              int misses)
+{
+    if (hits + misses == 0)
+        return 100.0;
+    return (100.0 * hits) / (hits + misses);
+}
+
 void
 gwkjs_memory_report(const char *where,
                   gboolean    die_if_leaks)
@@ -105,7 +182,243 @@ gwkjs_memory_report(const char *where,
                   counters[i]->value);
     }
 
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "  Statistics:");
+
+    for (i = 0; i < (int) G_N_ELEMENTS(stats); ++i) {
+        gwkjs_debug(GWKJS_DEBUG_MEMORY,
+                  "    %12s = %d",
+                  stats[i]->name,
+                  stats[i]->value);
+    }
+
+    /* Calls served by the inline buffer or without growing the arena
+     * count as hits; only the ones that had to malloc a chunk miss */
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "    invoke arena hit rate = %.1f%%",
+              stat_hit_rate(GWKJS_GET_STAT(arena_inline) + GWKJS_GET_STAT(arena_hit),
+                            GWKJS_GET_STAT(arena_miss)));
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "    callback trampoline reuse rate = %.1f%%",
+              stat_hit_rate(GWKJS_GET_STAT(trampoline_reuse),
+                            GWKJS_GET_STAT(trampoline_new)));
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "    async completion record reuse rate = %.1f%%",
+              stat_hit_rate(GWKJS_GET_STAT(async_call_reuse),
+                            GWKJS_GET_STAT(async_call_new)));
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "    property name cache hit rate = %.1f%%",
+              stat_hit_rate(GWKJS_GET_STAT(atom_hit),
+                            GWKJS_GET_STAT(atom_miss)));
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "    toggle refs per queue drain = %.1f",
+              GWKJS_GET_STAT(toggle_drains) > 0 ?
+              (double) GWKJS_GET_STAT(toggle_queued) / GWKJS_GET_STAT(toggle_drains) : 0.0);
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "    GC checks that collected = %.1f%%",
+              GWKJS_GET_STAT(gc_check) > 0 ?
+              (100.0 * GWKJS_GET_STAT(gc_run)) / GWKJS_GET_STAT(gc_check) : 0.0);
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "    import lookups per directory listing = %.1f",
+              GWKJS_GET_STAT(import_dir_scan) > 0 ?
+              (double) GWKJS_GET_STAT(import_dir_lookup) / GWKJS_GET_STAT(import_dir_scan) : 0.0);
+    gwkjs_debug(GWKJS_DEBUG_MEMORY,
+              "    compiled script cache hit rate = %.1f%%",
+              stat_hit_rate(GWKJS_GET_STAT(script_cache_hit),
+                            GWKJS_GET_STAT(script_cache_miss)));
+
     if (die_if_leaks && GWKJS_GET_COUNTER(everything) > 0) {
         g_error("%s: JavaScript objects were leaked.", where);
     }
 }
+
+/* Native size estimators.
+ *
+ * Estimators are registered on a GType and apply to its subtypes. A few
+ * types we don't link against are known by name. What a type resolves
+ * to is cached on it; registering a new estimator invalidates all the
+ * cached answers at once by bumping the generation.
+ */
+
+/* Reports smaller than this aren't worth telling the collector about */
+#define NATIVE_SIZE_MIN 1024
+
+typedef struct {
+    GwkjsNativeSizeFunc func;   /* NULL if no estimator applies */
+    guint generation;
+} NativeSizeCache;
+
+/* Wrappers are created on worker threads too; the generation and the
+ * per-type caches are only touched with this lock held. */
+G_LOCK_DEFINE_STATIC(native_size);
+static guint native_size_generation = 1;
+
+static GQuark
+gwkjs_native_size_func_quark (void)
+{
+    static GQuark val = 0;
+    if (G_UNLIKELY (!val))
+        val = g_quark_from_static_string ("gwkjs::native-size-func");
+
+    return val;
+}
+
+static GQuark
+gwkjs_native_size_cache_quark (void)
+{
+    static GQuark val = 0;
+    if (G_UNLIKELY (!val))
+        val = g_quark_from_static_string ("gwkjs::native-size-cache");
+
+    return val;
+}
+
+static gsize
+bytes_native_size(GType    gtype,
+                  gpointer instance)
+{
+    return g_bytes_get_size((GBytes *) instance);
+}
+
+static gsize
+byte_array_native_size(GType    gtype,
+                       gpointer instance)
+{
+    return ((GByteArray *) instance)->len;
+}
+
+static gsize
+pixbuf_native_size(GType    gtype,
+                   gpointer instance)
+{
+    int rowstride, height;
+
+    g_object_get(instance, "rowstride", &rowstride, "height", &height, NULL);
+    return rowstride > 0 && height > 0 ? (gsize) rowstride * height : 0;
+}
+
+static const struct {
+    const char *type_name;
+    GwkjsNativeSizeFunc func;
+} builtin_native_size_funcs[] = {
+    { "GBytes", bytes_native_size },
+    { "GByteArray", byte_array_native_size },
+    { "GdkPixbuf", pixbuf_native_size },
+};
+
+static GwkjsNativeSizeFunc
+resolve_native_size_func(GType gtype)
+{
+    GType type;
+    guint i;
+
+    for (type = gtype; type != 0; type = g_type_parent(type)) {
+        GwkjsNativeSizeFunc func;
+        const char *name;
+
+        func = (GwkjsNativeSizeFunc) g_type_get_qdata(type, gwkjs_native_size_func_quark());
+        if (func != NULL)
+            return func;
+
+        name = g_type_name(type);
+        for (i = 0; i < G_N_ELEMENTS(builtin_native_size_funcs); i++) {
+            if (strcmp(name, builtin_native_size_funcs[i].type_name) == 0)
+                return builtin_native_size_funcs[i].func;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * gwkjs_register_native_size_func:
+ * @gtype: a #GType
+ * @func: the estimator, or %NULL to remove it
+ *
+ * Makes @func the size estimator for @gtype and those of its subtypes
+ * that don't have one of their own. Replaces any built-in estimator.
+ */
+void
+gwkjs_register_native_size_func(GType               gtype,
+                                GwkjsNativeSizeFunc func)
+{
+    g_return_if_fail(gtype != G_TYPE_INVALID);
+
+    G_LOCK(native_size);
+    g_type_set_qdata(gtype, gwkjs_native_size_func_quark(), (gpointer) func);
+    native_size_generation++;
+    G_UNLOCK(native_size);
+}
+
+/**
+ * gwkjs_estimate_native_size:
+ * @gtype: the type of @instance
+ * @instance: (allow-none): a GObject, boxed or fundamental instance
+ *
+ * Returns: the estimated size in bytes of the native memory owned by
+ * @instance, or 0 if no estimator applies to @gtype.
+ */
+gsize
+gwkjs_estimate_native_size(GType    gtype,
+                           gpointer instance)
+{
+    NativeSizeCache *cache;
+    GwkjsNativeSizeFunc func;
+
+    if (instance == NULL || gtype == G_TYPE_INVALID || gtype == G_TYPE_NONE)
+        return 0;
+
+    G_LOCK(native_size);
+    cache = (NativeSizeCache *) g_type_get_qdata(gtype, gwkjs_native_size_cache_quark());
+    if (cache == NULL) {
+        /* GTypes are never unregistered, so neither is this freed */
+        cache = g_new0(NativeSizeCache, 1);
+        g_type_set_qdata(gtype, gwkjs_native_size_cache_quark(), cache);
+    }
+
+    if (cache->generation != native_size_generation) {
+        cache->func = resolve_native_size_func(gtype);
+        cache->generation = native_size_generation;
+    }
+    func = cache->func;
+    G_UNLOCK(native_size);
+
+    return func != NULL ? func(gtype, instance) : 0;
+}
+
+/**
+ * gwkjs_report_native_bytes:
+ * @context: a #JSContextRef
+ * @n_bytes: size of the native memory kept alive by a new wrapper
+ *
+ * Tells the garbage collector that a wrapper just created in @context
+ * owns @n_bytes of memory that it can't see, so that collections keep
+ * up with the real memory use of the process.
+ */
+void
+gwkjs_report_native_bytes(JSContextRef context,
+                          gsize        n_bytes)
+{
+    if (n_bytes < NATIVE_SIZE_MIN)
+        return;
+
+    GWKJS_ADD_STAT(native_size_kb, (gint) MIN(n_bytes / 1024, (gsize) G_MAXINT));
+    gwkjs_gc_report_external_size(context, n_bytes);
+}
+
+/**
+ * gwkjs_report_native_size:
+ * @context: a #JSContextRef
+ * @gtype: the type of @instance
+ * @instance: the native instance a new wrapper was created for
+ *
+ * Estimates the size of @instance with gwkjs_estimate_native_size()
+ * and reports it with gwkjs_report_native_bytes().
+ */
+void
+gwkjs_report_native_size(JSContextRef context,
+                         GType        gtype,
+                         gpointer     instance)
+{
+    gwkjs_report_native_bytes(context, gwkjs_estimate_native_size(gtype, instance));
+}
@@ -73,9 +73,105 @@ GWKJS_DECLARE_COUNTER(interface)
 #define GWKJS_GET_COUNTER(name) \
     g_atomic_int_get(&gwkjs_counter_ ## name .value)
 
+/* Statistics are event counts rather than live objects, so they are
+ * kept apart from the counters above and don't add up to "everything".
+ */
+#define GWKJS_DECLARE_STAT(name) \
+    extern GwkjsMemCounter gwkjs_stat_ ## name ;
+
+/* Scratch arena used for GI invocations; see util/arena.h */
+GWKJS_DECLARE_STAT(arena_inline)
+GWKJS_DECLARE_STAT(arena_hit)
+GWKJS_DECLARE_STAT(arena_miss)
+GWKJS_DECLARE_STAT(fast_invoke)
+
+/* Callback trampolines; see gi/function.cpp */
+GWKJS_DECLARE_STAT(trampoline_new)
+GWKJS_DECLARE_STAT(trampoline_reuse)
+GWKJS_DECLARE_STAT(async_call_new)
+GWKJS_DECLARE_STAT(async_call_reuse)
+
+/* Property name cache; see gwkjs/atoms.h */
+GWKJS_DECLARE_STAT(atom_hit)
+GWKJS_DECLARE_STAT(atom_miss)
+
+/* Estimated bytes not spent on per-instance GObject resolve tables;
+ * see gi/object.cpp */
+GWKJS_DECLARE_STAT(resolve_bytes_saved)
+
+/* Toggle refs waiting for the JS thread; see gi/object.cpp.
+ * The peak and wait are high-water marks, not counts. */
+GWKJS_DECLARE_STAT(toggle_queued)
+GWKJS_DECLARE_STAT(toggle_drains)
+GWKJS_DECLARE_STAT(toggle_queue_peak)
+GWKJS_DECLARE_STAT(toggle_max_wait_usec)
+
+/* Typed arrays passed as C arrays, either lent to the callee or copied
+ * straight from the backing store, and C arrays returned as typed
+ * arrays; see gi/arg.cpp */
+GWKJS_DECLARE_STAT(typed_array_borrow)
+GWKJS_DECLARE_STAT(typed_array_copy)
+GWKJS_DECLARE_STAT(typed_array_out)
+
+/* Idle checks scheduled after calls into C, checks that ran, and the
+ * full collections they decided on; see gwkjs_gc_if_needed() */
+GWKJS_DECLARE_STAT(gc_scheduled)
+GWKJS_DECLARE_STAT(gc_check)
+GWKJS_DECLARE_STAT(gc_run)
+
+/* Native memory reported to the garbage collector for new wrappers,
+ * in kilobytes; see gwkjs_report_native_size() */
+GWKJS_DECLARE_STAT(native_size_kb)
+
+/* Search path directories listed, and lookups answered from those
+ * listings (or a bundle's index) instead of by probing the file
+ * system; see gwkjs/importer.cpp */
+GWKJS_DECLARE_STAT(import_dir_scan)
+GWKJS_DECLARE_STAT(import_dir_lookup)
+
+/* Scripts evaluated from the compiled-script cache; see
+ * gwkjs/script-cache.h */
+GWKJS_DECLARE_STAT(script_cache_hit)
+GWKJS_DECLARE_STAT(script_cache_miss)
+
+#define GWKJS_INC_STAT(name) \
+    g_atomic_int_add(&gwkjs_stat_ ## name .value, 1)
+
+#define GWKJS_ADD_STAT(name, n) \
+    g_atomic_int_add(&gwkjs_stat_ ## name .value, (n))
+
+#define GWKJS_GET_STAT(name) \
+    g_atomic_int_get(&gwkjs_stat_ ## name .value)
+
+/* Not atomic as a whole; callers serialize updates themselves */
+#define GWKJS_MAX_STAT(name, n)                                 \
+    do {                                                        \
+        gint _n = (n);                                          \
+        if (_n > GWKJS_GET_STAT(name))                          \
+            g_atomic_int_set(&gwkjs_stat_ ## name .value, _n);  \
+    } while (0)
+
 void gwkjs_memory_report(const char *where,
                        gboolean    die_if_leaks);
 
+/* Returns an estimate of the native memory owned by @instance, an
+ * instance of @gtype or of one of its subtypes, for example the pixel
+ * data of an image. Wrappers are small, so without this the garbage
+ * collector can't tell that collecting one would free a lot.
+ */
+typedef gsize (*GwkjsNativeSizeFunc) (GType    gtype,
+                                      gpointer instance);
+
+void  gwkjs_register_native_size_func (GType               gtype,
+                                       GwkjsNativeSizeFunc func);
+gsize gwkjs_estimate_native_size      (GType               gtype,
+                                       gpointer            instance);
+void  gwkjs_report_native_size        (JSContextRef        context,
+                                       GType               gtype,
+                                       gpointer            instance);
+void  gwkjs_report_native_bytes       (JSContextRef        context,
+                                       gsize               n_bytes);
+
 G_END_DECLS
 
 #endif  /* __GWKJS_MEM_H__ */
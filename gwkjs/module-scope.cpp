@@ -0,0 +1,661 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "module-scope.h"
+
+/* Finding the top-level declarations doesn't need a parser, only a
+ * tokenizer that gets strings, comments, templates and regular
+ * expressions right, plus enough bookkeeping to know whether we are
+ * inside a function body (for var) or inside any block at all (for
+ * everything else). Anything we don't understand is skipped as an
+ * expression; a syntax error is reported by JSC when evaluating.
+ */
+
+typedef enum {
+    TOKEN_END,
+    TOKEN_NAME,     /* identifier or keyword */
+    TOKEN_VALUE,    /* number, string, template or regular expression */
+    TOKEN_PUNCT,
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    const char *start;
+    gsize len;
+    gboolean newline_before;
+} Token;
+
+typedef struct {
+    const char *p;
+    const char *end;
+    Token last;         /* last token returned */
+    Token peeked;
+    gboolean has_peeked;
+} Lexer;
+
+/* What opened a "(" */
+enum {
+    PAREN_CONTROL = 'c',    /* if, while, switch, catch, with */
+    PAREN_FOR = 'F',        /* for; its header can declare vars */
+    PAREN_OTHER = 'p',      /* parameters, calls and grouping */
+};
+
+/* What opened a "{" */
+enum {
+    BRACE_BLOCK = 'b',      /* blocks, object literals, class bodies */
+    BRACE_FUNCTION = 'f',
+};
+
+typedef struct {
+    Lexer lexer;
+    GString *braces;
+    GString *parens;
+    guint function_depth;
+    gboolean function_body_next;
+    Token last;         /* last token consumed */
+    GPtrArray *names;
+    GHashTable *seen;
+} Scanner;
+
+static gboolean
+token_is(const Token *token,
+         const char  *text)
+{
+    return token->type != TOKEN_END &&
+        token->len == strlen(text) &&
+        memcmp(token->start, text, token->len) == 0;
+}
+
+static gboolean
+token_is_punct(const Token *token,
+               char         c)
+{
+    return token->type == TOKEN_PUNCT && token->len == 1 && token->start[0] == c;
+}
+
+static gboolean
+is_name_char(char c)
+{
+    return g_ascii_isalnum(c) || c == '_' || c == '$' || c == '\\' ||
+        (guchar) c >= 0x80;
+}
+
+/* Keywords after which a "/" starts a regular expression */
+static gboolean
+is_operator_keyword(const Token *token)
+{
+    static const char *keywords[] = {
+        "return", "typeof", "instanceof", "in", "of", "new", "delete",
+        "void", "throw", "case", "do", "else", "yield", "await",
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(keywords); i++) {
+        if (token_is(token, keywords[i]))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+/* Whether @token can be the last one of an expression, so that a line
+ * break after it may end the statement */
+static gboolean
+ends_expression(const Token *token)
+{
+    switch (token->type) {
+    case TOKEN_VALUE:
+        return TRUE;
+    case TOKEN_NAME:
+        return !is_operator_keyword(token);
+    case TOKEN_PUNCT:
+        return token_is_punct(token, ')') || token_is_punct(token, ']') ||
+            token_is_punct(token, '}') || token_is(token, "++") || token_is(token, "--");
+    default:
+        return FALSE;
+    }
+}
+
+static void
+skip_space(Lexer    *lexer,
+           gboolean *newline)
+{
+    const char *p = lexer->p;
+
+    while (p < lexer->end) {
+        if (*p == '\n') {
+            *newline = TRUE;
+            p++;
+        } else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' || *p == '\f') {
+            p++;
+        } else if (*p == '/' && p + 1 < lexer->end && p[1] == '/') {
+            while (p < lexer->end && *p != '\n')
+                p++;
+        } else if (*p == '/' && p + 1 < lexer->end && p[1] == '*') {
+            for (p += 2; p < lexer->end; p++) {
+                if (*p == '\n')
+                    *newline = TRUE;
+                else if (*p == '*' && p + 1 < lexer->end && p[1] == '/')
+                    break;
+            }
+            p = p < lexer->end ? p + 2 : lexer->end;
+        } else {
+            break;
+        }
+    }
+
+    lexer->p = p;
+}
+
+static const char *
+skip_string(const char *p,
+            const char *end,
+            char        quote)
+{
+    while (p < end) {
+        if (*p == '\\')
+            p = MIN(p + 2, end);
+        else if (*p == quote || *p == '\n')
+            return p + 1;
+        else
+            p++;
+    }
+    return end;
+}
+
+static const char *skip_template(const char *p,
+                                 const char *end);
+
+static void lexer_init(Lexer      *lexer,
+                       const char *start,
+                       const char *end);
+
+static Token lexer_next(Lexer *lexer);
+
+/* Skips a ${...} substitution, whose "${" has been consumed */
+static const char *
+skip_substitution(const char *p,
+                  const char *end)
+{
+    Lexer lexer;
+    int depth = 0;
+
+    lexer_init(&lexer, p, end);
+    for (;;) {
+        Token token = lexer_next(&lexer);
+
+        if (token.type == TOKEN_END)
+            break;
+        if (token_is_punct(&token, '{')) {
+            depth++;
+        } else if (token_is_punct(&token, '}')) {
+            if (depth == 0)
+                break;
+            depth--;
+        }
+    }
+    return lexer.p;
+}
+
+static const char *
+skip_template(const char *p,
+              const char *end)
+{
+    while (p < end) {
+        if (*p == '\\') {
+            p = MIN(p + 2, end);
+        } else if (*p == '`') {
+            return p + 1;
+        } else if (*p == '$' && p + 1 < end && p[1] == '{') {
+            p = skip_substitution(p + 2, end);
+        } else {
+            p++;
+        }
+    }
+    return end;
+}
+
+static const char *
+skip_regex(const char *p,
+           const char *end)
+{
+    gboolean in_class = FALSE;
+
+    for (; p < end && *p != '\n'; p++) {
+        if (*p == '\\') {
+            p++;
+        } else if (*p == '[') {
+            in_class = TRUE;
+        } else if (*p == ']') {
+            in_class = FALSE;
+        } else if (*p == '/' && !in_class) {
+            p++;
+            break;
+        }
+    }
+    /* flags */
+    while (p < end && is_name_char(*p))
+        p++;
+    return MIN(p, end);
+}
+
+static gboolean
+regex_allowed(const Token *last)
+{
+    switch (last->type) {
+    case TOKEN_END:
+        return TRUE;
+    case TOKEN_VALUE:
+        return FALSE;
+    case TOKEN_NAME:
+        return is_operator_keyword(last);
+    case TOKEN_PUNCT:
+        return !(token_is_punct(last, ')') || token_is_punct(last, ']') ||
+                 token_is(last, "++") || token_is(last, "--"));
+    default:
+        return TRUE;
+    }
+}
+
+static void
+lexer_init(Lexer      *lexer,
+           const char *start,
+           const char *end)
+{
+    memset(lexer, 0, sizeof(Lexer));
+    lexer->p = start;
+    lexer->end = end;
+    lexer->last.type = TOKEN_END;
+}
+
+static Token
+lexer_next(Lexer *lexer)
+{
+    Token token;
+    const char *p;
+
+    if (lexer->has_peeked) {
+        lexer->has_peeked = FALSE;
+        lexer->last = lexer->peeked;
+        return lexer->peeked;
+    }
+
+    token.newline_before = FALSE;
+    skip_space(lexer, &token.newline_before);
+
+    p = token.start = lexer->p;
+    if (p >= lexer->end) {
+        token.type = TOKEN_END;
+        token.len = 0;
+        return token;
+    }
+
+    if (*p == '"' || *p == '\'') {
+        token.type = TOKEN_VALUE;
+        p = skip_string(p + 1, lexer->end, *p);
+    } else if (*p == '`') {
+        token.type = TOKEN_VALUE;
+        p = skip_template(p + 1, lexer->end);
+    } else if (g_ascii_isdigit(*p) ||
+               (*p == '.' && p + 1 < lexer->end && g_ascii_isdigit(p[1]))) {
+        token.type = TOKEN_VALUE;
+        for (p++; p < lexer->end; p++) {
+            if ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E') &&
+                !(token.start[0] == '0' && (token.start[1] == 'x' || token.start[1] == 'X')))
+                continue;
+            if (!is_name_char(*p) && *p != '.')
+                break;
+        }
+    } else if (is_name_char(*p)) {
+        token.type = TOKEN_NAME;
+        while (p < lexer->end && is_name_char(*p))
+            p++;
+    } else if (*p == '/' && regex_allowed(&lexer->last)) {
+        token.type = TOKEN_VALUE;
+        p = skip_regex(p + 1, lexer->end);
+    } else {
+        token.type = TOKEN_PUNCT;
+        if (p + 1 < lexer->end &&
+            ((p[0] == '=' && p[1] == '>') ||
+             (p[0] == '+' && p[1] == '+') ||
+             (p[0] == '-' && p[1] == '-')))
+            p += 2;
+        else
+            p++;
+    }
+
+    token.len = p - token.start;
+    lexer->p = p;
+    lexer->last = token;
+    return token;
+}
+
+static Token
+lexer_peek(Lexer *lexer)
+{
+    if (!lexer->has_peeked) {
+        Token last = lexer->last;
+
+        lexer->peeked = lexer_next(lexer);
+        lexer->has_peeked = TRUE;
+        lexer->last = last;
+    }
+    return lexer->peeked;
+}
+
+static Token
+scanner_next(Scanner *scanner)
+{
+    Token token = lexer_next(&scanner->lexer);
+
+    if (token.type != TOKEN_END)
+        scanner->last = token;
+    return token;
+}
+
+static void
+scanner_add_name(Scanner     *scanner,
+                 const Token *token)
+{
+    char *name;
+
+    if (token_is(token, "arguments"))
+        return;
+
+    name = g_strndup(token->start, token->len);
+    if (g_hash_table_contains(scanner->seen, name)) {
+        g_free(name);
+        return;
+    }
+    g_hash_table_add(scanner->seen, name);
+    g_ptr_array_add(scanner->names, name);
+}
+
+/* Whether @token, at the start of a line after @last, goes on with the
+ * expression that @last ended, rather than starting a new statement */
+static gboolean
+continues_expression(const Token *token)
+{
+    static const char continuing[] = ".([+-*/%&|^?:=<>,";
+
+    if (token->type == TOKEN_PUNCT)
+        return !token_is(token, "++") && !token_is(token, "--") &&
+            strchr(continuing, token->start[0]) != NULL;
+    if (token->type == TOKEN_VALUE)
+        return token->start[0] == '`';  /* tagged template */
+    return token_is(token, "in") || token_is(token, "instanceof");
+}
+
+/* Skips an initializer or default value, up to the "," or ";" after it
+ * or the bracket closing what contains it. Line breaks end it as
+ * automatic semicolon insertion would, except inside patterns.
+ */
+static void
+skip_expression(Scanner  *scanner,
+                gboolean  in_pattern)
+{
+    int depth = 0;
+
+    for (;;) {
+        Token token = lexer_peek(&scanner->lexer);
+
+        if (token.type == TOKEN_END)
+            return;
+
+        if (depth == 0) {
+            if (token_is_punct(&token, ',') || token_is_punct(&token, ';') ||
+                token_is_punct(&token, ')') || token_is_punct(&token, ']') ||
+                token_is_punct(&token, '}') ||
+                token_is(&token, "in") || token_is(&token, "of"))
+                return;
+            if (!in_pattern && token.newline_before &&
+                ends_expression(&scanner->last) && !continues_expression(&token))
+                return;
+        }
+
+        scanner_next(scanner);
+        if (token_is_punct(&token, '(') || token_is_punct(&token, '[') ||
+            token_is_punct(&token, '{'))
+            depth++;
+        else if (token_is_punct(&token, ')') || token_is_punct(&token, ']') ||
+                 token_is_punct(&token, '}'))
+            depth--;
+    }
+}
+
+/* Collects the names bound by a destructuring pattern, whose opening
+ * bracket has been consumed */
+static void
+scan_pattern(Scanner *scanner)
+{
+    int depth = 1;
+
+    while (depth > 0) {
+        Token token = scanner_next(scanner);
+
+        if (token.type == TOKEN_END)
+            return;
+
+        if (token_is_punct(&token, '{') || token_is_punct(&token, '[')) {
+            depth++;
+        } else if (token_is_punct(&token, '}') || token_is_punct(&token, ']')) {
+            depth--;
+        } else if (token.type == TOKEN_NAME) {
+            Token next = lexer_peek(&scanner->lexer);
+
+            /* { key: binding } */
+            if (token_is_punct(&next, ':'))
+                continue;
+
+            scanner_add_name(scanner, &token);
+            if (token_is_punct(&next, '=')) {
+                scanner_next(scanner);
+                skip_expression(scanner, TRUE);
+            }
+        } else if (token_is_punct(&token, '=')) {
+            /* default for a nested pattern */
+            skip_expression(scanner, TRUE);
+        }
+    }
+}
+
+/* Collects the names declared after var, let or const */
+static void
+scan_bindings(Scanner *scanner)
+{
+    for (;;) {
+        Token token = lexer_peek(&scanner->lexer);
+
+        if (token.type == TOKEN_NAME) {
+            scanner_next(scanner);
+            scanner_add_name(scanner, &token);
+        } else if (token_is_punct(&token, '{') || token_is_punct(&token, '[')) {
+            scanner_next(scanner);
+            scan_pattern(scanner);
+        } else {
+            return;
+        }
+
+        token = lexer_peek(&scanner->lexer);
+        if (token_is_punct(&token, '=')) {
+            scanner_next(scanner);
+            skip_expression(scanner, FALSE);
+            token = lexer_peek(&scanner->lexer);
+        }
+
+        if (!token_is_punct(&token, ','))
+            return;
+        scanner_next(scanner);
+    }
+}
+
+/* Whether a declaration keyword @token, following @last, starts a
+ * statement rather than being a property name or part of an expression */
+static gboolean
+at_statement_start(const Token *last,
+                   const Token *token)
+{
+    if (last->type == TOKEN_END)
+        return TRUE;
+    if (token_is_punct(last, ';') || token_is_punct(last, '{') ||
+        token_is_punct(last, '}') || token_is_punct(last, ')'))
+        return TRUE;
+    if (token_is(last, "else") || token_is(last, "do"))
+        return TRUE;
+    return token->newline_before && ends_expression(last);
+}
+
+/* Collects the name after function, function* or class */
+static void
+scan_declared_name(Scanner *scanner)
+{
+    Token next = lexer_peek(&scanner->lexer);
+
+    if (token_is_punct(&next, '*')) {
+        scanner_next(scanner);
+        next = lexer_peek(&scanner->lexer);
+    }
+    if (next.type == TOKEN_NAME) {
+        scanner_next(scanner);
+        scanner_add_name(scanner, &next);
+    }
+}
+
+static void
+scan_declarations(Scanner *scanner)
+{
+    for (;;) {
+        Token last = scanner->last;
+        Token token = scanner_next(scanner);
+        gboolean function_body_next = FALSE;
+        gboolean top_level = scanner->braces->len == 0 && scanner->parens->len == 0;
+
+        if (token.type == TOKEN_END)
+            return;
+
+        if (token_is_punct(&token, '{')) {
+            char kind = scanner->function_body_next ? BRACE_FUNCTION : BRACE_BLOCK;
+
+            g_string_append_c(scanner->braces, kind);
+            if (kind == BRACE_FUNCTION)
+                scanner->function_depth++;
+        } else if (token_is_punct(&token, '}')) {
+            if (scanner->braces->len > 0) {
+                if (scanner->braces->str[scanner->braces->len - 1] == BRACE_FUNCTION)
+                    scanner->function_depth--;
+                g_string_truncate(scanner->braces, scanner->braces->len - 1);
+            }
+        } else if (token_is_punct(&token, '(')) {
+            char kind = PAREN_OTHER;
+
+            if (token_is(&last, "for"))
+                kind = PAREN_FOR;
+            else if (token_is(&last, "if") || token_is(&last, "while") ||
+                     token_is(&last, "switch") || token_is(&last, "catch") ||
+                     token_is(&last, "with"))
+                kind = PAREN_CONTROL;
+            g_string_append_c(scanner->parens, kind);
+        } else if (token_is_punct(&token, ')')) {
+            if (scanner->parens->len > 0) {
+                /* "name(...) {" is a function or a method */
+                function_body_next = scanner->parens->str[scanner->parens->len - 1] == PAREN_OTHER;
+                g_string_truncate(scanner->parens, scanner->parens->len - 1);
+            }
+        } else if (token_is(&token, "=>")) {
+            function_body_next = TRUE;
+        } else if (token_is(&token, "var")) {
+            gboolean in_for = scanner->parens->len == 1 &&
+                scanner->parens->str[0] == PAREN_FOR && token_is_punct(&last, '(');
+
+            if (scanner->function_depth == 0 &&
+                (in_for || at_statement_start(&last, &token)))
+                scan_bindings(scanner);
+        } else if (token_is(&token, "let") || token_is(&token, "const")) {
+            Token next = lexer_peek(&scanner->lexer);
+
+            /* "let" is only a keyword in front of a binding */
+            if (top_level && at_statement_start(&last, &token) &&
+                (next.type == TOKEN_NAME || token_is_punct(&next, '{') ||
+                 token_is_punct(&next, '[')))
+                scan_bindings(scanner);
+        } else if (token_is(&token, "async")) {
+            Token next = lexer_peek(&scanner->lexer);
+
+            if (token_is(&next, "function") && !next.newline_before &&
+                top_level && at_statement_start(&last, &token)) {
+                scanner_next(scanner);
+                scan_declared_name(scanner);
+            }
+        } else if (token_is(&token, "function") || token_is(&token, "class")) {
+            if (top_level && at_statement_start(&last, &token))
+                scan_declared_name(scanner);
+        }
+
+        scanner->function_body_next = function_body_next;
+    }
+}
+
+char *
+gwkjs_module_scope_get_epilogue(const char *script,
+                                gssize      script_len)
+{
+    Scanner scanner;
+    GString *epilogue;
+    guint i;
+
+    if (script_len < 0)
+        script_len = strlen(script);
+
+    memset(&scanner, 0, sizeof(Scanner));
+    lexer_init(&scanner.lexer, script, script + script_len);
+    scanner.last.type = TOKEN_END;
+    scanner.braces = g_string_new(NULL);
+    scanner.parens = g_string_new(NULL);
+    scanner.names = g_ptr_array_new_with_free_func(g_free);
+    scanner.seen = g_hash_table_new(g_str_hash, g_str_equal);
+
+    scan_declarations(&scanner);
+
+    epilogue = g_string_sized_new(128 + 128 * scanner.names->len);
+    g_string_append(epilogue, "\n;__gwkjsDefine(__gwkjsModule, {\n");
+    for (i = 0; i < scanner.names->len; i++) {
+        const char *name = (const char *) scanner.names->pdata[i];
+
+        g_string_append_printf(epilogue,
+                               "%s: { get: function() { return %s; }, "
+                               "set: function(__gwkjsValue) { %s = __gwkjsValue; }, "
+                               "enumerable: true, configurable: true },\n",
+                               name, name, name);
+    }
+    g_string_append(epilogue, "});\n}; })(Object.defineProperties)");
+
+    g_hash_table_destroy(scanner.seen);
+    g_ptr_array_free(scanner.names, TRUE);
+    g_string_free(scanner.braces, TRUE);
+    g_string_free(scanner.parens, TRUE);
+
+    return g_string_free(epilogue, FALSE);
+}
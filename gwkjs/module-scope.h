@@ -0,0 +1,74 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GWKJS_MODULE_SCOPE_H__
+#define __GWKJS_MODULE_SCOPE_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Modules are evaluated in a global object of their own, which makes
+ * their top-level declarations properties of the module object. A
+ * global object costs a full set of builtins, so a GwkjsContext created
+ * with "module-globals" set to FALSE instead evaluates modules in a
+ * function scope on the shared global. That saves memory and startup
+ * time, but it is not fully transparent to modules, which is why it
+ * has to be asked for:
+ *
+ * - assignments to undeclared names create properties of the shared
+ *   global rather than of the module;
+ * - the module's own __moduleName__, __file__ and __parentModule__ are
+ *   properties of the module object only, not names in scope in the
+ *   module body;
+ * - the declarations appear on the module object only once the body
+ *   has finished, so a module importing one that is still being
+ *   evaluated (an import cycle) sees none of them;
+ * - every read and write through the module object goes through an
+ *   accessor;
+ * - the exports are found by scanning the source for top-level
+ *   declarations, so names created in other ways (eval(), for one)
+ *   are not exported.
+ *
+ * GWKJS_MODULE_SCOPE_PROLOGUE, the script and the string returned by
+ * gwkjs_module_scope_get_epilogue() together are the source of a
+ * function expression taking the module object as its only argument.
+ * Calling it runs the module body and then defines an accessor on the
+ * module object for each top-level var, let, const, function and
+ * class, so that the module object reads and writes the module's own
+ * bindings.
+ *
+ * The prologue doesn't end the line, so that line numbers are
+ * unchanged, and a "use strict" directive is still the first statement
+ * of the body. Object.defineProperties() is looked up before the
+ * module gets a chance to shadow Object.
+ */
+#define GWKJS_MODULE_SCOPE_PROLOGUE \
+    "(function(__gwkjsDefine) { return function(__gwkjsModule) {"
+
+char *gwkjs_module_scope_get_epilogue (const char *script,
+                                       gssize      script_len);
+
+G_END_DECLS
+
+#endif  /* __GWKJS_MODULE_SCOPE_H__ */
@@ -0,0 +1,284 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "script-cache.h"
+#include "mem.h"
+
+#ifdef HAVE_JSSCRIPTCREATEFROMSTRING
+/* From JSScriptRefPrivate.h, which is not installed */
+typedef struct OpaqueJSScript *JSScriptRef;
+
+extern "C" {
+JS_EXPORT JSScriptRef JSScriptCreateFromString(JSContextGroupRef contextGroup, JSStringRef url,
+                                               int startingLineNumber, JSStringRef source,
+                                               JSStringRef *errorMessage, int *errorLine);
+JS_EXPORT void JSScriptRetain(JSScriptRef script);
+JS_EXPORT void JSScriptRelease(JSScriptRef script);
+JS_EXPORT JSValueRef JSScriptEvaluate(JSContextRef ctx, JSScriptRef script,
+                                      JSValueRef thisValue, JSValueRef *exception);
+}
+#endif
+
+/* Bigger scripts are programs or modules that run once */
+#define MAX_CACHED_SCRIPT_SIZE (64 * 1024)
+
+typedef struct {
+    /* The key */
+    char *source;
+    gsize source_len;
+    char *filename;
+    int start_line_number;
+    guint hash;
+
+#ifdef HAVE_JSSCRIPTCREATEFROMSTRING
+    JSScriptRef compiled;
+#else
+    JSStringRef source_string;
+    JSStringRef url;
+#endif
+
+    GList link;     /* in GwkjsScriptCache.lru, data points back here */
+} CachedScript;
+
+struct _GwkjsScriptCache {
+    GHashTable *scripts;    /* CachedScript -> itself */
+    GQueue lru;             /* most recently used first */
+    guint max_entries;
+};
+
+/* FNV-1a */
+static guint
+script_hash(const char *source,
+            gsize       source_len,
+            const char *filename,
+            int         start_line_number)
+{
+    guint32 hash = 2166136261u;
+    gsize i;
+
+    for (i = 0; i < source_len; i++)
+        hash = (hash ^ (guchar) source[i]) * 16777619u;
+    if (filename)
+        hash ^= g_str_hash(filename);
+    return hash ^ start_line_number;
+}
+
+static guint
+cached_script_hash(gconstpointer key)
+{
+    return ((const CachedScript *) key)->hash;
+}
+
+static gboolean
+cached_script_equal(gconstpointer a,
+                    gconstpointer b)
+{
+    const CachedScript *sa = (const CachedScript *) a;
+    const CachedScript *sb = (const CachedScript *) b;
+
+    return sa->hash == sb->hash &&
+        sa->source_len == sb->source_len &&
+        sa->start_line_number == sb->start_line_number &&
+        g_strcmp0(sa->filename, sb->filename) == 0 &&
+        memcmp(sa->source, sb->source, sa->source_len) == 0;
+}
+
+static void
+cached_script_free(CachedScript *entry)
+{
+#ifdef HAVE_JSSCRIPTCREATEFROMSTRING
+    JSScriptRelease(entry->compiled);
+#else
+    JSStringRelease(entry->source_string);
+    if (entry->url)
+        JSStringRelease(entry->url);
+#endif
+    g_free(entry->source);
+    g_free(entry->filename);
+    g_slice_free(CachedScript, entry);
+}
+
+GwkjsScriptCache *
+gwkjs_script_cache_new(guint max_entries)
+{
+    GwkjsScriptCache *cache;
+
+    g_return_val_if_fail(max_entries > 0, NULL);
+
+    cache = g_slice_new0(GwkjsScriptCache);
+    cache->scripts = g_hash_table_new(cached_script_hash, cached_script_equal);
+    g_queue_init(&cache->lru);
+    cache->max_entries = max_entries;
+
+    return cache;
+}
+
+void
+gwkjs_script_cache_free(GwkjsScriptCache *cache)
+{
+    GList *l, *next;
+
+    for (l = cache->lru.head; l; l = next) {
+        next = l->next;
+        cached_script_free((CachedScript *) l->data);
+    }
+    g_hash_table_destroy(cache->scripts);
+
+    g_slice_free(GwkjsScriptCache, cache);
+}
+
+/* Returns NULL if the script can't be cached */
+static CachedScript *
+cached_script_new(JSContextRef context,
+                  const char  *script,
+                  gsize        script_len,
+                  const char  *filename,
+                  int          start_line_number,
+                  guint        hash)
+{
+    CachedScript *entry;
+    JSStringRef source_string;
+    JSStringRef url = NULL;
+
+    source_string = gwkjs_jsstring_new_from_utf8(script, script_len, NULL);
+    if (source_string == NULL)
+        return NULL;
+    if (filename)
+        url = gwkjs_cstring_to_jsstring(filename);
+
+    entry = g_slice_new0(CachedScript);
+
+#ifdef HAVE_JSSCRIPTCREATEFROMSTRING
+    entry->compiled = JSScriptCreateFromString(JSContextGetGroup(context), url,
+                                               start_line_number, source_string,
+                                               NULL, NULL);
+    JSStringRelease(source_string);
+    if (url)
+        JSStringRelease(url);
+
+    if (entry->compiled == NULL) {
+        g_slice_free(CachedScript, entry);
+        return NULL;
+    }
+#else
+    entry->source_string = source_string;
+    entry->url = url;
+#endif
+
+    entry->source = (char *) g_malloc(script_len);
+    memcpy(entry->source, script, script_len);
+    entry->source_len = script_len;
+    entry->filename = g_strdup(filename);
+    entry->start_line_number = start_line_number;
+    entry->hash = hash;
+    entry->link.data = entry;
+
+    return entry;
+}
+
+/**
+ * gwkjs_script_cache_evaluate:
+ *
+ * Like JSEvaluateScript(), for @script_len bytes of UTF-8 at @script.
+ *
+ * Returns: %FALSE if @script wasn't evaluated because it can't be
+ * cached, either because it is too big to keep or because it doesn't
+ * compile; the caller then evaluates it as usual.
+ */
+gboolean
+gwkjs_script_cache_evaluate(GwkjsScriptCache *cache,
+                            JSContextRef      context,
+                            const char       *script,
+                            gsize             script_len,
+                            const char       *filename,
+                            int               start_line_number,
+                            JSObjectRef       this_object,
+                            JSValueRef       *retval_p,
+                            JSValueRef       *exception)
+{
+    CachedScript key, *entry;
+    JSValueRef retval;
+
+    if (script_len > MAX_CACHED_SCRIPT_SIZE)
+        return FALSE;
+
+    key.source = (char *) script;
+    key.source_len = script_len;
+    key.filename = (char *) filename;
+    key.start_line_number = start_line_number;
+    key.hash = script_hash(script, script_len, filename, start_line_number);
+
+    entry = (CachedScript *) g_hash_table_lookup(cache->scripts, &key);
+    if (entry != NULL) {
+        GWKJS_INC_STAT(script_cache_hit);
+        if (cache->lru.head != &entry->link) {
+            g_queue_unlink(&cache->lru, &entry->link);
+            g_queue_push_head_link(&cache->lru, &entry->link);
+        }
+    } else {
+        GWKJS_INC_STAT(script_cache_miss);
+
+        entry = cached_script_new(context, script, script_len, filename,
+                                  start_line_number, key.hash);
+        if (entry == NULL)
+            return FALSE;
+
+        if (cache->lru.length >= cache->max_entries) {
+            CachedScript *oldest = (CachedScript *) cache->lru.tail->data;
+
+            g_queue_unlink(&cache->lru, &oldest->link);
+            g_hash_table_remove(cache->scripts, oldest);
+            cached_script_free(oldest);
+        }
+
+        g_hash_table_add(cache->scripts, entry);
+        g_queue_push_head_link(&cache->lru, &entry->link);
+    }
+
+    /* The script may evaluate others and push this one out of the
+     * cache while it runs */
+#ifdef HAVE_JSSCRIPTCREATEFROMSTRING
+    JSScriptRef compiled = entry->compiled;
+
+    JSScriptRetain(compiled);
+    retval = JSScriptEvaluate(context, compiled, this_object, exception);
+    JSScriptRelease(compiled);
+#else
+    JSStringRef source_string = JSStringRetain(entry->source_string);
+    JSStringRef url = entry->url ? JSStringRetain(entry->url) : NULL;
+
+    retval = JSEvaluateScript(context, source_string, this_object,
+                              url, start_line_number, exception);
+    JSStringRelease(source_string);
+    if (url)
+        JSStringRelease(url);
+#endif
+
+    if (retval_p)
+        *retval_p = retval;
+    return TRUE;
+}
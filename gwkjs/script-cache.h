@@ -0,0 +1,64 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef __GWKJS_SCRIPT_CACHE_H__
+#define __GWKJS_SCRIPT_CACHE_H__
+
+#include <glib.h>
+
+#include "jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* Scripts that are evaluated over and over, like templates and rules
+ * passed to gwkjs_context_eval(), are kept compiled so that later
+ * evaluations skip converting and parsing the source. Scripts are
+ * looked up by their source, file name and first line; the cache
+ * keeps only the @max_entries most recently used.
+ *
+ * With JSScriptRef from JavaScriptCore's private API the cache holds
+ * compiled scripts; a script with a syntax error is never cached, so
+ * it throws the same way every time. Without it the cache holds the
+ * converted source, and JavaScriptCore's own code cache spares most of
+ * the parsing.
+ */
+
+typedef struct _GwkjsScriptCache GwkjsScriptCache;
+
+GwkjsScriptCache *gwkjs_script_cache_new      (guint             max_entries);
+void              gwkjs_script_cache_free     (GwkjsScriptCache *cache);
+
+gboolean          gwkjs_script_cache_evaluate (GwkjsScriptCache *cache,
+                                               JSContextRef      context,
+                                               const char       *script,
+                                               gsize             script_len,
+                                               const char       *filename,
+                                               int               start_line_number,
+                                               JSObjectRef       this_object,
+                                               JSValueRef       *retval_p,
+                                               JSValueRef       *exception);
+
+G_END_DECLS
+
+#endif  /* __GWKJS_SCRIPT_CACHE_H__ */
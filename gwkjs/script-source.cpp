@@ -0,0 +1,110 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "bundle.h"
+#include "script-source.h"
+
+static GBytes *
+load_resource(GFile   *file,
+              GError **error)
+{
+    char *uri, *path;
+    GBytes *bytes;
+    GError *local_error = NULL;
+
+    uri = g_file_get_uri(file);
+    path = g_uri_unescape_string(uri + strlen("resource://"), NULL);
+    g_free(uri);
+
+    /* Points into the resource bundle unless the file is compressed */
+    bytes = g_resources_lookup_data(path, G_RESOURCE_LOOKUP_FLAGS_NONE, &local_error);
+    g_free(path);
+
+    if (bytes == NULL) {
+        if (g_error_matches(local_error, G_RESOURCE_ERROR, G_RESOURCE_ERROR_NOT_FOUND))
+            g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                                local_error->message);
+        else
+            g_propagate_error(error, local_error);
+        g_clear_error(&local_error);
+    }
+
+    return bytes;
+}
+
+static GBytes *
+load_mapped(const char *path)
+{
+    GMappedFile *mapped;
+    GBytes *bytes;
+
+    mapped = g_mapped_file_new(path, FALSE, NULL);
+    if (mapped == NULL)
+        return NULL;
+
+    bytes = g_mapped_file_get_bytes(mapped);
+    g_mapped_file_unref(mapped);
+
+    return bytes;
+}
+
+GBytes *
+gwkjs_script_source_load(GFile   *file,
+                         GError **error)
+{
+    GBytes *bytes = NULL;
+    char *contents;
+    gsize length;
+
+    if (g_file_has_uri_scheme(file, "resource"))
+        return load_resource(file, error);
+
+    if (g_file_is_native(file)) {
+        char *path = g_file_get_path(file);
+        const char *relative_path;
+        GwkjsBundle *bundle = gwkjs_bundle_lookup(path, &relative_path);
+
+        if (bundle != NULL) {
+            bytes = gwkjs_bundle_get_source(bundle, relative_path, error);
+            g_free(path);
+            return bytes;
+        }
+
+        /* Mapping fails for directories and the like; leave it to
+         * GIO to say why */
+        bytes = load_mapped(path);
+        g_free(path);
+    }
+
+    if (bytes == NULL) {
+        if (!g_file_load_contents(file, NULL, &contents, &length, NULL, error))
+            return NULL;
+        bytes = g_bytes_new_take(contents, length);
+    }
+
+    return bytes;
+}
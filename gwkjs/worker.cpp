@@ -0,0 +1,943 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include <util/log.h>
+
+#include "worker.h"
+#include "context-private.h"
+#include "exceptions.h"
+#include "jsapi-util.h"
+
+/* Deeper messages are most likely cyclic */
+#define MAX_MESSAGE_DEPTH 128
+
+typedef struct _GwkjsWorker GwkjsWorker;
+
+typedef enum {
+    WORKER_EVENT_MESSAGE,
+    WORKER_EVENT_ERROR,     /* data is the message, "s" */
+    WORKER_EVENT_CLOSED,    /* the worker script called close() */
+} WorkerEventType;
+
+typedef struct {
+    WorkerEventType type;
+    GVariant *data;
+} WorkerEvent;
+
+struct _GwkjsWorker {
+    volatile gint ref_count;
+
+    char *filename;
+    char **search_path;
+
+    /* Creating side, only used on its thread */
+    GMainContext *owner_main_context;
+    JSGlobalContextRef owner_context;
+    JSObjectRef object;             /* protected until terminated or closed */
+
+    /* Worker side */
+    GMainContext *main_context;
+    GMainLoop *loop;
+
+    GMutex lock;                    /* for the rest */
+    GQueue to_worker;               /* WorkerEvents */
+    GQueue to_owner;
+    gboolean worker_dispatch_pending;
+    gboolean owner_dispatch_pending;
+    gboolean closed;                /* the worker takes no more messages */
+    gboolean owner_gone;            /* nor does the creating side */
+};
+
+/* The worker running on this thread, if any */
+static GPrivate current_worker;
+
+static JSClassRef gwkjs_worker_class_ref = NULL;
+
+static GwkjsWorker *
+worker_ref(GwkjsWorker *worker)
+{
+    g_atomic_int_inc(&worker->ref_count);
+    return worker;
+}
+
+static void
+worker_event_free(WorkerEvent *event)
+{
+    if (event->data)
+        g_variant_unref(event->data);
+    g_slice_free(WorkerEvent, event);
+}
+
+static void
+worker_unref(GwkjsWorker *worker)
+{
+    if (!g_atomic_int_dec_and_test(&worker->ref_count))
+        return;
+
+    g_queue_foreach(&worker->to_worker, (GFunc) worker_event_free, NULL);
+    g_queue_clear(&worker->to_worker);
+    g_queue_foreach(&worker->to_owner, (GFunc) worker_event_free, NULL);
+    g_queue_clear(&worker->to_owner);
+    g_mutex_clear(&worker->lock);
+
+    g_main_loop_unref(worker->loop);
+    g_main_context_unref(worker->main_context);
+    g_main_context_unref(worker->owner_main_context);
+    g_strfreev(worker->search_path);
+    g_free(worker->filename);
+    g_slice_free(GwkjsWorker, worker);
+}
+
+/* Messages are GVariants in a "v", so that they can be looked at
+ * before they're turned back into JS values:
+ *
+ *   undefined          ()
+ *   null               mv, Nothing
+ *   booleans, numbers  b, d
+ *   strings            aq, as UTF-16 so that any string goes through
+ *   arrays             av
+ *   ArrayBuffers       ay
+ *   typed arrays       (ayu), the bytes of the view and its type
+ *   objects            a{sv}, the enumerable properties
+ */
+static GVariant *value_to_variant (JSContextRef  context,
+                                   JSValueRef    value,
+                                   guint         depth,
+                                   JSValueRef   *exception);
+
+static GVariant *
+string_to_variant(JSContextRef context,
+                  JSValueRef   value,
+                  JSValueRef  *exception)
+{
+    JSStringRef string;
+    GVariant *variant;
+
+    string = JSValueToStringCopy(context, value, exception);
+    if (string == NULL)
+        return NULL;
+
+    variant = g_variant_new_fixed_array(G_VARIANT_TYPE_UINT16,
+                                        JSStringGetCharactersPtr(string),
+                                        JSStringGetLength(string),
+                                        sizeof(JSChar));
+    JSStringRelease(string);
+    return variant;
+}
+
+static GVariant *
+bytes_to_variant(const void *data,
+                 gsize       length)
+{
+    return g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE, data, length, 1);
+}
+
+static GVariant *
+array_to_variant(JSContextRef context,
+                 JSObjectRef  array,
+                 guint        depth,
+                 JSValueRef  *exception)
+{
+    GVariantBuilder builder;
+    guint32 length, i;
+
+    if (!gwkjs_array_get_length(context, array, &length)) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "Array in message has no length");
+        return NULL;
+    }
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("av"));
+    for (i = 0; i < length; i++) {
+        JSValueRef elem;
+        GVariant *child;
+
+        elem = JSObjectGetPropertyAtIndex(context, array, i, exception);
+        if (*exception)
+            goto fail;
+        child = value_to_variant(context, elem, depth + 1, exception);
+        if (child == NULL)
+            goto fail;
+        g_variant_builder_add(&builder, "v", child);
+    }
+    return g_variant_builder_end(&builder);
+
+ fail:
+    g_variant_builder_clear(&builder);
+    return NULL;
+}
+
+static GVariant *
+object_to_variant(JSContextRef context,
+                  JSObjectRef  obj,
+                  guint        depth,
+                  JSValueRef  *exception)
+{
+    GVariantBuilder builder;
+    JSPropertyNameArrayRef names;
+    size_t n_names, i;
+
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+    names = JSObjectCopyPropertyNames(context, obj);
+    n_names = JSPropertyNameArrayGetCount(names);
+    for (i = 0; i < n_names; i++) {
+        JSStringRef name = JSPropertyNameArrayGetNameAtIndex(names, i);
+        JSValueRef prop;
+        GVariant *child;
+        char *utf8_name;
+
+        prop = JSObjectGetProperty(context, obj, name, exception);
+        if (*exception)
+            goto fail;
+        child = value_to_variant(context, prop, depth + 1, exception);
+        if (child == NULL)
+            goto fail;
+
+        utf8_name = gwkjs_jsstring_to_cstring(name);
+        g_variant_builder_add(&builder, "{sv}", utf8_name, child);
+        g_free(utf8_name);
+    }
+    JSPropertyNameArrayRelease(names);
+    return g_variant_builder_end(&builder);
+
+ fail:
+    JSPropertyNameArrayRelease(names);
+    g_variant_builder_clear(&builder);
+    return NULL;
+}
+
+static GVariant *
+value_to_variant(JSContextRef  context,
+                 JSValueRef    value,
+                 guint         depth,
+                 JSValueRef   *exception)
+{
+    JSTypedArrayType array_type;
+    JSObjectRef obj;
+    GVariant *child;
+
+    if (depth > MAX_MESSAGE_DEPTH) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "Message is too deep, or cyclic");
+        return NULL;
+    }
+
+    switch (JSValueGetType(context, value)) {
+    case kJSTypeUndefined:
+        child = g_variant_new_tuple(NULL, 0);
+        break;
+    case kJSTypeNull:
+        child = g_variant_new_maybe(G_VARIANT_TYPE_VARIANT, NULL);
+        break;
+    case kJSTypeBoolean:
+        child = g_variant_new_boolean(JSValueToBoolean(context, value));
+        break;
+    case kJSTypeNumber:
+        child = g_variant_new_double(JSValueToNumber(context, value, NULL));
+        break;
+    case kJSTypeString:
+        child = string_to_variant(context, value, exception);
+        break;
+    case kJSTypeObject:
+        obj = JSValueToObject(context, value, NULL);
+
+        array_type = JSValueGetTypedArrayType(context, value, exception);
+        if (*exception)
+            return NULL;
+
+        if (array_type == kJSTypedArrayTypeArrayBuffer) {
+            void *data = JSObjectGetArrayBufferBytesPtr(context, obj, exception);
+            gsize length = JSObjectGetArrayBufferByteLength(context, obj, exception);
+
+            if (*exception)
+                return NULL;
+            child = bytes_to_variant(data, length);
+        } else if (array_type != kJSTypedArrayTypeNone) {
+            void *data = JSObjectGetTypedArrayBytesPtr(context, obj, exception);
+            gsize length = JSObjectGetTypedArrayByteLength(context, obj, exception);
+
+            if (*exception)
+                return NULL;
+            child = g_variant_new("(@ayu)", bytes_to_variant(data, length),
+                                  (guint32) array_type);
+        } else if (JSObjectIsFunction(context, obj)) {
+            gwkjs_make_exception(context, exception, "Error",
+                                 "Functions can't be sent to or from a worker");
+            return NULL;
+        } else if (JSValueIsArray(context, value)) {
+            child = array_to_variant(context, obj, depth, exception);
+        } else if (JSObjectGetPrivate(obj) != NULL) {
+            /* Wrappers of native objects only make sense on their
+             * own thread */
+            gwkjs_make_exception(context, exception, "Error",
+                                 "Native objects can't be sent to or from a worker");
+            return NULL;
+        } else {
+            child = object_to_variant(context, obj, depth, exception);
+        }
+        break;
+    default:
+        gwkjs_make_exception(context, exception, "Error",
+                             "Value can't be sent to or from a worker");
+        return NULL;
+    }
+
+    if (child == NULL)
+        return NULL;
+    return g_variant_new_variant(child);
+}
+
+static void
+free_buffer_bytes(void *data,
+                  void *bytes)
+{
+    g_bytes_unref((GBytes *) bytes);
+}
+
+/* The receiving side gets the copy made when the message was sent;
+ * it is only copied again if it isn't aligned for a typed array */
+static JSObjectRef
+variant_to_array_buffer(JSContextRef  context,
+                        GVariant     *variant,
+                        JSValueRef   *exception)
+{
+    GBytes *bytes = g_variant_get_data_as_bytes(variant);
+    gsize length;
+    gconstpointer data = g_bytes_get_data(bytes, &length);
+
+    if (data == NULL || ((gsize) data % sizeof(gdouble)) != 0) {
+        g_bytes_unref(bytes);
+        bytes = g_bytes_new(data, length);
+        data = g_bytes_get_data(bytes, NULL);
+    }
+
+    return JSObjectMakeArrayBufferWithBytesNoCopy(context, (void *) data, length,
+                                                  free_buffer_bytes, bytes,
+                                                  exception);
+}
+
+static JSValueRef
+variant_to_value(JSContextRef  context,
+                 GVariant     *variant,
+                 JSValueRef   *exception)
+{
+    GVariant *child = g_variant_get_variant(variant);
+    const GVariantType *type = g_variant_get_type(child);
+    JSValueRef value = NULL;
+
+    if (g_variant_type_equal(type, G_VARIANT_TYPE_UNIT)) {
+        value = JSValueMakeUndefined(context);
+    } else if (g_variant_type_is_maybe(type)) {
+        value = JSValueMakeNull(context);
+    } else if (g_variant_type_equal(type, G_VARIANT_TYPE_BOOLEAN)) {
+        value = JSValueMakeBoolean(context, g_variant_get_boolean(child));
+    } else if (g_variant_type_equal(type, G_VARIANT_TYPE_DOUBLE)) {
+        value = JSValueMakeNumber(context, g_variant_get_double(child));
+    } else if (g_variant_type_equal(type, G_VARIANT_TYPE("aq"))) {
+        gsize length;
+        const JSChar *chars = (const JSChar *)
+            g_variant_get_fixed_array(child, &length, sizeof(JSChar));
+        JSStringRef string = JSStringCreateWithCharacters(chars, length);
+
+        value = JSValueMakeString(context, string);
+        JSStringRelease(string);
+    } else if (g_variant_type_equal(type, G_VARIANT_TYPE_BYTESTRING)) {
+        value = variant_to_array_buffer(context, child, exception);
+    } else if (g_variant_type_equal(type, G_VARIANT_TYPE("(ayu)"))) {
+        GVariant *data = g_variant_get_child_value(child, 0);
+        guint32 array_type;
+        JSObjectRef buffer;
+
+        g_variant_get_child(child, 1, "u", &array_type);
+        buffer = variant_to_array_buffer(context, data, exception);
+        g_variant_unref(data);
+        if (buffer)
+            value = JSObjectMakeTypedArrayWithArrayBuffer(context,
+                                                          (JSTypedArrayType) array_type,
+                                                          buffer, exception);
+    } else if (g_variant_type_equal(type, G_VARIANT_TYPE("av"))) {
+        gsize n = g_variant_n_children(child), i;
+        JSObjectRef array = JSObjectMakeArray(context, 0, NULL, exception);
+
+        /* Elements are set one at a time so that they are always
+         * reachable from the array */
+        for (i = 0; array && i < n; i++) {
+            GVariant *elem_variant = g_variant_get_child_value(child, i);
+            JSValueRef elem = variant_to_value(context, elem_variant, exception);
+
+            g_variant_unref(elem_variant);
+            if (elem == NULL)
+                break;
+            JSObjectSetPropertyAtIndex(context, array, i, elem, exception);
+        }
+        if (!*exception)
+            value = array;
+    } else if (g_variant_type_equal(type, G_VARIANT_TYPE_VARDICT)) {
+        JSObjectRef obj = JSObjectMake(context, NULL, NULL);
+        GVariantIter iter;
+        const char *name;
+        GVariant *prop_variant;
+
+        g_variant_iter_init(&iter, child);
+        while (g_variant_iter_next(&iter, "{&s@v}", &name, &prop_variant)) {
+            JSValueRef prop = variant_to_value(context, prop_variant, exception);
+
+            g_variant_unref(prop_variant);
+            if (prop == NULL)
+                break;
+            gwkjs_object_set_property(context, obj, name, prop,
+                                      kJSPropertyAttributeNone, exception);
+        }
+        if (!*exception)
+            value = obj;
+    } else {
+        gwkjs_make_exception(context, exception, "Error",
+                             "Unexpected message of type %s",
+                             g_variant_get_type_string(child));
+    }
+
+    g_variant_unref(child);
+    return *exception ? NULL : value;
+}
+
+/* Event delivery. The queues are drained by an idle on the receiving
+ * main context, scheduled once for any number of queued events. */
+
+static gboolean dispatch_to_worker (gpointer data);
+static gboolean dispatch_to_owner  (gpointer data);
+
+static void
+schedule_dispatch(GwkjsWorker  *worker,
+                  GMainContext *main_context,
+                  GSourceFunc   func)
+{
+    GSource *source = g_idle_source_new();
+
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, func, worker_ref(worker),
+                          (GDestroyNotify) worker_unref);
+    g_source_attach(source, main_context);
+    g_source_unref(source);
+}
+
+static void
+post_to_worker(GwkjsWorker *worker,
+               GVariant    *data)
+{
+    WorkerEvent *event = g_slice_new0(WorkerEvent);
+
+    event->type = WORKER_EVENT_MESSAGE;
+    event->data = g_variant_ref_sink(data);
+
+    /* The idle is attached under the lock, so that it is never
+     * attached after the worker has stopped */
+    g_mutex_lock(&worker->lock);
+    if (worker->closed) {
+        g_mutex_unlock(&worker->lock);
+        worker_event_free(event);
+        return;
+    }
+    g_queue_push_tail(&worker->to_worker, event);
+    if (!worker->worker_dispatch_pending) {
+        worker->worker_dispatch_pending = TRUE;
+        schedule_dispatch(worker, worker->main_context, dispatch_to_worker);
+    }
+    g_mutex_unlock(&worker->lock);
+}
+
+static void
+post_to_owner(GwkjsWorker     *worker,
+              WorkerEventType  type,
+              GVariant        *data)
+{
+    WorkerEvent *event = g_slice_new0(WorkerEvent);
+
+    event->type = type;
+    event->data = data ? g_variant_ref_sink(data) : NULL;
+
+    g_mutex_lock(&worker->lock);
+    if (worker->owner_gone) {
+        g_mutex_unlock(&worker->lock);
+        worker_event_free(event);
+        return;
+    }
+    g_queue_push_tail(&worker->to_owner, event);
+    if (!worker->owner_dispatch_pending) {
+        worker->owner_dispatch_pending = TRUE;
+        schedule_dispatch(worker, worker->owner_main_context, dispatch_to_owner);
+    }
+    g_mutex_unlock(&worker->lock);
+}
+
+static gboolean
+quit_worker_loop(gpointer data)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) data;
+
+    g_main_loop_quit(worker->loop);
+    return G_SOURCE_REMOVE;
+}
+
+/* Stops the worker after the event it may be handling; the messages
+ * still queued for it are dropped */
+static void
+worker_close(GwkjsWorker *worker)
+{
+    /* Quitting from an idle can't be missed even if the loop isn't
+     * running yet */
+    g_mutex_lock(&worker->lock);
+    if (!worker->closed) {
+        worker->closed = TRUE;
+        schedule_dispatch(worker, worker->main_context, quit_worker_loop);
+    }
+    g_mutex_unlock(&worker->lock);
+}
+
+/* On the creating thread, once no more events are wanted there */
+static void
+worker_release_owner(GwkjsWorker *worker)
+{
+    JSGlobalContextRef owner_context = worker->owner_context;
+
+    if (owner_context == NULL)
+        return;
+
+    g_mutex_lock(&worker->lock);
+    worker->owner_gone = TRUE;
+    g_mutex_unlock(&worker->lock);
+
+    worker->owner_context = NULL;
+    JSValueUnprotect(owner_context, worker->object);
+    JSGlobalContextRelease(owner_context);
+}
+
+static void
+call_handler(JSContextRef  context,
+             JSObjectRef   this_obj,
+             const char   *handler_name,
+             const char   *field,
+             JSValueRef    value)
+{
+    JSValueRef exception = NULL;
+    JSValueRef handler;
+    JSObjectRef handler_obj;
+    JSValueRef args[1];
+
+    handler = gwkjs_object_get_property(context, this_obj, handler_name, &exception);
+    if (exception)
+        goto out;
+    if (!JSValueIsObject(context, handler))
+        return;
+    handler_obj = JSValueToObject(context, handler, NULL);
+    if (!JSObjectIsFunction(context, handler_obj))
+        return;
+
+    args[0] = JSObjectMake(context, NULL, NULL);
+    gwkjs_object_set_property(context, (JSObjectRef) args[0], field, value,
+                              kJSPropertyAttributeNone, &exception);
+    if (exception)
+        goto out;
+
+    JSObjectCallAsFunction(context, handler_obj, this_obj, 1, args, &exception);
+
+ out:
+    if (exception)
+        gwkjs_log_exception(context, exception);
+}
+
+static GQueue *
+steal_events(GwkjsWorker *worker,
+             GQueue      *queue,
+             gboolean    *pending)
+{
+    GQueue *events = g_queue_new();
+
+    g_mutex_lock(&worker->lock);
+    *events = *queue;
+    g_queue_init(queue);
+    *pending = FALSE;
+    g_mutex_unlock(&worker->lock);
+
+    return events;
+}
+
+static gboolean
+dispatch_to_worker(gpointer data)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) data;
+    GwkjsContext *gwkjs_context = gwkjs_context_get_current();
+    JSContextRef context = (JSContextRef) gwkjs_context_get_native_context(gwkjs_context);
+    JSObjectRef global = JSContextGetGlobalObject(context);
+    GQueue *events;
+    WorkerEvent *event;
+
+    events = steal_events(worker, &worker->to_worker, &worker->worker_dispatch_pending);
+    while ((event = (WorkerEvent *) g_queue_pop_head(events))) {
+        JSValueRef exception = NULL;
+        JSValueRef value;
+        gboolean closed;
+
+        g_mutex_lock(&worker->lock);
+        closed = worker->closed;
+        g_mutex_unlock(&worker->lock);
+
+        if (!closed) {
+            value = variant_to_value(context, event->data, &exception);
+            if (value)
+                call_handler(context, global, "onmessage", "data", value);
+            else
+                gwkjs_log_exception(context, exception);
+        }
+        worker_event_free(event);
+    }
+    g_queue_free(events);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+dispatch_to_owner(gpointer data)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) data;
+    GQueue *events;
+    WorkerEvent *event;
+
+    events = steal_events(worker, &worker->to_owner, &worker->owner_dispatch_pending);
+    while ((event = (WorkerEvent *) g_queue_pop_head(events))) {
+        JSContextRef context = worker->owner_context;
+        JSValueRef exception = NULL;
+        JSValueRef value;
+
+        /* Terminated while these were queued */
+        if (context == NULL) {
+            worker_event_free(event);
+            continue;
+        }
+
+        switch (event->type) {
+        case WORKER_EVENT_MESSAGE:
+            value = variant_to_value(context, event->data, &exception);
+            if (value)
+                call_handler(context, worker->object, "onmessage", "data", value);
+            else
+                gwkjs_log_exception(context, exception);
+            break;
+        case WORKER_EVENT_ERROR:
+            value = gwkjs_cstring_to_jsvalue(context,
+                                             g_variant_get_string(event->data, NULL));
+            call_handler(context, worker->object, "onerror", "message", value);
+            break;
+        case WORKER_EVENT_CLOSED:
+            worker_release_owner(worker);
+            break;
+        }
+        worker_event_free(event);
+    }
+    g_queue_free(events);
+
+    return G_SOURCE_REMOVE;
+}
+
+/* Functions of the worker's global object */
+
+static JSValueRef
+worker_global_post_message(JSContextRef     context,
+                           JSObjectRef      function,
+                           JSObjectRef      this_obj,
+                           size_t           argc,
+                           const JSValueRef argv[],
+                           JSValueRef      *exception)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) g_private_get(&current_worker);
+    GVariant *data;
+
+    data = value_to_variant(context,
+                            argc > 0 ? argv[0] : JSValueMakeUndefined(context),
+                            0, exception);
+    if (data == NULL)
+        return NULL;
+
+    post_to_owner(worker, WORKER_EVENT_MESSAGE, data);
+    return JSValueMakeUndefined(context);
+}
+
+static JSValueRef
+worker_global_close(JSContextRef     context,
+                    JSObjectRef      function,
+                    JSObjectRef      this_obj,
+                    size_t           argc,
+                    const JSValueRef argv[],
+                    JSValueRef      *exception)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) g_private_get(&current_worker);
+
+    worker_close(worker);
+    post_to_owner(worker, WORKER_EVENT_CLOSED, NULL);
+    return JSValueMakeUndefined(context);
+}
+
+static gpointer
+worker_thread_main(gpointer data)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) data;
+    GwkjsContext *gwkjs_context;
+    JSContextRef context;
+    JSObjectRef global;
+    GError *error = NULL;
+    gboolean closed;
+
+    g_main_context_push_thread_default(worker->main_context);
+    g_private_set(&current_worker, worker);
+
+    gwkjs_context = gwkjs_context_new_with_search_path(worker->search_path);
+    _gwkjs_context_set_worker(gwkjs_context);
+
+    context = (JSContextRef) gwkjs_context_get_native_context(gwkjs_context);
+    global = JSContextGetGlobalObject(context);
+    gwkjs_object_set_property(context, global, "postMessage",
+                              JSObjectMakeFunctionWithCallback(context, NULL,
+                                                               worker_global_post_message),
+                              kJSPropertyAttributeDontEnum, NULL);
+    gwkjs_object_set_property(context, global, "close",
+                              JSObjectMakeFunctionWithCallback(context, NULL,
+                                                               worker_global_close),
+                              kJSPropertyAttributeDontEnum, NULL);
+
+    if (!gwkjs_context_eval_file(gwkjs_context, worker->filename, NULL, &error)) {
+        char *message = error ? g_strdup(error->message) :
+            g_strdup_printf("Failed to run worker script %s", worker->filename);
+
+        post_to_owner(worker, WORKER_EVENT_ERROR, g_variant_new_take_string(message));
+        g_clear_error(&error);
+    }
+
+    g_mutex_lock(&worker->lock);
+    closed = worker->closed;
+    g_mutex_unlock(&worker->lock);
+
+    if (!closed)
+        g_main_loop_run(worker->loop);
+
+    /* Events still queued are dropped, but their idles hold
+     * references to the worker */
+    while (g_main_context_iteration(worker->main_context, FALSE))
+        ;
+
+    _gwkjs_context_destroy_worker(gwkjs_context);
+
+    g_private_set(&current_worker, NULL);
+    g_main_context_pop_thread_default(worker->main_context);
+
+    worker_unref(worker);
+    return NULL;
+}
+
+/* The Worker class on the creating side */
+
+static void
+worker_finalize(JSObjectRef obj)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) JSObjectGetPrivate(obj);
+
+    if (worker == NULL)
+        return;
+
+    /* Only when the heap goes away is this still running */
+    worker_close(worker);
+    g_mutex_lock(&worker->lock);
+    worker->owner_gone = TRUE;
+    g_mutex_unlock(&worker->lock);
+
+    /* The context is being torn down, so it can't be released here */
+    worker->owner_context = NULL;
+    worker->object = NULL;
+    worker_unref(worker);
+}
+
+static JSValueRef
+worker_post_message(JSContextRef     context,
+                    JSObjectRef      function,
+                    JSObjectRef      this_obj,
+                    size_t           argc,
+                    const JSValueRef argv[],
+                    JSValueRef      *exception)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) JSObjectGetPrivate(this_obj);
+    GVariant *data;
+
+    if (worker == NULL || !JSValueIsObjectOfClass(context, this_obj, gwkjs_worker_class_ref)) {
+        gwkjs_make_exception(context, exception, "TypeError",
+                             "postMessage called on an object that is not a Worker");
+        return NULL;
+    }
+
+    /* A second argument listing buffers to transfer is accepted, but
+     * JSC can't detach ArrayBuffers, so they are copied like the rest */
+    data = value_to_variant(context,
+                            argc > 0 ? argv[0] : JSValueMakeUndefined(context),
+                            0, exception);
+    if (data == NULL)
+        return NULL;
+
+    post_to_worker(worker, data);
+    return JSValueMakeUndefined(context);
+}
+
+static JSValueRef
+worker_terminate(JSContextRef     context,
+                 JSObjectRef      function,
+                 JSObjectRef      this_obj,
+                 size_t           argc,
+                 const JSValueRef argv[],
+                 JSValueRef      *exception)
+{
+    GwkjsWorker *worker = (GwkjsWorker *) JSObjectGetPrivate(this_obj);
+
+    if (worker == NULL || !JSValueIsObjectOfClass(context, this_obj, gwkjs_worker_class_ref)) {
+        gwkjs_make_exception(context, exception, "TypeError",
+                             "terminate called on an object that is not a Worker");
+        return NULL;
+    }
+
+    worker_close(worker);
+    worker_release_owner(worker);
+    return JSValueMakeUndefined(context);
+}
+
+static JSStaticFunction gwkjs_worker_proto_funcs[] = {
+    { "postMessage", worker_post_message, kJSPropertyAttributeDontDelete },
+    { "terminate", worker_terminate, kJSPropertyAttributeDontDelete },
+    { NULL, NULL, 0 }
+};
+
+static JSClassDefinition gwkjs_worker_class = {
+    0,                         //     Version
+    kJSClassAttributeNone,     //     JSClassAttributes
+    "Worker",                  //     const char* className;
+    NULL,                      //     JSClassRef parentClass;
+    NULL,                      //     const JSStaticValue*                staticValues;
+    gwkjs_worker_proto_funcs,  //     const JSStaticFunction*             staticFunctions;
+    NULL,                      //     JSObjectInitializeCallback          initialize;
+    worker_finalize,           //     JSObjectFinalizeCallback            finalize;
+    NULL,                      //     JSObjectHasPropertyCallback         hasProperty;
+    NULL,                      //     JSObjectGetPropertyCallback         getProperty;
+    NULL,                      //     JSObjectSetPropertyCallback         setProperty;
+    NULL,                      //     JSObjectDeletePropertyCallback      deleteProperty;
+    NULL,                      //     JSObjectGetPropertyNamesCallback    getPropertyNames;
+    NULL,                      //     JSObjectCallAsFunctionCallback      callAsFunction;
+    NULL,                      //     JSObjectCallAsConstructorCallback   callAsConstructor;
+    NULL,                      //     JSObjectHasInstanceCallback         hasInstance;
+    NULL,                      //     JSObjectConvertToTypeCallback       convertToType;
+};
+
+static JSObjectRef
+worker_constructor(JSContextRef     context,
+                   JSObjectRef      constructor,
+                   size_t           argc,
+                   const JSValueRef argv[],
+                   JSValueRef      *exception)
+{
+    GwkjsContext *gwkjs_context;
+    GwkjsWorker *worker;
+    GThread *thread;
+    GError *error = NULL;
+    char *filename;
+
+    if (argc < 1 || !JSValueIsString(context, argv[0])) {
+        gwkjs_make_exception(context, exception, "TypeError",
+                             "Worker() expects the file name of a script");
+        return NULL;
+    }
+
+    gwkjs_context = gwkjs_get_private_context(context);
+    if (gwkjs_context == NULL) {
+        gwkjs_make_exception(context, exception, "Error",
+                             "Workers can only be created from a GwkjsContext");
+        return NULL;
+    }
+
+    filename = gwkjs_jsvalue_to_cstring(context, argv[0], exception);
+    if (filename == NULL)
+        return NULL;
+
+    worker = g_slice_new0(GwkjsWorker);
+    worker->ref_count = 1;              /* for the object */
+    worker->filename = filename;
+    worker->search_path = g_strdupv((char **) _gwkjs_context_get_search_path(gwkjs_context));
+    worker->owner_main_context = g_main_context_ref_thread_default();
+    worker->owner_context = JSGlobalContextRetain(JSContextGetGlobalContext(context));
+    worker->main_context = g_main_context_new();
+    worker->loop = g_main_loop_new(worker->main_context, FALSE);
+    g_mutex_init(&worker->lock);
+    g_queue_init(&worker->to_worker);
+    g_queue_init(&worker->to_owner);
+
+    /* Kept alive for its handlers until terminated or closed */
+    worker->object = JSObjectMake(context, gwkjs_worker_class_ref, worker);
+    JSValueProtect(context, worker->object);
+
+    thread = g_thread_try_new("gwkjs-worker", worker_thread_main,
+                              worker_ref(worker), &error);
+    if (thread == NULL) {
+        worker_unref(worker);
+        worker_release_owner(worker);
+        gwkjs_make_exception_from_gerror(context, exception, error);
+        g_error_free(error);
+        return NULL;
+    }
+    g_thread_unref(thread);
+
+    gwkjs_debug(GWKJS_DEBUG_CONTEXT, "Started worker for %s", filename);
+
+    return worker->object;
+}
+
+JSBool
+gwkjs_define_worker_stuff(JSContextRef  context,
+                          JSObjectRef  *module_out)
+{
+    JSValueRef exception = NULL;
+    JSObjectRef module;
+
+    /* Workers can start workers of their own */
+    if (g_once_init_enter(&gwkjs_worker_class_ref))
+        g_once_init_leave(&gwkjs_worker_class_ref,
+                          JSClassCreate(&gwkjs_worker_class));
+
+    module = JSObjectMake(context, NULL, NULL);
+    gwkjs_object_set_property(context, module, "Worker",
+                              JSObjectMakeConstructor(context, gwkjs_worker_class_ref,
+                                                      worker_constructor),
+                              kJSPropertyAttributeReadOnly |
+                              kJSPropertyAttributeDontDelete, &exception);
+    if (exception)
+        return JS_FALSE;
+
+    *module_out = module;
+    return JS_TRUE;
+}
@@ -0,0 +1,57 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Copyright (c) 2008  litl, LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __GWKJS_WORKER_H__
+#define __GWKJS_WORKER_H__
+
+#include <glib.h>
+#include "gwkjs/jsapi-util.h"
+
+G_BEGIN_DECLS
+
+/* imports.worker runs scripts on threads of their own:
+ *
+ *   const Worker = imports.worker;
+ *   let worker = new Worker.Worker('parser.js');
+ *   worker.onmessage = function(event) { ... event.data ... };
+ *   worker.onerror = function(event) { ... event.message ... };
+ *   worker.postMessage(value);
+ *   worker.terminate();
+ *
+ * Each worker has its own context group, GwkjsContext and
+ * GMainContext, with the search path of the context that created it.
+ * The worker script gets postMessage(), close() and the messages sent
+ * to it through a global onmessage(). Messages to the creating side
+ * are delivered on the main context that was the thread default when
+ * the worker was created, so it must be running.
+ *
+ * Messages are copies: undefined, null, booleans, numbers, strings,
+ * arrays, plain objects, ArrayBuffers and typed arrays can be sent.
+ * GObjects can't, and imports.gi is not available to workers.
+ */
+JSBool        gwkjs_define_worker_stuff (JSContextRef  context,
+                                         JSObjectRef  *module_out);
+
+G_END_DECLS
+
+#endif  /* __GWKJS_WORKER_H__ */
@@ -320,6 +320,17 @@ function testArrayIn() {
     JSUnit.assertEquals(10, Everything.test_array_gint16_in("\x01\x02\x03\x04"));
     JSUnit.assertEquals(2560, Everything.test_array_gint16_in("\u0100\u0200\u0300\u0400"));
 
+    // typed arrays, lent as is when the element type matches
+    JSUnit.assertEquals(10, Everything.test_array_gint8_in(new Int8Array([1,2,3,4])));
+    JSUnit.assertEquals(10, Everything.test_array_gint16_in(new Int16Array([1,2,3,4])));
+    JSUnit.assertEquals(10, Everything.test_array_gint32_in(new Int32Array([1,2,3,4])));
+    JSUnit.assertEquals(-6, Everything.test_array_gint32_in(new Int32Array([-1,-2,-3])));
+    // ...and converted from the backing store when it doesn't
+    JSUnit.assertEquals(10, Everything.test_array_gint32_in(new Uint8Array([1,2,3,4])));
+    JSUnit.assertEquals(10, Everything.test_array_gint16_in(new Int32Array([1,2,3,4])));
+    JSUnit.assertEquals(10, Everything.test_array_gint32_in(new Float64Array([1,2,3,4])));
+    JSUnit.assertEquals(0, Everything.test_array_gint32_in(new Int32Array(0)));
+
     // GType arrays
     JSUnit.assertEquals('[GSimpleAction,GIcon,GBoxed,]',
                  Everything.test_array_gtype_in([Gio.SimpleAction, Gio.Icon, GObject.TYPE_BOXED]));
@@ -344,6 +355,7 @@ function testArrayOut() {
 
     let array = Everything.test_array_int_out();
     arrayEqual([0, 1, 2, 3, 4], array);
+    JSUnit.assertTrue(Array.isArray(array));
 
     let array =  Everything.test_array_fixed_size_int_out();
     JSUnit.assertEquals(0, array[0]);
@@ -357,6 +369,15 @@ function testArrayOut() {
 
     array = Everything.test_array_int_full_out();
     arrayEqual([0, 1, 2, 3, 4], array);
+    JSUnit.assertTrue(Array.isArray(array));
+
+    // numeric arrays come back as typed arrays when asked for; this one
+    // adopts the buffer
+    Everything.test_array_int_full_out.typedArrays = true;
+    array = Everything.test_array_int_full_out();
+    Everything.test_array_int_full_out.typedArrays = false;
+    arrayEqual([0, 1, 2, 3, 4], array);
+    JSUnit.assertTrue(array instanceof Int32Array);
 
     array = Everything.test_array_int_null_out();
     JSUnit.assertEquals(0, array.length);
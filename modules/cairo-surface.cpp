@@ -130,6 +130,21 @@ JSFunctionSpec gwkjs_cairo_surface_proto_funcs[] = {
     { NULL }
 };
 
+/* Only image surfaces keep their pixels in our address space; the
+ * others are backed by files, streams or the X server */
+static gsize
+surface_native_size(GType    gtype,
+                    gpointer instance)
+{
+    cairo_surface_t *surface = (cairo_surface_t *) instance;
+
+    if (cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE)
+        return 0;
+
+    return (gsize) cairo_image_surface_get_stride(surface) *
+        cairo_image_surface_get_height(surface);
+}
+
 /* Public API */
 
 /**
@@ -162,6 +177,8 @@ gwkjs_cairo_surface_construct(JSContextRef       context,
     priv->context = context;
     priv->object = object;
     priv->surface = cairo_surface_reference(surface);
+
+    gwkjs_report_native_size(context, CAIRO_GOBJECT_TYPE_SURFACE, surface);
 }
 
 /**
@@ -305,4 +322,6 @@ void
 gwkjs_cairo_surface_init(JSContextRef context)
 {
     gwkjs_struct_foreign_register("cairo", "Surface", &foreign_info);
+    gwkjs_register_native_size_func(CAIRO_GOBJECT_TYPE_SURFACE,
+                                    surface_native_size);
 }
@@ -112,7 +112,7 @@ gwkjs_gc(JSContextRef ctx,
         NUMARG_EXPECTED_EXCEPTION("gc", "0 arguments");
     }
 
-    JSGarbageCollect(ctx);
+    gwkjs_force_gc(ctx);
     return JSValueMakeUndefined(ctx);
 }
 
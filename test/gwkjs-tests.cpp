@@ -24,11 +24,13 @@
 #include <config.h>
 #include <glib.h>
 #include <glib-object.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <unistd.h>
 #include <gwkjs/gwkjs-module.h>
 #include <util/glib.h>
 #include <util/crash.h>
-
-#include "gwkjs-tests-add-funcs.h"
+#include <gwkjs/bundle.h>
 
 typedef struct _GwkjsUnitTestFixture GwkjsUnitTestFixture;
 
@@ -37,27 +39,16 @@ struct _GwkjsUnitTestFixture {
     GwkjsContext *gwkjs_context;
 };
 
-static void
-test_error_reporter(JSContextRef     context,
-                    const char    *message,
-                    JSErrorReport *report)
-{
-    g_printerr("error reported by test: %s\n", message);
-}
-
 static void
 _gwkjs_unit_test_fixture_begin (GwkjsUnitTestFixture *fixture)
 {
     fixture->gwkjs_context = gwkjs_context_new ();
     fixture->context = (JSContextRef ) gwkjs_context_get_native_context (fixture->gwkjs_context);
-    JS_BeginRequest(fixture->context);
-    JS_SetErrorReporter(fixture->context, test_error_reporter);
 }
 
 static void
 _gwkjs_unit_test_fixture_finish (GwkjsUnitTestFixture *fixture)
 {
-    JS_EndRequest(fixture->context);
     g_object_unref(fixture->gwkjs_context);
 }
 
@@ -89,6 +80,38 @@ gwkjstest_test_func_gwkjs_context_construct_eval(void)
     g_object_unref (context);
 }
 
+static void
+gwkjstest_test_func_gwkjs_context_eval_script_cache(void)
+{
+    GwkjsContext *context;
+    int estatus;
+    GError *error = NULL;
+    int hits, i;
+
+    context = gwkjs_context_new ();
+
+    hits = GWKJS_GET_STAT(script_cache_hit);
+    for (i = 0; i < 3; i++) {
+        if (!gwkjs_context_eval (context, "var counter = (this.counter || 0) + 1;",
+                                 -1, "<input>", &estatus, &error))
+            g_error ("%s", error->message);
+    }
+    g_assert_cmpint(GWKJS_GET_STAT(script_cache_hit), ==, hits + 2);
+
+    /* Cached scripts still run each time */
+    if (!gwkjs_context_eval (context, "if (counter !== 3) throw new Error();",
+                             -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+
+    /* A script that doesn't compile fails every time */
+    for (i = 0; i < 2; i++) {
+        g_assert(!gwkjs_context_eval (context, "var = ;", -1, "<input>", &estatus, &error));
+        g_clear_error(&error);
+    }
+
+    g_object_unref (context);
+}
+
 #define N_ELEMS 15
 
 static void
@@ -96,39 +119,34 @@ gwkjstest_test_func_gwkjs_jsapi_util_array(void)
 {
     GwkjsUnitTestFixture fixture;
     JSContextRef context;
-    JSObjectRef global;
-    GwkjsRootedArray *array;
+    JSObjectRef array;
+    jsval values[N_ELEMS];
     int i;
-    jsval value;
 
     _gwkjs_unit_test_fixture_begin(&fixture);
     context = fixture.context;
 
-    array = gwkjs_rooted_array_new();
+    for (i = 0; i < N_ELEMS; i++)
+        g_assert(gwkjs_string_from_utf8(context, "abcdefghijk", -1, &values[i]));
 
-    global = JS_GetGlobalObject(context);
-    JSCompartment *oldCompartment = JS_EnterCompartment(context, global);
+    array = JSObjectMakeArray(context, N_ELEMS, values, NULL);
+    g_assert(array != NULL);
+    JSValueProtect(context, array);
 
-    for (i = 0; i < N_ELEMS; i++) {
-        value = STRING_TO_JSVAL(JS_NewStringCopyZ(context, "abcdefghijk"));
-        gwkjs_rooted_array_append(context, array, value);
-    }
-
-    JS_GC(JS_GetRuntime(context));
+    JSGarbageCollect(context);
 
     for (i = 0; i < N_ELEMS; i++) {
+        jsval value;
         char *ascii;
 
-        value = gwkjs_rooted_array_get(context, array, i);
-        g_assert(JSVAL_IS_STRING(value));
+        value = JSObjectGetPropertyAtIndex(context, array, i, NULL);
+        g_assert(JSVAL_IS_STRING(context, value));
         gwkjs_string_to_utf8(context, value, &ascii);
         g_assert(strcmp(ascii, "abcdefghijk") == 0);
         g_free(ascii);
     }
 
-    gwkjs_rooted_array_free(context, array, TRUE);
-
-    JS_LeaveCompartment(context, oldCompartment);
+    JSValueUnprotect(context, array);
     _gwkjs_unit_test_fixture_finish(&fixture);
 }
 
@@ -139,7 +157,6 @@ gwkjstest_test_func_gwkjs_jsapi_util_string_js_string_utf8(void)
 {
     GwkjsUnitTestFixture fixture;
     JSContextRef context;
-    JSObjectRef global;
 
     const char *utf8_string = "\303\211\303\226 foobar \343\203\237";
     char *utf8_result;
@@ -147,14 +164,11 @@ gwkjstest_test_func_gwkjs_jsapi_util_string_js_string_utf8(void)
 
     _gwkjs_unit_test_fixture_begin(&fixture);
     context = fixture.context;
-    global = JS_GetGlobalObject(context);
-    JSCompartment *oldCompartment = JS_EnterCompartment(context, global);
 
     g_assert(gwkjs_string_from_utf8(context, utf8_string, -1, &js_string) == JS_TRUE);
-    g_assert(JSVAL_IS_STRING(js_string));
+    g_assert(JSVAL_IS_STRING(context, js_string));
     g_assert(gwkjs_string_to_utf8(context, js_string, &utf8_result) == JS_TRUE);
 
-    JS_LeaveCompartment(context, oldCompartment);
     _gwkjs_unit_test_fixture_finish(&fixture);
 
     g_assert(g_str_equal(utf8_string, utf8_result));
@@ -164,66 +178,99 @@ gwkjstest_test_func_gwkjs_jsapi_util_string_js_string_utf8(void)
 
 static void
 gwkjstest_test_func_gwkjs_jsapi_util_error_throw(void)
+{
+    /* gwkjs_throw() only warns until it can leave an exception pending
+     * for the caller; exceptions are made with gwkjs_make_exception()
+     * for now, see /gwkjs/exceptions/make */
+    g_test_skip("gwkjs_throw() is a stub");
+
+//    GwkjsUnitTestFixture fixture;
+//    JSContextRef context;
+//    JSObjectRef global;
+//    jsval exc, value, previous;
+//    char *s = NULL;
+//    int strcmp_result;
+//
+//    _gwkjs_unit_test_fixture_begin(&fixture);
+//    context = fixture.context;
+//    global = JS_GetGlobalObject(context);
+//    JSCompartment *oldCompartment = JS_EnterCompartment(context, global);
+//    /* Test that we can throw */
+//
+//    gwkjs_throw(context, "This is an exception %d", 42);
+//
+//    g_assert(JS_IsExceptionPending(context));
+//
+//    exc = JSVAL_VOID;
+//    JS_GetPendingException(context, &exc);
+//    g_assert(!JSVAL_IS_VOID(exc));
+//
+//    value = JSVAL_VOID;
+//    JS_GetProperty(context, JSVAL_TO_OBJECT(exc), "message",
+//                   &value);
+//
+//    g_assert(JSVAL_IS_STRING(value));
+//
+//    gwkjs_string_to_utf8(context, value, &s);
+//    g_assert(s != NULL);
+//    strcmp_result = strcmp(s, "This is an exception 42");
+//    free(s);
+//    if (strcmp_result != 0)
+//        g_error("Exception has wrong message '%s'", s);
+//
+//    /* keep this around before we clear it */
+//    previous = exc;
+//    JS_AddValueRoot(context, &previous);
+//
+//    JS_ClearPendingException(context);
+//
+//    g_assert(!JS_IsExceptionPending(context));
+//
+//    /* Check that we don't overwrite a pending exception */
+//    JS_SetPendingException(context, previous);
+//
+//    g_assert(JS_IsExceptionPending(context));
+//
+//    gwkjs_throw(context, "Second different exception %s", "foo");
+//
+//    g_assert(JS_IsExceptionPending(context));
+//
+//    exc = JSVAL_VOID;
+//    JS_GetPendingException(context, &exc);
+//    g_assert(!JSVAL_IS_VOID(exc));
+//    g_assert(JSVAL_TO_OBJECT(exc) == JSVAL_TO_OBJECT(previous));
+//
+//    JS_RemoveValueRoot(context, &previous);
+//
+//    JS_LeaveCompartment(context, oldCompartment);
+//    _gwkjs_unit_test_fixture_finish(&fixture);
+}
+
+static void
+gwkjstest_test_func_gwkjs_exceptions_make(void)
 {
     GwkjsUnitTestFixture fixture;
     JSContextRef context;
-    JSObjectRef global;
-    jsval exc, value, previous;
-    char *s = NULL;
-    int strcmp_result;
+    JSValueRef exception = NULL;
+    char *name, *message;
 
     _gwkjs_unit_test_fixture_begin(&fixture);
     context = fixture.context;
-    global = JS_GetGlobalObject(context);
-    JSCompartment *oldCompartment = JS_EnterCompartment(context, global);
-    /* Test that we can throw */
-
-    gwkjs_throw(context, "This is an exception %d", 42);
-
-    g_assert(JS_IsExceptionPending(context));
-
-    exc = JSVAL_VOID;
-    JS_GetPendingException(context, &exc);
-    g_assert(!JSVAL_IS_VOID(exc));
-
-    value = JSVAL_VOID;
-    JS_GetProperty(context, JSVAL_TO_OBJECT(exc), "message",
-                   &value);
-
-    g_assert(JSVAL_IS_STRING(value));
 
-    gwkjs_string_to_utf8(context, value, &s);
-    g_assert(s != NULL);
-    strcmp_result = strcmp(s, "This is an exception 42");
-    free(s);
-    if (strcmp_result != 0)
-        g_error("Exception has wrong message '%s'", s);
+    gwkjs_make_exception(context, &exception, "TypeError", "This is an exception %d", 42);
+    g_assert(exception != NULL);
+    g_assert(JSValueIsObject(context, exception));
 
-    /* keep this around before we clear it */
-    previous = exc;
-    JS_AddValueRoot(context, &previous);
+    name = gwkjs_exception_get_name(context, exception);
+    message = gwkjs_exception_get_message(context, exception);
+    g_assert_cmpstr(name, ==, "TypeError");
+    g_assert_cmpstr(message, ==, "This is an exception 42");
+    g_free(name);
+    g_free(message);
 
-    JS_ClearPendingException(context);
+    /* Without somewhere to store it, nothing is made */
+    gwkjs_make_exception(context, NULL, "Error", "Not stored");
 
-    g_assert(!JS_IsExceptionPending(context));
-
-    /* Check that we don't overwrite a pending exception */
-    JS_SetPendingException(context, previous);
-
-    g_assert(JS_IsExceptionPending(context));
-
-    gwkjs_throw(context, "Second different exception %s", "foo");
-
-    g_assert(JS_IsExceptionPending(context));
-
-    exc = JSVAL_VOID;
-    JS_GetPendingException(context, &exc);
-    g_assert(!JSVAL_IS_VOID(exc));
-    g_assert(JSVAL_TO_OBJECT(exc) == JSVAL_TO_OBJECT(previous));
-
-    JS_RemoveValueRoot(context, &previous);
-
-    JS_LeaveCompartment(context, oldCompartment);
     _gwkjs_unit_test_fixture_finish(&fixture);
 }
 
@@ -265,6 +312,549 @@ gwkjstest_test_func_util_glib_strv_concat_pointers(void)
     g_strfreev(ret);
 }
 
+static gsize
+fixed_native_size(GType    gtype,
+                  gpointer instance)
+{
+    return 4096;
+}
+
+static void
+gwkjstest_test_func_gwkjs_mem_native_size(void)
+{
+    GBytes *bytes;
+    GObject *object;
+
+    bytes = g_bytes_new_take(g_malloc0(20000), 20000);
+    g_assert_cmpuint(gwkjs_estimate_native_size(G_TYPE_BYTES, bytes), ==, 20000);
+    g_assert_cmpuint(gwkjs_estimate_native_size(G_TYPE_BYTES, NULL), ==, 0);
+
+    /* Estimators apply to subtypes, and registering one takes effect
+     * even for types whose answer was already cached */
+    object = (GObject *) g_object_new(G_TYPE_INITIALLY_UNOWNED, NULL);
+    g_assert_cmpuint(gwkjs_estimate_native_size(G_TYPE_INITIALLY_UNOWNED, object), ==, 0);
+    gwkjs_register_native_size_func(G_TYPE_OBJECT, fixed_native_size);
+    g_assert_cmpuint(gwkjs_estimate_native_size(G_TYPE_INITIALLY_UNOWNED, object), ==, 4096);
+    gwkjs_register_native_size_func(G_TYPE_OBJECT, NULL);
+    g_assert_cmpuint(gwkjs_estimate_native_size(G_TYPE_INITIALLY_UNOWNED, object), ==, 0);
+
+    g_object_unref(object);
+    g_bytes_unref(bytes);
+}
+
+/* Writes @n_modules modules m0.js, m1.js, ... to a new temporary
+ * directory and returns its path */
+static char *
+write_test_modules(guint       n_modules,
+                   const char *source_format)
+{
+    GError *error = NULL;
+    char *dir;
+    guint i;
+
+    dir = g_dir_make_tmp("gwkjs-modules-XXXXXX", &error);
+    g_assert_no_error(error);
+
+    for (i = 0; i < n_modules; i++) {
+        char *name = g_strdup_printf("m%u.js", i);
+        char *path = g_build_filename(dir, name, NULL);
+        char *source = g_strdup_printf(source_format, i, i);
+
+        g_file_set_contents(path, source, -1, &error);
+        g_assert_no_error(error);
+
+        g_free(source);
+        g_free(path);
+        g_free(name);
+    }
+
+    return dir;
+}
+
+static void
+remove_test_modules(char  *dir,
+                    guint  n_modules)
+{
+    guint i;
+
+    for (i = 0; i < n_modules; i++) {
+        char *name = g_strdup_printf("m%u.js", i);
+        char *path = g_build_filename(dir, name, NULL);
+
+        g_unlink(path);
+        g_free(path);
+        g_free(name);
+    }
+    g_rmdir(dir);
+    g_free(dir);
+}
+
+static GwkjsContext *
+new_context_for_modules(const char *dir,
+                        gboolean    module_globals)
+{
+    const char *search_path[] = { dir, NULL };
+
+    return (GwkjsContext *) g_object_new(GWKJS_TYPE_CONTEXT,
+                                         "search-path", search_path,
+                                         "module-globals", module_globals,
+                                         NULL);
+}
+
+static const char module_scope_source[] =
+    "var a = 1, unused;\n"
+    "let b = 2;\n"
+    "const { c, d: [e] } = { c: 3, d: [4] };\n"
+    "function f() { return a + b; }\n"
+    "class K { constructor() { this.x = %u; } }\n"
+    "function setA(v) { a = v; }\n"
+    "if (true) { let inner = 1; var hoisted = %u; }\n"
+    "this.explicit = 'yes';\n";
+
+static const char module_scope_checks[] =
+    "const M = imports.m0;\n"
+    "function check(cond, what) { if (!cond) throw new Error(what); }\n"
+    "check(M.a === 1 && M.f() === 3 && M.hoisted === 0, 'declarations');\n"
+    "check(M.explicit === 'yes', 'this is the module');\n"
+    "M.setA(10);\n"
+    "check(M.a === 10 && M.f() === 12, 'module sees its own writes');\n"
+    "M.a = 20;\n"
+    "check(M.f() === 22, 'module object writes go to the binding');\n"
+    "check(imports.m0 === M, 'module is imported once');\n";
+
+/* Lexical declarations are not properties of a global object, so only
+ * modules in a function scope export them */
+static const char module_scope_lexical_checks[] =
+    "const M = imports.m0;\n"
+    "function check(cond, what) { if (!cond) throw new Error(what); }\n"
+    "check(M.b === 2 && M.c === 3 && M.e === 4 && new M.K().x === 0, 'lexical declarations');\n"
+    "check(!('inner' in M), 'block scoped declarations');\n"
+    "check(typeof a == 'undefined' && typeof f == 'undefined', 'no leaks onto the global');\n";
+
+static void
+gwkjstest_test_func_gwkjs_importer_module_scope(void)
+{
+    GwkjsContext *context;
+    char *dir;
+    int estatus;
+    GError *error = NULL;
+    guint i;
+
+    dir = write_test_modules(1, module_scope_source);
+
+    /* Both ways of evaluating modules must look the same from outside */
+    for (i = 0; i < 2; i++) {
+        context = new_context_for_modules(dir, i == 1);
+        if (!gwkjs_context_eval (context, module_scope_checks, -1, "<input>", &estatus, &error))
+            g_error ("%s", error->message);
+        g_object_unref(context);
+    }
+
+    context = new_context_for_modules(dir, FALSE);
+    if (!gwkjs_context_eval (context, module_scope_lexical_checks, -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_object_unref(context);
+
+    remove_test_modules(dir, 1);
+}
+
+#define N_CONTEXTS 8
+
+static void
+check_context_state(GwkjsContext *context,
+                    int           id,
+                    int           counter)
+{
+    char *script;
+    int estatus;
+    GError *error = NULL;
+
+    script = g_strdup_printf("if (imports.m0.id !== %d)\n"
+                             "    throw new Error('importer of another context');\n"
+                             "if (this.counter !== %d)\n"
+                             "    throw new Error('global of another context');\n"
+                             "counter;\n", id, counter);
+    if (!gwkjs_context_eval (context, script, -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint(estatus, ==, counter);
+    g_free(script);
+}
+
+static void
+gwkjstest_test_func_gwkjs_context_multiple(void)
+{
+    GwkjsContext *contexts[N_CONTEXTS];
+    JSGlobalContextRef natives[N_CONTEXTS];
+    char *dirs[N_CONTEXTS];
+    int estatus;
+    GError *error = NULL;
+    int round, i;
+
+    /* Contexts that go away import into module globals, which can
+     * outlive them */
+    for (i = 0; i < N_CONTEXTS; i++) {
+        char *source = g_strdup_printf("var id = %d;\n"
+                                       "var GLib = imports.gi.GLib;\n"
+                                       "function basename(path) {\n"
+                                       "    return GLib.path_get_basename(path);\n"
+                                       "}\n", i);
+
+        dirs[i] = write_test_modules(1, source);
+        contexts[i] = new_context_for_modules(dirs[i], i % 2 == 0);
+        g_free(source);
+    }
+
+    /* Interleaved, so that each context runs after all the others */
+    for (round = 1; round <= 3; round++) {
+        for (i = 0; i < N_CONTEXTS; i++) {
+            if (!gwkjs_context_eval (contexts[i], "this.counter = (this.counter || 0) + 1;",
+                                     -1, "<input>", &estatus, &error))
+                g_error ("%s", error->message);
+            check_context_state(contexts[i], i, round);
+        }
+    }
+
+    /* The remaining contexts don't depend on the ones going away */
+    for (i = 0; i < N_CONTEXTS; i += 2) {
+        if (!gwkjs_context_eval (contexts[i], "var basename = imports.m0.basename;",
+                                 -1, "<input>", &estatus, &error))
+            g_error ("%s", error->message);
+        natives[i] = JSGlobalContextRetain((JSGlobalContextRef) gwkjs_context_get_native_context(contexts[i]));
+        g_object_unref(contexts[i]);
+        contexts[i] = NULL;
+    }
+    gwkjs_context_gc(contexts[1]);
+
+    /* Module functions still run, without reaching the finalized context */
+    for (i = 0; i < N_CONTEXTS; i += 2) {
+        JSStringRef script = JSStringCreateWithUTF8CString("basename('/tmp/gwkjs-module')");
+        JSValueRef exception = NULL;
+        JSValueRef value;
+        char *result;
+
+        value = JSEvaluateScript(natives[i], script, NULL, NULL, 0, &exception);
+        g_assert(exception == NULL);
+        g_assert(gwkjs_string_to_utf8(natives[i], value, &result));
+        g_assert_cmpstr(result, ==, "gwkjs-module");
+        g_free(result);
+
+        JSStringRelease(script);
+        JSGlobalContextRelease(natives[i]);
+    }
+
+    for (i = 1; i < N_CONTEXTS; i += 2) {
+        check_context_state(contexts[i], i, 3);
+        g_object_unref(contexts[i]);
+    }
+
+    for (i = 0; i < N_CONTEXTS; i++)
+        remove_test_modules(dirs[i], 1);
+}
+
+static const char worker_source[] =
+    "onmessage = function(event) {\n"
+    "    let d = event.data;\n"
+    "    postMessage({ sum: d.values.reduce(function(a, b) { return a + b; }, 0),\n"
+    "                  text: d.text + '!', byte: new Uint8Array(d.buffer)[1],\n"
+    "                  typed: d.typed[2], nothing: d.nothing, missing: d.missing });\n"
+    "    close();\n"
+    "};\n";
+
+static const char worker_checks[] =
+    "if (!reply || reply.sum !== 6 || reply.text !== 'ok!' || reply.byte !== 6 ||\n"
+    "    reply.typed !== 1.5 || reply.nothing !== null ||\n"
+    "    !('missing' in reply) || reply.missing !== undefined)\n"
+    "    throw new Error(JSON.stringify(reply));\n";
+
+/* Runs this thread's main context until @expr evaluates to @expected,
+ * for at most 10 seconds */
+static void
+wait_for_eval(GwkjsContext *context,
+              const char   *expr,
+              int           expected)
+{
+    gint64 deadline;
+    int estatus;
+    GError *error = NULL;
+
+    deadline = g_get_monotonic_time() + 10 * G_USEC_PER_SEC;
+    for (;;) {
+        g_main_context_iteration(NULL, FALSE);
+        if (!gwkjs_context_eval (context, expr, -1, "<input>", &estatus, &error))
+            g_error ("%s", error->message);
+        if (estatus == expected || g_get_monotonic_time() >= deadline)
+            break;
+        g_usleep(1000);
+    }
+    g_assert_cmpint(estatus, ==, expected);
+}
+
+static void
+gwkjstest_test_func_gwkjs_worker_message(void)
+{
+    GwkjsContext *context;
+    char *dir, *path, *script;
+    int estatus = 0;
+    GError *error = NULL;
+
+    dir = write_test_modules(1, worker_source);
+    path = g_build_filename(dir, "m0.js", NULL);
+    context = gwkjs_context_new ();
+
+    script = g_strdup_printf("var done = false, reply = null;\n"
+                             "let worker = new imports.worker.Worker('%s');\n"
+                             "worker.onmessage = function(event) { reply = event.data; done = true; };\n"
+                             "worker.onerror = function(event) { done = true; };\n"
+                             "worker.postMessage({ values: [1, 2, 3], text: 'ok',\n"
+                             "                     buffer: new Uint8Array([5, 6]).buffer,\n"
+                             "                     typed: new Float64Array([0, 0, 1.5]),\n"
+                             "                     nothing: null, missing: undefined });\n",
+                             path);
+    if (!gwkjs_context_eval (context, script, -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+
+    /* Replies come on this thread's main context */
+    wait_for_eval(context, "done ? 1 : 0", 1);
+
+    if (!gwkjs_context_eval (context, worker_checks, -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+
+    g_object_unref(context);
+    g_free(script);
+    g_free(path);
+    remove_test_modules(dir, 1);
+}
+
+static const char call_in_thread_source[] =
+    "const GLib = imports.gi.GLib;\n"
+    "var results = [];\n"
+    "GLib.usleep.callInThread(null, 1000).then(function(value) {\n"
+    "    results.push(value === undefined); });\n"
+    "GLib.path_get_basename.callInThread(null, '/tmp/basename').then(function(value) {\n"
+    "    results.push(value === 'basename'); });\n"
+    "GLib.file_get_contents.callInThread(null, '/nonexistent/gwkjs-test').then(function() {\n"
+    "    results.push(false); }, function(e) { results.push(true); });\n";
+
+static void
+gwkjstest_test_func_gi_function_call_in_thread(void)
+{
+    GwkjsContext *context;
+    int estatus = 0;
+    GError *error = NULL;
+
+    context = gwkjs_context_new ();
+
+    if (!gwkjs_context_eval (context, call_in_thread_source, -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+
+    /* The promises are settled on this thread's main context */
+    wait_for_eval(context, "results.length", 3);
+
+    if (!gwkjs_context_eval (context, "results.every(function(r) { return r; }) ? 1 : 0",
+                             -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint(estatus, ==, 1);
+
+    g_object_unref(context);
+}
+
+static void
+gwkjstest_test_func_gi_function_call_promise(void)
+{
+    GwkjsContext *context;
+    char *dir, *path, *script;
+    int estatus = 0;
+    GError *error = NULL;
+    int reused;
+
+    dir = write_test_modules(1, "var contents = 'promised';");
+    path = g_build_filename(dir, "m0.js", NULL);
+    context = gwkjs_context_new ();
+
+    script = g_strdup_printf("const Gio = imports.gi.Gio;\n"
+                             "var results = [];\n"
+                             "var file = Gio.File.new_for_path('%s');\n"
+                             "for (let i = 0; i < 4; i++)\n"
+                             "    file.load_contents_async.callPromise(file, null).then(function(r) {\n"
+                             "        results.push(r[0] && r[1].length > 0); });\n"
+                             "let missing = Gio.File.new_for_path('%s.missing');\n"
+                             "missing.load_contents_async.callPromise(missing, null).then(function() {\n"
+                             "    results.push(false); }, function(e) { results.push(true); });\n",
+                             path, path);
+    if (!gwkjs_context_eval (context, script, -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+
+    wait_for_eval(context, "results.length", 5);
+
+    if (!gwkjs_context_eval (context, "results.every(function(r) { return r; }) ? 1 : 0",
+                             -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint(estatus, ==, 1);
+
+    /* Records of completed calls are reused */
+    reused = GWKJS_GET_STAT(async_call_reuse);
+    if (!gwkjs_context_eval (context,
+                             "file.load_contents_async.callPromise(file, null).then(function(r) {\n"
+                             "    results.push(r[0]); });\n",
+                             -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    wait_for_eval(context, "results.length", 6);
+    g_assert_cmpint(GWKJS_GET_STAT(async_call_reuse), ==, reused + 1);
+
+    g_object_unref(context);
+    g_free(script);
+    g_free(path);
+    remove_test_modules(dir, 1);
+}
+
+static void
+gwkjstest_test_func_gwkjs_importer_search_path_cache(void)
+{
+    GwkjsContext *context;
+    char *dir, *path;
+    int estatus;
+    GError *error = NULL;
+    int lookups;
+
+    dir = write_test_modules(1, module_scope_source);
+    context = new_context_for_modules(dir, FALSE);
+
+    lookups = GWKJS_GET_STAT(import_dir_lookup);
+    if (!gwkjs_context_eval (context, "imports.m0;", -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint(GWKJS_GET_STAT(import_dir_lookup), >, lookups);
+
+    /* No main loop runs here, so the monitor can't have seen it */
+    path = g_build_filename(dir, "m1.js", NULL);
+    g_file_set_contents(path, "var added = true;", -1, &error);
+    g_assert_no_error(error);
+    gwkjs_importer_invalidate_search_path_cache(dir);
+
+    if (!gwkjs_context_eval (context, "if (!imports.m1.added) throw new Error();", -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+
+    g_object_unref(context);
+    gwkjs_importer_invalidate_search_path_cache(NULL);
+    g_unlink(path);
+    g_free(path);
+    remove_test_modules(dir, 1);
+}
+
+static void
+gwkjstest_test_func_gwkjs_importer_bundle(void)
+{
+    const char *paths[] = { "m0.js", "sub/m1.js" };
+    GBytes *sources[2];
+    GwkjsContext *context;
+    char *dir, *bundle_path, *bad_path;
+    int estatus;
+    GError *error = NULL;
+    int lookups;
+
+    dir = g_dir_make_tmp("gwkjs-bundle-XXXXXX", &error);
+    g_assert_no_error(error);
+    bundle_path = g_build_filename(dir, "test.bundle", NULL);
+    bad_path = g_build_filename(dir, "bad.bundle", NULL);
+
+    sources[0] = g_bytes_new_static("var a = 1;", strlen("var a = 1;"));
+    sources[1] = g_bytes_new_static("var x = 42;", strlen("var x = 42;"));
+    g_assert(gwkjs_bundle_write(bundle_path, 2, paths, sources, &error));
+    g_assert_no_error(error);
+
+    /* Modules and directories of the bundle are imported without
+     * probing the file system */
+    context = new_context_for_modules(bundle_path, FALSE);
+    lookups = GWKJS_GET_STAT(import_dir_lookup);
+    if (!gwkjs_context_eval (context, "if (imports.m0.a !== 1 || imports.sub.m1.x !== 42) throw new Error();",
+                             -1, "<input>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_assert_cmpint(GWKJS_GET_STAT(import_dir_lookup), >, lookups);
+    g_object_unref(context);
+
+    g_assert(gwkjs_bundle_lookup(bundle_path, NULL) != NULL);
+    g_assert_cmpint(gwkjs_bundle_query_type(gwkjs_bundle_lookup(bundle_path, NULL), "", "sub"),
+                    ==, G_FILE_TYPE_DIRECTORY);
+
+    /* A truncated bundle doesn't mount */
+    g_file_set_contents(bad_path, GWKJS_BUNDLE_MAGIC "\1\0\0\0\7\0\0\0", 16, &error);
+    g_assert_no_error(error);
+    g_assert(gwkjs_bundle_mount(bad_path, &error) == NULL);
+    g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+    g_clear_error(&error);
+
+    gwkjs_importer_invalidate_search_path_cache(NULL);
+    g_bytes_unref(sources[0]);
+    g_bytes_unref(sources[1]);
+    g_unlink(bad_path);
+    g_unlink(bundle_path);
+    g_rmdir(dir);
+    g_free(bad_path);
+    g_free(bundle_path);
+    g_free(dir);
+}
+
+/* Lengths around the 8/16 code unit blocks of the ASCII fast path, with
+ * and without something non-ASCII at either end */
+static void
+gwkjstest_test_func_gwkjs_jsapi_util_string_utf8_ascii(void)
+{
+    static const char *suffixes[] = { "", "\303\251", "\343\203\237", "\360\237\230\200" };
+    static const int lengths[] = { 0, 1, 7, 8, 9, 15, 16, 17, 31, 32, 33, 300 };
+    GwkjsUnitTestFixture fixture;
+    JSContextRef context;
+    guint i, j;
+
+    _gwkjs_unit_test_fixture_begin(&fixture);
+    context = fixture.context;
+
+    for (i = 0; i < G_N_ELEMENTS(lengths); i++) {
+        for (j = 0; j < G_N_ELEMENTS(suffixes); j++) {
+            char *ascii = g_strnfill(lengths[i], 'x');
+            char *tail = g_strconcat(ascii, suffixes[j], NULL);
+            char *head = g_strconcat(suffixes[j], ascii, NULL);
+            const char *inputs[] = { tail, head };
+            guint k;
+
+            for (k = 0; k < G_N_ELEMENTS(inputs); k++) {
+                jsval js_string;
+                char *utf8_result;
+                JSStringRef str;
+                gsize length;
+
+                g_assert(gwkjs_string_from_utf8(context, inputs[k], -1, &js_string));
+                g_assert(gwkjs_string_to_utf8(context, js_string, &utf8_result));
+                g_assert_cmpstr(utf8_result, ==, inputs[k]);
+                g_free(utf8_result);
+
+                str = JSValueToStringCopy(context, js_string, NULL);
+                g_assert_cmpuint(gwkjs_jsstring_get_utf8_length(str), ==, strlen(inputs[k]));
+                utf8_result = gwkjs_jsstring_to_utf8(str, &length);
+                g_assert_cmpuint(length, ==, strlen(inputs[k]));
+                g_assert_cmpstr(utf8_result, ==, inputs[k]);
+                g_free(utf8_result);
+                JSStringRelease(str);
+            }
+
+            g_free(ascii);
+            g_free(tail);
+            g_free(head);
+        }
+    }
+
+    /* Unpaired surrogates come out as U+FFFD */
+    {
+        static const JSChar lone[] = { 'a', 0xd800, 'b', 0xdc00 };
+        JSStringRef str = JSStringCreateWithCharacters(lone, G_N_ELEMENTS(lone));
+        char *utf8_result = gwkjs_jsstring_to_utf8(str, NULL);
+
+        g_assert_cmpstr(utf8_result, ==, "a\357\277\275b\357\277\275");
+        g_free(utf8_result);
+        JSStringRelease(str);
+    }
+
+    _gwkjs_unit_test_fixture_finish(&fixture);
+}
+
 static void
 gwkjstest_test_strip_shebang_no_advance_for_no_shebang(void)
 {
@@ -316,6 +906,264 @@ gwkjstest_test_strip_shebang_return_null_for_just_shebang(void)
     g_assert(line_number == -1);
 }
 
+static void
+gwkjstest_test_func_gwkjs_jsapi_util_string_utf8_pieces(void)
+{
+    /* Pieces are cut out of a larger buffer, so none of them is
+     * nul-terminated */
+    static const char buffer[] = "(function() {\303\251\360\237\230\200})xxx\377";
+    const char *pieces[] = { buffer, buffer + 13, buffer + 19, buffer + 24 };
+    gsize lengths[] = { 13, 6, 2, 1 };
+    JSStringRef str;
+    GError *error = NULL;
+    char *utf8_result;
+
+    str = gwkjs_jsstring_new_from_utf8_pieces(pieces, lengths, 3, &error);
+    g_assert_no_error(error);
+    /* The emoji takes a surrogate pair */
+    g_assert_cmpuint(JSStringGetLength(str), ==, 13 + 1 + 2 + 2);
+    utf8_result = gwkjs_jsstring_to_utf8(str, NULL);
+    g_assert_cmpstr(utf8_result, ==, "(function() {\303\251\360\237\230\200})");
+    g_free(utf8_result);
+    JSStringRelease(str);
+
+    str = gwkjs_jsstring_new_from_utf8_pieces(pieces, lengths, 4, &error);
+    g_assert(str == NULL);
+    g_assert_error(error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE);
+    g_error_free(error);
+}
+
+#define N_INVOKE_CALLS 200000
+
+/* Calls per second for a few GLib functions with scalar signatures,
+ * either through the direct callers in gi/function.cpp or, with
+ * GWKJS_DISABLE_FAST_INVOKE set, through ffi_call().
+ */
+static double
+run_invoke_benchmark(gboolean    disable_fast_invoke,
+                     const char *call)
+{
+    GwkjsContext *context;
+    int estatus;
+    GError *error = NULL;
+    char *script;
+    double elapsed;
+
+    if (disable_fast_invoke)
+        g_setenv("GWKJS_DISABLE_FAST_INVOKE", "1", TRUE);
+    else
+        g_unsetenv("GWKJS_DISABLE_FAST_INVOKE");
+
+    context = gwkjs_context_new ();
+
+    /* Don't time the import and the first lookup of the function */
+    script = g_strdup_printf("const GLib = imports.gi.GLib; %s;", call);
+    if (!gwkjs_context_eval (context, script, -1, "<warmup>", &estatus, &error))
+        g_error ("%s", error->message);
+    g_free(script);
+
+    script = g_strdup_printf("for (let i = 0; i < %d; i++) %s;", N_INVOKE_CALLS, call);
+    g_test_timer_start();
+    if (!gwkjs_context_eval (context, script, -1, "<benchmark>", &estatus, &error))
+        g_error ("%s", error->message);
+    elapsed = g_test_timer_elapsed();
+    g_free(script);
+
+    g_object_unref(context);
+    g_unsetenv("GWKJS_DISABLE_FAST_INVOKE");
+
+    return N_INVOKE_CALLS / elapsed;
+}
+
+static void
+gwkjstest_test_func_gi_function_invoke_perf(void)
+{
+    static const char *calls[] = {
+        "GLib.random_int_range(0, 100)",
+        "GLib.random_double_range(0, 1)",
+        "GLib.get_monotonic_time()",
+    };
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(calls); i++) {
+        double generic = run_invoke_benchmark(TRUE, calls[i]);
+        double fast = run_invoke_benchmark(FALSE, calls[i]);
+
+        g_test_message("%s: generic %.0f calls/s, fast %.0f calls/s (%.2fx)",
+                       calls[i], generic, fast, fast / generic);
+        g_test_maximized_result(fast, "%s: %.0f calls/s", calls[i], fast);
+    }
+}
+
+#undef N_INVOKE_CALLS
+
+#define N_STRING_CONVERSIONS 200000
+
+/* Strings shaped like what typically goes through introspected calls:
+ * widget labels, Pango markup and log lines.
+ */
+static const char *string_perf_inputs[][2] = {
+    { "label",  "Save As" },
+    { "label (non-ASCII)", "Open Recent\342\200\246" },
+    { "markup", "<span weight=\"bold\">Download complete</span>: "
+                "<i>3 files</i> saved to <tt>~/Downloads</tt>" },
+    { "log line", "2016-03-14 09:26:53.589 gnome-shell[1234]: JS WARNING: "
+                  "[resource:///org/gnome/shell/ui/main.js 412]: "
+                  "reference to undefined property \"actor\"" },
+};
+
+/* Round trips per second, UTF-8 to JS string and back */
+static double
+run_string_benchmark(const char *input,
+                     gboolean    use_jsc)
+{
+    double elapsed;
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < N_STRING_CONVERSIONS; i++) {
+        JSStringRef str;
+        char *utf8;
+
+        if (use_jsc) {
+            size_t size;
+
+            str = JSStringCreateWithUTF8CString(input);
+            size = JSStringGetMaximumUTF8CStringSize(str);
+            utf8 = (char *) g_malloc(size);
+            JSStringGetUTF8CString(str, utf8, size);
+        } else {
+            str = gwkjs_jsstring_new_from_utf8(input, -1, NULL);
+            utf8 = gwkjs_jsstring_to_utf8(str, NULL);
+        }
+
+        g_free(utf8);
+        JSStringRelease(str);
+    }
+    elapsed = g_test_timer_elapsed();
+
+    return N_STRING_CONVERSIONS / elapsed;
+}
+
+static void
+gwkjstest_test_func_gwkjs_jsapi_util_string_perf(void)
+{
+    GwkjsUnitTestFixture fixture;
+    guint i;
+
+    _gwkjs_unit_test_fixture_begin(&fixture);
+
+    for (i = 0; i < G_N_ELEMENTS(string_perf_inputs); i++) {
+        const char *name = string_perf_inputs[i][0];
+        const char *input = string_perf_inputs[i][1];
+        double jsc = run_string_benchmark(input, TRUE);
+        double ours = run_string_benchmark(input, FALSE);
+
+        g_test_message("%s (%u bytes): JSC %.0f round trips/s, gwkjs %.0f round trips/s (%.2fx)",
+                       name, (guint) strlen(input), jsc, ours, ours / jsc);
+        g_test_maximized_result(ours, "%s: %.0f round trips/s", name, ours);
+    }
+
+    _gwkjs_unit_test_fixture_finish(&fixture);
+}
+
+#undef N_STRING_CONVERSIONS
+
+#define N_STARTUP_MODULES 300
+
+/* Roughly the shape of a small application module: a few imports,
+ * constants, functions and a class */
+static const char startup_module_source[] =
+    "const GLib = imports.gi.GLib;\n"
+    "const Lang = imports.lang;\n"
+    "const ID = %u;\n"
+    "var counter = 0;\n"
+    "function describe(obj) { return 'm' + ID + ': ' + String(obj); }\n"
+    "function bump() { return ++counter; }\n"
+    "const Thing = new Lang.Class({\n"
+    "    Name: 'Thing%u',\n"
+    "    _init: function(value) { this.value = value; },\n"
+    "    toString: function() { return describe(this.value); },\n"
+    "});\n";
+
+static gsize
+get_resident_size(void)
+{
+    char *contents;
+    gsize resident = 0;
+
+    if (g_file_get_contents("/proc/self/statm", &contents, NULL, NULL)) {
+        unsigned long size, pages;
+
+        if (sscanf(contents, "%lu %lu", &size, &pages) == 2)
+            resident = pages * sysconf(_SC_PAGESIZE);
+        g_free(contents);
+    }
+
+    return resident;
+}
+
+/* Seconds to import all the modules; the growth of the resident size
+ * is returned in @resident_growth */
+static double
+run_startup_benchmark(const char *dir,
+                      gboolean    module_globals,
+                      gssize     *resident_growth)
+{
+    GwkjsContext *context;
+    int estatus;
+    GError *error = NULL;
+    char *script;
+    gsize resident;
+    double elapsed;
+
+    context = new_context_for_modules(dir, module_globals);
+
+    /* The modules all share these */
+    if (!gwkjs_context_eval (context, "imports.gi.GLib; imports.lang;", -1, "<warmup>", &estatus, &error))
+        g_error ("%s", error->message);
+
+    script = g_strdup_printf("for (let i = 0; i < %d; i++) imports['m' + i];", N_STARTUP_MODULES);
+    resident = get_resident_size();
+    g_test_timer_start();
+    if (!gwkjs_context_eval (context, script, -1, "<benchmark>", &estatus, &error))
+        g_error ("%s", error->message);
+    elapsed = g_test_timer_elapsed();
+    *resident_growth = get_resident_size() - resident;
+    g_free(script);
+
+    g_object_unref(context);
+
+    return elapsed;
+}
+
+static void
+gwkjstest_test_func_gwkjs_importer_module_scope_perf(void)
+{
+    char *dir;
+    double globals_time, scope_time;
+    gssize globals_growth, scope_growth;
+
+    dir = write_test_modules(N_STARTUP_MODULES, startup_module_source);
+
+    /* The module scope run goes second so that it doesn't benefit from
+     * memory the other run had to ask for */
+    globals_time = run_startup_benchmark(dir, TRUE, &globals_growth);
+    scope_time = run_startup_benchmark(dir, FALSE, &scope_growth);
+
+    g_test_message("%d modules: module globals %.1f ms, %" G_GSSIZE_FORMAT " kB; "
+                   "module scopes %.1f ms, %" G_GSSIZE_FORMAT " kB",
+                   N_STARTUP_MODULES,
+                   globals_time * 1000, globals_growth / 1024,
+                   scope_time * 1000, scope_growth / 1024);
+    g_test_minimized_result(scope_time * 1000, "import %d modules: %.1f ms",
+                            N_STARTUP_MODULES, scope_time * 1000);
+
+    remove_test_modules(dir, N_STARTUP_MODULES);
+}
+
+#undef N_STARTUP_MODULES
+
 int
 main(int    argc,
      char **argv)
@@ -326,16 +1174,35 @@ main(int    argc,
 
     g_test_add_func("/gwkjs/context/construct/destroy", gwkjstest_test_func_gwkjs_context_construct_destroy);
     g_test_add_func("/gwkjs/context/construct/eval", gwkjstest_test_func_gwkjs_context_construct_eval);
+    g_test_add_func("/gwkjs/context/eval/script-cache", gwkjstest_test_func_gwkjs_context_eval_script_cache);
+    g_test_add_func("/gwkjs/context/multiple", gwkjstest_test_func_gwkjs_context_multiple);
+    g_test_add_func("/gwkjs/exceptions/make", gwkjstest_test_func_gwkjs_exceptions_make);
+    g_test_add_func("/gwkjs/importer/module-scope", gwkjstest_test_func_gwkjs_importer_module_scope);
+    g_test_add_func("/gwkjs/importer/bundle", gwkjstest_test_func_gwkjs_importer_bundle);
+    g_test_add_func("/gwkjs/importer/search-path-cache", gwkjstest_test_func_gwkjs_importer_search_path_cache);
     g_test_add_func("/gwkjs/jsapi/util/array", gwkjstest_test_func_gwkjs_jsapi_util_array);
     g_test_add_func("/gwkjs/jsapi/util/error/throw", gwkjstest_test_func_gwkjs_jsapi_util_error_throw);
     g_test_add_func("/gwkjs/jsapi/util/string/js/string/utf8", gwkjstest_test_func_gwkjs_jsapi_util_string_js_string_utf8);
+    g_test_add_func("/gwkjs/jsapi/util/string/utf8/ascii", gwkjstest_test_func_gwkjs_jsapi_util_string_utf8_ascii);
+    g_test_add_func("/gwkjs/jsapi/util/string/utf8/pieces", gwkjstest_test_func_gwkjs_jsapi_util_string_utf8_pieces);
     g_test_add_func("/gwkjs/jsutil/strip_shebang/no_shebang", gwkjstest_test_strip_shebang_no_advance_for_no_shebang);
     g_test_add_func("/gwkjs/jsutil/strip_shebang/have_shebang", gwkjstest_test_strip_shebang_advance_for_shebang);
     g_test_add_func("/gwkjs/jsutil/strip_shebang/only_shebang", gwkjstest_test_strip_shebang_return_null_for_just_shebang);
+    g_test_add_func("/gwkjs/mem/native_size", gwkjstest_test_func_gwkjs_mem_native_size);
+    g_test_add_func("/gwkjs/worker/message", gwkjstest_test_func_gwkjs_worker_message);
+    g_test_add_func("/gi/function/call-in-thread", gwkjstest_test_func_gi_function_call_in_thread);
+    g_test_add_func("/gi/function/call-promise", gwkjstest_test_func_gi_function_call_promise);
     g_test_add_func("/util/glib/strv/concat/null", gwkjstest_test_func_util_glib_strv_concat_null);
     g_test_add_func("/util/glib/strv/concat/pointers", gwkjstest_test_func_util_glib_strv_concat_pointers);
 
-    gwkjs_test_add_tests_for_coverage ();
+    if (g_test_perf()) {
+        g_test_add_func("/gi/function/invoke/perf", gwkjstest_test_func_gi_function_invoke_perf);
+        g_test_add_func("/gwkjs/jsapi/util/string/perf", gwkjstest_test_func_gwkjs_jsapi_util_string_perf);
+        g_test_add_func("/gwkjs/importer/module-scope/perf", gwkjstest_test_func_gwkjs_importer_module_scope_perf);
+    }
+
+    /* The coverage tests are not built until gwkjs/coverage.cpp is
+     * ported to JavaScriptCore */
 
     g_test_run();
 
@@ -0,0 +1,160 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <config.h>
+
+#include <string.h>
+
+#include "arena.h"
+
+#include <gwkjs/mem.h>
+
+/* Enough for a GArgument or a double on every platform we care about */
+#define ARENA_ALIGN (2 * sizeof(gpointer))
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct _GwkjsArenaChunk {
+    GwkjsArenaChunk *prev;
+    gsize size;
+    gsize used;
+};
+
+#define CHUNK_HEADER_SIZE ARENA_ROUND(sizeof(GwkjsArenaChunk))
+#define CHUNK_DATA(chunk) (((guint8 *) (chunk)) + CHUNK_HEADER_SIZE)
+
+struct _GwkjsArena {
+    GwkjsArenaChunk *current;
+    /* One default-sized chunk kept around after a release, so that a
+     * call which overflows the first chunk doesn't hit malloc every
+     * time it is repeated */
+    GwkjsArenaChunk *spare;
+    gsize chunk_size;
+};
+
+static GwkjsArenaChunk *
+arena_chunk_new(gsize size)
+{
+    GwkjsArenaChunk *chunk;
+
+    chunk = (GwkjsArenaChunk *) g_malloc(CHUNK_HEADER_SIZE + size);
+    chunk->prev = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+
+    return chunk;
+}
+
+GwkjsArena *
+gwkjs_arena_new(gsize chunk_size)
+{
+    GwkjsArena *arena;
+
+    arena = g_slice_new0(GwkjsArena);
+    arena->chunk_size = ARENA_ROUND(chunk_size);
+    arena->current = arena_chunk_new(arena->chunk_size);
+
+    return arena;
+}
+
+void
+gwkjs_arena_free(GwkjsArena *arena)
+{
+    GwkjsArenaChunk *chunk, *prev;
+
+    for (chunk = arena->current; chunk; chunk = prev) {
+        prev = chunk->prev;
+        g_free(chunk);
+    }
+    g_free(arena->spare);
+    g_slice_free(GwkjsArena, arena);
+}
+
+GwkjsArenaMark
+gwkjs_arena_mark(GwkjsArena *arena)
+{
+    GwkjsArenaMark mark;
+
+    mark.chunk = arena->current;
+    mark.used = arena->current->used;
+
+    return mark;
+}
+
+void
+gwkjs_arena_release(GwkjsArena     *arena,
+                    GwkjsArenaMark  mark)
+{
+    while (arena->current != mark.chunk) {
+        GwkjsArenaChunk *chunk = arena->current;
+
+        g_assert(chunk->prev != NULL);
+        arena->current = chunk->prev;
+
+        if (arena->spare == NULL && chunk->size == arena->chunk_size)
+            arena->spare = chunk;
+        else
+            g_free(chunk);
+    }
+
+    g_assert(mark.used <= arena->current->used);
+    arena->current->used = mark.used;
+}
+
+gpointer
+gwkjs_arena_alloc(GwkjsArena *arena,
+                  gsize       size)
+{
+    GwkjsArenaChunk *chunk = arena->current;
+    gpointer retval;
+
+    size = ARENA_ROUND(size);
+
+    if (G_UNLIKELY(chunk->used + size > chunk->size)) {
+        if (size <= arena->chunk_size && arena->spare != NULL) {
+            chunk = arena->spare;
+            arena->spare = NULL;
+            chunk->used = 0;
+            GWKJS_INC_STAT(arena_hit);
+        } else {
+            chunk = arena_chunk_new(MAX(size, arena->chunk_size));
+            GWKJS_INC_STAT(arena_miss);
+        }
+        chunk->prev = arena->current;
+        arena->current = chunk;
+    } else {
+        GWKJS_INC_STAT(arena_hit);
+    }
+
+    retval = CHUNK_DATA(chunk) + chunk->used;
+    chunk->used += size;
+
+    return retval;
+}
+
+gpointer
+gwkjs_arena_alloc0(GwkjsArena *arena,
+                   gsize       size)
+{
+    gpointer retval = gwkjs_arena_alloc(arena, size);
+
+    memset(retval, 0, size);
+    return retval;
+}
@@ -0,0 +1,60 @@
+/* -*- mode: C; c-basic-offset: 4; indent-tabs-mode: nil; -*- */
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#ifndef __GWKJS_UTIL_ARENA_H__
+#define __GWKJS_UTIL_ARENA_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* A bump allocator for short-lived scratch memory. Allocations are
+ * never freed individually; instead callers take a mark before they
+ * start allocating and release back to it when done. Marks must be
+ * released in LIFO order, which makes nested users (a C call that
+ * calls back into JS that makes another C call) safe.
+ */
+
+typedef struct _GwkjsArena      GwkjsArena;
+typedef struct _GwkjsArenaChunk GwkjsArenaChunk;
+
+typedef struct {
+    GwkjsArenaChunk *chunk;
+    gsize            used;
+} GwkjsArenaMark;
+
+GwkjsArena     *gwkjs_arena_new     (gsize           chunk_size);
+void            gwkjs_arena_free    (GwkjsArena     *arena);
+
+GwkjsArenaMark  gwkjs_arena_mark    (GwkjsArena     *arena);
+void            gwkjs_arena_release (GwkjsArena     *arena,
+                                     GwkjsArenaMark  mark);
+
+gpointer        gwkjs_arena_alloc   (GwkjsArena     *arena,
+                                     gsize           size);
+gpointer        gwkjs_arena_alloc0  (GwkjsArena     *arena,
+                                     gsize           size);
+
+#define gwkjs_arena_new_n(arena, type, n) \
+    ((type *) gwkjs_arena_alloc((arena), sizeof(type) * (n)))
+
+G_END_DECLS
+
+#endif